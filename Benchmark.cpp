@@ -0,0 +1,113 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+uint32_t Benchmark::frame() {
+	frames.emplace_back(Frame{ .section = uint32_t(sections.size()) });
+	return uint32_t(frames.size() - 1);
+}
+
+void Benchmark::add(uint32_t frame, std::string const &timer, double ms) {
+	assert(frame < frames.size());
+	frames[frame].timings.emplace_back(timer, ms);
+}
+
+void Benchmark::mark(std::string const &name) {
+	sections.emplace_back(name);
+}
+
+//names can come from event files, so escape them for json:
+static std::string json_string(std::string const &str) {
+	std::string ret = "\"";
+	for (char c : str) {
+		if (c == '"' || c == '\\') {
+			ret += '\\';
+			ret += c;
+		} else if (uint8_t(c) < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", uint32_t(c));
+			ret += buf;
+		} else {
+			ret += c;
+		}
+	}
+	return ret + "\"";
+}
+
+//MARK names may hold commas or quotes, so quote them for csv:
+static std::string csv_string(std::string const &str) {
+	std::string ret = "\"";
+	for (char c : str) {
+		if (c == '"') ret += '"';
+		ret += c;
+	}
+	return ret + "\"";
+}
+
+//nearest-rank percentile of sorted values:
+static double percentile(std::vector< double > const &sorted, double p) {
+	assert(!sorted.empty());
+	size_t rank = size_t(std::ceil(p / 100.0 * double(sorted.size())));
+	return sorted[std::clamp< size_t >(rank, 1, sorted.size()) - 1];
+}
+
+void Benchmark::write(std::string const &prefix) const {
+	std::vector< std::string > names = sections;
+	if (!frames.empty() && frames.back().section >= names.size()) names.emplace_back("end");
+
+	{ //every timing of every frame:
+		std::ofstream csv(prefix + ".csv");
+		if (!csv) throw std::runtime_error("Failed to open '" + prefix + ".csv' to write benchmark timings.");
+		csv << "frame,section,timer,ms\n";
+		for (uint32_t f = 0; f < frames.size(); ++f) {
+			for (auto const &[timer, ms] : frames[f].timings) {
+				csv << f << ',' << csv_string(names[frames[f].section]) << ',' << timer << ',' << ms << '\n';
+			}
+		}
+		if (!csv) throw std::runtime_error("Failed to write benchmark timings to '" + prefix + ".csv'.");
+	}
+
+	{ //summary of each timer in each section:
+		std::ofstream json(prefix + ".json");
+		if (!json) throw std::runtime_error("Failed to open '" + prefix + ".json' to write benchmark summary.");
+		json << "{\"sections\":[";
+		for (uint32_t s = 0; s < names.size(); ++s) {
+			std::map< std::string, std::vector< double > > timers; //(sorted by name, so sections list timers in the same order)
+			uint32_t frame_count = 0;
+			for (Frame const &frame : frames) {
+				if (frame.section != s) continue;
+				frame_count += 1;
+				for (auto const &[timer, ms] : frame.timings) {
+					timers[timer].emplace_back(ms);
+				}
+			}
+
+			json << (s ? "," : "") << "\n{\"name\":" << json_string(names[s]) << ",\"frames\":" << frame_count << ",\"timers\":{";
+			bool first = true;
+			for (auto &[timer, values] : timers) {
+				std::sort(values.begin(), values.end());
+				double total = 0.0;
+				for (double v : values) total += v;
+				json << (first ? "" : ",") << "\n\t" << json_string(timer) << ":{"
+				     << "\"count\":" << values.size()
+				     << ",\"mean\":" << total / double(values.size())
+				     << ",\"min\":" << values.front()
+				     << ",\"median\":" << percentile(values, 50.0)
+				     << ",\"p95\":" << percentile(values, 95.0)
+				     << ",\"p99\":" << percentile(values, 99.0)
+				     << ",\"max\":" << values.back()
+				     << "}";
+				first = false;
+			}
+			json << "}}";
+		}
+		json << "\n]}\n";
+		if (!json) throw std::runtime_error("Failed to write benchmark summary to '" + prefix + ".json'.");
+	}
+}
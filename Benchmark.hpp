@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+//Per-frame timings collected by headless mode's `--benchmark`, split into sections at each MARK event:
+struct Benchmark {
+	//start a frame in the current section; returns its index for add():
+	uint32_t frame();
+
+	//record a timing (in milliseconds) for a frame; GPU timings may arrive a few frames late:
+	void add(uint32_t frame, std::string const &timer, double ms);
+
+	//end the current section, naming it after the MARK that ended it:
+	void mark(std::string const &name);
+
+	//write every timing to <prefix>.csv (frame,section,timer,ms rows) and per-section count/mean/min/median/p95/p99
+	// of each timer to <prefix>.json; frames after the last MARK form a section named "end".
+	//throws on failure:
+	void write(std::string const &prefix) const;
+
+	struct Frame {
+		uint32_t section;
+		std::vector< std::pair< std::string, double > > timings; //(timer, ms)
+	};
+	std::vector< Frame > frames;
+	std::vector< std::string > sections; //names of the sections ended so far
+};
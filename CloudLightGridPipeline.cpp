@@ -140,7 +140,7 @@ void RTGRenderer::CloudLightGirdPipeline::create(RTG &rtg) {
             .layout = layout,
         };
 
-        VK(vkCreateComputePipelines(rtg.device, VK_NULL_HANDLE, 1, &create_info, nullptr, &handle));
+        VK(vkCreateComputePipelines(rtg.device, rtg.pipeline_cache, 1, &create_info, nullptr, &handle));
 
         // Destroy shader module after pipeline creation
         vkDestroyShaderModule(rtg.device, comp_module, nullptr);
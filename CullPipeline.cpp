@@ -0,0 +1,120 @@
+#include "RTGRenderer.hpp"
+
+#include "Helpers.hpp"
+
+#include "VK.hpp"
+
+static uint32_t comp_code[] =
+#include "spv/cull.comp.inl"
+;
+
+void RTGRenderer::CullPipeline::create(RTG &rtg) {
+	VkShaderModule comp_module = rtg.helpers.create_shader_module(comp_code);
+
+	{//the set0_Cull layout holds the per-instance inputs and the indirect draw outputs
+		std::array<VkDescriptorSetLayoutBinding, 6> bindings{
+			VkDescriptorSetLayoutBinding{ // Transforms
+				.binding = 0,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+			},
+			VkDescriptorSetLayoutBinding{ // Instances
+				.binding = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+			},
+			VkDescriptorSetLayoutBinding{ // Frusta
+				.binding = 2,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+			},
+			VkDescriptorSetLayoutBinding{ // DrawCommands
+				.binding = 3,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+			},
+			VkDescriptorSetLayoutBinding{ // DrawCounts
+				.binding = 4,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+			},
+			VkDescriptorSetLayoutBinding{ // Candidates
+				.binding = 5,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+			},
+		};
+
+		VkDescriptorSetLayoutCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.bindingCount = uint32_t(bindings.size()),
+			.pBindings = bindings.data(),
+		};
+
+		VK(vkCreateDescriptorSetLayout(rtg.device, &create_info, nullptr, &set0_Cull));
+	}
+
+	{//create pipeline layout:
+		VkPushConstantRange range{
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+			.offset = 0,
+			.size = sizeof(Push),
+		};
+
+		std::array<VkDescriptorSetLayout, 1> layouts{
+			set0_Cull,
+		};
+
+		VkPipelineLayoutCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.setLayoutCount = uint32_t(layouts.size()),
+			.pSetLayouts = layouts.data(),
+			.pushConstantRangeCount = 1,
+			.pPushConstantRanges = &range,
+		};
+		VK(vkCreatePipelineLayout(rtg.device, &create_info, nullptr, &layout));
+	}
+
+	{ //create pipeline:
+		VkPipelineShaderStageCreateInfo shader_stage{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = comp_module,
+			.pName = "main",
+		};
+
+		VkComputePipelineCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			.stage = shader_stage,
+			.layout = layout,
+		};
+
+		VK(vkCreateComputePipelines(rtg.device, rtg.pipeline_cache, 1, &create_info, nullptr, &handle));
+
+		// Destroy shader module after pipeline creation
+		vkDestroyShaderModule(rtg.device, comp_module, nullptr);
+	}
+}
+
+void RTGRenderer::CullPipeline::destroy(RTG &rtg) {
+	if (set0_Cull != VK_NULL_HANDLE) {
+		vkDestroyDescriptorSetLayout(rtg.device, set0_Cull, nullptr);
+		set0_Cull = VK_NULL_HANDLE;
+	}
+
+	if (layout != VK_NULL_HANDLE) {
+		vkDestroyPipelineLayout(rtg.device, layout, nullptr);
+		layout = VK_NULL_HANDLE;
+	}
+
+	if (handle != VK_NULL_HANDLE) {
+		vkDestroyPipeline(rtg.device, handle, nullptr);
+		handle = VK_NULL_HANDLE;
+	}
+}
@@ -5,6 +5,7 @@
 
 #include <vulkan/utility/vk_format_utils.h> //useful for byte counting
 #include <utility>
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <iostream>
@@ -43,19 +44,82 @@ Helpers::Allocation::~Allocation() {
 Helpers::Allocation Helpers::allocate(VkDeviceSize size, VkDeviceSize alignment, uint32_t memory_type_index, MapFlag map) {
 	Helpers::Allocation allocation;
 
-	VkMemoryAllocateInfo alloc_info{
-		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-		.allocationSize = size,
-		.memoryTypeIndex = memory_type_index
+	//buffers and optimal-tiling images share slabs, so keep them at least a granularity page apart:
+	alignment = std::max< VkDeviceSize >({ alignment, rtg.device_properties.limits.bufferImageGranularity, 1 });
+
+	auto align_up = [](VkDeviceSize value, VkDeviceSize align) -> VkDeviceSize {
+		return (value + align - 1) / align * align;
 	};
 
-	VK(vkAllocateMemory(rtg.device, &alloc_info, nullptr, &allocation.handle));
+	//try to carve the request out of a slab's free ranges (first fit):
+	auto try_slab = [&](MemorySlab &slab) -> bool {
+		if (slab.memory_type_index != memory_type_index) return false;
+		for (uint32_t r = 0; r < slab.free_ranges.size(); ++r) {
+			MemorySlab::Range range = slab.free_ranges[r];
+			VkDeviceSize begin = align_up(range.offset, alignment);
+			if (begin + size > range.offset + range.size) continue;
+
+			//split the range into (optional) front padding and (optional) tail:
+			MemorySlab::Range front{ .offset = range.offset, .size = begin - range.offset };
+			MemorySlab::Range back{ .offset = begin + size, .size = (range.offset + range.size) - (begin + size) };
+			slab.free_ranges.erase(slab.free_ranges.begin() + r);
+			if (back.size > 0) slab.free_ranges.insert(slab.free_ranges.begin() + r, back);
+			if (front.size > 0) slab.free_ranges.insert(slab.free_ranges.begin() + r, front);
+
+			allocation.handle = slab.handle;
+			allocation.offset = begin;
+			allocation.size = size;
+			slab.used += size;
+			slab.allocation_count += 1;
+			return true;
+		}
+		return false;
+	};
 
-	allocation.size = size;
-	allocation.offset = 0;
+	MemorySlab *owner = nullptr;
+	if (size <= SlabSize / 2) {
+		for (MemorySlab &slab : slabs) {
+			if (!slab.dedicated && try_slab(slab)) {
+				owner = &slab;
+				break;
+			}
+		}
+	}
+
+	if (!owner) {
+		//no room anywhere, so make a new slab (or a dedicated one for big requests):
+		MemorySlab slab;
+		slab.memory_type_index = memory_type_index;
+		slab.dedicated = (size > SlabSize / 2);
+		slab.size = slab.dedicated ? size : SlabSize;
+
+		//don't let one slab eat a large fraction of a small heap (e.g. a 256MB BAR heap):
+		VkDeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[memory_type_index].heapIndex].size;
+		if (!slab.dedicated && heap_size / 4 < slab.size) {
+			slab.size = std::max(align_up(size, alignment), align_up(heap_size / 4, alignment));
+		}
+
+		VkMemoryAllocateInfo alloc_info{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.allocationSize = slab.size,
+			.memoryTypeIndex = memory_type_index
+		};
+
+		VK(vkAllocateMemory(rtg.device, &alloc_info, nullptr, &slab.handle));
+
+		slab.free_ranges.emplace_back(MemorySlab::Range{ .offset = 0, .size = slab.size });
+		slabs.emplace_back(std::move(slab));
+		owner = &slabs.back();
+
+		[[maybe_unused]] bool placed = try_slab(*owner);
+		assert(placed && "fresh slab should always fit the request");
+	}
 
 	if (map == Mapped) {
-		VK(vkMapMemory(rtg.device, allocation.handle, 0, allocation.size, 0, &allocation.mapped));
+		if (owner->mapped == nullptr) {
+			VK(vkMapMemory(rtg.device, owner->handle, 0, VK_WHOLE_SIZE, 0, &owner->mapped));
+		}
+		allocation.mapped = owner->mapped; //(data() adds the offset)
 	}
 
 	return allocation;
@@ -66,16 +130,90 @@ Helpers::Allocation Helpers::allocate(VkMemoryRequirements const &req, VkMemoryP
 }
 
 void Helpers::free(Helpers::Allocation &&allocation) {
-	if (allocation.mapped != nullptr) {
-		vkUnmapMemory(rtg.device, allocation.handle);
-		allocation.mapped = nullptr;
+	if (allocation.handle == VK_NULL_HANDLE) return;
+
+	auto found = std::find_if(slabs.begin(), slabs.end(), [&](MemorySlab const &slab) {
+		return slab.handle == allocation.handle;
+	});
+	if (found == slabs.end()) {
+		throw std::runtime_error("Freeing an allocation that does not belong to any memory slab.");
+	}
+	MemorySlab &slab = *found;
+
+	assert(slab.allocation_count > 0 && slab.used >= allocation.size);
+	slab.used -= allocation.size;
+	slab.allocation_count -= 1;
+
+	//dedicated slabs go away with their allocation; otherwise keep at most one empty slab per memory type around for reuse:
+	bool release = slab.dedicated;
+	if (!release && slab.allocation_count == 0) {
+		for (MemorySlab const &other : slabs) {
+			if (&other != &slab && !other.dedicated && other.memory_type_index == slab.memory_type_index && other.allocation_count == 0) {
+				release = true;
+				break;
+			}
+		}
 	}
 
-	vkFreeMemory(rtg.device, allocation.handle, nullptr);
+	if (release) {
+		if (slab.mapped != nullptr) {
+			vkUnmapMemory(rtg.device, slab.handle);
+			slab.mapped = nullptr;
+		}
+		vkFreeMemory(rtg.device, slab.handle, nullptr);
+		slabs.erase(found);
+	} else {
+		//insert the range back in offset order, then merge with neighbors:
+		MemorySlab::Range range{ .offset = allocation.offset, .size = allocation.size };
+		auto after = std::lower_bound(slab.free_ranges.begin(), slab.free_ranges.end(), range.offset, [](MemorySlab::Range const &r, VkDeviceSize offset) {
+			return r.offset < offset;
+		});
+		auto at = slab.free_ranges.insert(after, range);
+		if (at + 1 != slab.free_ranges.end() && at->offset + at->size == (at + 1)->offset) {
+			at->size += (at + 1)->size;
+			slab.free_ranges.erase(at + 1);
+		}
+		if (at != slab.free_ranges.begin() && (at - 1)->offset + (at - 1)->size == at->offset) {
+			(at - 1)->size += at->size;
+			slab.free_ranges.erase(at);
+		}
+	}
 
 	allocation.handle = VK_NULL_HANDLE;
 	allocation.offset = 0;
 	allocation.size = 0;
+	allocation.mapped = nullptr;
+}
+
+void Helpers::dump_memory_stats() const {
+	VkDeviceSize total_size = 0;
+	VkDeviceSize total_used = 0;
+	uint32_t total_allocations = 0;
+	std::cout << "Memory slabs (" << slabs.size() << "):\n";
+	for (uint32_t i = 0; i < slabs.size(); ++i) {
+		MemorySlab const &slab = slabs[i];
+		VkDeviceSize free_bytes = 0;
+		VkDeviceSize largest_free = 0;
+		for (MemorySlab::Range const &range : slab.free_ranges) {
+			free_bytes += range.size;
+			largest_free = std::max(largest_free, range.size);
+		}
+		//fragmentation: how much of the free space is *not* in the largest free range
+		float fragmentation = (free_bytes == 0 ? 0.0f : 1.0f - float(largest_free) / float(free_bytes));
+		std::cout << " [" << i << "] type " << slab.memory_type_index
+			<< (slab.dedicated ? " (dedicated)" : "") << (slab.mapped ? " (mapped)" : "")
+			<< ", " << slab.used << " / " << slab.size << " bytes used"
+			<< " (" << (100.0f * float(slab.used) / float(slab.size)) << "%)"
+			<< ", " << slab.allocation_count << " allocations"
+			<< ", " << slab.free_ranges.size() << " free ranges"
+			<< ", largest free " << largest_free
+			<< ", fragmentation " << (100.0f * fragmentation) << "%\n";
+		total_size += slab.size;
+		total_used += slab.used;
+		total_allocations += slab.allocation_count;
+	}
+	std::cout << " total: " << total_used << " / " << total_size << " bytes used by " << total_allocations
+		<< " allocations in " << slabs.size() << " vkAllocateMemory calls." << std::endl;
 }
 
 
@@ -209,89 +347,103 @@ void Helpers::destroy_image_3D(AllocatedImage3D &&image)
 
 //----------------------------
 
-void Helpers::transfer_to_buffer(void *data, size_t size, AllocatedBuffer &target) {
-	//NOTE: could let this stick around and use it for all uploads, but this function isn't for performant transfers:
-	AllocatedBuffer transfer_src = create_buffer(
-		size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		Mapped
-	);
-	//copy data to transfer buffer
-	std::memcpy(transfer_src.allocation.data(), data, size);
-
-
-	{ //record command buffer that does CPU->GPU transfer:
-		VK(vkResetCommandBuffer(transfer_command_buffers[0], 0));
+void Helpers::begin_upload_batch() {
+	upload_batch_depth += 1;
+}
 
-		VkCommandBufferBeginInfo begin_info{
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, //will record again every submit
-		};
+void Helpers::end_upload_batch() {
+	assert(upload_batch_depth > 0 && "end_upload_batch without matching begin_upload_batch");
+	upload_batch_depth -= 1;
+	if (upload_batch_depth == 0) {
+		flush_upload_batch();
+	}
+}
 
-		VK(vkBeginCommandBuffer(transfer_command_buffers[0], &begin_info));
+Helpers::StagedUpload Helpers::stage_upload(void const *data, size_t size) {
+	//keep copies aligned for any texel size (and the device's preferred copy alignment):
+	VkDeviceSize alignment = std::max< VkDeviceSize >(16, rtg.device_properties.limits.optimalBufferCopyOffsetAlignment);
+	VkDeviceSize begin = (upload_ring_head + alignment - 1) / alignment * alignment;
 
-		VkBufferCopy copy_region{
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = size
-		};
-		vkCmdCopyBuffer(transfer_command_buffers[0], transfer_src.handle, target.handle, 1, &copy_region);
+	StagedUpload staged;
+	if (size > upload_ring.size) {
+		//too big for the ring; give it a one-off staging buffer that lives until the batch is flushed:
+		if (upload_overflow_bytes + size > 4 * upload_ring.size) {
+			flush_upload_batch(); //don't pile up an unbounded amount of one-off staging memory
+		}
+		upload_overflow.emplace_back(create_buffer(
+			size,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			Mapped
+		));
+		upload_overflow_bytes += size;
+		staged.buffer = upload_overflow.back().handle;
+		staged.offset = 0;
+		staged.mapped = upload_overflow.back().allocation.data();
+	} else {
+		if (begin + size > upload_ring.size) {
+			//ring is full; submit what's pending, wait for it, and wrap around:
+			flush_upload_batch();
+			begin = 0;
+		}
+		upload_ring_head = begin + size;
+		staged.buffer = upload_ring.handle;
+		staged.offset = begin;
+		staged.mapped = reinterpret_cast< char * >(upload_ring.allocation.data()) + begin;
+	}
 
-		VK(vkEndCommandBuffer(transfer_command_buffers[0]));
+	if (data != nullptr) {
+		std::memcpy(staged.mapped, data, size);
 	}
 
-	{//run command buffer
-		VkSubmitInfo submit_info{
-			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.commandBufferCount = 1,
-			.pCommandBuffers = &transfer_command_buffers[0]
+	if (!upload_recording) { //begin recording the batch's command buffer
+		VK(vkResetCommandBuffer(upload_command_buffer, 0));
+
+		VkCommandBufferBeginInfo begin_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, //will record again every batch
 		};
 
-		VK(vkQueueSubmit(rtg.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+		VK(vkBeginCommandBuffer(upload_command_buffer, &begin_info));
+		upload_recording = true;
 	}
 
-	//wait for command buffer to finish
-	VK(vkQueueWaitIdle(rtg.graphics_queue));
-
-	//don't leak buffer memory:
-	destroy_buffer(std::move(transfer_src));
+	return staged;
 }
 
-void Helpers::transfer_to_image(void *data, size_t size, AllocatedImage &target) {
-	assert(target.handle); //target image should be allocated already
-	//check data is the right size:
-	size_t bytes_per_pixel = vkuFormatElementSize(target.format);
-	assert(size == target.extent.width * target.extent.height * bytes_per_pixel);
+void Helpers::record_buffer_upload(StagedUpload const &staged, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset) {
+	assert(upload_recording);
 
-	//create a host-coherent source buffer
-	AllocatedBuffer transfer_src = create_buffer(
-		size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		Mapped
-	);
-
-	//copy image data into the source buffer
-	std::memcpy(transfer_src.allocation.data(), data, size);
-
-	//begin recording a command buffer
-	VK(vkResetCommandBuffer(transfer_command_buffers[0], 0));
-
-	VkCommandBufferBeginInfo begin_info{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, //will record again every submit
+	VkBufferCopy copy_region{
+		.srcOffset = staged.offset,
+		.dstOffset = target_offset,
+		.size = size
 	};
+	vkCmdCopyBuffer(upload_command_buffer, staged.buffer, target.handle, 1, &copy_region);
+
+	//make the copy visible to whatever reads the buffer (vertex/index fetch, shaders):
+	upload_buffer_barriers.emplace_back(VkBufferMemoryBarrier{
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.buffer = target.handle,
+		.offset = target_offset,
+		.size = size,
+	});
+	upload_dst_stages |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+		| VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+}
 
-	VK(vkBeginCommandBuffer(transfer_command_buffers[0], &begin_info));
+void Helpers::record_image_upload(void const *data, size_t size, VkImage image, VkImageSubresourceRange const &range,
+	std::vector< VkBufferImageCopy > regions, VkPipelineStageFlags dst_stage) {
 
-	VkImageSubresourceRange whole_image{
-		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-		.baseMipLevel = 0,
-		.levelCount = 1,
-		.baseArrayLayer = 0,
-		.layerCount = 1,
-	};
+	//stage first, since running out of ring space flushes the batch:
+	StagedUpload staged = stage_upload(data, size);
+	for (VkBufferImageCopy &region : regions) {
+		region.bufferOffset += staged.offset;
+	}
 
 	{ //put the receiving image in destination-optimal layout
 		VkImageMemoryBarrier barrier{
@@ -302,12 +454,12 @@ void Helpers::transfer_to_image(void *data, size_t size, AllocatedImage &target)
 			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
 			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.image = target.handle,
-			.subresourceRange = whole_image,
+			.image = image,
+			.subresourceRange = range,
 		};
 
 		vkCmdPipelineBarrier(
-			transfer_command_buffers[0], //commandBuffer
+			upload_command_buffer, //commandBuffer
 			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, //srcStageMask
 			VK_PIPELINE_STAGE_TRANSFER_BIT, //dstStageMask
 			0, //dependencyFlags
@@ -317,106 +469,198 @@ void Helpers::transfer_to_image(void *data, size_t size, AllocatedImage &target)
 		);
 	}
 
-	{ // copy the source buffer to the image
-		VkBufferImageCopy region{
-			.bufferOffset = 0,
-			.bufferRowLength = target.extent.width,
-			.bufferImageHeight = target.extent.height,
-			.imageSubresource{
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.mipLevel = 0,
-				.baseArrayLayer = 0,
-				.layerCount = 1,
-			},
-			.imageOffset{ .x = 0, .y = 0, .z = 0 },
-			.imageExtent{
-				.width = target.extent.width,
-				.height = target.extent.height,
-				.depth = 1
-			},
-		};
+	vkCmdCopyBufferToImage(
+		upload_command_buffer,
+		staged.buffer,
+		image,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		uint32_t(regions.size()), regions.data()
+	);
 
-		vkCmdCopyBufferToImage(
-			transfer_command_buffers[0],
-			transfer_src.handle,
-			target.handle,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &region
+	//transition to shader-read-only-optimal layout (recorded when the batch is flushed):
+	upload_image_barriers.emplace_back(VkImageMemoryBarrier{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = range,
+	});
+	upload_dst_stages |= dst_stage;
+}
+
+void Helpers::flush_upload_batch() {
+	if (!upload_recording) return;
+
+	bool dedicated_transfer = (rtg.transfer_queue_family.value() != rtg.graphics_queue_family.value());
+
+	if (dedicated_transfer) {
+		//resources are exclusive to one queue family, so the transfer queue releases them...
+		std::vector< VkBufferMemoryBarrier > buffer_releases = upload_buffer_barriers;
+		std::vector< VkImageMemoryBarrier > image_releases = upload_image_barriers;
+		for (auto &barrier : buffer_releases) {
+			barrier.dstAccessMask = 0;
+			barrier.srcQueueFamilyIndex = rtg.transfer_queue_family.value();
+			barrier.dstQueueFamilyIndex = rtg.graphics_queue_family.value();
+		}
+		for (auto &barrier : image_releases) {
+			barrier.dstAccessMask = 0;
+			barrier.srcQueueFamilyIndex = rtg.transfer_queue_family.value();
+			barrier.dstQueueFamilyIndex = rtg.graphics_queue_family.value();
+		}
+		vkCmdPipelineBarrier(
+			upload_command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0,
+			0, nullptr,
+			uint32_t(buffer_releases.size()), buffer_releases.data(),
+			uint32_t(image_releases.size()), image_releases.data()
 		);
+		VK(vkEndCommandBuffer(upload_command_buffer));
+
+		//...and the graphics queue acquires them (with a matching layout transition):
+		std::vector< VkBufferMemoryBarrier > buffer_acquires = upload_buffer_barriers;
+		std::vector< VkImageMemoryBarrier > image_acquires = upload_image_barriers;
+		for (auto &barrier : buffer_acquires) {
+			barrier.srcAccessMask = 0;
+			barrier.srcQueueFamilyIndex = rtg.transfer_queue_family.value();
+			barrier.dstQueueFamilyIndex = rtg.graphics_queue_family.value();
+		}
+		for (auto &barrier : image_acquires) {
+			barrier.srcAccessMask = 0;
+			barrier.srcQueueFamilyIndex = rtg.transfer_queue_family.value();
+			barrier.dstQueueFamilyIndex = rtg.graphics_queue_family.value();
+		}
 
-		//NOTE: if image has mip levels, need to copy additional regions here
-	}
+		VK(vkResetCommandBuffer(upload_acquire_command_buffer, 0));
+		VkCommandBufferBeginInfo begin_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		};
+		VK(vkBeginCommandBuffer(upload_acquire_command_buffer, &begin_info));
+		vkCmdPipelineBarrier(
+			upload_acquire_command_buffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+			upload_dst_stages,
+			0,
+			0, nullptr,
+			uint32_t(buffer_acquires.size()), buffer_acquires.data(),
+			uint32_t(image_acquires.size()), image_acquires.data()
+		);
+		VK(vkEndCommandBuffer(upload_acquire_command_buffer));
 
-	{ // transition the image memory to shader-read-only-optimal layout:
-		VkImageMemoryBarrier barrier{
-			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-			.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.image = target.handle,
-			.subresourceRange = whole_image,
+		VkSubmitInfo transfer_submit{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &upload_command_buffer,
+			.signalSemaphoreCount = 1,
+			.pSignalSemaphores = &upload_semaphore,
 		};
+		VK(vkQueueSubmit(rtg.transfer_queue, 1, &transfer_submit, VK_NULL_HANDLE));
 
+		VkPipelineStageFlags wait_stage = upload_dst_stages;
+		VkSubmitInfo acquire_submit{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.waitSemaphoreCount = 1,
+			.pWaitSemaphores = &upload_semaphore,
+			.pWaitDstStageMask = &wait_stage,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &upload_acquire_command_buffer,
+		};
+		VK(vkQueueSubmit(rtg.graphics_queue, 1, &acquire_submit, upload_fence));
+	} else {
+		//same queue for copies and rendering, so just make the copies visible:
 		vkCmdPipelineBarrier(
-			transfer_command_buffers[0], //commandBuffer
-			VK_PIPELINE_STAGE_TRANSFER_BIT, //srcStageMask
-			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, //dstStageMask
-			0, //dependencyFlags
-			0, nullptr, //memory barrier count, pointer
-			0, nullptr, //buffer memory barrier count, pointer
-			1, &barrier //image memory barrier count, pointer
+			upload_command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT,
+			upload_dst_stages,
+			0,
+			0, nullptr,
+			uint32_t(upload_buffer_barriers.size()), upload_buffer_barriers.data(),
+			uint32_t(upload_image_barriers.size()), upload_image_barriers.data()
 		);
+		VK(vkEndCommandBuffer(upload_command_buffer));
+
+		VkSubmitInfo submit_info{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.commandBufferCount = 1,
+			.pCommandBuffers = &upload_command_buffer,
+		};
+		VK(vkQueueSubmit(rtg.graphics_queue, 1, &submit_info, upload_fence));
 	}
 
-	//end and submit the command buffer
-	VK( vkEndCommandBuffer(transfer_command_buffers[0]) );
+	//one wait for the whole batch:
+	VK(vkWaitForFences(rtg.device, 1, &upload_fence, VK_TRUE, UINT64_MAX));
+	VK(vkResetFences(rtg.device, 1, &upload_fence));
 
-	VkSubmitInfo submit_info{
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &transfer_command_buffers[0]
-	};
+	for (AllocatedBuffer &overflow : upload_overflow) {
+		destroy_buffer(std::move(overflow));
+	}
+	upload_overflow.clear();
+	upload_overflow_bytes = 0;
+	upload_buffer_barriers.clear();
+	upload_image_barriers.clear();
+	upload_dst_stages = 0;
+	upload_ring_head = 0;
+	upload_recording = false;
+}
 
-	VK(vkQueueSubmit(rtg.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
+void Helpers::transfer_to_buffer(void *data, size_t size, AllocatedBuffer &target) {
+	begin_upload_batch();
+	StagedUpload staged = stage_upload(data, size);
+	record_buffer_upload(staged, size, target, 0);
+	end_upload_batch();
+}
 
-	//wait for command buffer to finish executing
-	VK(vkQueueWaitIdle(rtg.graphics_queue));
+void Helpers::transfer_to_image(void *data, size_t size, AllocatedImage &target) {
+	assert(target.handle); //target image should be allocated already
+	//check data is the right size:
+	[[maybe_unused]] size_t bytes_per_pixel = vkuFormatElementSize(target.format);
+	assert(size == target.extent.width * target.extent.height * bytes_per_pixel);
+
+	VkImageSubresourceRange whole_image{
+		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+		.baseMipLevel = 0,
+		.levelCount = 1,
+		.baseArrayLayer = 0,
+		.layerCount = 1,
+	};
 
-	//destroy the source buffer
-	destroy_buffer(std::move(transfer_src));
+	VkBufferImageCopy region{
+		.bufferOffset = 0,
+		.bufferRowLength = target.extent.width,
+		.bufferImageHeight = target.extent.height,
+		.imageSubresource{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.mipLevel = 0,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+		.imageOffset{ .x = 0, .y = 0, .z = 0 },
+		.imageExtent{
+			.width = target.extent.width,
+			.height = target.extent.height,
+			.depth = 1
+		},
+	};
+	//NOTE: if image has mip levels, need to copy additional regions here
+
+	begin_upload_batch();
+	record_image_upload(data, size, target.handle, whole_image, { region }, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	end_upload_batch();
 }
 
 void Helpers::transfer_to_image_3D(void *data, size_t size, AllocatedImage3D &target)
 {
 	assert(target.handle); //target image should be allocated already
 	//check data is the right size:
-	size_t bytes_per_pixel = vkuFormatElementSize(target.format);
+	[[maybe_unused]] size_t bytes_per_pixel = vkuFormatElementSize(target.format);
 	assert(size == target.extent.width * target.extent.height * target.extent.depth * bytes_per_pixel);
 
-	//create a host-coherent source buffer
-	AllocatedBuffer transfer_src = create_buffer(
-		size,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		Mapped
-	);
-
-	//copy image data into the source buffer
-	std::memcpy(transfer_src.allocation.data(), data, size);
-
-	//begin recording a command buffer
-	VK(vkResetCommandBuffer(transfer_command_buffers[0], 0));
-
-	VkCommandBufferBeginInfo begin_info{
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, //will record again every submit
-	};
-
-	VK(vkBeginCommandBuffer(transfer_command_buffers[0], &begin_info));
-
 	VkImageSubresourceRange whole_image{
 		.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
 		.baseMipLevel = 0,
@@ -425,100 +669,28 @@ void Helpers::transfer_to_image_3D(void *data, size_t size, AllocatedImage3D &ta
 		.layerCount = 1,
 	};
 
-	{ //put the receiving image in destination-optimal layout
-		VkImageMemoryBarrier barrier{
-			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-			.srcAccessMask = 0,
-			.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED, //throw away old image
-			.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.image = target.handle,
-			.subresourceRange = whole_image,
-		};
-
-		vkCmdPipelineBarrier(
-			transfer_command_buffers[0], //commandBuffer
-			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, //srcStageMask
-			VK_PIPELINE_STAGE_TRANSFER_BIT, //dstStageMask
-			0, //dependencyFlags
-			0, nullptr, //memory barrier count, pointer
-			0, nullptr, //buffer memory barrier count, pointer
-			1, &barrier //image memory barrier count, pointer
-		);
-	}
-
-	{ // copy the source buffer to the image
-		VkBufferImageCopy region{
-			.bufferOffset = 0,
-			.bufferRowLength = target.extent.width,
-			.bufferImageHeight = target.extent.height,
-			.imageSubresource{
-				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-				.mipLevel = 0,
-				.baseArrayLayer = 0,
-				.layerCount = 1,
-			},
-			.imageOffset{ .x = 0, .y = 0, .z = 0 },
-			.imageExtent{
-				.width = target.extent.width,
-				.height = target.extent.height,
-				.depth = target.extent.depth,
-			},
-		};
-
-		vkCmdCopyBufferToImage(
-			transfer_command_buffers[0],
-			transfer_src.handle,
-			target.handle,
-			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			1, &region
-		);
-
-		//NOTE: if image has mip levels, need to copy additional regions here
-	}
-
-	{ // transition the image memory to shader-read-only-optimal layout:
-		VkImageMemoryBarrier barrier{
-			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-			.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-			.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.image = target.handle,
-			.subresourceRange = whole_image,
-		};
-
-		vkCmdPipelineBarrier(
-			transfer_command_buffers[0], //commandBuffer
-			VK_PIPELINE_STAGE_TRANSFER_BIT, //srcStageMask
-			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //dstStageMask
-			0, //dependencyFlags
-			0, nullptr, //memory barrier count, pointer
-			0, nullptr, //buffer memory barrier count, pointer
-			1, &barrier //image memory barrier count, pointer
-		);
-	}
-
-	//end and submit the command buffer
-	VK( vkEndCommandBuffer(transfer_command_buffers[0]) );
-
-	VkSubmitInfo submit_info{
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &transfer_command_buffers[0]
+	VkBufferImageCopy region{
+		.bufferOffset = 0,
+		.bufferRowLength = target.extent.width,
+		.bufferImageHeight = target.extent.height,
+		.imageSubresource{
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.mipLevel = 0,
+			.baseArrayLayer = 0,
+			.layerCount = 1,
+		},
+		.imageOffset{ .x = 0, .y = 0, .z = 0 },
+		.imageExtent{
+			.width = target.extent.width,
+			.height = target.extent.height,
+			.depth = target.extent.depth,
+		},
 	};
 
-	VK(vkQueueSubmit(rtg.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
-
-	//wait for command buffer to finish executing
-	VK(vkQueueWaitIdle(rtg.graphics_queue));
-
-	//destroy the source buffer
-	destroy_buffer(std::move(transfer_src));
+	//3D images are read by the cloud compute passes:
+	begin_upload_batch();
+	record_image_upload(data, size, target.handle, whole_image, { region }, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+	end_upload_batch();
 }
 
 void Helpers::transfer_to_image_layered(void *data, size_t size, AllocatedImage &image, uint32_t layer_count)
@@ -527,24 +699,6 @@ void Helpers::transfer_to_image_layered(void *data, size_t size, AllocatedImage
 
     size_t bytes_per_pixel = vkuFormatElementSize(image.format);
 
-    AllocatedBuffer transfer_src = create_buffer(
-        size,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        Mapped
-    );
-
-    std::memcpy(transfer_src.allocation.data(), data, size);
-
-    VK(vkResetCommandBuffer(transfer_command_buffers[0], 0));
-
-    VkCommandBufferBeginInfo begin_info{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
- 
-    };
-    VK(vkBeginCommandBuffer(transfer_command_buffers[0], &begin_info));
-
     VkImageSubresourceRange all_layers{
         .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
         .baseMipLevel = 0,
@@ -553,104 +707,30 @@ void Helpers::transfer_to_image_layered(void *data, size_t size, AllocatedImage
         .layerCount = layer_count,
     };
 
-    { // Image memory barrier for all layers
-        VkImageMemoryBarrier barrier{
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = 0,
-            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED, 
-            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = image.handle,
-            .subresourceRange = all_layers,
-        };
-
-        vkCmdPipelineBarrier(
-            transfer_command_buffers[0], 
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 
-            VK_PIPELINE_STAGE_TRANSFER_BIT, 
-            0, 
-            0, nullptr, 
-            0, nullptr, 
-            1, &barrier 
-        );
-    }
-
-    { // Copy buffer to all layers of the image
-        std::vector<VkBufferImageCopy> regions(layer_count); // Array of layers
-
-        for (uint8_t layer = 0; layer < layer_count; ++layer) {
-			
-			regions[layer] = {
-				.bufferOffset = image.extent.width * image.extent.height * bytes_per_pixel * layer,
-				.bufferRowLength = image.extent.width,
-				.bufferImageHeight = image.extent.height,
-				.imageSubresource{
-					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.mipLevel = 0,
-					.baseArrayLayer = layer,   // Layer index
-					.layerCount = 1,       // One layer per region
-				},
-				.imageOffset{ .x = 0, .y = 0, .z = 0 },
-				.imageExtent{
-					.width = image.extent.width,
-					.height = image.extent.height,
-					.depth = 1
-				},
-			};
-			
-        }
-
-        vkCmdCopyBufferToImage(
-            transfer_command_buffers[0],
-            transfer_src.handle,
-            image.handle,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            uint32_t(regions.size()), regions.data() // Copy all regions
-        );
-    }
-
-    { // Image memory barrier for all layers
-        VkImageMemoryBarrier barrier{
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = image.handle,
-            .subresourceRange = all_layers,
+    std::vector<VkBufferImageCopy> regions(layer_count); // Array of layers
+    for (uint32_t layer = 0; layer < layer_count; ++layer) {
+        regions[layer] = {
+            .bufferOffset = image.extent.width * image.extent.height * bytes_per_pixel * layer,
+            .bufferRowLength = image.extent.width,
+            .bufferImageHeight = image.extent.height,
+            .imageSubresource{
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = 0,
+                .baseArrayLayer = layer,   // Layer index
+                .layerCount = 1,       // One layer per region
+            },
+            .imageOffset{ .x = 0, .y = 0, .z = 0 },
+            .imageExtent{
+                .width = image.extent.width,
+                .height = image.extent.height,
+                .depth = 1
+            },
         };
-
-        vkCmdPipelineBarrier(
-            transfer_command_buffers[0], 
-            VK_PIPELINE_STAGE_TRANSFER_BIT, 
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
-            0, 
-            0, nullptr,
-            0, nullptr,
-            1, &barrier 
-        );
     }
 
-	//end and submit the command buffer
-	VK( vkEndCommandBuffer(transfer_command_buffers[0]) );
-
-	VkSubmitInfo submit_info{
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &transfer_command_buffers[0]
-	};
-
-	VK(vkQueueSubmit(rtg.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
-
-	//wait for command buffer to finish executing
-	VK(vkQueueWaitIdle(rtg.graphics_queue));
-
-	//destroy the source buffer
-	destroy_buffer(std::move(transfer_src));
+	begin_upload_batch();
+	record_image_upload(data, size, image.handle, all_layers, std::move(regions), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	end_upload_batch();
 }
 
 void Helpers::transfer_to_image_cube(void* data, size_t size, AllocatedImage& target, uint8_t mip_level) {
@@ -658,25 +738,6 @@ void Helpers::transfer_to_image_cube(void* data, size_t size, AllocatedImage& ta
 
     size_t bytes_per_pixel = vkuFormatElementSize(target.format);
 
-    AllocatedBuffer transfer_src = create_buffer(
-        size,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        Mapped
-    );
-
-    std::memcpy(transfer_src.allocation.data(), data, size);
-
-    VK(vkResetCommandBuffer(transfer_command_buffers[0], 0));
-
-    VkCommandBufferBeginInfo begin_info{
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
- 
-    };
-
-    VK(vkBeginCommandBuffer(transfer_command_buffers[0], &begin_info));
-
     VkImageSubresourceRange all_layers{
         .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
         .baseMipLevel = 0,
@@ -685,105 +746,32 @@ void Helpers::transfer_to_image_cube(void* data, size_t size, AllocatedImage& ta
         .layerCount = 6,       // Include all 6 layers
     };
 
-    { // Image memory barrier for all layers
-        VkImageMemoryBarrier barrier{
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = 0,
-            .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED, 
-            .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = target.handle,
-            .subresourceRange = all_layers,
-        };
-
-        vkCmdPipelineBarrier(
-            transfer_command_buffers[0], 
-            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 
-            VK_PIPELINE_STAGE_TRANSFER_BIT, 
-            0, 
-            0, nullptr, 
-            0, nullptr, 
-            1, &barrier 
-        );
-    }
-
-    { // Copy buffer to all layers of the image
-        std::vector<VkBufferImageCopy> regions(6 * mip_level); // Array of regions for each layer
-
-        for (uint8_t face = 0; face < 6; ++face) {
-			for (uint8_t level = 0; level < mip_level; ++level) {
-				regions[face*mip_level + level] = {
-					.bufferOffset = get_cube_buffer_offset(target.extent.width, target.extent.height, face, level, bytes_per_pixel), // Offset for each layer
-					.bufferRowLength = target.extent.width >> level,
-					.bufferImageHeight = target.extent.height >> level,
-					.imageSubresource{
-						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-						.mipLevel = level,
-						.baseArrayLayer = face,   // Layer index
-						.layerCount = 1,       // One layer per region
-					},
-					.imageOffset{ .x = 0, .y = 0, .z = 0 },
-					.imageExtent{
-						.width = target.extent.width >> level,
-						.height = target.extent.height >> level,
-						.depth = 1
-					},
-				};
-			}
+    std::vector<VkBufferImageCopy> regions(6 * mip_level); // Array of regions for each layer
+    for (uint8_t face = 0; face < 6; ++face) {
+        for (uint8_t level = 0; level < mip_level; ++level) {
+            regions[face*mip_level + level] = {
+                .bufferOffset = get_cube_buffer_offset(target.extent.width, target.extent.height, face, level, bytes_per_pixel), // Offset for each layer
+                .bufferRowLength = target.extent.width >> level,
+                .bufferImageHeight = target.extent.height >> level,
+                .imageSubresource{
+                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                    .mipLevel = level,
+                    .baseArrayLayer = face,   // Layer index
+                    .layerCount = 1,       // One layer per region
+                },
+                .imageOffset{ .x = 0, .y = 0, .z = 0 },
+                .imageExtent{
+                    .width = target.extent.width >> level,
+                    .height = target.extent.height >> level,
+                    .depth = 1
+                },
+            };
         }
-
-        vkCmdCopyBufferToImage(
-            transfer_command_buffers[0],
-            transfer_src.handle,
-            target.handle,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            uint32_t(regions.size()), regions.data() // Copy all regions
-        );
     }
 
-    { // Image memory barrier for all layers
-        VkImageMemoryBarrier barrier{
-            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-            .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-            .image = target.handle,
-            .subresourceRange = all_layers,
-        };
-
-        vkCmdPipelineBarrier(
-            transfer_command_buffers[0], 
-            VK_PIPELINE_STAGE_TRANSFER_BIT, 
-            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 
-            0, 
-            0, nullptr,
-            0, nullptr,
-            1, &barrier 
-        );
-    }
-
-	//end and submit the command buffer
-	VK( vkEndCommandBuffer(transfer_command_buffers[0]) );
-
-	VkSubmitInfo submit_info{
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &transfer_command_buffers[0]
-	};
-
-	VK(vkQueueSubmit(rtg.graphics_queue, 1, &submit_info, VK_NULL_HANDLE));
-
-	//wait for command buffer to finish executing
-	VK(vkQueueWaitIdle(rtg.graphics_queue));
-
-	//destroy the source buffer
-	destroy_buffer(std::move(transfer_src));
-
+	begin_upload_batch();
+	record_image_upload(data, size, target.handle, all_layers, std::move(regions), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	end_upload_batch();
 }
 
 VkDeviceSize Helpers::get_cube_buffer_offset(uint32_t base_width, uint32_t base_height, uint32_t face, uint32_t level, size_t bytes_per_pixel)
@@ -976,6 +964,43 @@ void Helpers::create() {
 		.commandBufferCount = rtg.configuration.workspaces,
 	};
 	VK(vkAllocateCommandBuffers(rtg.device, &alloc_info, transfer_command_buffers.data()));
+
+	{ //upload batch resources:
+		VkCommandPoolCreateInfo upload_pool_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = rtg.transfer_queue_family.value(),
+		};
+		VK(vkCreateCommandPool(rtg.device, &upload_pool_info, nullptr, &upload_command_pool));
+
+		VkCommandBufferAllocateInfo upload_alloc_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = upload_command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		VK(vkAllocateCommandBuffers(rtg.device, &upload_alloc_info, &upload_command_buffer));
+
+		//ownership acquire happens on the graphics queue:
+		VkCommandBufferAllocateInfo acquire_alloc_info{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = transfer_command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1,
+		};
+		VK(vkAllocateCommandBuffers(rtg.device, &acquire_alloc_info, &upload_acquire_command_buffer));
+
+		VkSemaphoreCreateInfo semaphore_info{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		};
+		VK(vkCreateSemaphore(rtg.device, &semaphore_info, nullptr, &upload_semaphore));
+
+		VkFenceCreateInfo fence_info{
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		};
+		VK(vkCreateFence(rtg.device, &fence_info, nullptr, &upload_fence));
+	}
+
 	vkGetPhysicalDeviceMemoryProperties(rtg.physical_device, &memory_properties);
 	if (rtg.configuration.debug) {
 		std::cout << "Memory types:\n";
@@ -990,9 +1015,53 @@ void Helpers::create() {
 		}
 		std::cout.flush();
 	}
+
+	upload_ring = create_buffer(
+		UploadRingSize,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		Mapped
+	);
 }
 
 void Helpers::destroy() {
+	if (upload_batch_depth != 0) {
+		std::cerr << "Destroying Helpers with an upload batch still open." << std::endl;
+	}
+	if (upload_ring.handle != VK_NULL_HANDLE) {
+		destroy_buffer(std::move(upload_ring));
+	}
+	if (upload_fence != VK_NULL_HANDLE) {
+		vkDestroyFence(rtg.device, upload_fence, nullptr);
+		upload_fence = VK_NULL_HANDLE;
+	}
+	if (upload_semaphore != VK_NULL_HANDLE) {
+		vkDestroySemaphore(rtg.device, upload_semaphore, nullptr);
+		upload_semaphore = VK_NULL_HANDLE;
+	}
+	if (upload_command_pool != VK_NULL_HANDLE) {
+		vkDestroyCommandPool(rtg.device, upload_command_pool, nullptr); //(frees upload_command_buffer)
+		upload_command_pool = VK_NULL_HANDLE;
+		upload_command_buffer = VK_NULL_HANDLE;
+	}
+	upload_acquire_command_buffer = VK_NULL_HANDLE; //(freed with transfer_command_pool, below)
+
+	if (rtg.configuration.debug) {
+		dump_memory_stats();
+	}
+	for (MemorySlab &slab : slabs) {
+		if (slab.allocation_count != 0) {
+			std::cerr << "Releasing a memory slab with " << slab.allocation_count << " live allocations." << std::endl;
+		}
+		if (slab.mapped != nullptr) {
+			vkUnmapMemory(rtg.device, slab.handle);
+			slab.mapped = nullptr;
+		}
+		vkFreeMemory(rtg.device, slab.handle, nullptr);
+		slab.handle = VK_NULL_HANDLE;
+	}
+	slabs.clear();
+
 	//technically not needed since freeing the pool frees the buffers contained
 	for (VkCommandBuffer& transfer_command_buffer : transfer_command_buffers) {
 		if (transfer_command_buffer != VK_NULL_HANDLE) {
@@ -37,9 +37,34 @@ struct Helpers {
 	//allocate a block that works for a given VkMemoryRequirements and VkMemoryPropertyFlags:
 	Allocation allocate(VkMemoryRequirements const &requirements, VkMemoryPropertyFlags memory_properties, MapFlag map = Unmapped);
 
-	//free an allocated block:
+	//free an allocated block (returns its range to the owning slab):
 	void free(Allocation &&allocation);
 
+	//Allocations are sub-allocated out of large per-memory-type slabs of device memory,
+	// so that thousands of buffers/images don't each cost a vkAllocateMemory:
+	struct MemorySlab {
+		VkDeviceMemory handle = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		uint32_t memory_type_index = 0;
+		void *mapped = nullptr; //whole slab is mapped (once) the first time a Mapped allocation lands in it
+		bool dedicated = false; //slab holds a single oversized allocation and is released when it is freed
+
+		struct Range {
+			VkDeviceSize offset = 0;
+			VkDeviceSize size = 0;
+		};
+		std::vector< Range > free_ranges; //sorted by offset, neighbors coalesced on free
+		VkDeviceSize used = 0; //bytes handed out (not counting alignment padding)
+		uint32_t allocation_count = 0;
+	};
+	std::vector< MemorySlab > slabs;
+
+	//default slab size; requests larger than half of this get a dedicated slab:
+	static constexpr VkDeviceSize SlabSize = VkDeviceSize(64) * 1024 * 1024;
+
+	//print per-slab usage and fragmentation to std::cout:
+	void dump_memory_stats() const;
+
 	//specializations that also create a buffer or image (respectively):
 	struct AllocatedBuffer {
 		VkBuffer handle = VK_NULL_HANDLE;
@@ -74,7 +99,8 @@ struct Helpers {
 	//-----------------------
 	//CPU -> GPU data transfer:
 
-	// NOTE: synchronizes *hard* against the GPU; inefficient to use for streaming data!
+	// NOTE: each call is staged through a persistent ring buffer; outside of an upload batch (below)
+	//  the call waits for its copy to finish, so wrap bulk loading in begin/end_upload_batch!
 	void transfer_to_buffer(void *data, size_t size, AllocatedBuffer &target);
 	void transfer_to_image(void *data, size_t size, AllocatedImage &image); //NOTE: image layout after call is VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 	void transfer_to_image_3D(void *data, size_t size, AllocatedImage3D &image); //NOTE: image layout after call is VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
@@ -86,6 +112,44 @@ struct Helpers {
 
 	VkCommandPool transfer_command_pool = VK_NULL_HANDLE;
 	std::vector<VkCommandBuffer> transfer_command_buffers;
+
+	//batched uploads: transfer_to_* calls between begin_upload_batch() and end_upload_batch() are
+	// recorded into one command buffer (on the dedicated transfer queue, if the device has one)
+	// and waited on with a single fence when the outermost batch ends:
+	void begin_upload_batch();
+	void end_upload_batch();
+
+	//a range of staging memory, already holding the data to upload:
+	struct StagedUpload {
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkDeviceSize offset = 0;
+		void *mapped = nullptr; //CPU pointer to the start of the range
+	};
+	//reserve staging space (copying data into it if data is non-null); may flush the batch if the ring is full:
+	StagedUpload stage_upload(void const *data, size_t size);
+	//record a copy from staging memory into a buffer (must be inside a batch):
+	void record_buffer_upload(StagedUpload const &staged, size_t size, AllocatedBuffer &target, VkDeviceSize target_offset);
+	//stage data and record a copy into an image, leaving it in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+	void record_image_upload(void const *data, size_t size, VkImage image, VkImageSubresourceRange const &range,
+		std::vector< VkBufferImageCopy > regions, VkPipelineStageFlags dst_stage);
+	//submit pending copies, wait for them, and rewind the ring:
+	void flush_upload_batch();
+
+	static constexpr VkDeviceSize UploadRingSize = VkDeviceSize(64) * 1024 * 1024;
+	AllocatedBuffer upload_ring; //persistently mapped staging buffer
+	VkDeviceSize upload_ring_head = 0;
+	std::vector< AllocatedBuffer > upload_overflow; //one-off staging for uploads bigger than the ring
+	VkDeviceSize upload_overflow_bytes = 0;
+	uint32_t upload_batch_depth = 0;
+	bool upload_recording = false;
+	VkCommandPool upload_command_pool = VK_NULL_HANDLE; //on the transfer queue family
+	VkCommandBuffer upload_command_buffer = VK_NULL_HANDLE;
+	VkCommandBuffer upload_acquire_command_buffer = VK_NULL_HANDLE; //on the graphics queue family; only used with a dedicated transfer queue
+	VkSemaphore upload_semaphore = VK_NULL_HANDLE; //transfer queue -> graphics queue
+	VkFence upload_fence = VK_NULL_HANDLE;
+	std::vector< VkBufferMemoryBarrier > upload_buffer_barriers; //final barriers for uploaded resources, recorded at flush
+	std::vector< VkImageMemoryBarrier > upload_image_barriers;
+	VkPipelineStageFlags upload_dst_stages = 0;
 	
 	//-----------------------
 	//Misc utilities:
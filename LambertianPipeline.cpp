@@ -22,7 +22,7 @@ void RTGRenderer::LambertianPipeline::create(RTG &rtg, VkRenderPass render_pass,
 				.binding = 0,
 				.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
 				.descriptorCount = 1,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
+				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT //CLIP_FROM_WORLD is read by the vertex shader
 			},
             VkDescriptorSetLayoutBinding{
 				.binding = 1,
@@ -72,13 +72,19 @@ void RTGRenderer::LambertianPipeline::create(RTG &rtg, VkRenderPass render_pass,
 	}
 
     {//the set1_Transforms layout holds an array of Transform structures in a storage buffer used in the vertex shader:
-		std::array<VkDescriptorSetLayoutBinding, 1> bindings{
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings{
 			VkDescriptorSetLayoutBinding{
 				.binding = 0,
 				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT
 			},
+			VkDescriptorSetLayoutBinding{ // per-instance material index (the cull pass's instance buffer)
+				.binding = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT
+			},
 		};
 		
 		VkDescriptorSetLayoutCreateInfo create_info{
@@ -90,42 +96,48 @@ void RTGRenderer::LambertianPipeline::create(RTG &rtg, VkRenderPass render_pass,
 		VK(vkCreateDescriptorSetLayout(rtg.device, &create_info, nullptr, &set1_Transforms));
 	}
 
-    { //the set2_TEXTURE layout has 3 sampler2Ds used in the fragment shader (normal, displacement, albedo):
-		std::array< VkDescriptorSetLayoutBinding, 3 > bindings{
-			VkDescriptorSetLayoutBinding{
+    { //the set2_Materials layout holds the material table and every scene texture, indexed per instance in the fragment shader:
+		std::array< VkDescriptorSetLayoutBinding, 2 > bindings{
+			VkDescriptorSetLayoutBinding{ // materials
 				.binding = 0,
-				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
 			},
-            VkDescriptorSetLayoutBinding{
+            VkDescriptorSetLayoutBinding{ // textures, actual count given at allocation
 				.binding = 1,
 				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.descriptorCount = 1,
-				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
-			},
-            VkDescriptorSetLayoutBinding{
-				.binding = 2,
-				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.descriptorCount = 1,
+				.descriptorCount = max_material_textures,
 				.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
 			},
 		};
+		std::array< VkDescriptorBindingFlags, 2 > binding_flags{
+			0,
+			VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT,
+		};
+
+		VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+			.bindingCount = uint32_t(binding_flags.size()),
+			.pBindingFlags = binding_flags.data(),
+		};
 		
 		VkDescriptorSetLayoutCreateInfo create_info{
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+			.pNext = &flags_info,
+			.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT, //update-after-bind limits allow far more samplers
 			.bindingCount = uint32_t(bindings.size()),
 			.pBindings = bindings.data(),
 		};
 
-		VK(vkCreateDescriptorSetLayout(rtg.device, &create_info, nullptr, &set2_TEXTURE));
+		VK(vkCreateDescriptorSetLayout(rtg.device, &create_info, nullptr, &set2_Materials));
     }
 
     {//create pipeline layout:
 		std::array<VkDescriptorSetLayout, 3> layouts{
 			set0_World, //we'd like to say "VK_NULL_HANDLE" here, but that's not valid without an extension
             set1_Transforms,
-            set2_TEXTURE,
+            set2_Materials,
         };
 
 		VkPipelineLayoutCreateInfo create_info{
@@ -241,7 +253,7 @@ void RTGRenderer::LambertianPipeline::create(RTG &rtg, VkRenderPass render_pass,
 			.subpass = subpass,
         };
 
-        VK(vkCreateGraphicsPipelines(rtg.device, VK_NULL_HANDLE, 1, &create_info, nullptr, &handle));
+        VK(vkCreateGraphicsPipelines(rtg.device, rtg.pipeline_cache, 1, &create_info, nullptr, &handle));
 
         //modules no longer needed now that the pipeline is created
         vkDestroyShaderModule(rtg.device, frag_module, nullptr);
@@ -259,9 +271,9 @@ void RTGRenderer::LambertianPipeline::destroy(RTG &rtg) {
 		vkDestroyDescriptorSetLayout(rtg.device, set1_Transforms, nullptr);
 		set1_Transforms = VK_NULL_HANDLE;
 	}
-    if (set2_TEXTURE != VK_NULL_HANDLE) {
-		vkDestroyDescriptorSetLayout(rtg.device, set2_TEXTURE, nullptr);
-		set2_TEXTURE = VK_NULL_HANDLE;
+    if (set2_Materials != VK_NULL_HANDLE) {
+		vkDestroyDescriptorSetLayout(rtg.device, set2_Materials, nullptr);
+		set2_Materials = VK_NULL_HANDLE;
 	}
     if (layout != VK_NULL_HANDLE) {
         vkDestroyPipelineLayout(rtg.device, layout, nullptr);
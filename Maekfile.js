@@ -26,14 +26,23 @@ custom_flags_and_rules();
 
 //maek.CPP(...) builds a c++ file:
 // it returns the path to the output object file
+const mapped_file_obj = maek.CPP('MappedFile.cpp'); //shared with the json parsing benchmark
+const sejp_obj = maek.CPP('sejp.cpp'); //shared with the json parsing benchmark
+
 const main_objs = [
 	maek.CPP('HeadlessEvent.cpp'),
 	maek.CPP('RTGRenderer.cpp'),
 	maek.CPP('RTG.cpp'),
 	maek.CPP('Helpers.cpp'),
 	maek.CPP('data_path.cpp'),
+	maek.CPP('ThreadPool.cpp'),
+	mapped_file_obj,
+	maek.CPP('image_output.cpp'),
+	maek.CPP('Benchmark.cpp'),
 ];
 
+const frustum_culling_obj = maek.CPP('frustum_culling.cpp'); //shared with the culling benchmark
+
 const viewer_objs = [
 	maek.CPP('main.cpp'),
 	maek.CPP('PosColVertex.cpp'),
@@ -42,8 +51,11 @@ const viewer_objs = [
 	maek.CPP('ShadowAtlas.cpp'),
 	maek.CPP('Cloud.cpp'),
 	maek.CPP('scene.cpp'),
-	maek.CPP('frustum_culling.cpp'),
-	maek.CPP('sejp.cpp'),
+	maek.CPP('SceneCache.cpp'),
+	frustum_culling_obj,
+	maek.CPP('bvh.cpp'),
+	maek.CPP('mesh_processing.cpp'),
+	sejp_obj,
 ]
 
 //maek.GLSLC(...) builds a glsl source file:
@@ -66,28 +78,28 @@ main_objs.push( maek.CPP('Tutorial-LinesPipeline.cpp', undefined, { depends:[...
 // build lambertian shaders and pipeline:
 const lambertian_shaders = [
 	maek.GLSLC('glsl/lambertian.vert', 'spv/lambertian.vert', {GLSLCFlags: []}),
-	maek.GLSLC('glsl/lambertian.frag', 'spv/lambertian.frag', {GLSLCFlags: [], depends:["glsl/light.glsl"]}),
+	maek.GLSLC('glsl/lambertian.frag', 'spv/lambertian.frag', {GLSLCFlags: [], depends:["glsl/light.glsl", "glsl/material.glsl"]}),
 ];
 main_objs.push( maek.CPP('LambertianPipeline.cpp', undefined, { depends:[...lambertian_shaders] } ) );
 
 // build environment shaders and pipeline:
 const environment_shaders = [
 	maek.GLSLC('glsl/environment.vert', 'spv/environment.vert', {GLSLCFlags: []}),
-	maek.GLSLC('glsl/environment.frag', 'spv/environment.frag', {GLSLCFlags: []}),
+	maek.GLSLC('glsl/environment.frag', 'spv/environment.frag', {GLSLCFlags: [], depends:["glsl/material.glsl"]}),
 ];
 main_objs.push( maek.CPP('EnvironmentPipeline.cpp', undefined, { depends:[...environment_shaders] } ) );
 
 // build mirror shaders and pipeline:
 const mirror_shaders = [
 	maek.GLSLC('glsl/mirror.vert', 'spv/mirror.vert', {GLSLCFlags: []}),
-	maek.GLSLC('glsl/mirror.frag', 'spv/mirror.frag', {GLSLCFlags: []}),
+	maek.GLSLC('glsl/mirror.frag', 'spv/mirror.frag', {GLSLCFlags: [], depends:["glsl/material.glsl"]}),
 ];
 main_objs.push( maek.CPP('MirrorPipeline.cpp', undefined, { depends:[...mirror_shaders] } ) );
 
 // build mirror shaders and pipeline:
 const pbr_shaders = [
 	maek.GLSLC('glsl/pbr.vert', 'spv/pbr.vert', {GLSLCFlags: []}),
-	maek.GLSLC('glsl/pbr.frag', 'spv/pbr.frag', {GLSLCFlags: [], depends:["glsl/light.glsl"]}),
+	maek.GLSLC('glsl/pbr.frag', 'spv/pbr.frag', {GLSLCFlags: [], depends:["glsl/light.glsl", "glsl/material.glsl"]}),
 ];
 main_objs.push( maek.CPP('PBRPipeline.cpp', undefined, { depends:[...pbr_shaders] } ) );
 
@@ -110,9 +122,27 @@ const cloud_lightgrid_shaders = [
 ]
 main_objs.push( maek.CPP('CloudLightGridPipeline.cpp', undefined, { depends:[...cloud_lightgrid_shaders] } ) );
 
+// build culling shader and pipeline
+const cull_shaders = [
+	maek.GLSLC('glsl/cull.comp', 'spv/cull.comp', {GLSLCFlags: []}),
+]
+main_objs.push( maek.CPP('CullPipeline.cpp', undefined, { depends:[...cull_shaders] } ) );
+
+// build depth pyramid shader and pipeline
+const hiz_shaders = [
+	maek.GLSLC('glsl/hiz.comp', 'spv/hiz.comp', {GLSLCFlags: []}),
+]
+main_objs.push( maek.CPP('HiZPipeline.cpp', undefined, { depends:[...hiz_shaders] } ) );
+
 
 const main_exe = maek.LINK([...main_objs, ...viewer_objs], 'bin/viewer');
 
+//culling microbenchmark (not built by default; run `node Maekfile.js bin/cull-bench`):
+const cull_bench_exe = maek.LINK([maek.CPP('cull-bench.cpp'), frustum_culling_obj], 'bin/cull-bench');
+
+//json parsing microbenchmark (not built by default; run `node Maekfile.js bin/sejp-bench`):
+const sejp_bench_exe = maek.LINK([maek.CPP('sejp-bench.cpp'), sejp_obj, mapped_file_obj], 'bin/sejp-bench');
+
 //default targets:
 maek.TARGETS = [main_exe];
 
@@ -143,6 +173,7 @@ function custom_flags_and_rules() {
 			'-lX11',
 			`-lvulkan`,
 			`-lglfw3`,
+			'-pthread',
 		];
 
 	} else if (maek.OS === 'windows') {
@@ -0,0 +1,95 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+#include <utility>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(std::string const &filename_) : filename(filename_) {
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Error opening file for mapping: " + filename);
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Error getting size of file: " + filename);
+	}
+	file_handle = file;
+	size = size_t(file_size.QuadPart);
+	if (size == 0) return; //(can't map an empty file, but there's also nothing to read)
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		unmap();
+		throw std::runtime_error("Error creating file mapping: " + filename);
+	}
+	mapping_handle = mapping;
+	data = reinterpret_cast< uint8_t const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr) {
+		unmap();
+		throw std::runtime_error("Error mapping view of file: " + filename);
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error("Error opening file for mapping: " + filename);
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Error getting size of file: " + filename);
+	}
+	size = size_t(info.st_size);
+	if (size != 0) {
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			close(fd);
+			size = 0;
+			throw std::runtime_error("Error mapping file: " + filename);
+		}
+		data = reinterpret_cast< uint8_t const * >(mapped);
+	}
+	close(fd); //(mapping stays valid after the descriptor is closed)
+	#endif
+}
+
+MappedFile::MappedFile(MappedFile &&from) {
+	*this = std::move(from);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&from) {
+	if (this != &from) {
+		unmap();
+		std::swap(data, from.data);
+		std::swap(size, from.size);
+		std::swap(filename, from.filename);
+		#if defined(_WIN32)
+		std::swap(file_handle, from.file_handle);
+		std::swap(mapping_handle, from.mapping_handle);
+		#endif
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile() {
+	unmap();
+}
+
+void MappedFile::unmap() {
+	#if defined(_WIN32)
+	if (data != nullptr) UnmapViewOfFile(data);
+	if (mapping_handle != nullptr) CloseHandle(mapping_handle);
+	if (file_handle != nullptr) CloseHandle(file_handle);
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+	#else
+	if (data != nullptr) munmap(const_cast< uint8_t * >(data), size);
+	#endif
+	data = nullptr;
+	size = 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <stdint.h>
+#include <stddef.h>
+
+//Read-only memory mapping of a whole file (mmap / MapViewOfFile):
+struct MappedFile {
+	MappedFile() = default; //default-constructed MappedFile maps nothing
+	MappedFile(std::string const &filename); //throws std::runtime_error if the file can't be opened or mapped
+	MappedFile(MappedFile &&); //takes ownership of the moved-from mapping
+	MappedFile &operator=(MappedFile &&);
+	MappedFile(MappedFile const &) = delete; //you shouldn't be copying mappings
+	~MappedFile(); //unmaps
+
+	uint8_t const *data = nullptr;
+	size_t size = 0;
+	std::string filename;
+
+	//internals:
+	void unmap();
+	#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
@@ -2,6 +2,10 @@
 
 #include "VK.hpp"
 #include "data_path.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+#include "Benchmark.hpp"
+#include "image_output.hpp"
 
 #include <vulkan/vulkan_core.h>
 #include <vulkan/utility/vk_format_utils.h> //useful for byte counting
@@ -15,8 +19,11 @@
 
 #include <cassert>
 #include <chrono>
+#include <condition_variable>
 #include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <mutex>
 #include <set>
 #include <fstream>
 
@@ -49,6 +56,10 @@ void RTG::Configuration::parse(int argc, char **argv) {
 			if (argi + 1 >= argc) throw std::runtime_error("--scene requires a parameter (a .72 format scene path).");
 			argi += 1;
 			scene_path = argv[argi];
+		} else if (arg == "--scene-cache") {
+			if (argi + 1 >= argc) throw std::runtime_error("--scene-cache requires a parameter (a directory to keep scene caches in).");
+			argi += 1;
+			scene_cache = argv[argi];
 		} else if (arg == "--camera"){
 			argi += 1;
 			scene_camera = argv[argi];
@@ -77,13 +88,76 @@ void RTG::Configuration::parse(int argc, char **argv) {
 			else if (settings == "frustum") {
 				culling_settings = 1;
 			}
+			else if (settings == "occlusion") {
+				culling_settings = 2;
+			}
 			else {
-				throw std::runtime_error("--culling only takes none or frustum as parameters");
+				throw std::runtime_error("--culling only takes none, frustum, or occlusion as parameters");
+			}
+		} else if (arg == "--cull-stats") {
+			print_cull_stats = true;
+		} else if (arg == "--sun-cascades") {
+			if (argi + 1 >= argc) throw std::runtime_error("--sun-cascades requires a parameter (a cascade count).");
+			argi += 1;
+			std::string val = argv[argi];
+			if (val.size() != 1 || val[0] < '0' || val[0] > '4') {
+				throw std::runtime_error("--sun-cascades should be 0 to 4, got '" + val + "'.");
+			}
+			sun_cascades = uint32_t(val[0] - '0');
+		} else if (arg == "--sun-cascade-size") {
+			if (argi + 1 >= argc) throw std::runtime_error("--sun-cascade-size requires a parameter (a size in pixels).");
+			argi += 1;
+			std::string val = argv[argi];
+			if (val.empty() || val.find_first_not_of("0123456789") != std::string::npos) {
+				throw std::runtime_error("--sun-cascade-size should match [0-9]+, got '" + val + "'.");
 			}
+			sun_cascade_size = uint32_t(std::stoul(val));
+		} else if (arg == "--sun-shadow-distance") {
+			if (argi + 1 >= argc) throw std::runtime_error("--sun-shadow-distance requires a parameter (a distance).");
+			argi += 1;
+			sun_shadow_distance = std::stof(argv[argi]);
+			if (!(sun_shadow_distance > 0.0f)) {
+				throw std::runtime_error("--sun-shadow-distance should be positive, got '" + std::string(argv[argi]) + "'.");
+			}
+		} else if (arg == "--benchmark") {
+			if (argi + 1 >= argc) throw std::runtime_error("--benchmark requires a parameter (an output path prefix).");
+			argi += 1;
+			benchmark_prefix = argv[argi];
 		} else if (arg == "--headless"){
 			argi += 1;
 			headless_event_path = argv[argi];
 			headless_mode = true;
+		} else if (arg == "--workspaces") {
+			if (argi + 1 >= argc) throw std::runtime_error("--workspaces requires a parameter (a workspace count).");
+			argi += 1;
+			std::string val = argv[argi];
+			if (val.empty() || val.find_first_not_of("0123456789") != std::string::npos || std::stoul(val) < 1 || std::stoul(val) > 16) {
+				throw std::runtime_error("--workspaces should be 1 to 16, got '" + val + "'.");
+			}
+			workspaces = uint32_t(std::stoul(val));
+		} else if (arg == "--load-threads") {
+			if (argi + 1 >= argc) throw std::runtime_error("--load-threads requires a parameter (a thread count).");
+			argi += 1;
+			std::string val = argv[argi];
+			if (val.empty() || val.find_first_not_of("0123456789") != std::string::npos) {
+				throw std::runtime_error("--load-threads should match [0-9]+, got '" + val + "'.");
+			}
+			load_threads = uint32_t(std::stoul(val));
+		} else if (arg == "--pipeline-cache") {
+			if (argi + 1 >= argc) throw std::runtime_error("--pipeline-cache requires a parameter (a file to keep compiled pipelines in).");
+			argi += 1;
+			pipeline_cache_path = argv[argi];
+			use_pipeline_cache = true;
+		} else if (arg == "--no-pipeline-cache") {
+			use_pipeline_cache = false;
+		} else if (arg == "--frame-threads") {
+			if (argi + 1 >= argc) throw std::runtime_error("--frame-threads requires a parameter (a thread count).");
+			argi += 1;
+			std::string val = argv[argi];
+			if (val.empty() || val.find_first_not_of("0123456789") != std::string::npos) {
+				throw std::runtime_error("--frame-threads should match [0-9]+, got '" + val + "'.");
+			}
+			frame_threads = uint32_t(std::stoul(val));
 		} else {
 			throw std::runtime_error("Unrecognized argument '" + arg + "'.");
 		}
@@ -92,6 +166,9 @@ void RTG::Configuration::parse(int argc, char **argv) {
 	if (scene_path == "") {
 		throw std::runtime_error("Have to set scene path to run.");
 	}
+	if (benchmark_prefix != "" && !headless_mode) {
+		throw std::runtime_error("--benchmark only works in headless mode (with --headless).");
+	}
 }
 
 void RTG::Configuration::usage(std::function< void(const char *, const char *) > const &callback) {	
@@ -99,10 +176,21 @@ void RTG::Configuration::usage(std::function< void(const char *, const char *) >
 	callback("--physical-device <name>", "Run on the named physical device (guesses, otherwise).");
 	callback("--drawing-size <w> <h>", "Set the size of the surface to draw to.");
 	callback("--scene <p>", "Read the scene file in .s72 format.");
+	callback("--scene-cache <dir>", "Keep a binary cache of the loaded scene, meshes, and textures in <dir>; later runs load from it while the scene's files are unchanged.");
 	callback("--camera <c>", "View the scene through camera with name <c>.");
 	callback("--animation < loop | play-once | paused >", "Animate the scene with drivers starting paused, only plays once, or loops, default plays ones");
-	callback("--culling < none | frustum >", "Choose how the scene should be culled");
+	callback("--culling < none | frustum | occlusion >", "Choose how the scene should be culled; occlusion also skips instances hidden behind last frame's depth");
+	callback("--cull-stats", "Print how many instances were drawn and culled about once a second.");
+	callback("--sun-cascades <n>", "Split sun shadows into <n> cascades (0 to 4, default 4; 0 turns sun shadows off).");
+	callback("--sun-cascade-size <s>", "Render each sun shadow cascade at <s> by <s> pixels (default: the sun's shadow size from the scene).");
+	callback("--sun-shadow-distance <d>", "Cover <d> units in front of the camera with sun shadow cascades (default 100).");
 	callback("--headless <event>", "Runs in headless mode with events given in the <event> path");
+	callback("--benchmark <prefix>", "In headless mode, write per-frame CPU and GPU pass timings to <prefix>.csv and their statistics between MARKs to <prefix>.json.");
+	callback("--workspaces <n>", "Keep up to <n> frames in flight (default 2); in headless mode, also how many frames can be saving at once.");
+	callback("--load-threads <n>", "Create pipelines, process meshes, and decode textures on <n> threads while loading (default: one per hardware thread).");
+	callback("--frame-threads <n>", "Update the scene and record command buffers on <n> threads each frame (default: one per hardware thread).");
+	callback("--pipeline-cache <file>", "Load compiled pipelines from <file> at startup and save them there at exit (default: pipeline-cache.bin next to the executable).");
+	callback("--no-pipeline-cache", "Compile every pipeline from scratch and don't save them.");
 }
 
 void RTG::Configuration::cube_usage(std::function< void(const char *, const char *) > const &callback) {
@@ -354,6 +442,14 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 					if (!graphics_queue_family) graphics_queue_family = i;
 				}
 
+				//if it only does transfers (and can copy at texel granularity), use it for uploads:
+				if ((queue_family.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queue_family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+					VkExtent3D const &granularity = queue_family.minImageTransferGranularity;
+					if (granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+						if (!transfer_queue_family) transfer_queue_family = i;
+					}
+				}
+
 				VkBool32 present_support = VK_FALSE;
 				if (!configuration.headless_mode) {
 					//if it has present support, set the present queue family:
@@ -402,6 +498,14 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 			if (!configuration.headless_mode && !present_queue_family) {
 				throw std::runtime_error("No queue with present support.");
 			}
+
+			//no dedicated transfer family; uploads share the graphics queue:
+			if (!transfer_queue_family) {
+				transfer_queue_family = graphics_queue_family;
+			}
+			if (configuration.debug) {
+				std::cout << "Using queue family " << transfer_queue_family.value() << " for uploads." << std::endl;
+			}
 		}
 
 		//select device extensions:
@@ -419,12 +523,14 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 			if (configuration.headless_mode) {
 				unique_queue_families = {
 					graphics_queue_family.value(),
+					transfer_queue_family.value(),
 				};
 			}
 			else {
 				unique_queue_families = {
 					graphics_queue_family.value(),
-					present_queue_family.value()
+					present_queue_family.value(),
+					transfer_queue_family.value(),
 				};
 			}
 			float queue_priorities[1] = { 1.0f };
@@ -445,8 +551,43 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 				enabled_features.samplerAnisotropy = true;
 			}
 
+			{ //the renderer draws from GPU-culled streams with vkCmdDrawIndexedIndirectCount, and indexes material textures bindlessly:
+				VkPhysicalDeviceVulkan12Features vulkan12_features{
+					.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+				};
+				VkPhysicalDeviceFeatures2 features2{
+					.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+					.pNext = &vulkan12_features,
+				};
+				vkGetPhysicalDeviceFeatures2(physical_device, &features2);
+				if (!vulkan12_features.drawIndirectCount) {
+					throw std::runtime_error("Physical device does not support drawIndirectCount.");
+				}
+				if (!features.drawIndirectFirstInstance) { //(the cull pass writes each draw's firstInstance)
+					throw std::runtime_error("Physical device does not support drawIndirectFirstInstance.");
+				}
+				enabled_features.drawIndirectFirstInstance = VK_TRUE;
+				if (!vulkan12_features.runtimeDescriptorArray
+				 || !vulkan12_features.descriptorBindingPartiallyBound
+				 || !vulkan12_features.descriptorBindingVariableDescriptorCount
+				 || !vulkan12_features.descriptorBindingSampledImageUpdateAfterBind
+				 || !vulkan12_features.shaderSampledImageArrayNonUniformIndexing) {
+					throw std::runtime_error("Physical device does not support the descriptor indexing features needed for bindless textures.");
+				}
+			}
+			VkPhysicalDeviceVulkan12Features enabled_vulkan12_features{
+				.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+				.drawIndirectCount = VK_TRUE,
+				.shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+				.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+				.descriptorBindingPartiallyBound = VK_TRUE,
+				.descriptorBindingVariableDescriptorCount = VK_TRUE,
+				.runtimeDescriptorArray = VK_TRUE,
+			};
+
 			VkDeviceCreateInfo create_info{
 				.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+				.pNext = &enabled_vulkan12_features,
 				.queueCreateInfoCount = uint32_t(queue_create_infos.size()),
 				.pQueueCreateInfos = queue_create_infos.data(),
 
@@ -464,6 +605,7 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 			#if defined(__APPLE__)
 			VkPhysicalDevicePortabilitySubsetFeaturesKHR portability_features{
 				.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PORTABILITY_SUBSET_FEATURES_KHR,
+				.pNext = &enabled_vulkan12_features,
 				.mutableComparisonSamplers = VK_TRUE,
 			};
 			create_info.pNext = &portability_features;
@@ -472,6 +614,7 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 			VK( vkCreateDevice(physical_device, &create_info, nullptr, &device) );
 
 			vkGetDeviceQueue(device, graphics_queue_family.value(), 0, &graphics_queue);
+			vkGetDeviceQueue(device, transfer_queue_family.value(), 0, &transfer_queue);
 			if (!configuration.headless_mode) {
 				vkGetDeviceQueue(device, present_queue_family.value(), 0, &present_queue);
 			}
@@ -481,6 +624,9 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 	//run any resource creation required by Helpers structure:
 	helpers.create();
 
+	//load compiled pipelines from last time (before anything makes pipelines):
+	create_pipeline_cache();
+
 	//create initial swapchain:
 	recreate_swapchain();
 
@@ -505,6 +651,27 @@ RTG::RTG(Configuration const &configuration_) : helpers(*this) {
 			VK(vkCreateSemaphore(device, &semaphore_create_info, nullptr, &workspace.image_done));
 		}
 	}
+
+	if (configuration.benchmark_prefix != "") { //create timestamp queries for timing GPU passes, if the graphics queue can write them:
+		uint32_t count = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, nullptr);
+		std::vector< VkQueueFamilyProperties > queue_families(count);
+		vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &count, queue_families.data());
+
+		if (queue_families[graphics_queue_family.value()].timestampValidBits == 0) {
+			std::cerr << "WARNING: graphics queue doesn't support timestamps, so --benchmark will only time the CPU." << std::endl;
+		}
+		else {
+			VkQueryPoolCreateInfo create_info{
+				.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+				.queryType = VK_QUERY_TYPE_TIMESTAMP,
+				.queryCount = 2 * PassTimer::max_passes,
+			};
+			for (auto &workspace : workspaces) {
+				VK(vkCreateQueryPool(device, &create_info, nullptr, &workspace.timer.queries));
+			}
+		}
+	}
 	
 
 }
@@ -534,12 +701,19 @@ RTG::~RTG() {
 			vkDestroySemaphore(device, workspace.image_done, nullptr);
 			workspace.image_done = VK_NULL_HANDLE;
 		}
+		if (workspace.timer.queries != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, workspace.timer.queries, nullptr);
+			workspace.timer.queries = VK_NULL_HANDLE;
+		}
 	}
 	workspaces.clear();
 
 	//destroy the swapchain:
 	destroy_swapchain();
 
+	//keep compiled pipelines for next time:
+	save_pipeline_cache();
+
 	//destroy the rest of the resources:
 	if (device != VK_NULL_HANDLE) {
 		vkDestroyDevice(device, nullptr);
@@ -759,6 +933,157 @@ void RTG::destroy_swapchain() {
 	}
 }
 
+//pipeline cache files hold the driver's cache data behind a header naming the device + driver that made it:
+// (drivers should reject another device's data themselves, but not every driver does so gracefully)
+struct PipelineCacheFileHeader {
+	char magic[8] = {'n','a','k','l','u','V','p','c'};
+	uint32_t version = 1; //of this file layout
+	uint32_t vendor_id = 0;
+	uint32_t device_id = 0;
+	uint32_t driver_version = 0;
+	uint8_t pipeline_cache_uuid[VK_UUID_SIZE] = {};
+	uint64_t data_size = 0;
+	uint64_t data_hash = 0; //FNV-1a of the data, to catch damaged files
+};
+
+static uint64_t fnv1a(uint8_t const *data, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ data[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static PipelineCacheFileHeader pipeline_cache_header_for(VkPhysicalDeviceProperties const &properties) {
+	PipelineCacheFileHeader header;
+	header.vendor_id = properties.vendorID;
+	header.device_id = properties.deviceID;
+	header.driver_version = properties.driverVersion;
+	std::memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+	return header;
+}
+
+void RTG::create_pipeline_cache() {
+	if (configuration.use_pipeline_cache) {
+		pipeline_cache_file = (configuration.pipeline_cache_path != "" ? configuration.pipeline_cache_path : data_path("pipeline-cache.bin"));
+	}
+
+	//use what was saved last time, if it was saved by this device and driver:
+	MappedFile file;
+	VkPipelineCacheCreateInfo create_info{
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+	};
+	std::error_code ec;
+	if (pipeline_cache_file != "" && std::filesystem::exists(pipeline_cache_file, ec)) {
+		PipelineCacheFileHeader expected = pipeline_cache_header_for(device_properties);
+		//returns what's wrong with the file, or "" if it's usable:
+		auto check = [&]() -> std::string {
+			file = MappedFile(pipeline_cache_file);
+			PipelineCacheFileHeader header;
+			if (file.size < sizeof(header)) return "too short";
+			std::memcpy(&header, file.data, sizeof(header));
+			if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != expected.version) return "not a pipeline cache";
+			if (header.vendor_id != expected.vendor_id || header.device_id != expected.device_id) return "saved on a different device";
+			if (header.driver_version != expected.driver_version) return "saved by a different driver version";
+			if (std::memcmp(header.pipeline_cache_uuid, expected.pipeline_cache_uuid, VK_UUID_SIZE) != 0) return "saved with a different pipeline cache UUID";
+			if (header.data_size != file.size - sizeof(header)) return "wrong size";
+			if (fnv1a(file.data + sizeof(header), file.size - sizeof(header)) != header.data_hash) return "damaged";
+
+			//the driver's own header should agree, too:
+			VkPipelineCacheHeaderVersionOne driver_header;
+			if (header.data_size < sizeof(driver_header)) return "missing the driver's header";
+			std::memcpy(&driver_header, file.data + sizeof(header), sizeof(driver_header));
+			if (driver_header.headerSize < sizeof(driver_header)
+			 || driver_header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+			 || driver_header.vendorID != expected.vendor_id
+			 || driver_header.deviceID != expected.device_id
+			 || std::memcmp(driver_header.pipelineCacheUUID, expected.pipeline_cache_uuid, VK_UUID_SIZE) != 0) {
+				return "driver's header doesn't match this device";
+			}
+
+			create_info.initialDataSize = size_t(header.data_size);
+			create_info.pInitialData = file.data + sizeof(header);
+			return "";
+		};
+		std::string problem;
+		try {
+			problem = check();
+		} catch (std::exception &e) {
+			problem = e.what();
+		}
+		if (problem != "") {
+			std::cout << "Not using pipeline cache '" << pipeline_cache_file << "' (" << problem << "); pipelines will be compiled from scratch." << std::endl;
+		} else if (configuration.debug) {
+			std::cout << "Loaded " << create_info.initialDataSize << " bytes of compiled pipelines from '" << pipeline_cache_file << "'." << std::endl;
+		}
+	}
+
+	VK(vkCreatePipelineCache(device, &create_info, nullptr, &pipeline_cache));
+}
+
+void RTG::save_pipeline_cache() {
+	if (pipeline_cache == VK_NULL_HANDLE) return;
+
+	//(failures are only warnings: this runs from ~RTG, and the worst that happens is compiling pipelines again next time)
+	if (pipeline_cache_file != "") {
+		size_t size = 0;
+		std::vector< uint8_t > data;
+		VkResult result = vkGetPipelineCacheData(device, pipeline_cache, &size, nullptr);
+		if (result == VK_SUCCESS) {
+			data.resize(size);
+			result = vkGetPipelineCacheData(device, pipeline_cache, &size, data.data());
+			data.resize(size);
+		}
+		if (result != VK_SUCCESS) {
+			std::cerr << "WARNING: Failed to get pipeline cache data [" << string_VkResult(result) << "]; not saving it." << std::endl;
+		} else {
+			PipelineCacheFileHeader header = pipeline_cache_header_for(device_properties);
+			header.data_size = data.size();
+			header.data_hash = fnv1a(data.data(), data.size());
+
+			//write next to the old file, then replace it all at once, so a half-written cache is never loaded:
+			std::string temporary = pipeline_cache_file + ".tmp";
+			std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+			out.write(reinterpret_cast< char const * >(data.data()), std::streamsize(data.size()));
+			out.close();
+			std::error_code ec;
+			if (!out) {
+				std::cerr << "WARNING: Failed to write pipeline cache '" << temporary << "'." << std::endl;
+				std::filesystem::remove(temporary, ec);
+			} else if (std::filesystem::rename(temporary, pipeline_cache_file, ec); ec) {
+				std::cerr << "WARNING: Failed to move pipeline cache into place at '" << pipeline_cache_file << "': " << ec.message() << std::endl;
+				std::filesystem::remove(temporary, ec);
+			}
+		}
+	}
+
+	vkDestroyPipelineCache(device, pipeline_cache, nullptr);
+	pipeline_cache = VK_NULL_HANDLE;
+}
+
+void RTG::PassTimer::reset(VkCommandBuffer cb) {
+	passes.clear();
+	if (queries == VK_NULL_HANDLE) return;
+	vkCmdResetQueryPool(cb, queries, 0, 2 * max_passes);
+}
+
+uint32_t RTG::PassTimer::pass(std::string name) {
+	if (queries == VK_NULL_HANDLE || passes.size() == max_passes) return max_passes; //(not timed)
+	passes.emplace_back(std::move(name));
+	return uint32_t(passes.size() - 1);
+}
+
+void RTG::PassTimer::begin(VkCommandBuffer cb, uint32_t pass) const {
+	if (queries == VK_NULL_HANDLE || pass >= max_passes) return;
+	vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries, 2 * pass);
+}
+
+void RTG::PassTimer::end(VkCommandBuffer cb, uint32_t pass) const {
+	if (queries == VK_NULL_HANDLE || pass >= max_passes) return;
+	vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries, 2 * pass + 1);
+}
+
 static void cursor_pos_callback(GLFWwindow *window, double xpos, double ypos) {
 	std::vector<InputEvent>* event_queue = reinterpret_cast<std::vector<InputEvent>*>(glfwGetWindowUserPointer(window));
 	if (!event_queue) return;
@@ -991,6 +1316,42 @@ void RTG::headless_run(Application &application) {
 	for(uint8_t i = 0; i < uint8_t(workspaces.size()); i++)
         helpers.signal_a_semaphore(workspaces[i].image_available, i);
 
+	//SAVE events are handed to a pool of encoders, so the render loop only waits when it needs a workspace whose frame hasn't been copied out yet:
+	ThreadPool encoders(0);
+	std::mutex readback_mutex;
+	std::condition_variable readback_done;
+	std::vector< uint32_t > readback_pending(workspaces.size(), 0); //queued saves still reading each workspace's headless_image_dsts
+
+	//--benchmark timings; GPU pass times of a frame are read back the next time its workspace is acquired:
+	bool benchmarking = configuration.benchmark_prefix != "";
+	Benchmark benchmark;
+	std::vector< uint32_t > workspace_frame(workspaces.size(), -1U); //benchmark frame last rendered in each workspace
+	double update_ms = 0.0; //time spent in update since the last frame
+	auto read_pass_times = [&](uint32_t workspace_index) {
+		PassTimer &timer = workspaces[workspace_index].timer;
+		uint32_t frame = workspace_frame[workspace_index];
+		workspace_frame[workspace_index] = -1U;
+		if (frame == -1U || timer.queries == VK_NULL_HANDLE || timer.passes.empty()) return;
+
+		//(timestamp, availability) pairs; a pass that wasn't recorded after all is left unavailable:
+		std::vector< uint64_t > results(2 * 2 * timer.passes.size());
+		VkResult query_result = vkGetQueryPoolResults(device, timer.queries, 0, uint32_t(2 * timer.passes.size()),
+			results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if (query_result != VK_NOT_READY) VK(query_result);
+
+		double total_ms = 0.0;
+		for (uint32_t p = 0; p < timer.passes.size(); ++p) {
+			uint64_t const *start = &results[4 * p];
+			uint64_t const *end = &results[4 * p + 2];
+			if (start[1] == 0 || end[1] == 0) continue;
+			double ms = double(end[0] - start[0]) * double(device_properties.limits.timestampPeriod) * 1.0e-6;
+			benchmark.add(frame, "gpu " + timer.passes[p], ms);
+			total_ms += ms;
+		}
+		benchmark.add(frame, "gpu passes", total_ms);
+	};
+
 	float before = float(events.events[0].ts) / 1000000.0f;
 	int32_t image_index = -1;
 	std::chrono::high_resolution_clock::time_point before_debug = std::chrono::high_resolution_clock::now();
@@ -1003,12 +1364,15 @@ void RTG::headless_run(Application &application) {
 		float dt = after - before;
 		before = after;
 		if (dt > 0.0f) {
+			auto update_start = std::chrono::steady_clock::now();
 			application.update(dt);
+			update_ms += std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - update_start).count();
 		}
 		if (configuration.debug) {
 			cur_event.print();
 		}
 		if (cur_event.type == HeadlessEvent::MARK) {
+			if (benchmarking) benchmark.mark(std::get<std::string>(cur_event.event_params));
 			//TODO: robust debug system 
 			if (!configuration.debug) // prevents the debug mode to print MARK twice
 				std::cout << "MARK" << std::get<std::string>(cur_event.event_params)<<std::endl;
@@ -1029,15 +1393,26 @@ void RTG::headless_run(Application &application) {
 				workspace_index = next_workspace;
 				next_workspace = (next_workspace + 1) % workspaces.size();
 
+				//wait until the frame this workspace last read back has been copied out by its encoder (blocks only when the ring of workspaces has wrapped around to it):
+				{
+					std::unique_lock< std::mutex > lock(readback_mutex);
+					readback_done.wait(lock, [&]() { return readback_pending[workspace_index] == 0; });
+				}
+
 				//wait until the workspace is not being used:
 				VK(vkWaitForFences(device, 1, &workspaces[workspace_index].workspace_available, VK_TRUE, UINT64_MAX));
 
+				//the workspace's last frame is done, so its pass timings can be read (before render records new ones):
+				if (benchmarking) read_pass_times(workspace_index);
+
 				//mark the workspace as in use:
 				VK(vkResetFences(device, 1, &workspaces[workspace_index].workspace_available));
 			}
 
 			image_index = workspace_index;
 
+			auto render_start = std::chrono::steady_clock::now();
+
 			//signal workspaces[workspace_index].image_available
 			//call render function:
 			application.render(*this, RenderParams{
@@ -1047,6 +1422,14 @@ void RTG::headless_run(Application &application) {
 				.image_done = workspaces[workspace_index].image_done,
 				.workspace_available = workspaces[workspace_index].workspace_available,
 			});
+
+			if (benchmarking) {
+				uint32_t frame = benchmark.frame();
+				benchmark.add(frame, "cpu update", update_ms);
+				benchmark.add(frame, "cpu render", std::chrono::duration< double, std::milli >(std::chrono::steady_clock::now() - render_start).count());
+				update_ms = 0.0;
+				workspace_frame[workspace_index] = frame;
+			}
 			// transfer the data from the GPU to CPU
 			helpers.gpu_image_transfer_to_buffer(
 				headless_image_dsts[workspace_index], 
@@ -1059,37 +1442,46 @@ void RTG::headless_run(Application &application) {
 		}
 		else if (cur_event.type == HeadlessEvent::SAVE){
 			assert(image_index != -1 && "AVAILABLE should have happened before SAVE");
-					//save image if requested
-			if (events.events[events.cur_event_index].type == HeadlessEvent::SAVE) {
-				// wait until the workspace is not being used:
-				VK(vkWaitForFences(device, 1, &workspaces[image_index].workspace_available, VK_TRUE, UINT64_MAX));
-				// save image
-				char* data = reinterpret_cast<char *>(headless_image_dsts[image_index].allocation.data());
-
-				std::ofstream file(std::get<std::string>(cur_event.event_params), std::ios::out | std::ios::binary);
-				const uint32_t width = configuration.surface_extent.width;
-				const uint32_t height = configuration.surface_extent.height;
-
-				// ppm header
-				file << "P6\n" << width << "\n" << height << "\n" << 255 << "\n";
-
-				for (uint32_t i = 0; i < height; i++) {
-					for (uint32_t j = 0; j < width; j++) {
-						// write color
-
-						file.write(data + 2, 1);
-						file.write(data + 1, 1);
-						file.write(data    , 1);
-						data += 4; //skip alpha
-					}
+			uint32_t slot = uint32_t(image_index);
+			{
+				std::lock_guard< std::mutex > lock(readback_mutex);
+				readback_pending[slot] += 1;
+			}
+			encoders.run([this, slot, path = std::get<std::string>(cur_event.event_params), &readback_mutex, &readback_done, &readback_pending]() {
+				std::vector< uint8_t > bgra;
+				try {
+					// wait until the copy into the readback buffer is done (the render loop won't reset this fence while the save is pending):
+					VK(vkWaitForFences(device, 1, &workspaces[slot].workspace_available, VK_TRUE, UINT64_MAX));
+					//copy the frame out so the workspace can go back to rendering while this frame is encoded:
+					uint8_t const *data = reinterpret_cast< uint8_t const * >(headless_image_dsts[slot].allocation.data());
+					bgra.assign(data, data + size_t(swapchain_extent.width) * swapchain_extent.height * 4);
+				} catch (...) {
+					bgra.clear();
+				}
+				{
+					std::lock_guard< std::mutex > lock(readback_mutex);
+					readback_pending[slot] -= 1;
 				}
+				readback_done.notify_all();
 
-				file.close();
-			}
+				if (bgra.empty()) throw std::runtime_error("Failed to read back the frame for '" + path + "'.");
+				save_frame(path, bgra.data(), swapchain_extent.width, swapchain_extent.height);
+			});
 		}
 
 	}
-	
+
+	//finish encoding, and report any file that couldn't be saved:
+	encoders.wait();
+
+	if (benchmarking) { //collect the frames still in flight, then write everything out:
+		for (uint32_t workspace_index = 0; workspace_index < workspaces.size(); ++workspace_index) {
+			VK(vkWaitForFences(device, 1, &workspaces[workspace_index].workspace_available, VK_TRUE, UINT64_MAX));
+			read_pass_times(workspace_index);
+		}
+		benchmark.write(configuration.benchmark_prefix);
+		std::cout << "Wrote " << benchmark.frames.size() << " frames of timings to '" << configuration.benchmark_prefix << ".csv' and '" << configuration.benchmark_prefix << ".json'." << std::endl;
+	}
 }
 
 void RTG::cube_run(Application &)
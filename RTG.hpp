@@ -65,15 +65,35 @@ struct RTG {
 		//camera to use for the scene
 		std::optional<std::string> scene_camera;
 
+		//folder to keep binary caches of loaded scenes (and their decoded meshes + textures) in, if set:
+		// `--scene-cache <dir>` command-line flag
+		std::optional<std::string> scene_cache;
+
 		//animtion settings
 		uint8_t animation_settings = 0; // 0 play once, 1 loop, 2 paused
 
 		//culling settings
-		uint8_t culling_settings = 1; // 0 no culling, 1 frustum culling
+		uint8_t culling_settings = 1; // 0 no culling, 1 frustum culling, 2 frustum and occlusion culling
+
+		//print how many instances were drawn and culled about once a second:
+		// `--cull-stats` command-line flag
+		bool print_cull_stats = false;
+
+		//cascaded shadow maps for sun lights (suns cast shadows when the scene gives them a shadow size, or when a cascade size is set):
+		// `--sun-cascades <n>` (0 to 4; 0 turns sun shadows off), `--sun-cascade-size <pixels>` (0 uses each sun's shadow size),
+		// and `--sun-shadow-distance <d>` (how far from the camera the last cascade reaches) command-line flags
+		uint32_t sun_cascades = 4;
+		uint32_t sun_cascade_size = 0;
+		float sun_shadow_distance = 100.0f;
 
 		//headless mode (for benchmarking)
 		bool headless_mode = false;
 
+		//in headless mode, time update, render, and each GPU pass of every frame, and write the timings to <prefix>.csv,
+		// with their count/mean/min/median/p95/p99 between MARK events in <prefix>.json:
+		// `--benchmark <prefix>` command-line flag
+		std::string benchmark_prefix = "";
+
 		//cube mode
 		bool cube = false;
 		//path to the input image
@@ -102,8 +122,24 @@ struct RTG {
 		VkExtent2D surface_extent{ .width = 800, .height=540 };
 
 		//how many "workspaces" (frames that can currently be being worked on by the CPU or GPU) to use:
+		// in headless mode, also how many rendered frames can be waiting to be saved at once
+		// `--workspaces <n>` command-line flag
 		uint32_t workspaces = 2;
 
+		//how many threads to create pipelines, process meshes, and decode textures with while loading (0 means one per hardware thread):
+		// `--load-threads <n>` command-line flag
+		uint32_t load_threads = 0;
+
+		//how many threads to update the scene and record secondary command buffers with each frame (0 means one per hardware thread):
+		// `--frame-threads <n>` command-line flag
+		uint32_t frame_threads = 0;
+
+		//file to load compiled pipelines from at startup and save them back to at exit ("" means next to the executable):
+		// `--pipeline-cache <file>` command-line flag
+		std::string pipeline_cache_path = "";
+		// `--no-pipeline-cache` command-line flag
+		bool use_pipeline_cache = true;
+
 		//for configuration construction + management:
 		Configuration() = default;
 		void parse(int argc, char **argv); //parse command-line options; throws on error
@@ -138,8 +174,20 @@ struct RTG {
 	std::optional< uint32_t > compute_queue_family;
 	VkQueue compute_queue = VK_NULL_HANDLE;
 
+	//queue for (upload) transfer operations; a dedicated transfer-only family if the device has one, else the graphics queue:
+	std::optional< uint32_t > transfer_queue_family;
+	VkQueue transfer_queue = VK_NULL_HANDLE;
+
 	VkPhysicalDeviceProperties device_properties{};
 
+	//every pipeline's create() passes this to vkCreate*Pipelines, so restarts skip recompiling shaders the driver has seen:
+	// (loaded from configuration.pipeline_cache_path if it was saved by this same device + driver; saved back in ~RTG)
+	// NOTE: pipeline caches are internally synchronized, so pipelines can be created from several threads at once
+	VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+	std::string pipeline_cache_file; //where pipeline_cache is loaded from / saved to ("" if not keeping one)
+	void create_pipeline_cache();
+	void save_pipeline_cache();
+
 	//-------------------------------------------------
 	//Handles for the window and surface:
 
@@ -174,10 +222,26 @@ struct RTG {
 	// (The bulk of per-workspace data will be managed by the Application.)
 	VkFence cube_work_finished;
 
+	//GPU timestamps around the passes of a workspace's frame; without --benchmark there is no query pool and every call does nothing:
+	struct PassTimer {
+		static constexpr uint32_t max_passes = 32;
+		VkQueryPool queries = VK_NULL_HANDLE; //start and end timestamps of each pass
+		std::vector< std::string > passes; //names of the passes in the frame last recorded
+
+		//start timing a new frame; records a reset of the queries, so call outside of any render pass:
+		void reset(VkCommandBuffer cb);
+		//add a pass to the frame; returns the index to hand to begin() and end():
+		// (not thread-safe, but begin() and end() may be recorded from any thread)
+		uint32_t pass(std::string name);
+		void begin(VkCommandBuffer cb, uint32_t pass) const;
+		void end(VkCommandBuffer cb, uint32_t pass) const;
+	};
+
 	struct PerWorkspace {
 		VkFence workspace_available = VK_NULL_HANDLE; //workspace is ready for a new render
 		VkSemaphore image_available = VK_NULL_HANDLE; //the image is ready to write to
 		VkSemaphore image_done = VK_NULL_HANDLE; //the image is done being written to
+		PassTimer timer; //(read back by headless_run once workspace_available signals)
 	};
 	std::vector< PerWorkspace > workspaces;
 	//^^ this size could probably be hardcoded (it will almost always be 2 unless you want bottlenecks!), but I'm leaving it variable at the moment.
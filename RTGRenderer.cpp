@@ -8,20 +8,34 @@
 #include "VK.hpp"
 #include "rgbe.hpp"
 #include "data_path.hpp"
+#include "ThreadPool.hpp"
+#include "MappedFile.hpp"
+#include "mesh_processing.hpp"
+#include "SceneCache.hpp"
 
 #include "stb_image.h"
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
 #include <cstring>
 #include <deque>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <span>
+#include <tuple>
+#include <unordered_map>
 
 static constexpr unsigned int WORKGROUP_SIZE = 32;
+static constexpr uint32_t CULL_WORKGROUP_SIZE = 64; //matches glsl/cull.comp
+static constexpr uint32_t HIZ_WORKGROUP_SIZE = 8; //matches glsl/hiz.comp
+static constexpr uint32_t HIERARCHY_CHUNK = 256; //fewest hierarchy entries worth handing to another thread
 
-RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), shadow_atlas(ShadowAtlas(shadow_atlas_length)) {
+RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), frame_threads(rtg_.configuration.frame_threads), shadow_atlas(ShadowAtlas(shadow_atlas_length)) {
 	{ //create command pool
 		VkCommandPoolCreateInfo create_info{
 			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
@@ -45,6 +59,9 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 		color_final_layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	}
 
+	//with occlusion culling, late_render_pass finishes the frame instead:
+	bool occlusion_culling = rtg.configuration.culling_settings == 2;
+
 	{ //create render pass
 		std::array<VkAttachmentDescription, 2> attachments{
 			VkAttachmentDescription{//0 - color attachment:
@@ -55,7 +72,7 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 				.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 				.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 				.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-				.finalLayout = color_final_layout, // rtg.configuration.headless_mode ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+				.finalLayout = occlusion_culling ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : color_final_layout, // rtg.configuration.headless_mode ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
 			},
 			VkAttachmentDescription{//1 - depth attachment:
 				.format = depth_format,
@@ -121,16 +138,85 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 		VK( vkCreateRenderPass(rtg.device, &create_info, nullptr, &render_pass) );
 	}
 
+	if (occlusion_culling) { //create late render pass; compatible with render_pass, but keeps what it drew
+		std::array<VkAttachmentDescription, 2> attachments{
+			VkAttachmentDescription{//0 - color attachment:
+				.format = rtg.surface_format.format,
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+				.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				.finalLayout = color_final_layout,
+			},
+			VkAttachmentDescription{//1 - depth attachment:
+				.format = depth_format,
+				.samples = VK_SAMPLE_COUNT_1_BIT,
+				.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD,
+				.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+				.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			},
+		};
+
+		VkAttachmentReference color_attachment_ref{
+			.attachment = 0,
+			.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+		};
+
+		VkAttachmentReference depth_attachment_ref{
+			.attachment = 1,
+			.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		};
+
+		VkSubpassDescription subpass{
+			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+			.inputAttachmentCount = 0,
+			.pInputAttachments = nullptr,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &color_attachment_ref,
+			.pDepthStencilAttachment = &depth_attachment_ref,
+		};
+
+		//blending and depth testing over render_pass's output:
+		// (the depth buffer's trip through the depth pyramid build is synchronized by a barrier in render)
+		std::array<VkSubpassDependency, 1> dependencies{
+			VkSubpassDependency{
+				.srcSubpass = VK_SUBPASS_EXTERNAL,
+				.dstSubpass = 0,
+				.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			},
+		};
+
+		VkRenderPassCreateInfo create_info{
+			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+			.attachmentCount = uint32_t(attachments.size()),
+			.pAttachments = attachments.data(),
+			.subpassCount = 1,
+			.pSubpasses = &subpass,
+			.dependencyCount = uint32_t(dependencies.size()),
+			.pDependencies = dependencies.data(),
+		};
+
+		VK( vkCreateRenderPass(rtg.device, &create_info, nullptr, &late_render_pass) );
+	}
+
 	{// create shadow atlas render pass, referenced https://github.com/SaschaWillems/Vulkan/blob/master/examples/shadowmapping/shadowmapping.cpp
 
 		VkAttachmentDescription attachment_description{
 			.format = depth_format,
 			.samples = VK_SAMPLE_COUNT_1_BIT,
-			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD, //regions that didn't change are kept; the rest are cleared one by one
 			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
 			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, //where the last frame left it
 			.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
 		};
 
@@ -150,10 +236,10 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			VkSubpassDependency {
 				.srcSubpass = VK_SUBPASS_EXTERNAL,
 				.dstSubpass = 0,
-				.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-				.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
-				.srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
-				.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, //(earlier frames' sampling and rendering)
+				.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
 				.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
 			},
 			VkSubpassDependency {
@@ -246,15 +332,25 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 
 	}
 
-	background_pipeline.create(rtg, render_pass, 0);
-	lines_pipeline.create(rtg, render_pass, 0);
-	lambertian_pipeline.create(rtg, render_pass, 0);
-	environment_pipeline.create(rtg, render_pass, 0);
-	mirror_pipeline.create(rtg, render_pass, 0);
-	pbr_pipeline.create(rtg, render_pass, 0);
-	shadow_pipeline.create(rtg, shadow_atlas_pass, 0);
-	cloud_pipeline.create(rtg);
-	cloud_lightgrid_pipeline.create(rtg);
+	{ //create pipelines; they don't depend on each other, and most of the time goes to the driver compiling shaders, so spread them over threads:
+		// (they all share rtg.pipeline_cache, which is internally synchronized)
+		ThreadPool pipeline_pool(rtg.configuration.load_threads);
+		pipeline_pool.run([&]() { background_pipeline.create(rtg, render_pass, 0); });
+		pipeline_pool.run([&]() { lines_pipeline.create(rtg, render_pass, 0); });
+		pipeline_pool.run([&]() { lambertian_pipeline.create(rtg, render_pass, 0); });
+		pipeline_pool.run([&]() { environment_pipeline.create(rtg, render_pass, 0); });
+		pipeline_pool.run([&]() { mirror_pipeline.create(rtg, render_pass, 0); });
+		pipeline_pool.run([&]() { pbr_pipeline.create(rtg, render_pass, 0); });
+		pipeline_pool.run([&]() { shadow_pipeline.create(rtg, shadow_atlas_pass, 0); });
+		pipeline_pool.run([&]() { cloud_pipeline.create(rtg); });
+		pipeline_pool.run([&]() { cloud_lightgrid_pipeline.create(rtg); });
+		pipeline_pool.run([&]() { cull_pipeline.create(rtg); });
+		pipeline_pool.run([&]() { hiz_pipeline.create(rtg); });
+		pipeline_pool.wait();
+	}
+
+	//batch all the static uploads below (clouds, environment, meshes, textures) into as few submits as the staging ring allows:
+	rtg.helpers.begin_upload_batch();
 
 	if (scene.has_cloud) {//cloud resources
 		{// lodad cloud voxel data as 3D images
@@ -379,68 +475,95 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 
 	
 	{//create environment texture
-		std::string environment_source;
-		if (scene.environment.source == "") {
-			environment_source  = data_path("../resource/default_environment.png");
+		int face_length = 0;
+		uint8_t mip_levels = 1;
+		std::vector<uint32_t> rgb_image; // Store the converted RGB data
+		std::span<uint32_t const> environment_pixels; // (rgb_image, or straight out of the scene cache)
+		if (scene.cache && scene.cache->hit) {
+			face_length = scene.cache->reader.pod<int>();
+			mip_levels = scene.cache->reader.pod<uint8_t>();
+			environment_pixels = scene.cache->reader.array<uint32_t>();
 		}
 		else {
-			environment_source = scene.scene_path +"/"+ scene.environment.source;
-		}
-		int width,height,n;
-		std::vector<unsigned char*> images;
-		images.push_back(stbi_load(environment_source.c_str(), &width, &height, &n, 4));
-		if (images[0] == NULL) throw std::runtime_error("Error loading texture " + environment_source);
-		 // cube map must have 6 sides and stacked vertically
-		if (height % 6 != 0 || width != height / 6) {
-			throw std::runtime_error("Invalid image dimensions for a cubemap");
-		}
-
-		uint8_t mip_levels = 1;
-		size_t period_index = environment_source.find_last_of(".");
-  		std::string base_source = environment_source.substr(0, period_index);
-		std::string file_type = environment_source.substr(period_index+1, environment_source.size()-period_index);
-		int last_width = width;
-		int last_height = height;
-		int total_size = width*height;
-		// load all ggx mip levels of the environment map
-		while (true) {
-			// attempt to load the next mip level, if failed, exit
-			int cur_width, cur_height, cur_n;
-			std::string cur_source = base_source + "." + std::to_string(mip_levels) + "." + file_type;
-			images.push_back(stbi_load(cur_source.c_str(), &cur_width, &cur_height, &cur_n, 4));
-			if (images[mip_levels] == NULL) {
-				if (rtg.configuration.debug) {
-					std::cout<<"Environment Loading Completed, " << int(mip_levels) << " mip levels\n";
-				}
-				break;
+			std::string environment_source;
+			if (scene.environment.source == "") {
+				environment_source  = data_path("../resource/default_environment.png");
 			}
-			if (cur_width == last_width >> 2 && cur_height == last_height >> 2) {
-				throw std::runtime_error("Mip not properly resized");
+			else {
+				environment_source = scene.scene_path +"/"+ scene.environment.source;
 			}
-			if (cur_height % 6 != 0 || cur_width != cur_height / 6) {
+			int width,height,n;
+			std::vector<unsigned char*> images;
+			images.push_back(stbi_load(environment_source.c_str(), &width, &height, &n, 4));
+			if (images[0] == NULL) throw std::runtime_error("Error loading texture " + environment_source);
+			 // cube map must have 6 sides and stacked vertically
+			if (height % 6 != 0 || width != height / 6) {
 				throw std::runtime_error("Invalid image dimensions for a cubemap");
 			}
-			total_size += cur_width * cur_height;
-			last_width = cur_width;
-			last_height = cur_height;
-			mip_levels++;
-		}
 
-		int face_length = width;
+			size_t period_index = environment_source.find_last_of(".");
+	  		std::string base_source = environment_source.substr(0, period_index);
+			std::string file_type = environment_source.substr(period_index+1, environment_source.size()-period_index);
+			int last_width = width;
+			int last_height = height;
+			int total_size = width*height;
+			// load all ggx mip levels of the environment map
+			while (true) {
+				// attempt to load the next mip level, if failed, exit
+				int cur_width, cur_height, cur_n;
+				std::string cur_source = base_source + "." + std::to_string(mip_levels) + "." + file_type;
+				images.push_back(stbi_load(cur_source.c_str(), &cur_width, &cur_height, &cur_n, 4));
+				if (images[mip_levels] == NULL) {
+					if (rtg.configuration.debug) {
+						std::cout<<"Environment Loading Completed, " << int(mip_levels) << " mip levels\n";
+					}
+					break;
+				}
+				if (cur_width == last_width >> 2 && cur_height == last_height >> 2) {
+					throw std::runtime_error("Mip not properly resized");
+				}
+				if (cur_height % 6 != 0 || cur_width != cur_height / 6) {
+					throw std::runtime_error("Invalid image dimensions for a cubemap");
+				}
+				total_size += cur_width * cur_height;
+				last_width = cur_width;
+				last_height = cur_height;
+				mip_levels++;
+			}
+
+			face_length = width;
+
+			// convert rgbe to rgb values
+			rgb_image.resize(total_size);
+			int temp_width = width;
+			int temp_height = height;
+			uint64_t pixel_index = 0;
+			for (uint8_t level = 0; level < mip_levels; ++level) {
+				for (int i = 0; i < temp_width*temp_height; ++i) {
+					glm::u8vec4 rgbe_pixel = glm::u8vec4(images[level][4*i], images[level][4*i + 1], images[level][4*i + 2], images[level][4*i + 3]);
+					rgb_image[pixel_index] = rgbe_to_E5B9G9R9(rgbe_pixel);
+					++pixel_index;
+				}
+				temp_width = temp_width >> 1;
+				temp_height = temp_height >> 1;
+			}
+			environment_pixels = rgb_image;
+
+			//free images:
+			for (unsigned char* image : images){
+				stbi_image_free(image);
+			}
 
-		// convert rgbe to rgb values
-		std::vector<uint32_t> rgb_image(total_size); // Store the converted RGB data
-		int temp_width = width;
-		int temp_height = height;
-		uint64_t pixel_index = 0;
-		for (uint8_t level = 0; level < mip_levels; ++level) {
-			for (int i = 0; i < temp_width*temp_height; ++i) {
-				glm::u8vec4 rgbe_pixel = glm::u8vec4(images[level][4*i], images[level][4*i + 1], images[level][4*i + 2], images[level][4*i + 3]);
-				rgb_image[pixel_index] = rgbe_to_E5B9G9R9(rgbe_pixel);
-				++pixel_index;
+			if (scene.cache && scene.cache->writing()) {
+				// (including the first missing mip level, since adding it would change the environment)
+				scene.cache->add_source(environment_source);
+				for (uint8_t level = 1; level <= mip_levels; ++level) {
+					scene.cache->add_source(base_source + "." + std::to_string(level) + "." + file_type);
+				}
+				scene.cache->writer.pod(face_length);
+				scene.cache->writer.pod(mip_levels);
+				scene.cache->writer.array(rgb_image);
 			}
-			temp_width = temp_width >> 1;
-			temp_height = temp_height >> 1;
 		}
 
 		World_environment = rtg.helpers.create_image(
@@ -451,12 +574,8 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			Helpers::Unmapped, 6, mip_levels
 		);
-		rtg.helpers.transfer_to_image_cube(rgb_image.data(), sizeof(rgb_image[0]) * rgb_image.size(), World_environment, mip_levels);
-	
-		//free images:
-		for (unsigned char* image : images){
-			stbi_image_free(image);
-		}
+		// (transfer only reads the pixels, so the cache's read-only mapping is fine to pass)
+		rtg.helpers.transfer_to_image_cube(const_cast<uint32_t *>(environment_pixels.data()), sizeof(environment_pixels[0]) * environment_pixels.size(), World_environment, mip_levels);
 
 		// set world mip level
 		world.ENVIRONMENT_MIPS = mip_levels-1;
@@ -585,18 +704,18 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			},
 			VkDescriptorPoolSize{
 				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.descriptorCount = 5 * per_workspace, //one descriptor per set, one set per workspace
+				.descriptorCount = 6 * per_workspace, //one descriptor per set, one set per workspace; plus the cull set's depth pyramid
 			},
 			VkDescriptorPoolSize{
 				.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-				.descriptorCount = 4 * per_workspace, //three descriptor for set 0, one for set 1, one set per workspace
+				.descriptorCount = 12 * per_workspace, //three descriptor for set 0, two for set 1, seven for the cull set, one set per workspace
 			},
 		};
 		
 		VkDescriptorPoolCreateInfo create_info{
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 			.flags = 0, //because CREATE_FREE_DESCRIPTOR_SET_BIT isn't included, *can't* free individual descriptors allocated from this pool
-			.maxSets = 6 * per_workspace, //three sets per workspace
+			.maxSets = 7 * per_workspace, //seven sets per workspace
 			.poolSizeCount = uint32_t(pool_sizes.size()),
 			.pPoolSizes = pool_sizes.data(),
 		};
@@ -683,6 +802,17 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			};
 			VK(vkAllocateCommandBuffers(rtg.device, &alloc_info, &workspace.command_buffer));
 		}
+
+		//command pools for secondary command buffers, one per frame thread:
+		workspace.recorders.resize(frame_threads.size());
+		for (Workspace::Recorder &recorder : workspace.recorders) {
+			VkCommandPoolCreateInfo create_info{
+				.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+				.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT, //re-recorded every frame
+				.queueFamilyIndex = rtg.graphics_queue_family.value(),
+			};
+			VK(vkCreateCommandPool(rtg.device, &create_info, nullptr, &recorder.command_pool));
+		}
 	
 		workspace.Camera_src = rtg.helpers.create_buffer(
 			sizeof(LinesPipeline::Camera),
@@ -842,6 +972,18 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 			//NOTE: will fill in this descriptor set in render when buffers are [re-]allocated
 		}
 
+		{//allocate descriptor set for the cull pass
+			VkDescriptorSetAllocateInfo alloc_info{
+				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+				.descriptorPool = descriptor_pool,
+				.descriptorSetCount = 1,
+				.pSetLayouts = &cull_pipeline.set0_Cull,
+			};
+
+			VK(vkAllocateDescriptorSets(rtg.device, &alloc_info, &workspace.Cull_descriptors));
+			//NOTE: will fill in this descriptor set in render when buffers are [re-]allocated
+		}
+
 		{//point descriptors to buffers:
 			VkDescriptorBufferInfo Camera_info{
 				.buffer = workspace.Camera.handle,
@@ -1055,143 +1197,375 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 	}
 	
 
-	{//create object vertices
-		std::vector<PosNorTanTexVertex> vertices;
-		vertices.resize(scene.vertices_count);
-		uint32_t new_vertices_start = 0;
-		mesh_vertices.assign(scene.meshes.size(), ObjectVertices());
-		mesh_AABBs.assign(scene.meshes.size(),AABB());
-		for (uint32_t i = 0; i < uint32_t(scene.meshes.size()); ++i) {
-			Scene::Mesh& cur_mesh = scene.meshes[i];
-			mesh_vertices[i].count = cur_mesh.count;
-			mesh_vertices[i].first = new_vertices_start;
-			std::ifstream file(scene.scene_path + "/" + cur_mesh.attributes[0].source, std::ios::binary); // assuming the attribute layout holds
-			if (!file.is_open()) throw std::runtime_error("Error opening file for mesh data: " + scene.scene_path + "/" + cur_mesh.attributes[0].source);
-			if (!file.read(reinterpret_cast< char * >(&vertices[new_vertices_start]), cur_mesh.count * sizeof(PosNorTanTexVertex))) {
-				throw std::runtime_error("Failed to read mesh data: " + scene.scene_path + "/" + cur_mesh.attributes[0].source);
-			}
-			//find OOB
-			for (size_t vertex_i = mesh_vertices[i].first; vertex_i < (mesh_vertices[i].first + mesh_vertices[i].count); ++vertex_i) {
-				glm::vec3 cur_vert_pos = {vertices[vertex_i].Position.x, vertices[vertex_i].Position.y, vertices[vertex_i].Position.z};
-				mesh_AABBs[i].min = glm::min(mesh_AABBs[i].min, cur_vert_pos);
-				mesh_AABBs[i].max = glm::max(mesh_AABBs[i].max, cur_vert_pos);
-			}
-			new_vertices_start += cur_mesh.count;
-		}
-		assert(new_vertices_start == scene.vertices_count);
-
-		size_t bytes = vertices.size() * sizeof(vertices[0]);
+	{//create object vertices and indices
+		//each .b72 file is mapped once; meshes that point at the same (source, offset, count) share one range of
+		// object_vertices/object_indices. Each range is welded into indexed form and reordered for the vertex cache:
+		std::unordered_map< std::string, MappedFile > mapped_files;
+		std::map< std::tuple< std::string, uint32_t, uint32_t >, uint32_t > unique_ranges; //(source, offset, count) -> index in ranges
+		struct VertexRange {
+			MappedFile const *file = nullptr;
+			uint32_t offset = 0; //byte offset in file
+			uint32_t count = 0; //(non-indexed) vertex count in file
+			std::vector< PosNorTanTexVertex > vertices; //welded
+			std::vector< uint32_t > indices;
+			uint32_t first_vertex = 0; //in object_vertices
+			uint32_t first_index = 0; //in object_indices
+			float acmr_welded = 0.0f; //ACMR of the welded mesh in file order
+			float acmr_optimized = 0.0f; //ACMR after triangle reordering
+		};
+		std::vector< VertexRange > ranges;
+		std::vector< uint32_t > mesh_range(scene.meshes.size());
+
+		uint32_t total_vertices = 0;
+		uint32_t total_indices = 0;
+		std::span< PosNorTanTexVertex const > cached_vertices; //(straight out of the scene cache, if loading from one)
+		std::span< uint32_t const > cached_indices;
+
+		if (scene.cache && scene.cache->hit) {
+			//already welded, reordered, and bounded:
+			mesh_vertices = scene.cache->reader.vector< ObjectVertices >();
+			mesh_AABBs = scene.cache->reader.vector< AABB >();
+			cached_vertices = scene.cache->reader.array< PosNorTanTexVertex >();
+			cached_indices = scene.cache->reader.array< uint32_t >();
+			if (mesh_vertices.size() != scene.meshes.size() || mesh_AABBs.size() != scene.meshes.size()) {
+				throw std::runtime_error("Scene cache " + scene.cache->path + " doesn't match the scene's meshes; delete it to rebuild it.");
+			}
+			total_vertices = uint32_t(cached_vertices.size());
+			total_indices = uint32_t(cached_indices.size());
+		} else {
+			for (uint32_t i = 0; i < uint32_t(scene.meshes.size()); ++i) {
+				Scene::Mesh const &cur_mesh = scene.meshes[i];
+				std::string const &source = cur_mesh.attributes[0].source; // assuming the attribute layout holds
+				auto file = mapped_files.find(source);
+				if (file == mapped_files.end()) {
+					file = mapped_files.emplace(source, MappedFile(scene.scene_path + "/" + source)).first;
+				}
+				auto [range, inserted] = unique_ranges.emplace(std::make_tuple(source, cur_mesh.attributes[0].offset, uint32_t(cur_mesh.count)), uint32_t(ranges.size()));
+				if (inserted) {
+					if (size_t(cur_mesh.attributes[0].offset) + size_t(cur_mesh.count) * sizeof(PosNorTanTexVertex) > file->second.size) {
+						throw std::runtime_error("Failed to read mesh data: " + file->second.filename + " is too small for mesh " + cur_mesh.name + ".");
+					}
+					ranges.emplace_back(VertexRange{ .file = &file->second, .offset = cur_mesh.attributes[0].offset, .count = uint32_t(cur_mesh.count) });
+				}
+				mesh_range[i] = range->second;
+			}
+
+			{ //weld + optimize each range (independent, so spread over threads):
+				ThreadPool mesh_pool(rtg.configuration.load_threads);
+				for (VertexRange &range : ranges) {
+					mesh_pool.run([&range]() {
+						PosNorTanTexVertex const *file_vertices = reinterpret_cast< PosNorTanTexVertex const * >(range.file->data + range.offset);
+						weld_vertices(file_vertices, range.count, range.vertices, range.indices);
+						range.acmr_welded = compute_ACMR(range.indices);
+						optimize_vertex_cache(range.indices, uint32_t(range.vertices.size()));
+						optimize_vertex_fetch(range.vertices, range.indices);
+						range.acmr_optimized = compute_ACMR(range.indices);
+					});
+				}
+				mesh_pool.wait();
+			}
+
+			for (VertexRange &range : ranges) {
+				range.first_vertex = total_vertices;
+				range.first_index = total_indices;
+				total_vertices += uint32_t(range.vertices.size());
+				total_indices += uint32_t(range.indices.size());
+			}
+
+			mesh_vertices.assign(scene.meshes.size(), ObjectVertices());
+			mesh_AABBs.assign(scene.meshes.size(),AABB());
+			for (uint32_t i = 0; i < uint32_t(scene.meshes.size()); ++i) {
+				VertexRange const &range = ranges[mesh_range[i]];
+				mesh_vertices[i].count = uint32_t(range.indices.size());
+				mesh_vertices[i].first = range.first_index;
+				mesh_vertices[i].vertex_offset = int32_t(range.first_vertex);
+				//find OOB
+				for (PosNorTanTexVertex const &vertex : range.vertices) {
+					glm::vec3 cur_vert_pos = {vertex.Position.x, vertex.Position.y, vertex.Position.z};
+					mesh_AABBs[i].min = glm::min(mesh_AABBs[i].min, cur_vert_pos);
+					mesh_AABBs[i].max = glm::max(mesh_AABBs[i].max, cur_vert_pos);
+				}
+				if (rtg.configuration.debug) {
+					//ACMR of the original (unindexed) triangle list is 3.0 -- every corner is shaded
+					std::cout << "Mesh " << scene.meshes[i].name << ": " << range.count << " vertices -> " << range.vertices.size()
+						<< " unique; ACMR 3.00 (unindexed) -> " << range.acmr_welded << " (welded) -> " << range.acmr_optimized << " (reordered)" << std::endl;
+				}
+			}
+			if (rtg.configuration.debug) {
+				std::cout << "Mesh vertices: " << scene.vertices_count << " referenced, " << total_vertices << " unique, "
+					<< total_indices << " indices across " << mapped_files.size() << " files." << std::endl;
+			}
+		}
+
+		size_t vertex_bytes = size_t(std::max(total_vertices, 1u)) * sizeof(PosNorTanTexVertex);
+		size_t index_bytes = size_t(std::max(total_indices, 1u)) * sizeof(uint32_t);
 
 		object_vertices = rtg.helpers.create_buffer(
-			bytes,
+			vertex_bytes,
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			Helpers::Unmapped
 		);
+		object_indices = rtg.helpers.create_buffer(
+			index_bytes,
+			VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped
+		);
+
+		//copy processed ranges directly into staging memory, then to buffers:
+		Helpers::StagedUpload staged_vertices = rtg.helpers.stage_upload(nullptr, vertex_bytes);
+		for (VertexRange const &range : ranges) {
+			std::memcpy(
+				reinterpret_cast< char * >(staged_vertices.mapped) + size_t(range.first_vertex) * sizeof(PosNorTanTexVertex),
+				range.vertices.data(),
+				range.vertices.size() * sizeof(PosNorTanTexVertex)
+			);
+		}
+		if (!cached_vertices.empty()) std::memcpy(staged_vertices.mapped, cached_vertices.data(), cached_vertices.size_bytes());
+		rtg.helpers.record_buffer_upload(staged_vertices, vertex_bytes, object_vertices, 0);
+
+		Helpers::StagedUpload staged_indices = rtg.helpers.stage_upload(nullptr, index_bytes);
+		for (VertexRange const &range : ranges) {
+			std::memcpy(
+				reinterpret_cast< char * >(staged_indices.mapped) + size_t(range.first_index) * sizeof(uint32_t),
+				range.indices.data(),
+				range.indices.size() * sizeof(uint32_t)
+			);
+		}
+		if (!cached_indices.empty()) std::memcpy(staged_indices.mapped, cached_indices.data(), cached_indices.size_bytes());
+		rtg.helpers.record_buffer_upload(staged_indices, index_bytes, object_indices, 0);
 
-		//copy data to buffer:
-		rtg.helpers.transfer_to_buffer(vertices.data(), bytes, object_vertices);
+		if (scene.cache && scene.cache->writing()) {
+			for (auto const &[source, file] : mapped_files) {
+				scene.cache->add_source(file.filename);
+			}
+			SceneCache::Writer &writer = scene.cache->writer;
+			writer.array(mesh_vertices);
+			writer.array(mesh_AABBs);
+			//ranges go back to back, just as they sit in object_vertices/object_indices:
+			writer.begin_array(total_vertices);
+			for (VertexRange const &range : ranges) {
+				writer.bytes(range.vertices.data(), range.vertices.size() * sizeof(PosNorTanTexVertex));
+			}
+			writer.begin_array(total_indices);
+			for (VertexRange const &range : ranges) {
+				writer.bytes(range.indices.data(), range.indices.size() * sizeof(uint32_t));
+			}
+		}
 	}
 
 	{//make some textures
-		textures.reserve(scene.textures.size()); // index 0-4 is the default textures
+		// textures are decoded (and converted) on a pool of threads and uploaded as each finishes, so slots are filled out of order:
+		textures.resize(scene.textures.size()); // index 0-4 is the default textures
 
 		// all images loaded should be flipped as s72 file format has the image origin at bottom left while stbi load is top left
+		// (set before any decode threads start; stbi only reads the flag)
 		stbi_set_flip_vertically_on_load(true);
 
+		//a texture that has been decoded on a worker thread and is ready to upload:
+		struct DecodedTexture {
+			uint32_t index = 0;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			VkFormat format = VK_FORMAT_UNDEFINED;
+			unsigned char *image = nullptr; //stbi-owned pixels (if not converted)
+			std::vector< uint32_t > converted_image; //RGBE -> E5B9G9R9 pixels (if converted)
+			std::string error;
+		};
+		//finished textures, in completion order:
+		std::mutex decoded_mutex;
+		std::condition_variable decoded_cv;
+		std::deque< DecodedTexture > decoded;
+
+		//(declared after the queue so workers are joined before the queue goes away)
+		ThreadPool decode_pool(rtg.configuration.load_threads);
+
+		//a scene cache holds every texture already decoded, so nothing needs to go to the workers:
+		bool from_cache = scene.cache && scene.cache->hit;
+
+		uint32_t pending = 0;
 		for (uint32_t i = 0; i < scene.textures.size(); ++i) {
-			Scene::Texture& cur_texture = scene.textures[i];
-			if (cur_texture.has_src) {
-				int width,height,n;
-				unsigned char* image;
-				std::string source = std::get<std::string>(cur_texture.value);
-				
-				if (cur_texture.single_channel) { // just read the r value
-					assert(cur_texture.format != Scene::Texture::RGBE);
-					VkFormat format = cur_texture.format == Scene::Texture::Linear ? VK_FORMAT_R8_UNORM : VK_FORMAT_R8_SRGB;
-					image = stbi_load((scene.scene_path +"/"+ source).c_str(), &width, &height, &n, 1);
-					if (image == NULL) throw std::runtime_error("Error loading texture " + scene.scene_path + "/" + source);
-					textures.emplace_back(rtg.helpers.create_image(
-						VkExtent2D{ .width = uint32_t(width) , .height = uint32_t(height) }, //size of image
-						format,
-						VK_IMAGE_TILING_OPTIMAL,
-						VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
-						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
-						Helpers::Unmapped
-					));
-					
-					rtg.helpers.transfer_to_image(image, sizeof(image[0]) * width*height, textures.back());
-				}
-				else {
-					image = stbi_load((scene.scene_path +"/"+ source).c_str(), &width, &height, &n, 4);
-					if (image == NULL) throw std::runtime_error("Error loading texture " + scene.scene_path + "/" + source);		
-					if (cur_texture.format == Scene::Texture::RGBE) {
-						std::vector<uint32_t> converted_image(width * height);
-						for (uint32_t pixel_i = 0; pixel_i< uint32_t(width * height); ++pixel_i) {
-							glm::u8vec4 rgbe_pixel = glm::u8vec4(image[4*pixel_i], image[4*pixel_i + 1], image[4*pixel_i + 2], image[4*pixel_i + 3]);
-							converted_image[pixel_i] = rgbe_to_E5B9G9R9(rgbe_pixel);
-						}
-						textures.emplace_back(rtg.helpers.create_image(
-							VkExtent2D{ .width = uint32_t(width) , .height = uint32_t(height) }, //size of image
-							VK_FORMAT_E5B9G9R9_UFLOAT_PACK32,
-							VK_IMAGE_TILING_OPTIMAL,
-							VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
-							VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
-							Helpers::Unmapped
-						));
-						
-						rtg.helpers.transfer_to_image(converted_image.data(), sizeof(converted_image[0])*width*height, textures.back());
+			if (!scene.textures[i].has_src || from_cache) continue;
+			pending += 1;
+			decode_pool.run([&, i]() {
+				Scene::Texture const &cur_texture = scene.textures[i];
+				DecodedTexture result;
+				result.index = i;
+				std::string source = scene.scene_path + "/" + std::get<std::string>(cur_texture.value);
+				int width = 0, height = 0, n = 0;
+				try {
+					if (cur_texture.single_channel) { // just read the r value
+						assert(cur_texture.format != Scene::Texture::RGBE);
+						result.format = cur_texture.format == Scene::Texture::Linear ? VK_FORMAT_R8_UNORM : VK_FORMAT_R8_SRGB;
+						result.image = stbi_load(source.c_str(), &width, &height, &n, 1);
 					}
 					else {
-						VkFormat format = cur_texture.format == Scene::Texture::sRGB ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
-						textures.emplace_back(rtg.helpers.create_image(
-							VkExtent2D{ .width = uint32_t(width) , .height = uint32_t(height) }, //size of image
-							format, 
-							VK_IMAGE_TILING_OPTIMAL,
-							VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
-							VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
-							Helpers::Unmapped
-						));
-						
-						rtg.helpers.transfer_to_image(image, sizeof(image[0]) * width*height*4, textures.back());
+						result.image = stbi_load(source.c_str(), &width, &height, &n, 4);
+						if (cur_texture.format == Scene::Texture::RGBE) {
+							result.format = VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
+							if (result.image != NULL) {
+								result.converted_image.resize(size_t(width) * size_t(height));
+								for (uint32_t pixel_i = 0; pixel_i < uint32_t(width * height); ++pixel_i) {
+									glm::u8vec4 rgbe_pixel = glm::u8vec4(result.image[4*pixel_i], result.image[4*pixel_i + 1], result.image[4*pixel_i + 2], result.image[4*pixel_i + 3]);
+									result.converted_image[pixel_i] = rgbe_to_E5B9G9R9(rgbe_pixel);
+								}
+								stbi_image_free(result.image);
+								result.image = nullptr;
+							}
+						}
+						else {
+							result.format = cur_texture.format == Scene::Texture::sRGB ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+						}
 					}
+					if (result.image == NULL && result.converted_image.empty()) {
+						result.error = "Error loading texture " + source;
+					} else {
+						result.width = uint32_t(width);
+						result.height = uint32_t(height);
+					}
+				} catch (std::exception &e) {
+					result.error = "Error decoding texture " + source + ": " + e.what();
 				}
-				//free image:
-				stbi_image_free(image);
+
+				{
+					std::lock_guard< std::mutex > lock(decoded_mutex);
+					decoded.emplace_back(std::move(result));
+				}
+				decoded_cv.notify_one();
+			});
+		}
+
+		//constant-valued textures don't need decoding, so upload those while the workers run:
+		for (uint32_t i = 0; i < scene.textures.size(); ++i) {
+			Scene::Texture& cur_texture = scene.textures[i];
+			if (cur_texture.has_src) continue;
+			if (cur_texture.single_channel) {
+				uint8_t value = uint8_t(std::get<float>(cur_texture.value) * 255.0f);
+				textures[i] = rtg.helpers.create_image(
+					VkExtent2D{ .width = 1 , .height = 1 }, //size of image
+					VK_FORMAT_R8_UNORM, //how to interpret image data (in this case, SRGB-encoded 8-bit RGBA)
+					VK_IMAGE_TILING_OPTIMAL,
+					VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
+					Helpers::Unmapped
+				);
+
+				//transfer data:
+				rtg.helpers.transfer_to_image(&value, sizeof(uint8_t), textures[i]);
 			}
 			else {
-				if (cur_texture.single_channel) {
-					uint8_t value = uint8_t(std::get<float>(cur_texture.value) * 255.0f);
-					textures.emplace_back(rtg.helpers.create_image(
-						VkExtent2D{ .width = 1 , .height = 1 }, //size of image
-						VK_FORMAT_R8_UNORM, //how to interpret image data (in this case, SRGB-encoded 8-bit RGBA)
-						VK_IMAGE_TILING_OPTIMAL,
-						VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
-						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
-						Helpers::Unmapped
-					));
-
-					//transfer data:
-					rtg.helpers.transfer_to_image(&value, sizeof(uint8_t), textures.back());
+				glm::vec3 value = std::get<glm::vec3>(cur_texture.value);
+				uint8_t data[4] = {uint8_t(value.x*255.0f), uint8_t(value.y*255.0f), uint8_t(value.z*255.0f),255};
+				//make a place for the texture to live on the GPU:
+				textures[i] = rtg.helpers.create_image(
+					VkExtent2D{ .width = 1 , .height = 1 }, //size of image
+					VK_FORMAT_R8G8B8A8_UNORM, //how to interpret image data (in this case, SRGB-encoded 8-bit RGBA)
+					VK_IMAGE_TILING_OPTIMAL,
+					VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
+					Helpers::Unmapped
+				);
+
+				//transfer data:
+				rtg.helpers.transfer_to_image(&data, sizeof(uint8_t) * 4, textures[i]);
+			}
+		}
+
+		if (from_cache) {
+			auto mismatch = [&]() {
+				throw std::runtime_error("Scene cache " + scene.cache->path + " doesn't match the scene's textures; delete it to rebuild it.");
+			};
+			//every texture with a source must be cached exactly once:
+			std::vector< bool > restored(textures.size(), false);
+			uint64_t expected = uint64_t(std::count_if(scene.textures.begin(), scene.textures.end(), [](Scene::Texture const &texture) { return texture.has_src; }));
+
+			SceneCache::Reader &reader = scene.cache->reader;
+			uint64_t count = reader.pod< uint64_t >();
+			if (count != expected) mismatch();
+			for (uint64_t c = 0; c < count; ++c) {
+				uint32_t index = reader.pod< uint32_t >();
+				VkFormat format = reader.pod< VkFormat >();
+				uint32_t width = reader.pod< uint32_t >();
+				uint32_t height = reader.pod< uint32_t >();
+				std::span< uint8_t const > pixels = reader.array< uint8_t >();
+				if (index >= textures.size() || !scene.textures[index].has_src || restored[index]) mismatch();
+				restored[index] = true;
+				textures[index] = rtg.helpers.create_image(
+					VkExtent2D{ .width = width , .height = height }, //size of image
+					format,
+					VK_IMAGE_TILING_OPTIMAL,
+					VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
+					Helpers::Unmapped
+				);
+				// (transfer only reads the pixels, so the cache's read-only mapping is fine to pass)
+				rtg.helpers.transfer_to_image(const_cast< uint8_t * >(pixels.data()), pixels.size(), textures[index]);
+			}
+		}
+
+		//cached in the order they finish decoding (each with its index):
+		bool to_cache = scene.cache && scene.cache->writing();
+		if (to_cache) scene.cache->writer.pod(uint64_t(pending));
+
+		//upload decoded textures as they come in:
+		std::string first_error;
+		for (uint32_t received = 0; received < pending; ++received) {
+			DecodedTexture result;
+			{
+				std::unique_lock< std::mutex > lock(decoded_mutex);
+				decoded_cv.wait(lock, [&]() { return !decoded.empty(); });
+				result = std::move(decoded.front());
+				decoded.pop_front();
+			}
+			if (!result.error.empty()) {
+				if (first_error.empty()) first_error = result.error;
+				continue; //(keep draining so the workers' pixels get freed)
+			}
+			if (first_error.empty()) {
+				textures[result.index] = rtg.helpers.create_image(
+					VkExtent2D{ .width = result.width , .height = result.height }, //size of image
+					result.format,
+					VK_IMAGE_TILING_OPTIMAL,
+					VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
+					Helpers::Unmapped
+				);
+				void *pixels = result.image;
+				size_t pixel_bytes = 0;
+				if (result.image != nullptr) {
+					size_t bytes_per_pixel = (result.format == VK_FORMAT_R8_UNORM || result.format == VK_FORMAT_R8_SRGB) ? 1 : 4;
+					pixel_bytes = bytes_per_pixel * result.width * result.height;
+				} else {
+					pixels = result.converted_image.data();
+					pixel_bytes = sizeof(result.converted_image[0]) * result.converted_image.size();
 				}
-				else {
-					glm::vec3 value = std::get<glm::vec3>(cur_texture.value);
-					uint8_t data[4] = {uint8_t(value.x*255.0f), uint8_t(value.y*255.0f), uint8_t(value.z*255.0f),255};
-					//make a place for the texture to live on the GPU:
-					textures.emplace_back(rtg.helpers.create_image(
-						VkExtent2D{ .width = 1 , .height = 1 }, //size of image
-						VK_FORMAT_R8G8B8A8_UNORM, //how to interpret image data (in this case, SRGB-encoded 8-bit RGBA)
-						VK_IMAGE_TILING_OPTIMAL,
-						VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, //will sample and upload
-						VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //should be device-local
-						Helpers::Unmapped
-					));
-
-					//transfer data:
-					rtg.helpers.transfer_to_image(&data, sizeof(uint8_t) * 4, textures.back());
+				rtg.helpers.transfer_to_image(pixels, pixel_bytes, textures[result.index]);
+
+				if (to_cache) {
+					scene.cache->add_source(scene.scene_path + "/" + std::get<std::string>(scene.textures[result.index].value));
+					SceneCache::Writer &writer = scene.cache->writer;
+					writer.pod(result.index);
+					writer.pod(result.format);
+					writer.pod(result.width);
+					writer.pod(result.height);
+					writer.array(reinterpret_cast< uint8_t const * >(pixels), pixel_bytes);
 				}
 			}
+			//free image:
+			if (result.image != nullptr) stbi_image_free(result.image);
 		}
+		decode_pool.wait();
+		if (!first_error.empty()) throw std::runtime_error(first_error);
+	}
+
+	//submit and wait for all the static uploads at once:
+	rtg.helpers.end_upload_batch();
+
+	//everything cached has been read (or written) by now, so write out a new cache / let go of the old one's mapping:
+	if (scene.cache) {
+		scene.cache->finish();
+		scene.cache.reset();
 	}
 
 	{//make image views for the textures
@@ -1221,22 +1595,59 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 		assert(texture_views.size() == textures.size());
 	}
 
+	{//fill the material table, each material names its textures by index into texture_views:
+		std::vector< LambertianPipeline::Material > material_table;
+		material_table.reserve(scene.materials.size());
+		for (Scene::Material const &material : scene.materials) {
+			LambertianPipeline::Material entry{
+				.NORMAL = material.normal_index,
+				.DISPLACEMENT = material.displacement_index,
+				.ALBEDO = 0,
+				.ROUGHNESS = 0,
+				.METALNESS = 0,
+				.padding_{0, 0, 0},
+			};
+			if (material.material_type == Scene::Material::Lambertian) {
+				entry.ALBEDO = std::get<Scene::Material::MatLambertian>(material.material_textures).albedo_index;
+			}
+			else if (material.material_type == Scene::Material::PBR) {
+				const Scene::Material::MatPBR& pbr_textures = std::get<Scene::Material::MatPBR>(material.material_textures);
+				entry.ALBEDO = pbr_textures.albedo_index;
+				entry.ROUGHNESS = pbr_textures.roughness_index;
+				entry.METALNESS = pbr_textures.metalness_index;
+			}
+			material_table.emplace_back(entry);
+		}
+
+		size_t bytes = material_table.size() * sizeof(material_table[0]);
+		materials = rtg.helpers.create_buffer(
+			bytes,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, //going to use as storage buffer, also going to have GPU into this memory
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, //GPU-local memory
+			Helpers::Unmapped //don't get a pointer to the memory
+		);
+		rtg.helpers.transfer_to_buffer(material_table.data(), bytes, materials);
+	}
+
 	{//create the material descriptor pool
-		uint32_t per_material = uint32_t(scene.materials.size());
-		uint32_t per_pbr_material = uint32_t(scene.MatPBR_count);
-		uint32_t per_lambertian_material = uint32_t(scene.MatLambertian_count);
-		uint32_t per_envmirror_material = uint32_t(scene.MatEnvMirror_count);
-		std::array< VkDescriptorPoolSize, 1> pool_sizes{
+		if (texture_views.size() > max_material_textures) {
+			throw std::runtime_error("Scene uses " + std::to_string(texture_views.size()) + " textures, but at most " + std::to_string(max_material_textures) + " fit in the material texture array.");
+		}
+		std::array< VkDescriptorPoolSize, 2> pool_sizes{
+			VkDescriptorPoolSize{
+				.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1, //the material table
+			},
 			VkDescriptorPoolSize{
 				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.descriptorCount = 1 * 5 * per_pbr_material + 1 * 3 * per_lambertian_material + 1 * 2 * per_envmirror_material,
+				.descriptorCount = uint32_t(texture_views.size()), //every texture
 			},
 		};
 		
 		VkDescriptorPoolCreateInfo create_info{
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-			.flags = 0, //because CREATE_FREE_DESCRIPTOR_SET_BIT isn't included, *can't* free individual descriptors allocated from this pool
-			.maxSets = 1 * per_material, //one set per material
+			.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT, //needed by the set2_Materials layout; still *can't* free individual descriptors allocated from this pool
+			.maxSets = 1, //one set shared by every material pipeline
 			.poolSizeCount = uint32_t(pool_sizes.size()),
 			.pPoolSizes = pool_sizes.data(),
 		};
@@ -1245,102 +1656,59 @@ RTGRenderer::RTGRenderer(RTG &rtg_, Scene &scene_) : rtg(rtg_), scene(scene_), s
 		
 	}
 
-	{//allocate and write the texture descriptor sets
-		//allocate the descriptors (use the material type's alloc info)
-		VkDescriptorSetAllocateInfo mat_lambertian_alloc_info{
-			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-			.descriptorPool = material_descriptor_pool,
-			.descriptorSetCount = 1,
-			.pSetLayouts = &lambertian_pipeline.set2_TEXTURE,
-		};
-		VkDescriptorSetAllocateInfo mat_pbr_alloc_info{
-			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-			.descriptorPool = material_descriptor_pool,
+	{//allocate and write the material descriptor set
+		//all material pipelines declare the same set2_Materials layout, so one set serves them all:
+		uint32_t texture_count = uint32_t(texture_views.size());
+		VkDescriptorSetVariableDescriptorCountAllocateInfo variable_count_info{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
 			.descriptorSetCount = 1,
-			.pSetLayouts = &pbr_pipeline.set2_TEXTURE,
+			.pDescriptorCounts = &texture_count,
 		};
-		VkDescriptorSetAllocateInfo mat_envmirror_alloc_info{
+		VkDescriptorSetAllocateInfo alloc_info{
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = &variable_count_info,
 			.descriptorPool = material_descriptor_pool,
 			.descriptorSetCount = 1,
-			.pSetLayouts = &environment_pipeline.set2_TEXTURE,
+			.pSetLayouts = &lambertian_pipeline.set2_Materials,
 		};
-		material_descriptors.assign(scene.materials.size(), VK_NULL_HANDLE);
+		VK(vkAllocateDescriptorSets(rtg.device, &alloc_info, &Materials_descriptors));
 
-		for (uint32_t material_index = 0; material_index < scene.materials.size(); ++material_index) {
-			VkDescriptorSet &descriptor_set = material_descriptors[material_index];
-			if (scene.materials[material_index].material_type == Scene::Material::Lambertian) {
-				VK(vkAllocateDescriptorSets(rtg.device, &mat_lambertian_alloc_info, &descriptor_set));
-			}
-			else if (scene.materials[material_index].material_type == Scene::Material::PBR) {
-				VK(vkAllocateDescriptorSets(rtg.device, &mat_pbr_alloc_info, &descriptor_set));
-			}
-			else {
-				VK(vkAllocateDescriptorSets(rtg.device, &mat_envmirror_alloc_info, &descriptor_set));
-			}
-		}
-		//write descriptors for materials:
-		std::vector< VkWriteDescriptorSet > writes(scene.materials.size());
-		std::vector< std::array<VkDescriptorImageInfo,5> > infos(scene.materials.size());
-		constexpr uint8_t pbr_tex_count = 5;
-		constexpr uint8_t lambertian_tex_count = 3;
-		constexpr uint8_t envmirror_tex_count = 2;
+		VkDescriptorBufferInfo Materials_info{
+			.buffer = materials.handle,
+			.offset = 0,
+			.range = materials.size,
+		};
 
-		for (uint32_t material_index = 0; material_index < scene.materials.size(); ++material_index) {
-			const Scene::Material& material = scene.materials[material_index];
-			uint8_t cur_material_tex_count = 0;
-			std::array<VkDescriptorImageInfo,5>& cur_infos = infos[material_index];
-			cur_infos[0] = VkDescriptorImageInfo{
+		std::vector< VkDescriptorImageInfo > texture_infos;
+		texture_infos.reserve(texture_views.size());
+		for (VkImageView view : texture_views) {
+			texture_infos.emplace_back(VkDescriptorImageInfo{
 				.sampler = texture_sampler,
-				.imageView = texture_views[material.normal_index],
+				.imageView = view,
 				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			};
-			cur_infos[1] = VkDescriptorImageInfo{
-				.sampler = texture_sampler,
-				.imageView = texture_views[material.displacement_index],
-				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			};
-			if (material.material_type == Scene::Material::Lambertian) {
-				cur_material_tex_count = lambertian_tex_count;
-				cur_infos[2] = VkDescriptorImageInfo{
-					.sampler = texture_sampler,
-					.imageView = texture_views[std::get<Scene::Material::MatLambertian>(material.material_textures).albedo_index],
-					.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				};
-			}
-			else if (material.material_type == Scene::Material::PBR) {
-				cur_material_tex_count = pbr_tex_count;
-				const Scene::Material::MatPBR& pbr_textures = std::get<Scene::Material::MatPBR>(material.material_textures);
-				cur_infos[2] = VkDescriptorImageInfo{
-					.sampler = texture_sampler,
-					.imageView = texture_views[pbr_textures.albedo_index],
-					.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				};
-				cur_infos[3] = VkDescriptorImageInfo{
-					.sampler = texture_sampler,
-					.imageView = texture_views[pbr_textures.roughness_index],
-					.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				};
-				cur_infos[4] = VkDescriptorImageInfo{
-					.sampler = texture_sampler,
-					.imageView = texture_views[pbr_textures.metalness_index],
-					.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				};
-			}
-			else {
-				cur_material_tex_count = envmirror_tex_count;
-			}
+			});
+		}
 
-			writes[material_index] = VkWriteDescriptorSet{
+		std::array< VkWriteDescriptorSet, 2 > writes{
+			VkWriteDescriptorSet{
 				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.dstSet = material_descriptors[material_index],
+				.dstSet = Materials_descriptors,
 				.dstBinding = 0,
 				.dstArrayElement = 0,
-				.descriptorCount = cur_material_tex_count,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &Materials_info,
+			},
+			VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = Materials_descriptors,
+				.dstBinding = 1,
+				.dstArrayElement = 0,
+				.descriptorCount = texture_count,
 				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.pImageInfo = &cur_infos[0],
-			};
-		}
+				.pImageInfo = texture_infos.data(),
+			},
+		};
 
 		vkUpdateDescriptorSets(rtg.device, uint32_t(writes.size()), writes.data(), 0, nullptr);
 	}
@@ -1435,7 +1803,11 @@ RTGRenderer::~RTGRenderer() {
 		material_descriptor_pool = nullptr;
 
 		//the above also frees the descriptor sets allocated from the pool:
-		material_descriptors.clear();
+		Materials_descriptors = VK_NULL_HANDLE;
+	}
+
+	if (materials.handle) {
+		rtg.helpers.destroy_buffer(std::move(materials));
 	}
 
 	if (World_environment_sampler) {
@@ -1520,8 +1892,11 @@ RTGRenderer::~RTGRenderer() {
 	shadow_pipeline.destroy(rtg);
 	cloud_pipeline.destroy(rtg);
 	cloud_lightgrid_pipeline.destroy(rtg);
+	cull_pipeline.destroy(rtg);
+	hiz_pipeline.destroy(rtg);
 	
 	rtg.helpers.destroy_buffer(std::move(object_vertices));
+	rtg.helpers.destroy_buffer(std::move(object_indices));
 
 	if (shadow_sampler) {
 		vkDestroySampler(rtg.device, shadow_sampler, nullptr);
@@ -1552,6 +1927,14 @@ RTGRenderer::~RTGRenderer() {
 			workspace.command_buffer = VK_NULL_HANDLE;
 		}
 
+		for (Workspace::Recorder &recorder : workspace.recorders) {
+			//(also frees the secondaries allocated from the pool)
+			vkDestroyCommandPool(rtg.device, recorder.command_pool, nullptr);
+			recorder.command_pool = VK_NULL_HANDLE;
+			recorder.secondaries.clear();
+		}
+		workspace.recorders.clear();
+
 		if (workspace.lines_vertices_src.handle != VK_NULL_HANDLE) {
 		rtg.helpers.destroy_buffer(std::move(workspace.lines_vertices_src));
 		}
@@ -1596,6 +1979,38 @@ RTGRenderer::~RTGRenderer() {
 		}
 		//Transforms_descriptors freed when pool is destroyed.
 
+		if (workspace.CullInstances_src.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.CullInstances_src));
+		}
+		if (workspace.CullInstances.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.CullInstances));
+		}
+		if (workspace.CullFrusta_src.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.CullFrusta_src));
+		}
+		if (workspace.CullFrusta.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.CullFrusta));
+		}
+		if (workspace.DrawCommands.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.DrawCommands));
+		}
+		if (workspace.DrawCounts.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.DrawCounts));
+		}
+		if (workspace.CullCandidates_src.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.CullCandidates_src));
+		}
+		if (workspace.CullCandidates.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.CullCandidates));
+		}
+		if (workspace.CullLate.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.CullLate));
+		}
+		if (workspace.CullStats.handle != VK_NULL_HANDLE) {
+			rtg.helpers.destroy_buffer(std::move(workspace.CullStats));
+		}
+		//Cull_descriptors freed when pool is destroyed.
+
 		if (workspace.Cloud_lightgrid.handle) {
 			rtg.helpers.destroy_image_3D(std::move(workspace.Cloud_lightgrid));
 		}
@@ -1636,6 +2051,11 @@ RTGRenderer::~RTGRenderer() {
 		vkDestroyRenderPass(rtg.device, render_pass, nullptr);
 		render_pass = VK_NULL_HANDLE;
 	}
+
+	if (late_render_pass != VK_NULL_HANDLE) {
+		vkDestroyRenderPass(rtg.device, late_render_pass, nullptr);
+		late_render_pass = VK_NULL_HANDLE;
+	}
 }
 
 void RTGRenderer::on_swapchain(RTG &rtg_, RTG::SwapchainEvent const &swapchain) {
@@ -1690,9 +2110,124 @@ void RTGRenderer::on_swapchain(RTG &rtg_, RTG::SwapchainEvent const &swapchain)
 	}
 	std::cout<< "There are "<< swapchain.image_views.size() << " images in the swapchain" <<std::endl;
 
-	// target image for cloud rendering
-	for (auto& workspace : workspaces) {
-		workspace.Cloud_target = rtg.helpers.create_image(
+	{//depth pyramid for occlusion culling:
+		//level 0 rounds each dimension down to a power of two, so every level above halves it exactly:
+		VkExtent2D extent{
+			.width = std::bit_floor(swapchain.extent.width),
+			.height = std::bit_floor(swapchain.extent.height),
+		};
+		hiz_levels = uint32_t(std::bit_width(std::max(extent.width, extent.height)));
+
+		hiz_image = rtg.helpers.create_image(
+			extent,
+			VK_FORMAT_R32_SFLOAT,
+			VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, //built by hiz_pipeline, read by the cull pass
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped,
+			1, //layers
+			hiz_levels
+		);
+
+		auto make_view = [&](uint32_t base_level, uint32_t level_count) {
+			VkImageViewCreateInfo create_info{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+				.image = hiz_image.handle,
+				.viewType = VK_IMAGE_VIEW_TYPE_2D,
+				.format = hiz_image.format,
+				.subresourceRange{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = base_level,
+					.levelCount = level_count,
+					.baseArrayLayer = 0,
+					.layerCount = 1
+				},
+			};
+			VkImageView view = VK_NULL_HANDLE;
+			VK(vkCreateImageView(rtg.device, &create_info, nullptr, &view));
+			return view;
+		};
+		hiz_view = make_view(0, hiz_levels);
+		hiz_level_views.clear();
+		for (uint32_t level = 0; level < hiz_levels; ++level) {
+			hiz_level_views.emplace_back(make_view(level, 1));
+		}
+
+		{//one reduce set per level, re-made with the pyramid:
+			std::array< VkDescriptorPoolSize, 2 > pool_sizes{
+				VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.descriptorCount = hiz_levels,
+				},
+				VkDescriptorPoolSize{
+					.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.descriptorCount = hiz_levels,
+				},
+			};
+
+			VkDescriptorPoolCreateInfo create_info{
+				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+				.flags = 0,
+				.maxSets = hiz_levels,
+				.poolSizeCount = uint32_t(pool_sizes.size()),
+				.pPoolSizes = pool_sizes.data(),
+			};
+			VK(vkCreateDescriptorPool(rtg.device, &create_info, nullptr, &hiz_descriptor_pool));
+
+			std::vector< VkDescriptorSetLayout > layouts(hiz_levels, hiz_pipeline.set0_Reduce);
+			VkDescriptorSetAllocateInfo alloc_info{
+				.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+				.descriptorPool = hiz_descriptor_pool,
+				.descriptorSetCount = hiz_levels,
+				.pSetLayouts = layouts.data(),
+			};
+			hiz_reduce_descriptors.assign(hiz_levels, VK_NULL_HANDLE);
+			VK(vkAllocateDescriptorSets(rtg.device, &alloc_info, hiz_reduce_descriptors.data()));
+		}
+
+		{//level 0 reads the depth buffer, every other level reads the one below it:
+			std::vector< VkDescriptorImageInfo > sources(hiz_levels), destinations(hiz_levels);
+			std::vector< VkWriteDescriptorSet > writes;
+			for (uint32_t level = 0; level < hiz_levels; ++level) {
+				sources[level] = VkDescriptorImageInfo{
+					.sampler = texture_sampler, //(only read with texelFetch, so filtering doesn't matter)
+					.imageView = level == 0 ? swapchain_depth_image_view : hiz_level_views[level - 1],
+					.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL,
+				};
+				destinations[level] = VkDescriptorImageInfo{
+					.imageView = hiz_level_views[level],
+					.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+				};
+				writes.emplace_back(VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.dstSet = hiz_reduce_descriptors[level],
+					.dstBinding = 0,
+					.dstArrayElement = 0,
+					.descriptorCount = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+					.pImageInfo = &sources[level],
+				});
+				writes.emplace_back(VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.dstSet = hiz_reduce_descriptors[level],
+					.dstBinding = 1,
+					.dstArrayElement = 0,
+					.descriptorCount = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+					.pImageInfo = &destinations[level],
+				});
+			}
+			vkUpdateDescriptorSets(rtg.device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+		}
+
+		//the new pyramid holds nothing yet (render moves it to VK_IMAGE_LAYOUT_GENERAL), and the cull descriptors still point at the old one:
+		hiz_valid = false;
+		++hiz_serial;
+	}
+
+	// target image for cloud rendering
+	for (auto& workspace : workspaces) {
+		workspace.Cloud_target = rtg.helpers.create_image(
 			swapchain.extent,
 			VK_FORMAT_R8G8B8A8_SNORM,
 			VK_IMAGE_TILING_LINEAR,
@@ -1735,6 +2270,24 @@ void RTGRenderer::destroy_framebuffers() {
 
 	rtg.helpers.destroy_image(std::move(swapchain_depth_image));
 
+	if (hiz_descriptor_pool != VK_NULL_HANDLE) {
+		vkDestroyDescriptorPool(rtg.device, hiz_descriptor_pool, nullptr);
+		hiz_descriptor_pool = VK_NULL_HANDLE;
+		//(this also frees the reduce sets allocated from the pool)
+		hiz_reduce_descriptors.clear();
+	}
+	for (VkImageView &view : hiz_level_views) {
+		vkDestroyImageView(rtg.device, view, nullptr);
+	}
+	hiz_level_views.clear();
+	if (hiz_view != VK_NULL_HANDLE) {
+		vkDestroyImageView(rtg.device, hiz_view, nullptr);
+		hiz_view = VK_NULL_HANDLE;
+	}
+	if (hiz_image.handle != VK_NULL_HANDLE) {
+		rtg.helpers.destroy_image(std::move(hiz_image));
+	}
+
 	for (auto& workspace : workspaces) {
 		if (workspace.Cloud_target_view) {
 			vkDestroyImageView(rtg.device, workspace.Cloud_target_view, nullptr);
@@ -1763,6 +2316,12 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 	//reset the command buffer (clear old commands):
 	VK(vkResetCommandBuffer(workspace.command_buffer, 0));
 
+	//secondaries from the last use of this workspace are done executing as well:
+	for (Workspace::Recorder &recorder : workspace.recorders) {
+		VK(vkResetCommandPool(rtg.device, recorder.command_pool, 0));
+		recorder.used = 0;
+	}
+
 	{//begin recording:
 		VkCommandBufferBeginInfo begine_info{
 			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -1771,6 +2330,77 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 		VK(vkBeginCommandBuffer(workspace.command_buffer, &begine_info));
 	}
 
+	//GPU pass timings (recorded only with --benchmark):
+	RTG::PassTimer &timer = rtg.workspaces[render_params.workspace_index].timer;
+	timer.reset(workspace.command_buffer);
+
+	uint32_t instance_count = uint32_t(cull_instances.size());
+	uint32_t candidate_count = uint32_t(cull_candidates.size());
+	uint32_t shadow_view_count = uint32_t(shadow_views.size());
+	bool cull_descriptors_stale = false; //set when any buffer referenced by Cull_descriptors is re-allocated
+
+	//occlusion culling draws in two phases: instances visible in last frame's depth pyramid go in render_pass,
+	// the pyramid is rebuilt from that depth, and instances that turn out visible in it go in late_render_pass.
+	bool occlusion_culling = rtg.configuration.culling_settings == 2; //(decides which render passes exist)
+	bool occlusion_test = occlusion_culling && view_camera == culling_camera; //the pyramid only describes what the culling camera sees
+	uint32_t late_bucket = uint32_t(draw_buckets.size()) + shadow_view_count; //in DrawCounts
+	uint32_t late_first = camera_draw_commands + shadow_view_count * instance_count; //in DrawCommands
+
+	if (workspace.CullStats_instances != 0) { //the frame that last used this workspace has finished, so its counts can be read:
+		assert(workspace.CullStats.allocation.mapped);
+		uint32_t const *counts = reinterpret_cast< uint32_t const * >(workspace.CullStats.allocation.data());
+		cull_stats.instances = workspace.CullStats_instances;
+		cull_stats.drawn_early = counts[0] + counts[1] + counts[2] + counts[3];
+		cull_stats.drawn_late = counts[4] + counts[5] + counts[6] + counts[7];
+		cull_stats.occluded = counts[9];
+		cull_stats.frustum_culled = cull_stats.instances - cull_stats.drawn_early - counts[8]; //(counts[8] is everything the early phase deferred)
+		workspace.CullStats_instances = 0;
+
+		if (rtg.configuration.print_cull_stats) {
+			auto now = std::chrono::steady_clock::now();
+			if (now - cull_stats_printed >= std::chrono::seconds(1)) {
+				cull_stats_printed = now;
+				std::cout << "Culling: " << cull_stats.instances << " instances, "
+				          << cull_stats.drawn_early << " drawn early, " << cull_stats.drawn_late << " drawn late, "
+				          << cull_stats.occluded << " occluded, " << cull_stats.frustum_culled << " outside the frustum." << std::endl;
+			}
+		}
+	}
+
+	VkRect2D scissor{};
+	VkViewport viewport{};
+	{// compute viewport and scissors, set by every secondary command buffer (the cull pass also needs the viewport for occlusion tests)
+		VkExtent2D extent = rtg.swapchain_extent;
+		VkOffset2D offset = {.x = 0, .y = 0};
+		if (view_camera == SceneCamera) {
+			float camera_aspect = scene.cameras[scene.requested_camera_index].aspect; // W / H
+			float actual_aspect = rtg.swapchain_extent.width / float(rtg.swapchain_extent.height);
+			if (actual_aspect < camera_aspect) {
+				extent.height = uint32_t(float(extent.width) / camera_aspect);
+				offset.y += (rtg.swapchain_extent.height - extent.height) / 2;
+			}
+			else if (actual_aspect > camera_aspect) {
+				extent.width = uint32_t(float(extent.height) * camera_aspect);
+				offset.x += (rtg.swapchain_extent.width - extent.width) / 2;
+			}
+		}
+
+		//scissor rectangle:
+		scissor = VkRect2D{
+			.offset = offset,
+			.extent = extent,
+		};
+		//viewport transform:
+		viewport = VkViewport{
+			.x = float(offset.x),
+			.y = float(offset.y),
+			.width = float(extent.width),
+			.height = float(extent.height),
+			.minDepth = 0.0f,
+			.maxDepth = 1.0f,
+		};
+	}
+
 	//copy transforms, needed for both shadow atlas pass and render pass
 	if (!lambertian_instances.empty() || !environment_instances.empty() || !mirror_instances.empty() || !pbr_instances.empty()) { //upload object transforms:
 		size_t needed_bytes = (lambertian_instances.size() + environment_instances.size() + mirror_instances.size() + pbr_instances.size()) * sizeof(Transform);
@@ -1822,61 +2452,361 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 			);
 
 			std::cout << "Re-allocated object transforms buffers to " << new_bytes << " bytes." << std::endl;
+			cull_descriptors_stale = true;
+			workspace.Transforms_serial = 0; //new buffers hold nothing yet
 		}
 
 		assert(workspace.Transforms_src.size == workspace.Transforms.size);
 		assert(workspace.Transforms_src.size >= needed_bytes);
 
-		{ //copy transforms into Transforms_src:
+		{ //copy transforms changed since this workspace last uploaded into Transforms_src, and from there to Transforms:
 			assert(workspace.Transforms_src.allocation.mapped);
+			assert(transform_serials.size() * sizeof(Transform) == needed_bytes);
 			LambertianPipeline::Transform *out = reinterpret_cast< LambertianPipeline::Transform * >(workspace.Transforms_src.allocation.data()); // Strict aliasing violation, but it doesn't matter
-			for (ObjectInstance const &inst : lambertian_instances) {
-				*out = inst.transform;
-				++out;
+			std::array< std::vector< ObjectInstance > const *, 4 > instance_lists{
+				&lambertian_instances, &environment_instances, &mirror_instances, &pbr_instances
+			};
+
+			//runs of adjacent changed transforms become one copy region each:
+			std::vector< VkBufferCopy > copy_regions;
+			uint32_t index = 0;
+			for (std::vector< ObjectInstance > const *instances : instance_lists) {
+				for (ObjectInstance const &inst : *instances) {
+					if (transform_serials[index] > workspace.Transforms_serial) {
+						out[index] = inst.transform;
+						VkDeviceSize offset = VkDeviceSize(index) * sizeof(Transform);
+						if (!copy_regions.empty() && copy_regions.back().srcOffset + copy_regions.back().size == offset) {
+							copy_regions.back().size += sizeof(Transform);
+						}
+						else {
+							copy_regions.emplace_back(VkBufferCopy{
+								.srcOffset = offset,
+								.dstOffset = offset,
+								.size = sizeof(Transform),
+							});
+						}
+					}
+					++index;
+				}
 			}
-			for (ObjectInstance const &inst : environment_instances) {
-				*out = inst.transform;
-				++out;
+			workspace.Transforms_serial = update_serial;
+
+			//device-side copy from Transforms_src -> Transforms:
+			if (!copy_regions.empty()) {
+				vkCmdCopyBuffer(workspace.command_buffer, workspace.Transforms_src.handle, workspace.Transforms.handle, uint32_t(copy_regions.size()), copy_regions.data());
 			}
-			for (ObjectInstance const &inst : mirror_instances) {
-				*out = inst.transform;
-				++out;
+		}
+	}
+
+	if (instance_count > 0) { //upload cull pass inputs, make room for its outputs:
+		//[re-]allocate buffer if it can't hold needed_bytes, returning true if it was re-allocated:
+		auto reserve_buffer = [&](Helpers::AllocatedBuffer &buffer, size_t needed_bytes, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, Helpers::MapFlag map) {
+			if (buffer.handle != VK_NULL_HANDLE && buffer.size >= needed_bytes) return false;
+			//round to next multiple of 4k to avoid re-allocating continuously if instance count grows slowly:
+			size_t new_bytes = ((needed_bytes + 4096) / 4096) * 4096;
+			if (buffer.handle) {
+				rtg.helpers.destroy_buffer(std::move(buffer));
+			}
+			buffer = rtg.helpers.create_buffer(new_bytes, usage, properties, map);
+			return true;
+		};
+
+		size_t instances_bytes = cull_instances.size() * sizeof(CullPipeline::Instance);
+		size_t frusta_bytes = (1 + size_t(shadow_view_count) + 2) * sizeof(glm::mat4x4); //(+ previous and current camera for occlusion tests)
+		size_t commands_bytes = (size_t(late_first) + size_t(camera_draw_commands)) * sizeof(VkDrawIndexedIndirectCommand); //(late buckets last)
+		size_t counts_bytes = (size_t(late_bucket) + 4 + 2) * sizeof(uint32_t); //(four late buckets, late list length, occluded count)
+		size_t candidates_bytes = std::max< size_t >(candidate_count, 1) * sizeof(CullPipeline::Candidate); //never empty, so there is always a buffer to bind
+		size_t late_bytes = std::max< size_t >(candidate_count, 1) * sizeof(uint32_t); //every candidate is deferred at most once
+		size_t stats_bytes = (4 + 4 + 2) * sizeof(uint32_t); //camera buckets, then late buckets, late list length, occluded count
+
+		bool instances_reallocated = reserve_buffer(workspace.CullInstances_src, instances_bytes,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			Helpers::Mapped
+		);
+		if (reserve_buffer(workspace.CullInstances, instances_bytes,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped
+		)) {
+			cull_descriptors_stale = true;
+			instances_reallocated = true;
+		}
+		if (instances_reallocated) {
+			workspace.CullInstances_serial = 0; //new buffers hold nothing yet
+		}
+		//instances only change when the instance lists are rebuilt:
+		bool upload_instances = workspace.CullInstances_serial < instances_serial;
+		reserve_buffer(workspace.CullFrusta_src, frusta_bytes,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			Helpers::Mapped
+		);
+		cull_descriptors_stale |= reserve_buffer(workspace.CullFrusta, frusta_bytes,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped
+		);
+		cull_descriptors_stale |= reserve_buffer(workspace.DrawCommands, commands_bytes,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, //written by the cull pass, read by indirect draws
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped
+		);
+		cull_descriptors_stale |= reserve_buffer(workspace.DrawCounts, counts_bytes,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, //also cleared with vkCmdFillBuffer, and copied to CullStats
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped
+		);
+		reserve_buffer(workspace.CullCandidates_src, candidates_bytes,
+			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			Helpers::Mapped
+		);
+		cull_descriptors_stale |= reserve_buffer(workspace.CullCandidates, candidates_bytes,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped
+		);
+		cull_descriptors_stale |= reserve_buffer(workspace.CullLate, late_bytes,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			Helpers::Unmapped
+		);
+		reserve_buffer(workspace.CullStats, stats_bytes,
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			Helpers::Mapped
+		);
+
+		if (cull_descriptors_stale) { //point the cull descriptors at the current buffers:
+			std::array< VkDescriptorBufferInfo, 7 > infos{
+				VkDescriptorBufferInfo{ .buffer = workspace.Transforms.handle, .offset = 0, .range = workspace.Transforms.size },
+				VkDescriptorBufferInfo{ .buffer = workspace.CullInstances.handle, .offset = 0, .range = workspace.CullInstances.size },
+				VkDescriptorBufferInfo{ .buffer = workspace.CullFrusta.handle, .offset = 0, .range = workspace.CullFrusta.size },
+				VkDescriptorBufferInfo{ .buffer = workspace.DrawCommands.handle, .offset = 0, .range = workspace.DrawCommands.size },
+				VkDescriptorBufferInfo{ .buffer = workspace.DrawCounts.handle, .offset = 0, .range = workspace.DrawCounts.size },
+				VkDescriptorBufferInfo{ .buffer = workspace.CullCandidates.handle, .offset = 0, .range = workspace.CullCandidates.size },
+				VkDescriptorBufferInfo{ .buffer = workspace.CullLate.handle, .offset = 0, .range = workspace.CullLate.size },
+			};
+
+			std::array< VkWriteDescriptorSet, 8 > writes;
+			for (uint32_t i = 0; i < infos.size(); ++i) {
+				writes[i] = VkWriteDescriptorSet{
+					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+					.dstSet = workspace.Cull_descriptors,
+					.dstBinding = i < 6 ? i : 7, //(binding 6 is the depth pyramid, written below)
+					.dstArrayElement = 0,
+					.descriptorCount = 1,
+					.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+					.pBufferInfo = &infos[i],
+				};
+			}
+			//the vertex shaders read each instance's material index from the same buffer:
+			writes[7] = VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = workspace.Transforms_descriptors,
+				.dstBinding = 1,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.pBufferInfo = &infos[1],
+			};
+
+			vkUpdateDescriptorSets(
+				rtg.device,
+				uint32_t(writes.size()), writes.data(), //descriptorWrites count, data
+				0, nullptr //descriptorCopies count, data
+			);
+		}
+
+		if (workspace.Cull_hiz_serial != hiz_serial) { //point the cull descriptors at the current depth pyramid:
+			VkDescriptorImageInfo HiZ_info{
+				.sampler = texture_sampler, //(only read with texelFetch, so filtering doesn't matter)
+				.imageView = hiz_view,
+				.imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+			};
+			VkWriteDescriptorSet write{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = workspace.Cull_descriptors,
+				.dstBinding = 6,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.pImageInfo = &HiZ_info,
+			};
+			vkUpdateDescriptorSets(rtg.device, 1, &write, 0, nullptr);
+			workspace.Cull_hiz_serial = hiz_serial;
+		}
+
+		{ //copy instances, frusta, and candidates into their _src buffers:
+			if (upload_instances) {
+				assert(workspace.CullInstances_src.allocation.mapped);
+				std::memcpy(workspace.CullInstances_src.allocation.data(), cull_instances.data(), instances_bytes);
 			}
-			for (ObjectInstance const &inst : pbr_instances) {
-				*out = inst.transform;
+
+			assert(workspace.CullFrusta_src.allocation.mapped);
+			glm::mat4x4 *out = reinterpret_cast< glm::mat4x4 * >(workspace.CullFrusta_src.allocation.data());
+			*out = CULL_CLIP_FROM_WORLD;
+			++out;
+			for (ShadowView const &view : shadow_views) {
+				*out = view.LIGHT_FROM_WORLD;
 				++out;
 			}
+			//camera the depth pyramid was built from, then the camera this frame draws from:
+			*out = previous_CLIP_FROM_WORLD;
+			++out;
+			*out = CLIP_FROM_WORLD;
+			++out;
+
+			assert(workspace.CullCandidates_src.allocation.mapped);
+			std::memcpy(workspace.CullCandidates_src.allocation.data(), cull_candidates.data(), candidate_count * sizeof(CullPipeline::Candidate));
 		}
 
-		//device-side copy from Transforms_src -> Transforms:
-		VkBufferCopy copy_region{
-			.srcOffset = 0,
-			.dstOffset = 0,
-			.size = needed_bytes,
-		};
-		vkCmdCopyBuffer(workspace.command_buffer, workspace.Transforms_src.handle, workspace.Transforms.handle, 1, &copy_region);
+		//device-side copies from _src buffers:
+		if (upload_instances) {
+			VkBufferCopy instances_region{ .srcOffset = 0, .dstOffset = 0, .size = instances_bytes };
+			vkCmdCopyBuffer(workspace.command_buffer, workspace.CullInstances_src.handle, workspace.CullInstances.handle, 1, &instances_region);
+			workspace.CullInstances_serial = instances_serial;
+		}
+		VkBufferCopy frusta_region{ .srcOffset = 0, .dstOffset = 0, .size = frusta_bytes };
+		vkCmdCopyBuffer(workspace.command_buffer, workspace.CullFrusta_src.handle, workspace.CullFrusta.handle, 1, &frusta_region);
+		if (candidate_count > 0) {
+			VkBufferCopy candidates_region{ .srcOffset = 0, .dstOffset = 0, .size = candidate_count * sizeof(CullPipeline::Candidate) };
+			vkCmdCopyBuffer(workspace.command_buffer, workspace.CullCandidates_src.handle, workspace.CullCandidates.handle, 1, &candidates_region);
+		}
+
+		//every bucket starts empty:
+		vkCmdFillBuffer(workspace.command_buffer, workspace.DrawCounts.handle, 0, counts_bytes, 0);
 	}
 
-	VkBufferMemoryBarrier buffer_memory_barrier{
-			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+	{//memory barrier to make sure transforms and cull inputs are copied (and draw counts cleared, even if nothing gets culled) before culling and shadow rendering:
+		VkMemoryBarrier memory_barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
 			.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT,
-			.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-			.buffer = workspace.Transforms.handle,
-			.size = VK_WHOLE_SIZE, 
+			.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+		};
+		vkCmdPipelineBarrier( workspace.command_buffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, //srcStageMask
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, //dstStageMask
+			0, //dependencyFlags
+			1, &memory_barrier, //memoryBarriers (count, data)
+			0, nullptr, //bufferMemoryBarriers (count, data)
+			0, nullptr //imageMemoryBarriers (count, data)
+		);
+	}
+
+	if (!hiz_valid) {//the cull pass binds the depth pyramid even when not testing against it, so it must be in VK_IMAGE_LAYOUT_GENERAL:
+		VkImageMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = 0,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED, //nothing worth keeping
+			.newLayout = VK_IMAGE_LAYOUT_GENERAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = hiz_image.handle,
+			.subresourceRange{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = hiz_levels,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			},
+		};
+		vkCmdPipelineBarrier( workspace.command_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask (earlier frames' reads)
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //dstStageMask
+			0, //dependencyFlags
+			0, nullptr, //memoryBarriers (count, data)
+			0, nullptr, //bufferMemoryBarriers (count, data)
+			1, &barrier //imageMemoryBarriers (count, data)
+		);
+	}
+
+	CullPipeline::Push cull_push{
+		.VIEWPORT = glm::vec4(viewport.x, viewport.y, viewport.width, viewport.height),
+		.HIZ_SCALE = glm::vec2(
+			float(hiz_image.extent.width) / float(swapchain_depth_image.extent.width),
+			float(hiz_image.extent.height) / float(swapchain_depth_image.extent.height)
+		),
+		.INSTANCE_COUNT = instance_count,
+		.CANDIDATE_COUNT = candidate_count,
+		.FRUSTUM_COUNT = 1 + shadow_view_count,
+		.CAMERA_CULLING = rtg.configuration.culling_settings != 0 ? 1u : 0u,
+		.SHADOW_BUCKET = uint32_t(draw_buckets.size()),
+		.SHADOW_FIRST = camera_draw_commands,
+		.PHASE = 0,
+		.OCCLUSION = occlusion_test && hiz_valid ? 1u : 0u, //(the pyramid's previous-frame writes are ordered by the barrier after it was built)
+		.HIZ_LEVELS = hiz_levels,
+		.LATE_BUCKET = late_bucket,
+		.LATE_FIRST = late_first,
 	};
-	vkCmdPipelineBarrier( workspace.command_buffer,
-		VK_PIPELINE_STAGE_TRANSFER_BIT, //srcStageMask
-		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, //dstStageMask
-		0, //dependencyFlags
-		0, nullptr, //memoryBarriers (count, data)
-		1, &buffer_memory_barrier, //bufferMemoryBarriers (count, data)
-		0, nullptr //imageMemoryBarriers (count, data)
-	);
 
-	{//shadow atlas pass:
-		std::array<VkClearValue, 1> clear_values{
-			VkClearValue{.depthStencil{.depth = 1.0f, .stencil = 0}},
+	if (candidate_count > 0) {//cull the BVH's candidates against the camera and shadow view frusta, compacting survivors into indirect draws:
+		uint32_t cull_pass = timer.pass("cull");
+		timer.begin(workspace.command_buffer, cull_pass);
+
+		vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline.handle);
+		vkCmdBindDescriptorSets(
+			workspace.command_buffer, //command buffer
+			VK_PIPELINE_BIND_POINT_COMPUTE, //pipeline bind point
+			cull_pipeline.layout, //pipeline layout
+			0, //first set
+			1, &workspace.Cull_descriptors, //descriptor sets count, ptr
+			0, nullptr //dynamic offsets count, ptr
+		);
+		//push counts, where the shadow view and late streams start, and how to read the depth pyramid:
+		vkCmdPushConstants(workspace.command_buffer, cull_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(cull_push), &cull_push);
+		vkCmdDispatch(workspace.command_buffer, (candidate_count + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1 + shadow_view_count, 1);
+		timer.end(workspace.command_buffer, cull_pass);
+
+		//draw commands and counts must be written before the indirect draws (or the late phase, or the stats copy) read them:
+		VkMemoryBarrier memory_barrier{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+		};
+		vkCmdPipelineBarrier( workspace.command_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, //dstStageMask
+			0, //dependencyFlags
+			1, &memory_barrier, //memoryBarriers (count, data)
+			0, nullptr, //bufferMemoryBarriers (count, data)
+			0, nullptr //imageMemoryBarriers (count, data)
+		);
+	}
+
+	if (!shadow_atlas_ready) {//the shadow atlas pass loads the atlas, so it starts out in the layout the pass expects:
+		VkImageMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+			.srcAccessMask = 0,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+			.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = shadow_atlas_image.handle,
+			.subresourceRange = {
+				.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			},
 		};
+		vkCmdPipelineBarrier(
+			workspace.command_buffer,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, // srcStageMask
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, // dstStageMask
+			0, // dependencyFlags
+			0, nullptr, // memoryBarriers (count, data)
+			0, nullptr, // bufferMemoryBarriers (count, data)
+			1, &barrier // imageMemoryBarriers (count, data)
+		);
+		shadow_atlas_ready = true;
+	}
+
+	{//shadow atlas pass; only regions whose light or casters changed are cleared and drawn again, the rest keep last frame's depth:
 		VkRenderPassBeginInfo begin_info{
 			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 			.renderPass = shadow_atlas_pass,
@@ -1885,46 +2815,90 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 				.offset = {.x = 0, .y = 0},
 				.extent = {.width = shadow_atlas_length, .height = shadow_atlas_length},
 			},
-			.clearValueCount = uint32_t(clear_values.size()),
-			.pClearValues = clear_values.data(),
+			.clearValueCount = 0, //loaded, not cleared
+			.pClearValues = nullptr,
 		};
 
-		vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
+		//one secondary command buffer per stale shadow region, recorded in parallel:
+		std::vector< RecordTask > tasks;
+		for (uint32_t i = 0; i < shadow_view_count; ++i) {
+			ShadowView const &view = shadow_views[i];
+			ShadowAtlas::Region const &region = shadow_atlas.regions[view.region];
+			if (i < spot_light_from_world.size()) {
+				if (region.size == 0) continue; // skip shadow of size 0
+				spot_lights[view.region].LIGHT_FROM_WORLD = view.LIGHT_FROM_WORLD;
+				spot_lights[view.region].ATLAS_COORD_FROM_WORLD = ShadowAtlas::calculate_shadow_atlas_matrix(view.LIGHT_FROM_WORLD,region,shadow_atlas_length);
+			}
+			else if (i < spot_light_from_world.size() + sun_cascades.size()) {
+				SunCascade const &cascade = sun_cascades[i - spot_light_from_world.size()];
+				LambertianPipeline::SunLight &sun = sun_lights[cascade.sun];
+				if (region.size == 0) { //(cascades are looked up nearest first, so one without a region ends the sun's shadow)
+					sun.CASCADE_COUNT = std::min(sun.CASCADE_COUNT, cascade.cascade);
+					continue;
+				}
+				sun.LIGHT_FROM_WORLD[cascade.cascade] = view.LIGHT_FROM_WORLD;
+				sun.ATLAS_RECTS[cascade.cascade] = glm::vec4(glm::vec3(region.x, region.y, region.size) / float(shadow_atlas_length), 0.0f);
+			}
+			else {
+				uint32_t face_index = uint32_t(i - spot_light_from_world.size() - sun_cascades.size());
+				uint32_t face = face_index % 6;
+				LambertianPipeline::SphereLight &sphere = sphere_lights[sphere_shadows[face_index / 6].sphere];
+				if (region.size == 0) continue; //(the face's bit stays clear, so it is lit unshadowed)
+				sphere.SHADOW_FACES |= 1u << face;
+				sphere.ATLAS_COORD_FROM_WORLD[face] = ShadowAtlas::calculate_shadow_atlas_matrix(view.LIGHT_FROM_WORLD,region,shadow_atlas_length);
+			}
 
-		if (!lambertian_instances.empty() || !environment_instances.empty() || !mirror_instances.empty() || !pbr_instances.empty()) {
-			//bind Transforms descriptor set:
-			std::array< VkDescriptorSet, 1 > descriptor_sets{
-				workspace.Transforms_descriptors, //1: Transforms
-			};
-			vkCmdBindDescriptorSets(
-				workspace.command_buffer, //command buffer
-				VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-				shadow_pipeline.layout, //pipeline layout
-				0, //first set
-				uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
-				0, nullptr //dynamic offsets count, ptr
-			);
-		}
-		if (!spot_lights.empty()) {
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadow_pipeline.handle);
+			if (!shadow_atlas.stale(view.region)) continue; //(the cull pass skipped this view's frustum, too)
+			shadow_atlas.mark_rendered(view.region);
 
-			{//use object_vertices (offset 0) as vertex buffer binding 0:
-				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+			tasks.emplace_back([this, &workspace, i, region, instance_count](VkCommandBuffer cb) {
+				{//clear just this region:
+					VkClearAttachment attachment{
+						.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+						.clearValue{.depthStencil{.depth = 1.0f, .stencil = 0}},
+					};
+					VkClearRect rect{
+						.rect{
+							.offset = {.x = int32_t(region.x), .y = int32_t(region.y)},
+							.extent = {.width = region.size, .height = region.size},
+						},
+						.baseArrayLayer = 0,
+						.layerCount = 1,
+					};
+					vkCmdClearAttachments(cb, 1, &attachment, 1, &rect);
+				}
+
+				//draw every instance the cull pass found inside this view's frustum:
+				if (instance_count == 0) return;
+
+				vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, shadow_pipeline.handle);
+
+				{//bind Transforms descriptor set:
+					std::array< VkDescriptorSet, 1 > descriptor_sets{
+						workspace.Transforms_descriptors, //0: Transforms
+					};
+					vkCmdBindDescriptorSets(
+						cb, //command buffer
+						VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
+						shadow_pipeline.layout, //pipeline layout
+						0, //first set
+						uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
+						0, nullptr //dynamic offsets count, ptr
+					);
+				}
+
+				{//use object_vertices (offset 0) as vertex buffer binding 0, and object_indices as the index buffer:
+					std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
+					std::array< VkDeviceSize, 1 > offsets{ 0 };
+					vkCmdBindVertexBuffers(cb, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+					vkCmdBindIndexBuffer(cb, object_indices.handle, 0, VK_INDEX_TYPE_UINT32);
+				}
 
-			}
-			for (uint32_t i = 0; i < scene.spot_lights_sorted_indices.size(); ++i) {
-				uint32_t light_index = scene.spot_lights_sorted_indices[i].spot_lights_index;
-				ShadowAtlas::Region& region = shadow_atlas.regions[light_index];
-				if (region.size == 0) continue; // skip shadow of size 0
-				spot_lights[light_index].LIGHT_FROM_WORLD = spot_light_from_world[i];
-				spot_lights[light_index].ATLAS_COORD_FROM_WORLD = ShadowAtlas::calculate_shadow_atlas_matrix(spot_light_from_world[i],region,shadow_atlas_length);
 				{//push light:
 					ShadowAtlasPipeline::Light push{
-						.LIGHT_FROM_WORLD = spot_light_from_world[i],
+						.LIGHT_FROM_WORLD = shadow_views[i].LIGHT_FROM_WORLD,
 					};
-					vkCmdPushConstants(workspace.command_buffer, shadow_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+					vkCmdPushConstants(cb, shadow_pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
 				}
 				{// set viewport and scissors
 					VkExtent2D extent = {region.size, region.size};
@@ -1935,7 +2909,7 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 							.offset = offset,
 							.extent = extent,
 						};
-						vkCmdSetScissor(workspace.command_buffer, 0, 1, &scissor);
+						vkCmdSetScissor(cb, 0, 1, &scissor);
 					}
 					{//configure viewport transform:
 						VkViewport viewport{
@@ -1946,66 +2920,58 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 							.minDepth = 0.0f,
 							.maxDepth = 1.0f,
 						};
-						vkCmdSetViewport(workspace.command_buffer, 0, 1, &viewport);
+						vkCmdSetViewport(cb, 0, 1, &viewport);
 					}
 				}
 
-				//draw all instances:
-				for (uint32_t index : in_spot_light_instances[i][static_cast<uint32_t>(Scene::Material::Lambertian)]) {
-					ObjectInstance const &inst = lambertian_instances[index];
+				vkCmdDrawIndexedIndirectCount(
+					cb, //command buffer
+					workspace.DrawCommands.handle, (VkDeviceSize(camera_draw_commands) + VkDeviceSize(i) * instance_count) * sizeof(VkDrawIndexedIndirectCommand), //buffer, offset
+					workspace.DrawCounts.handle, (VkDeviceSize(draw_buckets.size()) + i) * sizeof(uint32_t), //count buffer, offset
+					instance_count, //max draw count
+					sizeof(VkDrawIndexedIndirectCommand) //stride
+				);
+			});
+		}
 
-					vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-				}
+		if (!tasks.empty()) { //(with nothing stale the atlas is left as is, already in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+			std::vector< VkCommandBuffer > secondaries = record_secondaries(workspace, shadow_atlas_pass, shadow_framebuffer, tasks);
 
-				uint32_t index_offset = uint32_t(lambertian_instances.size());// account for lambertian size
-				for (uint32_t index : in_spot_light_instances[i][static_cast<uint32_t>(Scene::Material::Environment)]) {
-					ObjectInstance const &inst = environment_instances[index];
-					index += index_offset; 
-					vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-				}
-				index_offset = uint32_t(lambertian_instances.size() + environment_instances.size());// account for lambertian and environment size
-				for (uint32_t index : in_spot_light_instances[i][static_cast<uint32_t>(Scene::Material::Mirror)]) {
-					ObjectInstance const &inst = mirror_instances[index];
-					index += index_offset; 
-					vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-				}
-				index_offset = uint32_t(lambertian_instances.size() + environment_instances.size() + mirror_instances.size());// account for lambertian, environment, and mirror size
-				for (uint32_t index : in_spot_light_instances[i][static_cast<uint32_t>(Scene::Material::PBR)]) {
-					ObjectInstance const &inst = pbr_instances[index];
-					index += index_offset; 
-					vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
-				}
-			}
-		}
-		vkCmdEndRenderPass(workspace.command_buffer);
-	}
+			uint32_t shadow_pass = timer.pass("shadow atlas");
+			timer.begin(workspace.command_buffer, shadow_pass);
+			vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			vkCmdExecuteCommands(workspace.command_buffer, uint32_t(secondaries.size()), secondaries.data());
+			vkCmdEndRenderPass(workspace.command_buffer);
+			timer.end(workspace.command_buffer, shadow_pass);
 
-	VkImageMemoryBarrier image_memory_barrier{
-		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-		.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
-		.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
-		.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-		.image = shadow_atlas_image.handle,
-		.subresourceRange = {
-			.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
-			.baseMipLevel = 0,
-			.levelCount = 1,
-			.baseArrayLayer = 0,
-			.layerCount = 1
-    	},
-	};
+			VkImageMemoryBarrier image_memory_barrier{
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+				.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				.image = shadow_atlas_image.handle,
+				.subresourceRange = {
+					.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+					.baseMipLevel = 0,
+					.levelCount = 1,
+					.baseArrayLayer = 0,
+					.layerCount = 1
+				},
+			};
 
-	// Command for barrier between render passes
-	vkCmdPipelineBarrier(
-		workspace.command_buffer,
-		VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, // srcStageMask
-		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, // dstStageMask
-		0, // dependencyFlags
-		0, nullptr, // memoryBarriers (count, data)
-		0, nullptr, // bufferMemoryBarriers (count, data)
-		1, &image_memory_barrier // imageMemoryBarriers (count, data)
-	);
+			// Command for barrier between render passes
+			vkCmdPipelineBarrier(
+				workspace.command_buffer,
+				VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, // srcStageMask
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, // dstStageMask
+				0, // dependencyFlags
+				0, nullptr, // memoryBarriers (count, data)
+				0, nullptr, // bufferMemoryBarriers (count, data)
+				1, &image_memory_barrier // imageMemoryBarriers (count, data)
+			);
+		}
+	}
 
 
 	if (!lines_vertices.empty()) { //upload lines vertices;
@@ -2076,6 +3042,7 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 	}
 
 	{ //upload world info:
+		world.CLIP_FROM_WORLD = CLIP_FROM_WORLD;
 		assert(workspace.World_src.size == sizeof(world));
 
 		//host-side copy into World_src:
@@ -2170,43 +3137,8 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 			.clearValueCount = uint32_t(clear_values.size()),
 			.pClearValues = clear_values.data(),
 		};
-		vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_INLINE);
-
-		{// set viewport and scissors
-			VkExtent2D extent = rtg.swapchain_extent;
-			VkOffset2D offset = {.x = 0, .y = 0};
-			if (view_camera == SceneCamera) {
-				float camera_aspect = scene.cameras[scene.requested_camera_index].aspect; // W / H
-				float actual_aspect = rtg.swapchain_extent.width / float(rtg.swapchain_extent.height);
-				if (actual_aspect < camera_aspect) {
-					extent.height = uint32_t(float(extent.width) / camera_aspect);
-					offset.y += (rtg.swapchain_extent.height - extent.height) / 2;
-				}
-				else if (actual_aspect > camera_aspect) {
-					extent.width = uint32_t(float(extent.height) * camera_aspect);
-					offset.x += (rtg.swapchain_extent.width - extent.width) / 2;
-				}
-			}
-
-			{//set scissor rectangle:
-				VkRect2D scissor{
-					.offset = offset,
-					.extent = extent,
-				};
-				vkCmdSetScissor(workspace.command_buffer, 0, 1, &scissor);
-			}
-			{//configure viewport transform:
-				VkViewport viewport{
-					.x = float(offset.x),
-					.y = float(offset.y),
-					.width = float(extent.width),
-					.height = float(extent.height),
-					.minDepth = 0.0f,
-					.maxDepth = 1.0f,
-				};
-				vkCmdSetViewport(workspace.command_buffer, 0, 1, &viewport);
-			}
-		}
+		//one secondary command buffer for the lines and one per material pipeline, recorded in parallel:
+		std::vector< RecordTask > tasks;
 
 		// {//draw with the background pipeline:
 		// 	vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, background_pipeline.handle);
@@ -2219,173 +3151,282 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 		// 	}
 			
 		// 	vkCmdDraw(workspace.command_buffer, 3, 1, 0, 0);
-		// }
-
-		if (!lines_vertices.empty()) {//draw with the lines pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lines_pipeline.handle);
-
-			{//use lines_vertices (offset 0) as vertex buffer binding 0:
-				std::array< VkBuffer, 1 > vertex_buffers{ workspace.lines_vertices.handle };
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
-			}
-
-			{ //bind Camera descriptor set:
-				std::array< VkDescriptorSet, 1 > descriptor_sets{
-					workspace.Camera_descriptors, //0: Camera
-				};
-		
-				vkCmdBindDescriptorSets(
-					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					lines_pipeline.layout, //pipeline layout
-					0, //first set
-					uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
-					0, nullptr //dynamic offsets count, ptr
-				);
-			}
+		// }
 
-			//draw lines vertices:
-			vkCmdDraw(workspace.command_buffer, uint32_t(lines_vertices.size()), 1, 0, 0);
-		}
+		if (!lines_vertices.empty()) {//draw with the lines pipeline:
+			tasks.emplace_back([this, &workspace, &timer, scissor, viewport, pass = timer.pass("lines")](VkCommandBuffer cb) {
+				timer.begin(cb, pass);
+				vkCmdSetScissor(cb, 0, 1, &scissor);
+				vkCmdSetViewport(cb, 0, 1, &viewport);
 
-		if (!lambertian_instances.empty() || !environment_instances.empty() || !mirror_instances.empty() || !pbr_instances.empty()) {
-			//bind World and Transforms descriptor set:
-			std::array< VkDescriptorSet, 2 > descriptor_sets{
-				workspace.World_descriptors, //0: World
-				workspace.Transforms_descriptors, //1: Transforms
-			};
-			vkCmdBindDescriptorSets(
-				workspace.command_buffer, //command buffer
-				VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-				lambertian_pipeline.layout, //pipeline layout
-				0, //first set
-				uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
-				0, nullptr //dynamic offsets count, ptr
-			);
-		}
+				vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, lines_pipeline.handle);
 
-		if (!lambertian_instances.empty()){//draw with the objects pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, lambertian_pipeline.handle);
+				{//use lines_vertices (offset 0) as vertex buffer binding 0:
+					std::array< VkBuffer, 1 > vertex_buffers{ workspace.lines_vertices.handle };
+					std::array< VkDeviceSize, 1 > offsets{ 0 };
+					vkCmdBindVertexBuffers(cb, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+				}
 
-			{//use object_vertices (offset 0) as vertex buffer binding 0:
-				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+				{ //bind Camera descriptor set:
+					std::array< VkDescriptorSet, 1 > descriptor_sets{
+						workspace.Camera_descriptors, //0: Camera
+					};
+			
+					vkCmdBindDescriptorSets(
+						cb, //command buffer
+						VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
+						lines_pipeline.layout, //pipeline layout
+						0, //first set
+						uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
+						0, nullptr //dynamic offsets count, ptr
+					);
+				}
 
-			}
+				//draw lines vertices:
+				vkCmdDraw(cb, uint32_t(lines_vertices.size()), 1, 0, 0);
+				timer.end(cb, pass);
+			});
+		}
 
-			// set 1 and 2 still bound
+		//every material pipeline draws its bucket with a single indirect draw (and its late bucket with another, in late_render_pass):
+		auto draw_bucket = [this, &workspace, &timer, scissor, viewport, late_bucket, late_first](VkPipeline pipeline, uint32_t bucket_index, bool late, std::string const &name) -> RecordTask {
+			VkDeviceSize first = (late ? late_first : 0) + draw_buckets[bucket_index].first;
+			VkDeviceSize count = (late ? late_bucket : 0) + bucket_index;
+			uint32_t pass = timer.pass(late ? name + " (late)" : name);
+			return [this, &workspace, &timer, scissor, viewport, pipeline, bucket_index, first, count, pass](VkCommandBuffer cb) {
+				timer.begin(cb, pass);
+				vkCmdSetScissor(cb, 0, 1, &scissor);
+				vkCmdSetViewport(cb, 0, 1, &viewport);
+
+				vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+
+				{//bind World, Transforms, and Materials descriptor sets, shared by every material pipeline:
+					std::array< VkDescriptorSet, 3 > descriptor_sets{
+						workspace.World_descriptors, //0: World
+						workspace.Transforms_descriptors, //1: Transforms
+						Materials_descriptors, //2: Materials
+					};
+					vkCmdBindDescriptorSets(
+						cb, //command buffer
+						VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
+						lambertian_pipeline.layout, //pipeline layout
+						0, //first set
+						uint32_t(descriptor_sets.size()), descriptor_sets.data(), //descriptor sets count, ptr
+						0, nullptr //dynamic offsets count, ptr
+					);
+				}
 
-			//draw all instances:
-			for (uint32_t index : in_view_instances[static_cast<uint32_t>(Scene::Material::Lambertian)]) {
-				ObjectInstance const &inst = lambertian_instances[index];
-				//bind texture descriptor set:
-				vkCmdBindDescriptorSets(
-					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					lambertian_pipeline.layout, //pipeline layout
-					2, //second set
-					1, &material_descriptors[inst.material_index], //descriptor sets count, ptr
-					0, nullptr //dynamic offsets count, ptr
+				{//use object_vertices (offset 0) as vertex buffer binding 0, and object_indices as the index buffer:
+					std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
+					std::array< VkDeviceSize, 1 > offsets{ 0 };
+					vkCmdBindVertexBuffers(cb, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+					vkCmdBindIndexBuffer(cb, object_indices.handle, 0, VK_INDEX_TYPE_UINT32);
+				}
+
+				//one indirect draw for every instance the cull pass kept:
+				vkCmdDrawIndexedIndirectCount(
+					cb, //command buffer
+					workspace.DrawCommands.handle, first * sizeof(VkDrawIndexedIndirectCommand), //buffer, offset
+					workspace.DrawCounts.handle, count * sizeof(uint32_t), //count buffer, offset
+					draw_buckets[bucket_index].capacity, //max draw count
+					sizeof(VkDrawIndexedIndirectCommand) //stride
 				);
+				timer.end(cb, pass);
+			};
+		};
 
-				vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
+		auto draw_buckets_tasks = [&](bool late) {
+			if (!lambertian_instances.empty()) {
+				tasks.emplace_back(draw_bucket(lambertian_pipeline.handle, static_cast<uint32_t>(Scene::Material::Lambertian), late, "lambertian"));
+			}
+			if (!environment_instances.empty()) {
+				tasks.emplace_back(draw_bucket(environment_pipeline.handle, static_cast<uint32_t>(Scene::Material::Environment), late, "environment"));
+			}
+			if (!mirror_instances.empty()) {
+				tasks.emplace_back(draw_bucket(mirror_pipeline.handle, static_cast<uint32_t>(Scene::Material::Mirror), late, "mirror"));
 			}
+			if (!pbr_instances.empty()) {
+				tasks.emplace_back(draw_bucket(pbr_pipeline.handle, static_cast<uint32_t>(Scene::Material::PBR), late, "pbr"));
+			}
+		};
+		draw_buckets_tasks(false);
 
+		std::vector< VkCommandBuffer > secondaries = record_secondaries(workspace, render_pass, framebuffer, tasks);
+
+		vkCmdBeginRenderPass(workspace.command_buffer, &begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		if (!secondaries.empty()) {
+			vkCmdExecuteCommands(workspace.command_buffer, uint32_t(secondaries.size()), secondaries.data());
 		}
-	
-		if (!environment_instances.empty()) {//draw with the objects pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, environment_pipeline.handle);
+		vkCmdEndRenderPass(workspace.command_buffer);
 
-			{//use object_vertices as vertex buffer binding 0:
-				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+		if (occlusion_test) {//build the depth pyramid from what render_pass drew, then re-test the instances the early phase deferred against it:
+			VkImageSubresourceRange depth_range{
+				.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+				.baseMipLevel = 0,
+				.levelCount = 1,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			};
 
+			{//depth buffer is read by the first reduction:
+				VkImageMemoryBarrier barrier{
+					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+					.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+					.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+					.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+					.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.image = swapchain_depth_image.handle,
+					.subresourceRange = depth_range,
+				};
+				//(also orders this frame's pyramid writes after the early phase's reads)
+				vkCmdPipelineBarrier( workspace.command_buffer,
+					VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //dstStageMask
+					0, //dependencyFlags
+					0, nullptr, //memoryBarriers (count, data)
+					0, nullptr, //bufferMemoryBarriers (count, data)
+					1, &barrier //imageMemoryBarriers (count, data)
+				);
 			}
 
-			//World descriptor still bound
-
-			//draw all instances:
-			uint32_t index_offset = uint32_t(lambertian_instances.size());// account for lambertian size
-			for (uint32_t index : in_view_instances[static_cast<uint32_t>(Scene::Material::Environment)]) {
-				ObjectInstance const &inst = environment_instances[index];
-				index += index_offset;
-				//bind texture descriptor set:
+			uint32_t hiz_pass = timer.pass("hiz");
+			timer.begin(workspace.command_buffer, hiz_pass);
+			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, hiz_pipeline.handle);
+			for (uint32_t level = 0; level < hiz_levels; ++level) {
 				vkCmdBindDescriptorSets(
 					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					environment_pipeline.layout, //pipeline layout
-					2, //second set
-					1, &material_descriptors[inst.material_index], //descriptor sets count, ptr
+					VK_PIPELINE_BIND_POINT_COMPUTE, //pipeline bind point
+					hiz_pipeline.layout, //pipeline layout
+					0, //first set
+					1, &hiz_reduce_descriptors[level], //descriptor sets count, ptr
 					0, nullptr //dynamic offsets count, ptr
 				);
-				vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
+				uint32_t width = std::max(hiz_image.extent.width >> level, 1u);
+				uint32_t height = std::max(hiz_image.extent.height >> level, 1u);
+				vkCmdDispatch(workspace.command_buffer, (width + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE, (height + HIZ_WORKGROUP_SIZE - 1) / HIZ_WORKGROUP_SIZE, 1);
+
+				//each level is read by the next one, the last by the late phase (and next frame's early phase):
+				VkMemoryBarrier memory_barrier{
+					.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+					.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+					.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+				};
+				vkCmdPipelineBarrier( workspace.command_buffer,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //dstStageMask
+					0, //dependencyFlags
+					1, &memory_barrier, //memoryBarriers (count, data)
+					0, nullptr, //bufferMemoryBarriers (count, data)
+					0, nullptr //imageMemoryBarriers (count, data)
+				);
 			}
+			timer.end(workspace.command_buffer, hiz_pass);
+			hiz_valid = true;
+			previous_CLIP_FROM_WORLD = CLIP_FROM_WORLD;
 
-		}
-
-		if (!mirror_instances.empty()) {//draw with the objects pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mirror_pipeline.handle);
-
-			{//use object_vertices as vertex buffer binding 0:
-				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
+			{//depth buffer goes back to being tested against by late_render_pass:
+				VkImageMemoryBarrier barrier{
+					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+					.srcAccessMask = VK_ACCESS_SHADER_READ_BIT,
+					.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+					.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+					.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+					.image = swapchain_depth_image.handle,
+					.subresourceRange = depth_range,
+				};
+				vkCmdPipelineBarrier( workspace.command_buffer,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask
+					VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, //dstStageMask
+					0, //dependencyFlags
+					0, nullptr, //memoryBarriers (count, data)
+					0, nullptr, //bufferMemoryBarriers (count, data)
+					1, &barrier //imageMemoryBarriers (count, data)
+				);
 			}
 
-			//World descriptor still bound
+			if (candidate_count > 0) {//late phase; one invocation per deferred instance at most:
+				CullPipeline::Push push = cull_push;
+				push.PHASE = 1;
 
-			//draw all instances:
-			uint32_t index_offset = uint32_t(lambertian_instances.size() + environment_instances.size());// account for lambertian and environment size
-			for (uint32_t index : in_view_instances[static_cast<uint32_t>(Scene::Material::Mirror)]) {
-				ObjectInstance const &inst = mirror_instances[index];
-				index += index_offset;
-				//bind texture descriptor set:
+				uint32_t late_cull_pass = timer.pass("cull (late)");
+				timer.begin(workspace.command_buffer, late_cull_pass);
+				vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull_pipeline.handle);
 				vkCmdBindDescriptorSets(
 					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					mirror_pipeline.layout, //pipeline layout
-					2, //second set
-					1, &material_descriptors[inst.material_index], //descriptor sets count, ptr
+					VK_PIPELINE_BIND_POINT_COMPUTE, //pipeline bind point
+					cull_pipeline.layout, //pipeline layout
+					0, //first set
+					1, &workspace.Cull_descriptors, //descriptor sets count, ptr
 					0, nullptr //dynamic offsets count, ptr
 				);
-				vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
+				vkCmdPushConstants(workspace.command_buffer, cull_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+				vkCmdDispatch(workspace.command_buffer, (candidate_count + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+				timer.end(workspace.command_buffer, late_cull_pass);
+
+				//late draw commands and counts must be written before late_render_pass (or the stats copy) reads them:
+				VkMemoryBarrier memory_barrier{
+					.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+					.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+					.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+				};
+				vkCmdPipelineBarrier( workspace.command_buffer,
+					VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, //srcStageMask
+					VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, //dstStageMask
+					0, //dependencyFlags
+					1, &memory_barrier, //memoryBarriers (count, data)
+					0, nullptr, //bufferMemoryBarriers (count, data)
+					0, nullptr //imageMemoryBarriers (count, data)
+				);
 			}
-
 		}
-		if (!pbr_instances.empty()) {//draw with the objects pipeline:
-			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pbr_pipeline.handle);
+		else {
+			hiz_valid = false; //nothing recorded this frame's depth
+		}
 
-			{//use object_vertices as vertex buffer binding 0:
-				std::array<VkBuffer, 1>vertex_buffers{object_vertices.handle};
-				std::array< VkDeviceSize, 1 > offsets{ 0 };
-				vkCmdBindVertexBuffers(workspace.command_buffer, 0, uint32_t(vertex_buffers.size()), vertex_buffers.data(), offsets.data());
-			}
+		if (occlusion_culling) {//late render pass; also moves the color attachment to its final layout, so runs (maybe empty) every frame:
+			VkRenderPassBeginInfo late_begin_info = begin_info;
+			late_begin_info.renderPass = late_render_pass;
+			late_begin_info.clearValueCount = 0;
+			late_begin_info.pClearValues = nullptr;
 
-			//World descriptor still bound
+			tasks.clear();
+			if (occlusion_test) draw_buckets_tasks(true);
 
-			//draw all instances:
-			uint32_t index_offset = uint32_t(lambertian_instances.size() + environment_instances.size() + mirror_instances.size());// account for lambertian, environment, and mirror size
-			for (uint32_t index : in_view_instances[static_cast<uint32_t>(Scene::Material::PBR)]) {
-				ObjectInstance const &inst = pbr_instances[index];
-				index += index_offset;
-				//bind texture descriptor set:
-				vkCmdBindDescriptorSets(
-					workspace.command_buffer, //command buffer
-					VK_PIPELINE_BIND_POINT_GRAPHICS, //pipeline bind point
-					pbr_pipeline.layout, //pipeline layout
-					2, //second set
-					1, &material_descriptors[inst.material_index], //descriptor sets count, ptr
-					0, nullptr //dynamic offsets count, ptr
-				);
-				vkCmdDraw(workspace.command_buffer, inst.vertices.count, 1, inst.vertices.first, index);
+			std::vector< VkCommandBuffer > late_secondaries = record_secondaries(workspace, late_render_pass, framebuffer, tasks);
+
+			vkCmdBeginRenderPass(workspace.command_buffer, &late_begin_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+			if (!late_secondaries.empty()) {
+				vkCmdExecuteCommands(workspace.command_buffer, uint32_t(late_secondaries.size()), late_secondaries.data());
 			}
+			vkCmdEndRenderPass(workspace.command_buffer);
+		}
+
+		if (candidate_count > 0) {//copy the camera's draw counts back for cull_stats:
+			std::array< VkBufferCopy, 2 > regions{
+				VkBufferCopy{ .srcOffset = 0, .dstOffset = 0, .size = 4 * sizeof(uint32_t) }, //camera buckets
+				VkBufferCopy{ .srcOffset = late_bucket * sizeof(uint32_t), .dstOffset = 4 * sizeof(uint32_t), .size = (4 + 2) * sizeof(uint32_t) }, //late buckets, late list length, occluded count
+			};
+			vkCmdCopyBuffer(workspace.command_buffer, workspace.DrawCounts.handle, workspace.CullStats.handle, uint32_t(regions.size()), regions.data());
 
+			VkMemoryBarrier memory_barrier{
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+			};
+			vkCmdPipelineBarrier( workspace.command_buffer,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, //srcStageMask
+				VK_PIPELINE_STAGE_HOST_BIT, //dstStageMask
+				0, //dependencyFlags
+				1, &memory_barrier, //memoryBarriers (count, data)
+				0, nullptr, //bufferMemoryBarriers (count, data)
+				0, nullptr //imageMemoryBarriers (count, data)
+			);
+			workspace.CullStats_instances = instance_count;
 		}
-	
-		vkCmdEndRenderPass(workspace.command_buffer);
 	}
 
 	if (scene.has_cloud){// cloud rendering
@@ -2405,6 +3446,9 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 			.layerCount = 1,
 		};
 		{ // cloud light grid
+			uint32_t lightgrid_pass = timer.pass("cloud light grid");
+			timer.begin(workspace.command_buffer, lightgrid_pass);
+
 			vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloud_lightgrid_pipeline.handle);
 
 			{// transfer target image to desired format: VK_IMAGE_LAYOUT_GENERAL
@@ -2459,6 +3503,7 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 				groups_y,
 				workspace.Cloud_lightgrid.extent.depth
 			);
+			timer.end(workspace.command_buffer, lightgrid_pass);
 		}
 
 		{// transfer depth image to desired format
@@ -2596,6 +3641,9 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 
 		
 
+		uint32_t march_pass = timer.pass("cloud march");
+		timer.begin(workspace.command_buffer, march_pass);
+
 		vkCmdBindPipeline(workspace.command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cloud_pipeline.handle);
 
 		vkCmdBindDescriptorSets(
@@ -2617,6 +3665,7 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 			groups_y,
 			1
 		);
+		timer.end(workspace.command_buffer, march_pass);
 
 		{ // transfer to swapchain
 			VkExtent3D image_extent = { workspace.Cloud_target.extent.width, workspace.Cloud_target.extent.height, 1 };
@@ -2770,6 +3819,55 @@ void RTGRenderer::render(RTG &rtg_, RTG::RenderParams const &render_params) {
 }
 
 
+std::vector< VkCommandBuffer > RTGRenderer::record_secondaries(Workspace &workspace, VkRenderPass render_pass_, VkFramebuffer framebuffer, std::vector< RecordTask > const &tasks) {
+	std::vector< VkCommandBuffer > secondaries(tasks.size(), VK_NULL_HANDLE);
+
+	//each recorder takes a contiguous run of tasks, so its command pool is only ever touched by one thread:
+	uint32_t chunks = std::min(uint32_t(workspace.recorders.size()), uint32_t(tasks.size()));
+	for (uint32_t chunk = 0; chunk < chunks; ++chunk) {
+		frame_threads.run([&, chunk]() {
+			Workspace::Recorder &recorder = workspace.recorders[chunk];
+			size_t begin = tasks.size() * chunk / chunks;
+			size_t end = tasks.size() * (chunk + 1) / chunks;
+			for (size_t t = begin; t < end; ++t) {
+				if (recorder.used == recorder.secondaries.size()) { //out of secondaries, allocate another:
+					VkCommandBufferAllocateInfo alloc_info{
+						.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+						.commandPool = recorder.command_pool,
+						.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+						.commandBufferCount = 1,
+					};
+					recorder.secondaries.emplace_back(VK_NULL_HANDLE);
+					VK(vkAllocateCommandBuffers(rtg.device, &alloc_info, &recorder.secondaries.back()));
+				}
+				VkCommandBuffer cb = recorder.secondaries[recorder.used];
+				recorder.used += 1;
+
+				VkCommandBufferInheritanceInfo inheritance_info{
+					.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+					.renderPass = render_pass_,
+					.subpass = 0,
+					.framebuffer = framebuffer,
+				};
+				VkCommandBufferBeginInfo begin_info{
+					.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+					.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, //records again every submit, entirely inside the render pass
+					.pInheritanceInfo = &inheritance_info,
+				};
+				VK(vkBeginCommandBuffer(cb, &begin_info));
+				tasks[t](cb);
+				VK(vkEndCommandBuffer(cb));
+
+				secondaries[t] = cb;
+			}
+		});
+	}
+	frame_threads.wait();
+
+	return secondaries;
+}
+
+
 void RTGRenderer::update(float dt) {
 	time = std::fmod(time + dt, 60.0f);
 
@@ -2855,15 +3953,11 @@ void RTGRenderer::update(float dt) {
 		glm::vec4(1.0f, -1.0f, 1.0f, 1.0f),   // Far bottom right
 		glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f)   // Far bottom left
 	};
-	std::vector<std::array<glm::vec3, 8>> light_frustums;
-
 	{// get light frustums for shadow atlas
 		spot_light_from_world.clear();
-		light_frustums.resize(scene.spot_lights_sorted_indices.size());
 		for (uint32_t i = 0; i < scene.spot_lights_sorted_indices.size(); ++i) {
 			Scene::Light& cur_light = scene.lights[scene.spot_lights_sorted_indices[i].lights_index];
 			assert(cur_light.light_type == Scene::Light::LightType::Spot); // only support spot for now
-			total_shadow_size += cur_light.shadow * cur_light.shadow;
 			glm::mat4x4 cur_light_transform = scene.nodes[scene.spot_lights_sorted_indices[i].local_to_world[0]].transform.parent_from_local();
 			for (int j = 1; j < scene.spot_lights_sorted_indices[i].local_to_world.size(); ++j) {
 				cur_light_transform *= scene.nodes[scene.spot_lights_sorted_indices[i].local_to_world[j]].transform.parent_from_local();
@@ -2900,15 +3994,6 @@ void RTGRenderer::update(float dt) {
 					up.x, up.y, up.z //up
 				).data());
 				spot_light_from_world.emplace_back(projection * view);
-
-
-				glm::mat4x4 world_from_clip = glm::inverse(spot_light_from_world.back());
-				// Transform clip space to world space and apply perspective divide
-				for (int j = 0; j < 8; ++j) {
-					glm::vec4 world_space_vertex = world_from_clip * clip_space_coordinates[j];
-					light_frustums[i][j] = glm::vec3(world_space_vertex) / world_space_vertex.w;
-				}
-
 			}
 		}
 	}
@@ -2916,23 +4001,16 @@ void RTGRenderer::update(float dt) {
 	lines_vertices.clear();
 	std::array<glm::vec3, 8> frustum_vertices;
 
-	if (rtg.configuration.culling_settings == 1) { // frustum culling is on
-		glm::mat4x4 world_from_clip = glm::inverse(culling_camera == SceneCamera ? clip_from_view[0] * view_from_world[0] : clip_from_view[1]* view_from_world[1]);
-		// Transform clip space to world space and apply perspective divide
-		for (int j = 0; j < 8; ++j) {
-			glm::vec4 world_space_vertex = world_from_clip * clip_space_coordinates[j];
-			frustum_vertices[j] = glm::vec3(world_space_vertex) / world_space_vertex.w;
-		}
-	}
+	// frustum the cull pass tests instances against (ignored by the pass when culling is off)
+	CULL_CLIP_FROM_WORLD = culling_camera == SceneCamera ? clip_from_view[0] * view_from_world[0] : clip_from_view[1]* view_from_world[1];
+
 	{// render last active frustum if in debug mode
 		if (view_camera == DebugCamera) {
-			if (rtg.configuration.culling_settings != 1) {
-				glm::mat4x4 world_from_clip = glm::inverse(culling_camera == SceneCamera ? clip_from_view[0] * view_from_world[0] : clip_from_view[1]* view_from_world[1]);
-				// Transform clip space to world space and apply perspective divide
-				for (int j = 0; j < 8; ++j) {
-					glm::vec4 world_space_vertex = world_from_clip * clip_space_coordinates[j];
-					frustum_vertices[j] = glm::vec3(world_space_vertex) / world_space_vertex.w;
-				}
+			glm::mat4x4 world_from_clip = glm::inverse(CULL_CLIP_FROM_WORLD);
+			// Transform clip space to world space and apply perspective divide
+			for (int j = 0; j < 8; ++j) {
+				glm::vec4 world_space_vertex = world_from_clip * clip_space_coordinates[j];
+				frustum_vertices[j] = glm::vec3(world_space_vertex) / world_space_vertex.w;
 			}
 
 			lines_vertices.emplace_back(PosColVertex{
@@ -3034,311 +4112,606 @@ void RTGRenderer::update(float dt) {
 		}
 	}
 
-	{ //fill object instances with scene hiearchy, optionally draw debug lines when on debug camera, fill light information
-		for (uint32_t i = 0; i < in_view_instances.size(); ++i) {
-			in_view_instances[i].clear();
-		}
-		in_spot_light_instances.resize(scene.spot_lights_sorted_indices.size());
-		for (uint32_t i = 0; i < in_spot_light_instances.size(); ++i) {
-			for (uint32_t j = 0; j < in_spot_light_instances[0].size(); ++j) {
-				in_spot_light_instances[i][j].clear();
-			}
-		}
-		lambertian_instances.clear();
-		environment_instances.clear();
-		mirror_instances.clear();
-		pbr_instances.clear();
+	{ //fill object instances from the flattened scene hierarchy, optionally draw debug lines when on debug camera, fill light information
 		//clear lights
 		sun_lights.clear();
+		sun_shadow_sizes.clear();
 		sphere_lights.clear();
+		sphere_shadows.clear();
 		spot_lights.clear();
-		spot_light_from_world.clear();
-		// culling resources
-		glm::mat4x4 frustum_view_from_world = culling_camera == SceneCamera ? view_from_world[0] : view_from_world[1];
 
-		std::deque<glm::mat4x4> transform_stack;
-		std::function<void(uint32_t)> collect_node_information = [&](uint32_t i) {
-			Scene::Node& cur_node = scene.nodes[i];
-			glm::mat4x4 cur_node_transform_in_parent = cur_node.transform.parent_from_local();
-			if (transform_stack.empty()) {
-				transform_stack.push_back(cur_node_transform_in_parent);
+		++update_serial;
+
+		Scene::Hierarchy &hierarchy = scene.hierarchy;
+
+		//world transforms one depth at a time; entries of a depth only read their parents, finished in the previous depth.
+		// only entries whose node or some ancestor moved are recomputed:
+		for (uint32_t level = 0; level + 1 < hierarchy.level_first.size(); ++level) {
+			uint32_t first = hierarchy.level_first[level];
+			uint32_t count = hierarchy.level_first[level + 1] - first;
+			frame_threads.parallel_for(count, HIERARCHY_CHUNK, [&](uint32_t, uint32_t begin, uint32_t end) {
+				for (uint32_t entry = first + begin; entry < first + end; ++entry) {
+					int32_t parent = hierarchy.parent[entry];
+					hierarchy.dirty[entry] = scene.nodes[hierarchy.node[entry]].dirty || (parent != -1 && hierarchy.dirty[parent]);
+					if (!hierarchy.dirty[entry]) continue;
+
+					hierarchy.parent_from_local[entry] = scene.nodes[hierarchy.node[entry]].transform.parent_from_local();
+					if (parent != -1) {
+						hierarchy.world_from_local[entry] = hierarchy.world_from_local[parent] * hierarchy.parent_from_local[entry];
+					}
+					else {
+						hierarchy.world_from_local[entry] = hierarchy.parent_from_local[entry];
+					}
+				}
+			});
+		}
+		//every world matrix depending on a node's transform is current now:
+		for (Scene::Node &node : scene.nodes) {
+			node.dirty = false;
+		}
+
+		// gather light information, in the order lights were numbered in while loading:
+		for (uint32_t entry : hierarchy.light_entries) {
+			glm::mat4x4 const &WORLD_FROM_LOCAL = hierarchy.world_from_local[entry];
+			uint32_t cur_light_index = scene.nodes[hierarchy.node[entry]].light_index;
+			Scene::Light& cur_light = scene.lights[cur_light_index];
+			
+			glm::vec3 tint = cur_light.tint;
+			if (cur_light.light_type == Scene::Light::Sun) {
+
+				glm::vec3 light_direction = glm::mat3x3(WORLD_FROM_LOCAL) * glm::vec3(0.0f,0.0f,1.0f);
+				Scene::Light::ParamSun sun_param = std::get<Scene::Light::ParamSun>(cur_light.additional_params);
+				sun_lights.emplace_back(LambertianPipeline::SunLight{
+					.DIRECTION = light_direction,
+					.ENERGY = sun_param.strength * tint / float(M_PI),
+					.SIN_ANGLE = sin(sun_param.angle/2.0f)
+				});
+				sun_shadow_sizes.emplace_back(rtg.configuration.sun_cascade_size != 0 ? rtg.configuration.sun_cascade_size : cur_light.shadow);
 			}
-			else {
-				glm::mat4x4 parent_node_transform_in_world = transform_stack.back();
-				transform_stack.push_back(parent_node_transform_in_world * cur_node_transform_in_parent);
+			else if (cur_light.light_type == Scene::Light::Sphere) {
+
+				glm::vec3 light_position = WORLD_FROM_LOCAL * glm::vec4(0.0f,0.0f,0.0f,1.0f);
+				Scene::Light::ParamSphere sphere_param = std::get<Scene::Light::ParamSphere>(cur_light.additional_params);
+				sphere_lights.emplace_back(LambertianPipeline::SphereLight{
+					.POSITION = glm::vec4(light_position, 0.0f),
+					.RADIUS = sphere_param.radius,
+					.ENERGY = sphere_param.power * tint / float(M_PI),
+					.LIMIT = sphere_param.limit,
+				});
+
+				if (cur_light.shadow > 0) { //one 90 degree perspective shadow per cube face:
+					float far;
+					if (sphere_param.limit == 0.0f) {
+						far = std::sqrt(glm::length(sphere_param.power * cur_light.tint) / (float(M_PI) * 4.0f * 0.001f));
+					}
+					else {
+						far = sphere_param.limit;
+					}
+					glm::mat4 projection = glm::make_mat4(perspective(0.5f * float(M_PI), 1.0f, 0.02f, far).data());
+
+					static const std::array< glm::vec3, 6 > face_forward{
+						glm::vec3( 1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+						glm::vec3( 0.0f, 1.0f, 0.0f), glm::vec3( 0.0f,-1.0f, 0.0f),
+						glm::vec3( 0.0f, 0.0f, 1.0f), glm::vec3( 0.0f, 0.0f,-1.0f),
+					};
+					SphereShadow shadow{
+						.sphere = uint32_t(sphere_lights.size()) - 1,
+						.size = cur_light.shadow,
+					};
+					for (uint32_t face = 0; face < 6; ++face) {
+						glm::vec3 target = light_position + face_forward[face];
+						glm::vec3 up = face < 4 ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+						glm::mat4 view = glm::make_mat4(look_at(
+							light_position.x, light_position.y, light_position.z, //eye
+							target.x, target.y, target.z, //target
+							up.x, up.y, up.z //up
+						).data());
+						shadow.LIGHT_FROM_WORLD[face] = projection * view;
+					}
+					sphere_shadows.emplace_back(shadow);
+				}
 			}
-			// gather light information
-			if (uint32_t cur_light_index = cur_node.light_index; cur_light_index != -1) {
-				glm::mat4x4 WORLD_FROM_LOCAL = transform_stack.back();
-				Scene::Light& cur_light = scene.lights[cur_light_index];
+			else if (cur_light.light_type == Scene::Light::Spot) {
+
+				glm::vec3 light_position = WORLD_FROM_LOCAL * glm::vec4(0.0f,0.0f,0.0f,1.0f);
+				glm::vec3 light_direction = glm::mat3x3(WORLD_FROM_LOCAL) * glm::vec3(0.0f,0.0f,1.0f);
+				Scene::Light::ParamSpot spot_param = std::get<Scene::Light::ParamSpot>(cur_light.additional_params);
 				
-				glm::vec3 tint = cur_light.tint;
-				if (cur_light.light_type == Scene::Light::Sun) {
-
-					glm::vec3 light_direction = glm::mat3x3(WORLD_FROM_LOCAL) * glm::vec3(0.0f,0.0f,1.0f);
-					Scene::Light::ParamSun sun_param = std::get<Scene::Light::ParamSun>(cur_light.additional_params);
-					sun_lights.emplace_back(LambertianPipeline::SunLight{
-						.DIRECTION = glm::vec4(light_direction, 0.0f),
-						.ENERGY = sun_param.strength * tint / float(M_PI),
-						.SIN_ANGLE = sin(sun_param.angle/2.0f)
+				float outer_angle = spot_param.fov / 2.0f;
+				float inner_angle = (1.0f - spot_param.blend) * outer_angle;
+				spot_lights.emplace_back(LambertianPipeline::SpotLight{
+					.POSITION = glm::vec4(light_position, 0.0f),
+					.shadow_size = cur_light.shadow,
+					.DIRECTION = light_direction,
+					.RADIUS = spot_param.radius,
+					.ENERGY = spot_param.power * tint / float(M_PI),
+					.LIMIT = spot_param.limit,
+					.CONE_ANGLES = glm::vec4(inner_angle, outer_angle, 0.0f, 0.0f),
+				});
+			}
+		}
+
+		//same order the transforms are uploaded in:
+		std::array< std::vector< ObjectInstance > *, 4 > instance_lists{
+			&lambertian_instances, &environment_instances, &mirror_instances, &pbr_instances
+		};
+
+		//instance lists are only rebuilt when the set of meshes changes, otherwise moved instances are patched in place:
+		bool rebuild_instances = instance_slots.size() != hierarchy.mesh_entries.size();
+		if (rebuild_instances) {
+			for (std::vector< ObjectInstance > *instances : instance_lists) {
+				instances->clear();
+			}
+			instance_slots.assign(hierarchy.mesh_entries.size(), InstanceSlot{});
+		}
+		std::array< uint32_t, 4 > pipeline_first{}; //first transform of each pipeline's instances
+		for (uint32_t pipeline = 1; pipeline < instance_lists.size(); ++pipeline) {
+			pipeline_first[pipeline] = pipeline_first[pipeline - 1] + uint32_t(instance_lists[pipeline - 1]->size());
+		}
+
+		//walk mesh entries in parallel, each chunk into its own output; appending the outputs in chunk order keeps the instance order stable:
+		instance_chunks.resize(frame_threads.size());
+		for (InstanceChunk &chunk : instance_chunks) {
+			for (std::vector< ObjectInstance > &instances : chunk.instances) {
+				instances.clear();
+			}
+			chunk.lines.clear();
+			chunk.begin = chunk.end = 0;
+		}
+		frame_threads.parallel_for(uint32_t(hierarchy.mesh_entries.size()), HIERARCHY_CHUNK, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+			InstanceChunk &out = instance_chunks[chunk];
+			out.begin = begin;
+			out.end = end;
+			for (uint32_t i = begin; i < end; ++i) {
+				uint32_t entry = hierarchy.mesh_entries[i];
+				int32_t cur_mesh_index = scene.nodes[hierarchy.node[entry]].mesh_index;
+				glm::mat4x4 const &WORLD_FROM_LOCAL = hierarchy.world_from_local[entry];
+
+				if (view_camera == DebugCamera) {//debug draw the OBBs
+					OBB obb = AABB_transform_to_OBB(WORLD_FROM_LOCAL, mesh_AABBs[cur_mesh_index]);
+					std::array<glm::vec3,8> vertices = {
+						obb.center + obb.extents[0] * obb.axes[0] + obb.extents[1]*obb.axes[1] + obb.extents[2]*obb.axes[2],
+						obb.center + obb.extents[0] * obb.axes[0] + obb.extents[1]*obb.axes[1] - obb.extents[2]*obb.axes[2],
+						obb.center + obb.extents[0] * obb.axes[0] - obb.extents[1]*obb.axes[1] + obb.extents[2]*obb.axes[2],
+						obb.center + obb.extents[0] * obb.axes[0] - obb.extents[1]*obb.axes[1] - obb.extents[2]*obb.axes[2],
+						obb.center - obb.extents[0] * obb.axes[0] + obb.extents[1]*obb.axes[1] + obb.extents[2]*obb.axes[2],
+						obb.center - obb.extents[0] * obb.axes[0] + obb.extents[1]*obb.axes[1] - obb.extents[2]*obb.axes[2],
+						obb.center - obb.extents[0] * obb.axes[0] - obb.extents[1]*obb.axes[1] + obb.extents[2]*obb.axes[2],
+						obb.center - obb.extents[0] * obb.axes[0] - obb.extents[1]*obb.axes[1] - obb.extents[2]*obb.axes[2]
+					};
+
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[0].x, .y = vertices[0].y, .z = vertices[0].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 					});
-				}
-				else if (cur_light.light_type == Scene::Light::Sphere) {
-
-					glm::vec3 light_position = WORLD_FROM_LOCAL * glm::vec4(0.0f,0.0f,0.0f,1.0f);
-					Scene::Light::ParamSphere sphere_param = std::get<Scene::Light::ParamSphere>(cur_light.additional_params);
-					sphere_lights.emplace_back(LambertianPipeline::SphereLight{
-						.POSITION = glm::vec4(light_position, 0.0f),
-						.RADIUS = sphere_param.radius,
-						.ENERGY = sphere_param.power * tint / float(M_PI),
-						.LIMIT = sphere_param.limit,
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[1].x, .y = vertices[1].y, .z = vertices[1].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 					});
-				}
-				else if (cur_light.light_type == Scene::Light::Spot) {
-
-					glm::vec3 light_position = WORLD_FROM_LOCAL * glm::vec4(0.0f,0.0f,0.0f,1.0f);
-					glm::vec3 light_direction = glm::mat3x3(WORLD_FROM_LOCAL) * glm::vec3(0.0f,0.0f,1.0f);
-					Scene::Light::ParamSpot spot_param = std::get<Scene::Light::ParamSpot>(cur_light.additional_params);
-					
-					float outer_angle = spot_param.fov / 2.0f;
-					float inner_angle = (1.0f - spot_param.blend) * outer_angle;
-					spot_lights.emplace_back(LambertianPipeline::SpotLight{
-						.POSITION = glm::vec4(light_position, 0.0f),
-						.shadow_size = cur_light.shadow,
-						.DIRECTION = light_direction,
-						.RADIUS = spot_param.radius,
-						.ENERGY = spot_param.power * tint / float(M_PI),
-						.LIMIT = spot_param.limit,
-						.CONE_ANGLES = glm::vec4(inner_angle, outer_angle, 0.0f, 0.0f),
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[0].x, .y = vertices[0].y, .z = vertices[0].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[2].x, .y = vertices[2].y, .z = vertices[2].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[2].x, .y = vertices[2].y, .z = vertices[2].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[3].x, .y = vertices[3].y, .z = vertices[3].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[3].x, .y = vertices[3].y, .z = vertices[3].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[1].x, .y = vertices[1].y, .z = vertices[1].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[0].x, .y = vertices[0].y, .z = vertices[0].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
 					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[4].x, .y = vertices[4].y, .z = vertices[4].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[4].x, .y = vertices[4].y, .z = vertices[4].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[6].x, .y = vertices[6].y, .z = vertices[6].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[2].x, .y = vertices[2].y, .z = vertices[2].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[6].x, .y = vertices[6].y, .z = vertices[6].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[4].x, .y = vertices[4].y, .z = vertices[4].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[5].x, .y = vertices[5].y, .z = vertices[5].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[6].x, .y = vertices[6].y, .z = vertices[6].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[7].x, .y = vertices[7].y, .z = vertices[7].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[1].x, .y = vertices[1].y, .z = vertices[1].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[5].x, .y = vertices[5].y, .z = vertices[5].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[3].x, .y = vertices[3].y, .z = vertices[3].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[7].x, .y = vertices[7].y, .z = vertices[7].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[5].x, .y = vertices[5].y, .z = vertices[5].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+					out.lines.emplace_back(PosColVertex{
+						.Position{.x = vertices[7].x, .y = vertices[7].y, .z = vertices[7].z},
+						.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
+					});
+				}
+
+				if (!rebuild_instances && !hierarchy.dirty[entry]) continue;
+
+				Transform transform{
+					.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
+					.WORLD_FROM_LOCAL_NORMAL = glm::mat4x4(glm::inverse(glm::transpose(glm::mat3(WORLD_FROM_LOCAL)))),
+				};
+
+				if (!rebuild_instances) { //patch the moved instance, and mark its transform for upload:
+					InstanceSlot const &slot = instance_slots[i];
+					(*instance_lists[slot.pipeline])[slot.index].transform = transform;
+					transform_serials[pipeline_first[slot.pipeline] + slot.index] = update_serial;
+					continue;
+				}
+
+				//instances go to the list of their material's pipeline, in the same order as MaterialType:
+				uint32_t pipeline = static_cast<uint32_t>(Scene::Material::Lambertian);
+				uint32_t cur_material_index = scene.meshes[cur_mesh_index].material_index;
+				if (cur_material_index != uint32_t(-1)) { /// has some material
+					pipeline = static_cast<uint32_t>(scene.materials[cur_material_index].material_type);
+				}
+				else {
+					// use lambertian pipeline to render the default albedo, displacement and normal maps
+					cur_material_index = 0; //default material
 				}
+				instance_slots[i] = InstanceSlot{
+					.pipeline = pipeline,
+					.index = uint32_t(out.instances[pipeline].size()), //within this chunk for now, offset once chunks are appended
+				};
+				out.instances[pipeline].emplace_back(ObjectInstance{
+					.vertices = mesh_vertices[cur_mesh_index],
+					.transform = transform,
+					.material_index = cur_material_index,
+					.mesh_index = uint32_t(cur_mesh_index),
+				});
 			}
+		});
 
-			for (uint32_t child_index : cur_node.children) {
-				collect_node_information(child_index);
-			}
-			// draw own mesh
-			if (int32_t cur_mesh_index = cur_node.mesh_index; cur_mesh_index != -1) {
-				glm::mat4x4 WORLD_FROM_LOCAL = transform_stack.back();
-				glm::mat4x4 WORLD_FROM_LOCAL_NORMAL = glm::mat4x4(glm::inverse(glm::transpose(glm::mat3(WORLD_FROM_LOCAL))));
-				OBB obb = AABB_transform_to_OBB(WORLD_FROM_LOCAL, mesh_AABBs[cur_mesh_index]);
-				{//draw debug obb and frustum
-					
-					if (view_camera == DebugCamera) {//debug draw the OBBs
-						std::array<glm::vec3,8> vertices = {
-							obb.center + obb.extents[0] * obb.axes[0] + obb.extents[1]*obb.axes[1] + obb.extents[2]*obb.axes[2],
-							obb.center + obb.extents[0] * obb.axes[0] + obb.extents[1]*obb.axes[1] - obb.extents[2]*obb.axes[2],
-							obb.center + obb.extents[0] * obb.axes[0] - obb.extents[1]*obb.axes[1] + obb.extents[2]*obb.axes[2],
-							obb.center + obb.extents[0] * obb.axes[0] - obb.extents[1]*obb.axes[1] - obb.extents[2]*obb.axes[2],
-							obb.center - obb.extents[0] * obb.axes[0] + obb.extents[1]*obb.axes[1] + obb.extents[2]*obb.axes[2],
-							obb.center - obb.extents[0] * obb.axes[0] + obb.extents[1]*obb.axes[1] - obb.extents[2]*obb.axes[2],
-							obb.center - obb.extents[0] * obb.axes[0] - obb.extents[1]*obb.axes[1] + obb.extents[2]*obb.axes[2],
-							obb.center - obb.extents[0] * obb.axes[0] - obb.extents[1]*obb.axes[1] - obb.extents[2]*obb.axes[2]
-						};
+		for (InstanceChunk const &chunk : instance_chunks) {
+			lines_vertices.insert(lines_vertices.end(), chunk.lines.begin(), chunk.lines.end());
+		}
 
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[0].x, .y = vertices[0].y, .z = vertices[0].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[1].x, .y = vertices[1].y, .z = vertices[1].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[0].x, .y = vertices[0].y, .z = vertices[0].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[2].x, .y = vertices[2].y, .z = vertices[2].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[2].x, .y = vertices[2].y, .z = vertices[2].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[3].x, .y = vertices[3].y, .z = vertices[3].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[3].x, .y = vertices[3].y, .z = vertices[3].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[1].x, .y = vertices[1].y, .z = vertices[1].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[0].x, .y = vertices[0].y, .z = vertices[0].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[4].x, .y = vertices[4].y, .z = vertices[4].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[4].x, .y = vertices[4].y, .z = vertices[4].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[6].x, .y = vertices[6].y, .z = vertices[6].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[2].x, .y = vertices[2].y, .z = vertices[2].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[6].x, .y = vertices[6].y, .z = vertices[6].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[4].x, .y = vertices[4].y, .z = vertices[4].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[5].x, .y = vertices[5].y, .z = vertices[5].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[6].x, .y = vertices[6].y, .z = vertices[6].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[7].x, .y = vertices[7].y, .z = vertices[7].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[1].x, .y = vertices[1].y, .z = vertices[1].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[5].x, .y = vertices[5].y, .z = vertices[5].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[3].x, .y = vertices[3].y, .z = vertices[3].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[7].x, .y = vertices[7].y, .z = vertices[7].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[5].x, .y = vertices[5].y, .z = vertices[5].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-						lines_vertices.emplace_back(PosColVertex{
-							.Position{.x = vertices[7].x, .y = vertices[7].y, .z = vertices[7].z},
-							.Color{ .r = 0xff, .g = 0x00, .b = 0x00, .a = 0xff},
-						});
-					}
-					
+		if (rebuild_instances) {
+			for (InstanceChunk const &chunk : instance_chunks) {
+				std::array< uint32_t, 4 > chunk_first{};
+				for (uint32_t pipeline = 0; pipeline < instance_lists.size(); ++pipeline) {
+					chunk_first[pipeline] = uint32_t(instance_lists[pipeline]->size());
+					instance_lists[pipeline]->insert(instance_lists[pipeline]->end(), chunk.instances[pipeline].begin(), chunk.instances[pipeline].end());
+				}
+				for (uint32_t i = chunk.begin; i < chunk.end; ++i) {
+					instance_slots[i].index += chunk_first[instance_slots[i].pipeline];
 				}
+			}
 
-				if (uint32_t cur_material_index = scene.meshes[cur_mesh_index].material_index; cur_material_index != -1) { /// has some material
-					const Scene::Material& cur_material = scene.materials[scene.meshes[cur_mesh_index].material_index];
-					uint32_t instance_index = 0;
-					if (cur_material.material_type == Scene::Material::MaterialType::Lambertian) {
-						instance_index = uint32_t(lambertian_instances.size());
-						lambertian_instances.emplace_back(ObjectInstance{
-							.vertices = mesh_vertices[cur_mesh_index],
-							.transform{
-								.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-							},
-							.material_index = cur_material_index,
-						});
-					}
-					else if (cur_material.material_type == Scene::Material::MaterialType::Environment) {
-						instance_index = uint32_t(environment_instances.size());
-						environment_instances.emplace_back(ObjectInstance{
-							.vertices = mesh_vertices[cur_mesh_index],
-							.transform{
-								.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-							},
-							.material_index = cur_material_index,
-						});
-					}
-					else if (cur_material.material_type == Scene::Material::MaterialType::Mirror) {
-						instance_index = uint32_t(mirror_instances.size());
-						mirror_instances.emplace_back(ObjectInstance{
-							.vertices = mesh_vertices[cur_mesh_index],
-							.transform{
-								.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-							},
-							.material_index = cur_material_index,
-						});
-					}
-					else if (cur_material.material_type == Scene::Material::MaterialType::PBR) {
-						instance_index = uint32_t(pbr_instances.size());
-						pbr_instances.emplace_back(ObjectInstance{
-							.vertices = mesh_vertices[cur_mesh_index],
-							.transform{
-								.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-								.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-							},
-							.material_index = cur_material_index,
-						});
-					}
-					if (rtg.configuration.culling_settings == 1 && check_frustum_obb_intersection(frustum_vertices, obb)) {
-						in_view_instances[static_cast<uint32_t>(cur_material.material_type)].push_back(instance_index);
+			instances_serial = update_serial;
+			transform_serials.assign(lambertian_instances.size() + environment_instances.size() + mirror_instances.size() + pbr_instances.size(), update_serial);
+		}
+	}
+
+	if (instances_serial == update_serial) { //instance lists were rebuilt; give each pipeline a draw bucket and describe every instance to the cull pass:
+		cull_instances.clear();
+		camera_draw_commands = 0;
+
+		//same order the transforms are uploaded in:
+		std::array< std::vector< ObjectInstance > const *, 4 > instance_lists{
+			&lambertian_instances, &environment_instances, &mirror_instances, &pbr_instances
+		};
+		for (uint32_t pipeline = 0; pipeline < instance_lists.size(); ++pipeline) {
+			DrawBucket &bucket = draw_buckets[pipeline];
+			bucket.first = camera_draw_commands;
+			bucket.capacity = uint32_t(instance_lists[pipeline]->size());
+			camera_draw_commands += bucket.capacity;
+
+			for (ObjectInstance const &inst : *instance_lists[pipeline]) {
+				AABB const &aabb = mesh_AABBs[inst.mesh_index];
+				cull_instances.emplace_back(CullPipeline::Instance{
+					.AABB_MIN = aabb.min,
+					.BUCKET = pipeline,
+					.AABB_MAX = aabb.max,
+					.BUCKET_FIRST = bucket.first,
+					.INDEX_COUNT = inst.vertices.count,
+					.FIRST_INDEX = inst.vertices.first,
+					.VERTEX_OFFSET = inst.vertices.vertex_offset,
+					.MATERIAL = inst.material_index,
+				});
+			}
+		}
+	}
+
+	{ //keep world-space bounds of every instance in a BVH, and pre-cull it against the camera and every shadow view in one traversal:
+		//same order the transforms are uploaded in:
+		std::array< std::vector< ObjectInstance > const *, 4 > instance_lists{
+			&lambertian_instances, &environment_instances, &mirror_instances, &pbr_instances
+		};
+		if (instances_serial == update_serial) {
+			std::vector< OBBHalfAxes > boxes;
+			boxes.reserve(cull_instances.size());
+			for (std::vector< ObjectInstance > const *instances : instance_lists) {
+				for (ObjectInstance const &inst : *instances) {
+					boxes.emplace_back(AABB_transform_to_half_axes(inst.transform.WORLD_FROM_LOCAL, mesh_AABBs[inst.mesh_index]));
+				}
+			}
+			instance_bvh.build(boxes);
+		}
+		else { //refit around the instances that moved this update:
+			uint32_t index = 0;
+			for (std::vector< ObjectInstance > const *instances : instance_lists) {
+				for (ObjectInstance const &inst : *instances) {
+					if (transform_serials[index] == update_serial) {
+						instance_bvh.update(index, AABB_transform_to_half_axes(inst.transform.WORLD_FROM_LOCAL, mesh_AABBs[inst.mesh_index]));
 					}
-					for (uint32_t frustum_i = 0; frustum_i < in_spot_light_instances.size(); ++frustum_i) {
-						if (check_frustum_obb_intersection(light_frustums[frustum_i], obb)) {
-							in_spot_light_instances[frustum_i][static_cast<uint32_t>(cur_material.material_type)].push_back(instance_index);
-						}
+					++index;
+				}
+			}
+			instance_bvh.refit();
+			if (instance_bvh.degraded()) {
+				instance_bvh.rebuild();
+			}
+		}
+
+		{ //cascaded shadows for suns: split the view camera's frustum along its depth and fit each slice a square the sun looks down on
+			sun_cascades.clear();
+			uint32_t cascade_count = std::min(rtg.configuration.sun_cascades, max_sun_cascades);
+
+			glm::mat4x4 const &projection = clip_from_view[view_camera];
+			float near = projection[3][2] / projection[2][2];
+			float far = projection[2][2] == -1.0f ? std::numeric_limits< float >::infinity() : projection[3][2] / (projection[2][2] + 1.0f);
+			float distance = std::min(far, near + rtg.configuration.sun_shadow_distance);
+			float tan_x = 1.0f / projection[0][0];
+			float tan_y = 1.0f / std::abs(projection[1][1]);
+			glm::mat4x4 world_from_view = glm::inverse(view_from_world[view_camera]);
+
+			//practical split scheme: a blend of logarithmic splits (even texel density) and uniform splits (not all spent up close):
+			constexpr float Lambda = 0.75f;
+			std::array< float, max_sun_cascades + 1 > splits;
+			splits[0] = near;
+			for (uint32_t c = 1; c <= cascade_count; ++c) {
+				float t = float(c) / float(cascade_count);
+				splits[c] = Lambda * near * std::pow(distance / near, t) + (1.0f - Lambda) * (near + (distance - near) * t);
+			}
+
+			AABB scene_bounds = instance_bvh.nodes.empty() ? AABB{} : instance_bvh.nodes[0].bounds;
+
+			for (uint32_t sun = 0; sun < sun_lights.size(); ++sun) {
+				if (sun_shadow_sizes[sun] == 0 || cascade_count == 0) continue;
+				sun_lights[sun].CASCADE_COUNT = cascade_count; //(lowered in render() if the atlas drops far cascades)
+
+				//light space turns with the sun only, so camera motion just slides the squares across it:
+				glm::vec3 forward = -glm::normalize(sun_lights[sun].DIRECTION);
+				glm::vec3 world_up = std::abs(forward.z) > 0.999f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+				glm::mat4x4 light_from_world = glm::make_mat4(look_at(
+					0.0f, 0.0f, 0.0f, //eye
+					forward.x, forward.y, forward.z, //target
+					world_up.x, world_up.y, world_up.z //up
+				).data());
+
+				//casters between the sun and a slice may be anywhere in the scene, so the near plane reaches back to the scene's bounds:
+				float scene_top = -std::numeric_limits< float >::infinity();
+				if (scene_bounds.min.x <= scene_bounds.max.x) {
+					for (uint32_t k = 0; k < 8; ++k) {
+						glm::vec3 corner(
+							(k & 1) ? scene_bounds.max.x : scene_bounds.min.x,
+							(k & 2) ? scene_bounds.max.y : scene_bounds.min.y,
+							(k & 4) ? scene_bounds.max.z : scene_bounds.min.z
+						);
+						scene_top = std::max(scene_top, (light_from_world * glm::vec4(corner, 1.0f)).z);
 					}
 				}
-				else {
-					if (rtg.configuration.culling_settings == 1 && check_frustum_obb_intersection(frustum_vertices, obb)) {
-						in_view_instances[0].push_back(uint32_t(lambertian_instances.size()));
+
+				for (uint32_t c = 0; c < cascade_count; ++c) {
+					//bounding sphere of the slice; it doesn't change as the camera turns, so neither does the square's size:
+					std::array< glm::vec3, 8 > corners;
+					glm::vec3 center = glm::vec3(0.0f);
+					for (uint32_t k = 0; k < 8; ++k) {
+						float depth = splits[c + (k >> 2)];
+						corners[k] = glm::vec3(world_from_view * glm::vec4(
+							((k & 1) ? tan_x : -tan_x) * depth,
+							((k & 2) ? tan_y : -tan_y) * depth,
+							-depth,
+							1.0f
+						));
+						center += corners[k] / 8.0f;
 					}
-					for (uint32_t frustum_i = 0; frustum_i < in_spot_light_instances.size(); ++frustum_i) {
-						if (check_frustum_obb_intersection(light_frustums[i], obb)) {
-							in_spot_light_instances[frustum_i][0].push_back(uint32_t(lambertian_instances.size()));
-						}
+					float radius = 0.0f;
+					for (glm::vec3 const &corner : corners) {
+						radius = std::max(radius, glm::length(corner - center));
 					}
-					// use lambertian pipeline to render the default albedo, displacement and normal maps
-					lambertian_instances.emplace_back(ObjectInstance{
-						.vertices = mesh_vertices[cur_mesh_index],
-						.transform{
-							.CLIP_FROM_LOCAL = CLIP_FROM_WORLD * WORLD_FROM_LOCAL,
-							.WORLD_FROM_LOCAL = WORLD_FROM_LOCAL,
-							.WORLD_FROM_LOCAL_NORMAL = WORLD_FROM_LOCAL_NORMAL,
-						},
-						.material_index = 0,//default material
+					radius = std::ceil(radius * 16.0f) / 16.0f; //(so rounding noise doesn't resize the square)
+
+					//the square is a bit larger than the sphere so its center can snap to a grid that is whole texels
+					// at every region size the atlas may pick (powers of two down to MIN_REGION), which keeps edges from shimmering:
+					float half = radius * 9.0f / 8.0f;
+					float step = 2.0f * half / float(ShadowAtlas::MIN_REGION);
+					glm::vec3 light_center = glm::vec3(light_from_world * glm::vec4(center, 1.0f));
+					light_center = glm::round(light_center / step) * step; //(depth too, so a still sun and camera keep the cached region)
+
+					float near_plane = -std::max(scene_top, light_center.z + half);
+					float far_plane = -(light_center.z - half);
+					glm::mat4x4 light_projection = glm::make_mat4(orthographic(
+						light_center.x - half, light_center.x + half, //left, right
+						light_center.y - half, light_center.y + half, //bottom, top
+						near_plane, far_plane
+					).data());
+
+					sun_cascades.emplace_back(SunCascade{
+						.sun = sun,
+						.cascade = c,
+						.size = sun_shadow_sizes[sun],
+						.LIGHT_FROM_WORLD = light_projection * light_from_world,
 					});
 				}
 			}
-			
-			transform_stack.pop_back();
-		};
+		}
+
+		shadow_views.clear();
+		for (uint32_t i = 0; i < spot_light_from_world.size(); ++i) {
+			uint32_t light_index = scene.spot_lights_sorted_indices[i].spot_lights_index;
+			shadow_views.emplace_back(ShadowView{
+				.LIGHT_FROM_WORLD = spot_light_from_world[i],
+				.region = light_index,
+				.size = spot_lights[light_index].shadow_size,
+			});
+		}
+		for (SunCascade const &cascade : sun_cascades) {
+			shadow_views.emplace_back(ShadowView{
+				.LIGHT_FROM_WORLD = cascade.LIGHT_FROM_WORLD,
+				.region = uint32_t(spot_lights.size() + shadow_views.size() - spot_light_from_world.size()),
+				.size = cascade.size,
+			});
+		}
+		for (SphereShadow const &shadow : sphere_shadows) {
+			for (glm::mat4x4 const &light_from_world : shadow.LIGHT_FROM_WORLD) {
+				shadow_views.emplace_back(ShadowView{
+					.LIGHT_FROM_WORLD = light_from_world,
+					.region = uint32_t(spot_lights.size() + shadow_views.size() - spot_light_from_world.size()),
+					.size = shadow.size,
+				});
+			}
+		}
 
-		//traverse the scene hiearchy:
-		for (uint32_t i = 0; i < scene.root_nodes.size(); ++i) {
-			transform_stack.clear();
-			collect_node_information(scene.root_nodes[i]);
+		cull_frusta.clear();
+		cull_frusta.emplace_back(make_frustum_planes(CULL_CLIP_FROM_WORLD));
+		for (ShadowView const &view : shadow_views) {
+			cull_frusta.emplace_back(make_frustum_planes(view.LIGHT_FROM_WORLD));
+		}
+
+		cull_candidates.clear();
+		if (cull_frusta.size() <= BVH::MAX_FRUSTA) {
+			uint32_t accept_mask = rtg.configuration.culling_settings != 0 ? 0u : 1u; //with culling off everything stays in the camera frustum
+			instance_bvh.cull(cull_frusta, accept_mask, cull_candidates);
+		}
+		else { //more frusta than the BVH tracks; leave all of the culling to the cull pass:
+			cull_candidates.reserve(cull_instances.size());
+			for (uint32_t index = 0; index < uint32_t(cull_instances.size()); ++index) {
+				cull_candidates.emplace_back(BVH::Visible{ .item = index, .frusta = ~0u });
+			}
 		}
 	}
 
 	{// shadow map atlas organization
 
-		// reduce shadow map size if requesting too many
-		uint8_t reduction = 0;
-		while (total_shadow_size > shadow_atlas_length * shadow_atlas_length) {
-			total_shadow_size/= 4;
-			++reduction;
+		//size each light's region by how much of the view its frustum can cover, then shrink the least important until they fit:
+		FrustumPlanes view_frustum = make_frustum_planes(CLIP_FROM_WORLD);
+		float focal = 0.5f * float(rtg.swapchain_extent.height) * std::abs(clip_from_view[view_camera][1][1]); //pixels per unit of view-space slope
+		std::vector< uint32_t > sizes(spot_lights.size() + shadow_views.size() - spot_light_from_world.size(), 0);
+		std::vector< float > importance(sizes.size(), 0.0f);
+		for (uint32_t v = 0; v < shadow_views.size(); ++v) {
+			ShadowView const &view = shadow_views[v];
+			if (view.size == 0) continue;
+			uint32_t current = view.region < shadow_atlas.regions.size() ? shadow_atlas.regions[view.region].size : 0;
+
+			uint32_t cascade = v - uint32_t(spot_light_from_world.size()); //(wraps around for spot lights)
+			if (cascade < sun_cascades.size()) { //cascades always cover the view; far ones cover it more coarsely, so they give up texels first:
+				sizes[view.region] = ShadowAtlas::choose_size(float(view.size), current, view.size);
+				importance[view.region] = 1.0f / float(1 + sun_cascades[cascade].cascade);
+				continue;
+			}
+
+			//bounding sphere of the view's frustum:
+			std::array< glm::vec3, 8 > const &corners = cull_frusta[1 + v].corners;
+			AABB bounds;
+			for (glm::vec3 const &corner : corners) {
+				bounds.min = glm::min(bounds.min, corner);
+				bounds.max = glm::max(bounds.max, corner);
+			}
+			glm::vec3 center = 0.5f * (bounds.min + bounds.max);
+			float radius = 0.0f;
+			for (glm::vec3 const &corner : corners) {
+				radius = std::max(radius, glm::length(corner - center));
+			}
+
+			//fraction of the requested resolution the sphere's size on screen can use:
+			float coverage = 0.0f;
+			if (classify_aabb(view_frustum, bounds) != Containment::Outside) {
+				float distance = glm::length(center - glm::vec3(world.CAMERA_POSITION));
+				if (distance <= radius) coverage = 1.0f;
+				else coverage = std::min(1.0f, focal * radius / std::sqrt(distance * distance - radius * radius) / float(view.size));
+			}
+
+			float wanted = std::max(float(view.size) * coverage, float(ShadowAtlas::MIN_REGION));
+			sizes[view.region] = ShadowAtlas::choose_size(wanted, current, view.size);
+			importance[view.region] = std::max(coverage, 1.0e-3f); //(off-screen lights still cast shadows into view, so never quite 0)
+		}
+		shadow_atlas.fit_sizes(sizes, importance);
+		shadow_atlas.update_regions(sizes);
+		for (uint32_t light_index = 0; light_index < spot_lights.size(); ++light_index) {
+			spot_lights[light_index].shadow_size = shadow_atlas.regions[light_index].size; //(0 turns the shadow lookup off)
+		}
+
+		//a region only needs re-rendering when its light, its placement, or a caster near the light's frustum changed:
+		std::vector< uint64_t > contents(sizes.size(), 0);
+		for (ShadowView const &view : shadow_views) {
+			contents[view.region] = ShadowAtlas::light_hash(view.LIGHT_FROM_WORLD, shadow_atlas.regions[view.region]);
+		}
+		for (BVH::Visible const &candidate : cull_candidates) {
+			uint64_t caster = ShadowAtlas::caster_hash(candidate.item, transform_serials[candidate.item]);
+			for (uint32_t v = 0; v < shadow_views.size(); ++v) {
+				uint32_t frustum = 1 + v;
+				if (frustum < 32 && (candidate.frusta & (1u << frustum)) == 0) continue; //(views past the first 31 count every candidate)
+				contents[shadow_views[v].region] += caster;
+			}
+		}
+		shadow_atlas.set_contents(contents);
+
+		//the cull pass needn't find casters for views whose regions are kept:
+		uint32_t kept_frusta = 0;
+		for (uint32_t v = 0; v + 1 < 32 && v < shadow_views.size(); ++v) {
+			if (!shadow_atlas.stale(shadow_views[v].region)) kept_frusta |= 1u << (1 + v);
+		}
+		if (kept_frusta != 0) {
+			for (BVH::Visible &candidate : cull_candidates) {
+				candidate.frusta &= ~kept_frusta;
+			}
+			std::erase_if(cull_candidates, [](BVH::Visible const &candidate) { return candidate.frusta == 0; });
 		}
-		shadow_atlas.update_regions(spot_lights, scene.spot_lights_sorted_indices, reduction);
-		//reset total_shadow_size
-		total_shadow_size = 0;
 	}
 
 	{ // cloud world information
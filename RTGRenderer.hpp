@@ -8,9 +8,13 @@
 #include "Cloud.hpp"
 #include "mat4.hpp"
 #include "frustum_culling.hpp"
+#include "bvh.hpp"
+#include "ThreadPool.hpp"
 
 #include "GLM.hpp"
 
+#include <chrono>
+
 struct RTGRenderer : RTG::Application {
 
 	RTGRenderer(RTG &, Scene &);
@@ -29,6 +33,7 @@ struct RTGRenderer : RTG::Application {
 	VkFormat depth_format{};
 	//Render passes describe how pipelines write to images:
 	VkRenderPass render_pass = VK_NULL_HANDLE;
+	VkRenderPass late_render_pass = VK_NULL_HANDLE; //draws the instances occlusion culling let through late, over render_pass's output
 	VkRenderPass shadow_atlas_pass = VK_NULL_HANDLE;
 
 	//Pipelines:
@@ -93,12 +98,14 @@ struct RTGRenderer : RTG::Application {
 	} shadow_pipeline;
 
 	static constexpr uint32_t shadow_atlas_length = 4096;
+	static constexpr uint32_t max_sun_cascades = 4; //matches MAX_SUN_CASCADES in light.glsl
+	static constexpr uint32_t max_material_textures = 4096; //upper bound on the bindless texture array
 
 	struct LambertianPipeline {
 		//descriptor set layouts:
 		VkDescriptorSetLayout set0_World = VK_NULL_HANDLE;
         VkDescriptorSetLayout set1_Transforms = VK_NULL_HANDLE;
-        VkDescriptorSetLayout set2_TEXTURE = VK_NULL_HANDLE;
+        VkDescriptorSetLayout set2_Materials = VK_NULL_HANDLE;
 
 		//types for descriptors:
 
@@ -109,23 +116,30 @@ struct RTGRenderer : RTG::Application {
 			uint32_t SPHERE_LIGHT_COUNT;
 			uint32_t SPOT_LIGHT_COUNT;
 			uint32_t SHADOW_ATLAS_SIZE = shadow_atlas_length;
+			glm::mat4x4 CLIP_FROM_WORLD; //read by the vertex shaders, so Transforms don't change when the camera moves
         };
-        static_assert(sizeof(World) == 4*3 + 4 + 4 + 4 + 4 + 4, "World is the expected size.");
+        static_assert(sizeof(World) == 4*3 + 4 + 4 + 4 + 4 + 4 + 16*4, "World is the expected size.");
 
 		struct SunLight {
-			glm::vec4 DIRECTION; // w padding
+			glm::vec3 DIRECTION;
+			uint32_t CASCADE_COUNT = 0; //0 when the sun casts no shadow
 			glm::vec3 ENERGY;
 			float SIN_ANGLE;
+			std::array<glm::mat4x4, max_sun_cascades> LIGHT_FROM_WORLD{}; //nearest cascade first
+			std::array<glm::vec4, max_sun_cascades> ATLAS_RECTS{}; //x, y: corner of the cascade's atlas region, z: its size; in atlas texture coordinates
 		};
-		static_assert(sizeof(SunLight) == 4*4 + 4*3 + 4, "SunLight is the expected size.");
+		static_assert(sizeof(SunLight) == 4*3 + 4 + 4*3 + 4 + 16*4*max_sun_cascades + 4*4*max_sun_cascades, "SunLight is the expected size.");
 
 		struct SphereLight {
 			glm::vec3 POSITION;
 			float RADIUS;
 			glm::vec3 ENERGY;
 			float LIMIT;
+			uint32_t SHADOW_FACES = 0; //bit f set when cube face f has an atlas region
+			uint32_t padding_[3];
+			std::array<glm::mat4x4, 6> ATLAS_COORD_FROM_WORLD{}; //+x, -x, +y, -y, +z, -z
 		};
-		static_assert(sizeof(SphereLight) == 4*3 + 4 + 4*3 + 4, "SphereLight is the expected size.");
+		static_assert(sizeof(SphereLight) == 4*3 + 4 + 4*3 + 4 + 4*4 + 16*4*6, "SphereLight is the expected size.");
 		
         struct SpotLight {
 			glm::vec3 POSITION;
@@ -142,11 +156,20 @@ struct RTGRenderer : RTG::Application {
 		static_assert(sizeof(SpotLight) == 4*4 + 4*3 + 4 + 4*3 + 4 + 4 * 4 + 16*4 + 16*4, "SpotLight is the expected size.");
 		
 		struct Transform {
-            glm::mat4x4 CLIP_FROM_LOCAL;
             glm::mat4x4 WORLD_FROM_LOCAL;
             glm::mat4x4 WORLD_FROM_LOCAL_NORMAL;
         };
-        static_assert(sizeof(Transform) == 16*4 + 16*4 + 16*4, "Transform is the expected size.");
+        static_assert(sizeof(Transform) == 16*4 + 16*4, "Transform is the expected size.");
+
+		struct Material {
+			uint32_t NORMAL; //indices into the bindless texture array
+			uint32_t DISPLACEMENT;
+			uint32_t ALBEDO; //lambertian and pbr only
+			uint32_t ROUGHNESS; //pbr only
+			uint32_t METALNESS; //pbr only
+			uint32_t padding_[3];
+		};
+		static_assert(sizeof(Material) == 4*8, "Material is the expected size.");
 
 		//no push constants
 
@@ -164,7 +187,7 @@ struct RTGRenderer : RTG::Application {
 		//descriptor set layouts:
 		VkDescriptorSetLayout set0_World = VK_NULL_HANDLE;
         VkDescriptorSetLayout set1_Transforms = VK_NULL_HANDLE;
-        VkDescriptorSetLayout set2_TEXTURE = VK_NULL_HANDLE;
+        VkDescriptorSetLayout set2_Materials = VK_NULL_HANDLE;
 
 		//types for descriptors same as objects pipeline
 
@@ -184,7 +207,7 @@ struct RTGRenderer : RTG::Application {
 		//descriptor set layouts:
 		VkDescriptorSetLayout set0_World = VK_NULL_HANDLE;
         VkDescriptorSetLayout set1_Transforms = VK_NULL_HANDLE;
-        VkDescriptorSetLayout set2_TEXTURE = VK_NULL_HANDLE;
+        VkDescriptorSetLayout set2_Materials = VK_NULL_HANDLE;
 
 		//types for descriptors same as objects pipeline
 		
@@ -204,7 +227,7 @@ struct RTGRenderer : RTG::Application {
 		//descriptor set layouts:
 		VkDescriptorSetLayout set0_World = VK_NULL_HANDLE;
         VkDescriptorSetLayout set1_Transforms = VK_NULL_HANDLE;
-        VkDescriptorSetLayout set2_TEXTURE = VK_NULL_HANDLE;
+        VkDescriptorSetLayout set2_Materials = VK_NULL_HANDLE;
 
 		//types for descriptors same as objects pipeline
 		
@@ -268,8 +291,76 @@ struct RTGRenderer : RTG::Application {
 		void destroy(RTG &);
 	} cloud_lightgrid_pipeline;
 
+	struct CullPipeline {
+		//descriptor set layouts:
+		VkDescriptorSetLayout set0_Cull = VK_NULL_HANDLE; // transforms, cull instances, frusta, draw commands, draw counts, candidates, depth pyramid, late list
+
+		//types for descriptors:
+		struct Instance {
+			glm::vec3 AABB_MIN; //local-space bounds of the instance's mesh
+			uint32_t BUCKET; //draw count the camera pass compacts this instance into
+			glm::vec3 AABB_MAX;
+			uint32_t BUCKET_FIRST; //first draw command of that bucket
+			uint32_t INDEX_COUNT;
+			uint32_t FIRST_INDEX;
+			int32_t VERTEX_OFFSET;
+			uint32_t MATERIAL; //not used for culling, read by the material pipelines' vertex shaders
+		};
+		static_assert(sizeof(Instance) == 4*3 + 4 + 4*3 + 4 + 4 + 4 + 4 + 4, "Instance is the expected size.");
+
+		//instance the CPU-side BVH found near at least one frustum:
+		struct Candidate {
+			uint32_t INSTANCE;
+			uint32_t FRUSTA; //bit per frustum (of the first 32) the instance may be visible to
+		};
+		static_assert(sizeof(Candidate) == 4 + 4, "Candidate is the expected size.");
+		static_assert(sizeof(Candidate) == sizeof(BVH::Visible), "Candidates are uploaded straight from BVH::cull output.");
+
+		struct Push {
+			glm::vec4 VIEWPORT; //camera viewport in depth buffer pixels: x, y, width, height
+			glm::vec2 HIZ_SCALE; //depth pyramid level 0 texels per depth buffer pixel
+			uint32_t INSTANCE_COUNT;
+			uint32_t CANDIDATE_COUNT; //invocations per frustum row
+			uint32_t FRUSTUM_COUNT; //camera frustum followed by one frustum per shadow view; the previous and current camera matrices follow those
+			uint32_t CAMERA_CULLING; //0 lets every instance through the camera frustum
+			uint32_t SHADOW_BUCKET; //draw count of the first shadow view
+			uint32_t SHADOW_FIRST; //first draw command of the first shadow view, each view gets INSTANCE_COUNT commands
+			uint32_t PHASE; //0: cull candidates (early), 1: re-test the instances the early phase found occluded (late)
+			uint32_t OCCLUSION; //0 skips the depth pyramid test
+			uint32_t HIZ_LEVELS;
+			uint32_t LATE_BUCKET; //draw count of the first late bucket; the late list length and occluded count follow the four late buckets
+			uint32_t LATE_FIRST; //first draw command of the late buckets, laid out like the camera buckets
+		};
+		static_assert(sizeof(Push) == 4*4 + 4*2 + 4*11, "Push is the expected size.");
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+
+		VkPipeline handle = VK_NULL_HANDLE;
+
+		void create(RTG &);
+		void destroy(RTG &);
+	} cull_pipeline;
+
+	//builds the depth pyramid used for occlusion culling, one level per dispatch:
+	struct HiZPipeline {
+		//descriptor set layouts:
+		VkDescriptorSetLayout set0_Reduce = VK_NULL_HANDLE; // level below (or the depth buffer), level being built
+
+		// no push constants
+
+		VkPipelineLayout layout = VK_NULL_HANDLE;
+
+		VkPipeline handle = VK_NULL_HANDLE;
+
+		void create(RTG &);
+		void destroy(RTG &);
+	} hiz_pipeline;
+
 	//pools from which per-workspace things are allocated:
 	VkCommandPool command_pool = VK_NULL_HANDLE;
+
+	//threads that help build each frame: world transforms and instances in update, secondary command buffers in render:
+	ThreadPool frame_threads;
 	
 	//descriptor pool
 	VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
@@ -277,6 +368,14 @@ struct RTGRenderer : RTG::Application {
 	//workspaces hold per-render resources:
 	struct Workspace {
 		VkCommandBuffer command_buffer = VK_NULL_HANDLE; //from the command pool above; reset at the start of every render.
+
+		//one per frame thread, since command pools can't be shared between threads:
+		struct Recorder {
+			VkCommandPool command_pool = VK_NULL_HANDLE; //reset as a whole at the start of every render
+			std::vector< VkCommandBuffer > secondaries; //allocated from command_pool as needed, re-used every frame
+			uint32_t used = 0; //secondaries recorded so far this frame
+		};
+		std::vector< Recorder > recorders;
 		
 		//location for lines data: (streamed to GPU per-frame)
 		Helpers::AllocatedBuffer lines_vertices_src; //host coherent; mapped
@@ -298,6 +397,25 @@ struct RTGRenderer : RTG::Application {
         Helpers::AllocatedBuffer Transforms_src; //host coherent; mapped
         Helpers::AllocatedBuffer Transforms; //device-local
         VkDescriptorSet Transforms_descriptors; //references Transforms
+		uint32_t Transforms_serial = 0; //update_serial of the last upload; transforms changed since then are copied again
+
+		// locations for CullPipeline data: (streamed to GPU per-frame)
+		Helpers::AllocatedBuffer CullInstances_src; //host coherent; mapped
+		Helpers::AllocatedBuffer CullInstances; //device-local
+		Helpers::AllocatedBuffer CullFrusta_src; //host coherent; mapped
+		Helpers::AllocatedBuffer CullFrusta; //device-local
+		Helpers::AllocatedBuffer DrawCommands; //device-local, written by the cull pass and read as indirect draws
+		Helpers::AllocatedBuffer DrawCounts; //device-local, cleared every frame, counted up by the cull pass
+		Helpers::AllocatedBuffer CullCandidates_src; //host coherent; mapped
+		Helpers::AllocatedBuffer CullCandidates; //device-local
+		Helpers::AllocatedBuffer CullLate; //device-local, instances the early cull phase found occluded
+		VkDescriptorSet Cull_descriptors; //references Transforms, CullInstances, CullFrusta, DrawCommands, DrawCounts, CullCandidates, the depth pyramid, CullLate
+		uint32_t CullInstances_serial = 0; //update_serial of the last CullInstances upload
+		uint32_t Cull_hiz_serial = 0; //hiz_serial of the depth pyramid Cull_descriptors references
+
+		//draw counts copied back after the frame, read the next time this workspace renders:
+		Helpers::AllocatedBuffer CullStats; //host coherent; mapped
+		uint32_t CullStats_instances = 0; //instance count of the frame that wrote CullStats, 0 if it holds nothing
 
 		// Storage Image for Cloud Rendering Result
 		Helpers::AllocatedImage Cloud_target;
@@ -316,9 +434,11 @@ struct RTGRenderer : RTG::Application {
 	//static scene resources:
 
     Helpers::AllocatedBuffer object_vertices;
+    Helpers::AllocatedBuffer object_indices; //uint32_t indices into object_vertices (relative to vertex_offset)
     struct ObjectVertices {
-		uint32_t first = 0;
-		uint32_t count = 0;
+		uint32_t first = 0; //first index in object_indices
+		uint32_t count = 0; //index count
+		int32_t vertex_offset = 0; //added to each index
 	};
 	std::vector<ObjectVertices> mesh_vertices; // indexed the same as scene.meshes
 	std::vector<AABB> mesh_AABBs; // also indexed the same as scene.meshes
@@ -333,8 +453,9 @@ struct RTGRenderer : RTG::Application {
     std::vector< Helpers::AllocatedImage > textures;
 	std::vector< VkImageView > texture_views;
 	VkSampler texture_sampler = VK_NULL_HANDLE;
+	Helpers::AllocatedBuffer materials; //LambertianPipeline::Material per scene material
 	VkDescriptorPool material_descriptor_pool = VK_NULL_HANDLE;
-	std::vector< VkDescriptorSet > material_descriptors; //allocated from texture_descriptor_pool
+	VkDescriptorSet Materials_descriptors = VK_NULL_HANDLE; //references materials and every texture view; allocated from material_descriptor_pool
 
 	VkImageView Shadow_atlas_view = VK_NULL_HANDLE;
 	VkSampler shadow_sampler = VK_NULL_HANDLE;
@@ -367,6 +488,17 @@ struct RTGRenderer : RTG::Application {
 	//used from on_swapchain and the destructor: (framebuffers are created in on_swapchain)
 	void destroy_framebuffers();
 
+	//depth pyramid for occlusion culling; every texel holds the farthest depth of the texels under it.
+	// level 0 is the depth buffer reduced to a power of two in each dimension. stays in VK_IMAGE_LAYOUT_GENERAL:
+	Helpers::AllocatedImage hiz_image;
+	uint32_t hiz_levels = 0;
+	VkImageView hiz_view = VK_NULL_HANDLE; //all levels, read by the cull pass
+	std::vector< VkImageView > hiz_level_views; //one per level, written by hiz_pipeline
+	VkDescriptorPool hiz_descriptor_pool = VK_NULL_HANDLE;
+	std::vector< VkDescriptorSet > hiz_reduce_descriptors; //building level i reads level i-1 (or the depth buffer) and writes level i
+	uint32_t hiz_serial = 0; //incremented every time the pyramid is re-created
+	bool hiz_valid = false; //holds depth from a previous frame
+
 	//--------------------------------------------------------------------
 	//Resources that change when time passes or the user interacts:
 	struct FreeCamera;
@@ -379,6 +511,8 @@ struct RTGRenderer : RTG::Application {
 	float time = 0.0f;
 
 	glm::mat4x4 CLIP_FROM_WORLD;
+	glm::mat4x4 CULL_CLIP_FROM_WORLD; //frustum of the culling camera, tested by the cull pass
+	glm::mat4x4 previous_CLIP_FROM_WORLD{1.0f}; //camera the depth pyramid was rendered from
 
 	std::vector<LinesPipeline::Vertex> lines_vertices;
 
@@ -392,12 +526,53 @@ struct RTGRenderer : RTG::Application {
 		ObjectVertices vertices;
 		Transform transform;
 		uint32_t material_index;
+		uint32_t mesh_index; //for mesh_AABBs
 	};
 	std::vector< ObjectInstance > lambertian_instances, environment_instances, mirror_instances, pbr_instances;
 
-	std::array<std::vector<uint32_t>, 4> in_view_instances; // order of array is lambertian, environment, mirror, pbr
+	//per-thread outputs of the parallel instance pass in update, appended to the lists above in chunk order when they are rebuilt:
+	struct InstanceChunk {
+		std::array< std::vector< ObjectInstance >, 4 > instances; //lambertian, environment, mirror, pbr
+		std::vector< LinesPipeline::Vertex > lines; //debug OBBs
+		uint32_t begin = 0, end = 0; //range of scene.hierarchy.mesh_entries this chunk walked
+	};
+	std::vector< InstanceChunk > instance_chunks;
+
+	//where each of scene.hierarchy.mesh_entries landed in the instance lists; the lists are only rebuilt when this goes stale:
+	struct InstanceSlot {
+		uint32_t pipeline; //lambertian, environment, mirror, pbr
+		uint32_t index; //in that pipeline's instance list
+	};
+	std::vector< InstanceSlot > instance_slots;
 
-	std::vector<std::array<std::vector<uint32_t>, 4>> in_spot_light_instances;
+	uint32_t update_serial = 0; //incremented every update
+	uint32_t instances_serial = 0; //update_serial when the instance lists were last rebuilt
+	std::vector< uint32_t > transform_serials; //update_serial when each transform last changed, indexed the same as the Transforms buffer
+
+	//instances sharing a pipeline are drawn by one indirect draw:
+	struct DrawBucket {
+		uint32_t first = 0; //first command in the workspace's DrawCommands
+		uint32_t capacity = 0; //number of instances that may land in the bucket
+	};
+	std::array<DrawBucket, 4> draw_buckets; // order of array is lambertian, environment, mirror, pbr; also their index in DrawCounts (shadow view counts follow)
+	uint32_t camera_draw_commands = 0; //commands used by all buckets; shadow view commands follow in DrawCommands
+
+	std::vector< CullPipeline::Instance > cull_instances; //indexed the same as the Transforms buffer
+
+	//world-space bounds of every instance, refit as transforms change; items are indexed the same as the Transforms buffer:
+	BVH instance_bvh;
+	std::vector< FrustumPlanes > cull_frusta; //camera frustum, then one per shadow view
+	std::vector< BVH::Visible > cull_candidates; //instances the cull pass tests, uploaded as CullPipeline::Candidate
+
+	//camera culling results, read back from a frame the GPU has finished:
+	struct CullStats {
+		uint32_t instances = 0;
+		uint32_t drawn_early = 0; //inside the camera frustum, not hidden by last frame's depth
+		uint32_t drawn_late = 0; //hidden by last frame's depth, but not by this frame's
+		uint32_t occluded = 0; //hidden by both
+		uint32_t frustum_culled = 0; //outside the camera frustum
+	} cull_stats;
+	std::chrono::steady_clock::time_point cull_stats_printed; //when --cull-stats last printed
 
 	struct ObjectLightInstance {
 		ObjectVertices vertices;
@@ -409,24 +584,84 @@ struct RTGRenderer : RTG::Application {
 	std::vector<LambertianPipeline::SphereLight> sphere_lights;
 	std::vector<LambertianPipeline::SpotLight> spot_lights;
 	std::vector<glm::mat4x4> spot_light_from_world;
-	uint64_t total_shadow_size = 0;
+	std::vector<uint32_t> sun_shadow_sizes; //cascade size requested by each of sun_lights, 0 for suns without shadows
+
+	//the view frustum split along its depth, one square orthographic shadow per slice, for each sun that casts shadows:
+	struct SunCascade {
+		uint32_t sun; //index in sun_lights
+		uint32_t cascade; //0 is nearest the camera
+		uint32_t size; //requested region size
+		glm::mat4x4 LIGHT_FROM_WORLD;
+	};
+	std::vector<SunCascade> sun_cascades;
+
+	//six perspective shadows, one per cube face, for each sphere light that casts shadows:
+	struct SphereShadow {
+		uint32_t sphere; //index in sphere_lights
+		uint32_t size; //requested region size of each face
+		std::array<glm::mat4x4, 6> LIGHT_FROM_WORLD; //+x, -x, +y, -y, +z, -z
+	};
+	std::vector<SphereShadow> sphere_shadows;
+
+	//everything drawn into the shadow atlas: the sorted spot lights, then sun_cascades, then the faces of sphere_shadows.
+	// view v is culled as frustum 1 + v and drawn from shadow bucket v:
+	struct ShadowView {
+		glm::mat4x4 LIGHT_FROM_WORLD;
+		uint32_t region; //index in shadow_atlas.regions; spot lights use their spot_lights index, the views after them spot_lights.size() + (v - spot lights)
+		uint32_t size; //requested region size
+	};
+	std::vector<ShadowView> shadow_views;
 	
 	Helpers::AllocatedImage shadow_atlas_image;
+	bool shadow_atlas_ready = false; //shadow_atlas_image has left VK_IMAGE_LAYOUT_UNDEFINED; regions are loaded, not cleared, every frame
 
 	struct ShadowAtlas {
-		uint32_t size;
+		uint32_t size = shadow_atlas_length;
+		static constexpr uint32_t MIN_REGION = 32; //smallest region handed to a light that gets one at all
 		struct Region{
 			uint32_t x;
 			uint32_t y;
 			uint32_t size;
 		} ;
-		std::vector<Region> regions;
+		std::vector<Region> regions; //indexed like ShadowView::region; size 0 for views without a region
 
-		//spot lights must be sorted
-		void update_regions(std::vector<RTGRenderer::LambertianPipeline::SpotLight> &, std::vector<Scene::LightInstance> &, uint8_t reduction);
+		//skyline packing: the atlas fills bottom-up, and each segment is the height of the filled part from x to x + width:
+		struct Segment {
+			uint32_t x;
+			uint32_t y;
+			uint32_t width;
+		};
+		std::vector<Segment> skyline; //sorted by x, spans the whole atlas width
+
+		//content hash of every region (light, placement, and caster transform versions), indexed like regions.
+		// a region whose wanted content matches what it was last rendered with keeps last frame's depth:
+		std::vector<uint64_t> wanted_contents;
+		std::vector<uint64_t> rendered_contents;
+
+		//give spot light i a sizes[i] region (0 for none); lights whose size didn't change keep their region,
+		// the others are evicted and inserted again, and everything is repacked if that fails:
+		void update_regions(std::vector<uint32_t> const &sizes);
+		void repack(std::vector<uint32_t> const &sizes);
+		bool insert(uint32_t region_size, Region &out);
+		void evict(Region const &region);
+		void set_skyline(uint32_t x, uint32_t width, uint32_t y);
+
+		//power-of-two region size for a light that wants about wanted texels across, with some hysteresis around current:
+		static uint32_t choose_size(float wanted, uint32_t current, uint32_t largest);
+		//shrink sizes, least important texels first, until they all fit in the atlas:
+		void fit_sizes(std::vector<uint32_t> &sizes, std::vector<float> const &importance) const;
 		void debug();
 		static glm::mat4 calculate_shadow_atlas_matrix(const glm::mat4& light_from_world, const Region& region, const int atlas_size);
 
+		//what region i should hold this frame; regions that aren't rendered again keep their old content hash:
+		void set_contents(std::vector<uint64_t> const &contents);
+		bool stale(uint32_t i) const { return wanted_contents[i] != rendered_contents[i]; }
+		void mark_rendered(uint32_t i) { rendered_contents[i] = wanted_contents[i]; }
+
+		//hash pieces; caster hashes are summed, so the order casters are found in doesn't matter:
+		static uint64_t light_hash(const glm::mat4& light_from_world, const Region& region);
+		static uint64_t caster_hash(uint32_t instance, uint32_t transform_serial);
+
 		ShadowAtlas(uint32_t size_) : size(size_) {};
 	} shadow_atlas;
 	
@@ -464,4 +699,9 @@ struct RTGRenderer : RTG::Application {
 	//Rendering function, uses all the resources above to queue work to draw a frame:
 
 	virtual void render(RTG &, RTG::RenderParams const &) override;
+
+	//records each task into its own secondary command buffer inside subpass 0 of render_pass, splitting the tasks over frame_threads;
+	// secondaries are returned in task order, ready for vkCmdExecuteCommands:
+	using RecordTask = std::function< void(VkCommandBuffer) >;
+	std::vector< VkCommandBuffer > record_secondaries(Workspace &workspace, VkRenderPass render_pass, VkFramebuffer framebuffer, std::vector< RecordTask > const &tasks);
 };
@@ -0,0 +1,232 @@
+#include "SceneCache.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+//the first bytes of every cache file:
+struct Header {
+	char magic[8] = {'n','a','k','l','u','V','s','c'};
+	uint32_t version = SceneCache::Version;
+	uint32_t byte_order = 0x01020304; //(caches aren't portable between byte orders)
+	uint64_t sources_offset = 0; //where the source list starts
+	uint64_t size = 0; //of the whole file, to catch truncated caches
+};
+static_assert(sizeof(Header) == 32, "Header keeps the first section 16-byte aligned");
+
+static constexpr size_t Alignment = 16;
+
+//FNV-1a, 64-bit:
+static constexpr uint64_t FNVOffset = 0xcbf29ce484222325ULL;
+static uint64_t fnv1a(uint8_t const *data, size_t size, uint64_t hash = FNVOffset) {
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ data[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+uint64_t SceneCache::hash_file(std::string const &filename) {
+	MappedFile mapped(filename);
+	return fnv1a(mapped.data, mapped.size);
+}
+
+//size and mtime of a file as it is now (hash left for the caller, since it's only sometimes needed):
+static SceneCache::Source stat_source(std::string const &path) {
+	SceneCache::Source source;
+	source.path = path;
+	std::error_code ec;
+	source.size = std::filesystem::file_size(path, ec);
+	if (ec) {
+		source.exists = false;
+		source.size = 0;
+		return source;
+	}
+	source.mtime = int64_t(std::filesystem::last_write_time(path, ec).time_since_epoch().count());
+	if (ec) throw std::runtime_error("Failed to read modification time of '" + path + "': " + ec.message());
+	return source;
+}
+
+//------------------------------------------------
+//Writer:
+
+void SceneCache::Writer::bytes(void const *data, size_t size) {
+	out.write(reinterpret_cast< char const * >(data), std::streamsize(size));
+	offset += size;
+}
+
+void SceneCache::Writer::align() {
+	static const char zeros[Alignment] = {};
+	bytes(zeros, (Alignment - offset % Alignment) % Alignment);
+}
+
+void SceneCache::Writer::string(std::string const &str) {
+	pod(uint64_t(str.size()));
+	bytes(str.data(), str.size());
+}
+
+void SceneCache::Writer::begin_array(size_t count) {
+	pod(uint64_t(count));
+	align();
+}
+
+//------------------------------------------------
+//Reader:
+
+void SceneCache::Reader::truncated() const {
+	throw std::runtime_error("Scene cache ends early (at byte " + std::to_string(at - begin) + "); delete it to rebuild it.");
+}
+
+uint8_t const *SceneCache::Reader::bytes(size_t size) {
+	if (size > size_t(end - at)) truncated();
+	uint8_t const *ret = at;
+	at += size;
+	return ret;
+}
+
+void SceneCache::Reader::align() {
+	bytes((Alignment - size_t(at - begin) % Alignment) % Alignment);
+}
+
+std::string SceneCache::Reader::string() {
+	uint64_t size = pod< uint64_t >();
+	if (size > uint64_t(end - at)) truncated();
+	return std::string(reinterpret_cast< char const * >(bytes(size_t(size))), size_t(size));
+}
+
+//------------------------------------------------
+
+SceneCache::SceneCache(std::string const &dir, std::string const &scene_file) {
+	//named after the scene, and keyed on its full path so same-named scenes in different folders don't share a cache:
+	std::filesystem::path scene = std::filesystem::absolute(scene_file);
+	std::string scene_string = scene.string();
+	char key[17];
+	snprintf(key, sizeof(key), "%016llx", (unsigned long long)fnv1a(reinterpret_cast< uint8_t const * >(scene_string.data()), scene_string.size()));
+	path = (std::filesystem::path(dir) / (scene.stem().string() + "." + key + ".s72cache")).string();
+
+	hit = open();
+	if (hit) {
+		std::cout << "Loading scene from cache " << path << std::endl;
+		return;
+	}
+
+	//otherwise, the scene will be loaded from its sources and written out as it goes:
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	temporary_path = path + ".tmp";
+	writer.out.open(temporary_path, std::ios::binary | std::ios::trunc);
+	if (!writer.out) {
+		std::cerr << "WARNING: Can't create scene cache '" << temporary_path << "'; loading without it." << std::endl;
+		writer.out = std::ofstream();
+		return;
+	}
+	writer.pod(Header()); //(filled in by finish())
+}
+
+SceneCache::~SceneCache() {
+	if (writing()) abandon(); //loading never finished
+}
+
+bool SceneCache::open() {
+	std::error_code ec;
+	if (!std::filesystem::exists(path, ec)) return false;
+
+	auto stale = [&](std::string const &why) {
+		std::cout << "Scene cache " << path << " is out of date (" << why << "); rebuilding it." << std::endl;
+		file = MappedFile();
+		reader = Reader();
+		return false;
+	};
+
+	try {
+		file = MappedFile(path);
+		reader = Reader{ .begin = file.data, .at = file.data, .end = file.data + file.size };
+
+		Header header = reader.pod< Header >();
+		Header expected;
+		if (std::memcmp(header.magic, expected.magic, sizeof(expected.magic)) != 0 || header.byte_order != expected.byte_order) {
+			return stale("not a scene cache");
+		}
+		if (header.version != expected.version) {
+			return stale("version " + std::to_string(header.version) + ", expected " + std::to_string(expected.version));
+		}
+		if (header.size != file.size || header.sources_offset < sizeof(Header) || header.sources_offset > file.size) {
+			return stale("incomplete file");
+		}
+
+		Reader list{ .begin = file.data, .at = file.data + header.sources_offset, .end = file.data + file.size };
+		uint64_t count = list.pod< uint64_t >();
+		for (uint64_t i = 0; i < count; ++i) {
+			Source source;
+			source.path = list.string();
+			source.exists = list.pod< uint8_t >() != 0;
+			source.size = list.pod< uint64_t >();
+			source.mtime = list.pod< int64_t >();
+			source.hash = list.pod< uint64_t >();
+
+			Source now = stat_source(source.path);
+			if (now.exists != source.exists) {
+				return stale(source.path + (source.exists ? " was removed" : " was added"));
+			}
+			if (!now.exists) continue;
+			if (now.size != source.size) return stale(source.path + " changed");
+			if (now.mtime == source.mtime) continue;
+			//touched, but maybe not changed:
+			if (hash_file(source.path) != source.hash) return stale(source.path + " changed");
+		}
+	} catch (std::exception &e) {
+		return stale(e.what());
+	}
+	return true;
+}
+
+void SceneCache::add_source(std::string const &source_path) {
+	if (!writing()) return;
+	if (std::find_if(sources.begin(), sources.end(), [&](Source const &s) { return s.path == source_path; }) != sources.end()) return;
+	Source source = stat_source(source_path);
+	if (source.exists) source.hash = hash_file(source_path);
+	sources.emplace_back(std::move(source));
+}
+
+void SceneCache::finish() {
+	if (!writing()) return;
+
+	writer.align();
+	Header header;
+	header.sources_offset = writer.offset;
+	writer.pod(uint64_t(sources.size()));
+	for (Source const &source : sources) {
+		writer.string(source.path);
+		writer.pod(uint8_t(source.exists ? 1 : 0));
+		writer.pod(source.size);
+		writer.pod(source.mtime);
+		writer.pod(source.hash);
+	}
+	header.size = writer.offset;
+	writer.out.seekp(0);
+	writer.out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	writer.out.close();
+	if (!writer.out) {
+		std::cerr << "WARNING: Failed to write scene cache '" << temporary_path << "'; it will be rebuilt next time." << std::endl;
+		abandon();
+		return;
+	}
+
+	//replace the old cache all at once, so a cache is never seen half-written:
+	std::error_code ec;
+	std::filesystem::rename(temporary_path, path, ec);
+	if (ec) {
+		std::cerr << "WARNING: Failed to move scene cache into place at '" << path << "': " << ec.message() << std::endl;
+		abandon();
+		return;
+	}
+	std::cout << "Wrote scene cache " << path << " (" << (double(header.size) / (1024.0 * 1024.0)) << " MB)" << std::endl;
+}
+
+void SceneCache::abandon() {
+	if (writer.out.is_open()) writer.out.close();
+	writer.out = std::ofstream();
+	std::error_code ec;
+	std::filesystem::remove(temporary_path, ec);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "MappedFile.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <stdint.h>
+
+//Binary cache of a loaded scene and its GPU-ready payloads (`--scene-cache <dir>`):
+// a warm start maps one file instead of parsing the .s72, welding every mesh, and decoding every texture.
+//
+//A cache file is a fixed header, then sections (written and read back in the same order as the scene loads),
+// then the list of source files it was built from. A cache is only used if it has this Version and every
+// source still has the same size and either the same mtime or (if touched but unchanged) the same contents.
+//Arrays start 16-byte aligned in the file, so they can be used straight out of the mapping.
+struct SceneCache {
+	static constexpr uint32_t Version = 1; //bump whenever anything written to a cache changes
+
+	//writes sections to a temporary file, which replaces the cache in finish():
+	struct Writer {
+		std::ofstream out;
+		uint64_t offset = 0; //bytes written so far
+
+		void bytes(void const *data, size_t size);
+		void align(); //pad to the next 16-byte boundary
+
+		template< typename T >
+		void pod(T const &value) {
+			static_assert(std::is_trivially_copyable_v< T >, "only plain data can be written directly");
+			bytes(&value, sizeof(T));
+		}
+		void string(std::string const &str);
+		//count, then aligned elements; arrays can also be written piecewise with begin_array() then bytes():
+		void begin_array(size_t count);
+		template< typename T >
+		void array(T const *data, size_t count) {
+			static_assert(std::is_trivially_copyable_v< T >, "only plain data can be written directly");
+			begin_array(count);
+			bytes(data, count * sizeof(T));
+		}
+		template< typename T >
+		void array(std::vector< T > const &vec) { array(vec.data(), vec.size()); }
+	};
+
+	//reads sections back out of the mapping; throws if a read would run off the end:
+	struct Reader {
+		uint8_t const *begin = nullptr;
+		uint8_t const *at = nullptr;
+		uint8_t const *end = nullptr;
+
+		uint8_t const *bytes(size_t size); //returns where the bytes are and skips past them
+		void align();
+		[[noreturn]] void truncated() const; //throws
+
+		template< typename T >
+		T pod() {
+			static_assert(std::is_trivially_copyable_v< T >, "only plain data can be read directly");
+			T value;
+			std::memcpy(&value, bytes(sizeof(T)), sizeof(T));
+			return value;
+		}
+		std::string string();
+		//NOTE: array() views point into the mapping, so they are only valid while the cache is open
+		template< typename T >
+		std::span< T const > array() {
+			static_assert(std::is_trivially_copyable_v< T >, "only plain data can be read directly");
+			uint64_t count = pod< uint64_t >();
+			align();
+			if (count > uint64_t(end - at) / sizeof(T)) truncated();
+			return std::span< T const >(reinterpret_cast< T const * >(bytes(size_t(count) * sizeof(T))), size_t(count));
+		}
+		template< typename T >
+		std::vector< T > vector() {
+			std::span< T const > span = array< T >();
+			return std::vector< T >(span.begin(), span.end());
+		}
+	};
+
+	//a file the cache was built from:
+	struct Source {
+		std::string path;
+		bool exists = true; //(some files matter because they *don't* exist, e.g., the mip level after an environment's last)
+		uint64_t size = 0;
+		int64_t mtime = 0; //filesystem clock ticks
+		uint64_t hash = 0; //FNV-1a of the contents
+	};
+
+	//picks this scene's cache file in dir and opens it if it's still valid:
+	SceneCache(std::string const &dir, std::string const &scene_file);
+	~SceneCache();
+
+	std::string path; //cache file for this scene
+	bool hit = false; //true if reading (the cache was valid); otherwise, writing (unless the file couldn't be created)
+
+	//warm start:
+	MappedFile file;
+	Reader reader; //positioned at the next unread section
+
+	//cold start:
+	Writer writer;
+	std::vector< Source > sources; //(files added so far)
+	bool writing() const { return !hit && writer.out.is_open(); }
+	void add_source(std::string const &source_path); //stats (and hashes) source_path now
+	void finish(); //writes the source list and replaces the old cache with the new one
+	void abandon(); //closes and removes the temporary file (e.g., if loading failed)
+
+	//internals:
+	std::string temporary_path;
+	bool open(); //maps and validates path; returns false if it can't be used
+	static uint64_t hash_file(std::string const &filename);
+};
@@ -1,40 +1,175 @@
 #include "RTGRenderer.hpp"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <limits>
 #include <utility>
 
-//referenced https://lisyarus.github.io/blog/posts/texture-packing.html
-void RTGRenderer::ShadowAtlas::update_regions(std::vector<RTGRenderer::LambertianPipeline::SpotLight> & spot_lights, std::vector<Scene::LightInstance> &sorted_indices, uint8_t reduction)
+void RTGRenderer::ShadowAtlas::update_regions(std::vector<uint32_t> const &sizes)
 {
-    regions.clear();
-    regions.resize(spot_lights.size());
-    struct point { uint32_t x, y; } pen = {0,0};
-    std::vector<point> ladder;
-    for (Scene::LightInstance pair : sorted_indices) {
-        uint32_t i = pair.spot_lights_index;
-        const uint32_t texture_size = spot_lights[i].shadow_size >> reduction;
-
-        // allocate a texture region
-        regions[i] = {pen.x, pen.y, texture_size};
-        // shift the pen to the right
-        pen.x += texture_size;
-
-        // update the ladder
-        if (!ladder.empty() && ladder.back().y == pen.y + texture_size)
-            ladder.back().x = pen.x;
-        else
-            ladder.push_back({pen.x, pen.y + texture_size});
-
-        if (pen.x == size)
-        {
-            // the pen hit the right edge of the atlas
-            ladder.pop_back();
-            pen.y += texture_size;
-            if (!ladder.empty())
-                pen.x = ladder.back().x;
-            else
-                pen.x = 0;
+    // lights that went away or changed size give their space back:
+    for (uint32_t i = 0; i < regions.size(); ++i) {
+        if (regions[i].size != 0 && (i >= sizes.size() || regions[i].size != sizes[i])) {
+            evict(regions[i]);
+            regions[i] = Region{0, 0, 0};
         }
     }
+    regions.resize(sizes.size(), Region{0, 0, 0});
+
+    // the rest are placed largest first; regions that kept their size keep their place (and their cached depth):
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < sizes.size(); ++i) {
+        if (sizes[i] != 0 && regions[i].size == 0) order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sizes[a] > sizes[b]; });
+    for (uint32_t i : order) {
+        if (!insert(sizes[i], regions[i])) {
+            // too fragmented; start over with everything
+            repack(sizes);
+            return;
+        }
+    }
+}
+
+void RTGRenderer::ShadowAtlas::repack(std::vector<uint32_t> const &sizes)
+{
+    skyline.assign(1, Segment{0, 0, size});
+    regions.assign(sizes.size(), Region{0, 0, 0});
+
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < sizes.size(); ++i) {
+        if (sizes[i] != 0) order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sizes[a] > sizes[b]; });
+    for (uint32_t i : order) {
+        // power-of-two squares no larger than the atlas, largest first, always fit if their area does (see fit_sizes)
+        if (!insert(sizes[i], regions[i])) {
+            std::cerr << "Shadow atlas: no room for a " << sizes[i] << " region; light " << i << " casts no shadow." << std::endl;
+        }
+    }
+}
+
+//skyline bottom-left: rest the region on the lowest spot it fits, leftmost on ties
+bool RTGRenderer::ShadowAtlas::insert(uint32_t region_size, Region &out)
+{
+    if (skyline.empty()) skyline.assign(1, Segment{0, 0, size});
+
+    uint32_t best_x = 0;
+    uint32_t best_y = uint32_t(-1);
+    for (uint32_t i = 0; i < skyline.size(); ++i) {
+        uint32_t x = skyline[i].x;
+        if (x + region_size > size) break;
+
+        // the region rests on the highest segment under it:
+        uint32_t y = 0;
+        for (uint32_t j = i; j < skyline.size() && skyline[j].x < x + region_size; ++j) {
+            y = std::max(y, skyline[j].y);
+        }
+        if (y + region_size <= size && y < best_y) {
+            best_x = x;
+            best_y = y;
+        }
+    }
+    if (best_y == uint32_t(-1)) return false;
+
+    out = Region{best_x, best_y, region_size};
+    set_skyline(best_x, region_size, best_y + region_size);
+    return true;
+}
+
+void RTGRenderer::ShadowAtlas::evict(Region const &region)
+{
+    // space under the skyline isn't tracked, so only the parts of the skyline this region holds up can come back down:
+    uint32_t top = region.y + region.size;
+    uint32_t end = region.x + region.size;
+    std::vector<Segment> lowered;
+    for (Segment const &segment : skyline) {
+        uint32_t from = std::max(segment.x, region.x);
+        uint32_t to = std::min(segment.x + segment.width, end);
+        if (from < to && segment.y == top) lowered.push_back(Segment{from, region.y, to - from});
+    }
+    for (Segment const &segment : lowered) {
+        set_skyline(segment.x, segment.width, segment.y);
+    }
+}
+
+void RTGRenderer::ShadowAtlas::set_skyline(uint32_t x, uint32_t width, uint32_t y)
+{
+    uint32_t end = x + width;
+    std::vector<Segment> result;
+    result.reserve(skyline.size() + 2);
+    auto push = [&](Segment segment) {
+        if (segment.width == 0) return;
+        if (!result.empty() && result.back().y == segment.y) {
+            result.back().width += segment.width; // (segments are contiguous)
+        } else {
+            result.push_back(segment);
+        }
+    };
+
+    bool placed = false;
+    for (Segment const &segment : skyline) {
+        uint32_t segment_end = segment.x + segment.width;
+        if (segment_end <= x || segment.x >= end) {
+            if (segment.x >= end && !placed) {
+                push(Segment{x, y, width});
+                placed = true;
+            }
+            push(segment);
+            continue;
+        }
+        if (segment.x < x) push(Segment{segment.x, segment.y, x - segment.x});
+        if (!placed) {
+            push(Segment{x, y, width});
+            placed = true;
+        }
+        if (segment_end > end) push(Segment{end, segment.y, segment_end - end});
+    }
+    if (!placed) push(Segment{x, y, width});
+    skyline = std::move(result);
+}
+
+uint32_t RTGRenderer::ShadowAtlas::choose_size(float wanted, uint32_t current, uint32_t largest)
+{
+    largest = std::max(std::bit_floor(largest), MIN_REGION);
+    // hold on to the current size until wanted is well past the point where rounding would change it,
+    // so regions (and their cached depth) don't flip between two sizes as the camera moves:
+    if (current != 0 && current <= largest && wanted > 0.6f * float(current) && wanted < 1.7f * float(current)) {
+        return current;
+    }
+    // nearest power of two, measured in octaves:
+    uint32_t rounded = std::bit_floor(uint32_t(std::max(wanted * std::sqrt(2.0f), 1.0f)));
+    return std::clamp(rounded, MIN_REGION, largest);
+}
+
+void RTGRenderer::ShadowAtlas::fit_sizes(std::vector<uint32_t> &sizes, std::vector<float> const &importance) const
+{
+    uint64_t budget = uint64_t(size) * size;
+    uint64_t total = 0;
+    for (uint32_t region_size : sizes) total += uint64_t(region_size) * region_size;
+
+    // halve whichever region's texels are worth least until everything fits;
+    // below MIN_REGION a region is dropped instead:
+    while (total > budget) {
+        uint32_t cheapest = uint32_t(-1);
+        float cheapest_value = std::numeric_limits<float>::infinity();
+        for (uint32_t i = 0; i < sizes.size(); ++i) {
+            if (sizes[i] == 0) continue;
+            float value = importance[i] / float(sizes[i]) + (sizes[i] > MIN_REGION ? 0.0f : 1.0f); // (shrink everything else to MIN_REGION first)
+            if (value < cheapest_value) {
+                cheapest = i;
+                cheapest_value = value;
+            }
+        }
+        assert(cheapest != uint32_t(-1));
+        uint32_t &region_size = sizes[cheapest];
+        uint32_t smaller = region_size > MIN_REGION ? region_size / 2 : 0;
+        total -= uint64_t(region_size) * region_size - uint64_t(smaller) * smaller;
+        region_size = smaller;
+    }
 }
 
 void RTGRenderer::ShadowAtlas::debug()
@@ -74,4 +209,34 @@ glm::mat4 RTGRenderer::ShadowAtlas::calculate_shadow_atlas_matrix(const glm::mat
     shadow_matrix = offset_to_atlas * shadow_matrix;
 
     return shadow_matrix;
-}
\ No newline at end of file
+}
+
+void RTGRenderer::ShadowAtlas::set_contents(std::vector<uint64_t> const &contents)
+{
+    wanted_contents = contents;
+    // new regions have never been rendered
+    rendered_contents.resize(wanted_contents.size(), 0);
+}
+
+//splitmix64 finalizer, spreads every input bit over the whole result
+static uint64_t mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+uint64_t RTGRenderer::ShadowAtlas::light_hash(const glm::mat4& light_from_world, const Region& region) {
+    uint64_t hash = mix((uint64_t(region.x) << 32) | region.y) ^ mix(region.size);
+    const float *values = &light_from_world[0][0];
+    for (uint32_t i = 0; i < 16; ++i) {
+        uint32_t bits;
+        std::memcpy(&bits, &values[i], sizeof(bits));
+        hash = mix(hash ^ bits);
+    }
+    return hash | 1; // a light without casters never hashes to the 0 that marks never-rendered regions
+}
+
+uint64_t RTGRenderer::ShadowAtlas::caster_hash(uint32_t instance, uint32_t transform_serial) {
+    return mix((uint64_t(instance) << 32) | transform_serial);
+}
@@ -17,14 +17,20 @@ void RTGRenderer::ShadowAtlasPipeline::create(RTG &rtg, VkRenderPass render_pass
     VkShaderModule frag_module = rtg.helpers.create_shader_module(frag_code);
 
 
-    {//the set0_Transforms layout holds an array of Transform structures in a storage buffer used in the vertex shader:
-		std::array<VkDescriptorSetLayoutBinding, 1> bindings{
+    {//the set0_Transforms layout holds an array of Transform structures in a storage buffer used in the vertex shader (same bindings as LambertianPipeline::set1_Transforms):
+		std::array<VkDescriptorSetLayoutBinding, 2> bindings{
 			VkDescriptorSetLayoutBinding{
 				.binding = 0,
 				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 				.descriptorCount = 1,
 				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT
 			},
+			VkDescriptorSetLayoutBinding{ // per-instance material index (unused here, but keeps the layout identical to set1_Transforms)
+				.binding = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+				.descriptorCount = 1,
+				.stageFlags = VK_SHADER_STAGE_VERTEX_BIT
+			},
 		};
 		
 		VkDescriptorSetLayoutCreateInfo create_info{
@@ -148,7 +154,7 @@ void RTGRenderer::ShadowAtlasPipeline::create(RTG &rtg, VkRenderPass render_pass
 			.subpass = subpass,
         };
 
-        VK(vkCreateGraphicsPipelines(rtg.device, VK_NULL_HANDLE, 1, &create_info, nullptr, &handle));
+        VK(vkCreateGraphicsPipelines(rtg.device, rtg.pipeline_cache, 1, &create_info, nullptr, &handle));
 
         //modules no longer needed now that the pipeline is created
         vkDestroyShaderModule(rtg.device, frag_module, nullptr);
@@ -0,0 +1,81 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t thread_count) {
+	if (thread_count == 0) {
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	}
+	workers.reserve(thread_count);
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		workers.emplace_back([this]() {
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				job_ready.wait(lock, [this]() { return quit || !jobs.empty(); });
+				if (jobs.empty()) break; //(quit, and nothing left to do)
+
+				std::function< void() > job = std::move(jobs.front());
+				jobs.pop_front();
+				running += 1;
+
+				lock.unlock();
+				try {
+					job();
+				} catch (...) {
+					std::lock_guard< std::mutex > error_lock(mutex);
+					if (!error) error = std::current_exception();
+				}
+				lock.lock();
+
+				running -= 1;
+				if (running == 0 && jobs.empty()) jobs_done.notify_all();
+			}
+		});
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	job_ready.notify_all();
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::run(std::function< void() > job) {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		jobs.emplace_back(std::move(job));
+	}
+	job_ready.notify_one();
+}
+
+void ThreadPool::wait() {
+	std::unique_lock< std::mutex > lock(mutex);
+	jobs_done.wait(lock, [this]() { return running == 0 && jobs.empty(); });
+	if (error) {
+		std::exception_ptr to_throw = error;
+		error = nullptr;
+		std::rethrow_exception(to_throw);
+	}
+}
+
+void ThreadPool::parallel_for(uint32_t count, uint32_t min_chunk, std::function< void(uint32_t chunk, uint32_t begin, uint32_t end) > const &body) {
+	if (count == 0) return;
+	uint32_t chunks = std::min(size(), std::max(1u, count / std::max(1u, min_chunk)));
+	if (chunks <= 1) {
+		body(0, 0, count);
+		return;
+	}
+	for (uint32_t chunk = 0; chunk < chunks; ++chunk) {
+		uint32_t begin = uint32_t(uint64_t(count) * chunk / chunks);
+		uint32_t end = uint32_t(uint64_t(count) * (chunk + 1) / chunks);
+		run([&body, chunk, begin, end]() {
+			body(chunk, begin, end);
+		});
+	}
+	wait();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+//A fixed set of worker threads pulling jobs off a shared queue:
+struct ThreadPool {
+	ThreadPool(uint32_t thread_count); //0 means "one per hardware thread"
+	ThreadPool(ThreadPool const &) = delete; //you shouldn't be copying ThreadPool
+	~ThreadPool(); //finishes any queued jobs, then joins the workers
+
+	//queue a job to be run on some worker:
+	void run(std::function< void() > job);
+
+	//block until all queued jobs have finished; rethrows the first exception a job threw (if any):
+	void wait();
+
+	//split [0,count) into at most size() contiguous chunks of at least min_chunk items,
+	// run body(chunk, begin, end) on each (chunk < size()), and wait for them all:
+	// (runs on the calling thread when there is only one chunk)
+	void parallel_for(uint32_t count, uint32_t min_chunk, std::function< void(uint32_t chunk, uint32_t begin, uint32_t end) > const &body);
+
+	uint32_t size() const { return uint32_t(workers.size()); }
+
+	//internals:
+	std::vector< std::thread > workers;
+	std::deque< std::function< void() > > jobs;
+	std::mutex mutex;
+	std::condition_variable job_ready; //signalled when a job is queued (or on quit)
+	std::condition_variable jobs_done; //signalled when the pool goes idle
+	uint32_t running = 0; //jobs currently being executed
+	std::exception_ptr error; //first exception thrown by a job
+	bool quit = false;
+};
@@ -0,0 +1,215 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <numeric>
+
+static AABB merged(AABB const &a, AABB const &b) {
+	return AABB{
+		.min = glm::min(a.min, b.min),
+		.max = glm::max(a.max, b.max),
+	};
+}
+
+static float surface_area(AABB const &aabb) {
+	glm::vec3 size = glm::max(aabb.max - aabb.min, glm::vec3(0.0f));
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+//split order[first, first + count) at the median centroid along the longest axis of the centroids' bounds:
+static uint32_t build_node(BVH &bvh, uint32_t first, uint32_t count, uint32_t parent) {
+	uint32_t index = uint32_t(bvh.nodes.size());
+	bvh.nodes.emplace_back(BVH::Node{
+		.first = first,
+		.count = count,
+		.parent = parent,
+	});
+
+	AABB bounds;
+	AABB centroids;
+	for (uint32_t i = first; i < first + count; ++i) {
+		AABB const &item = bvh.item_bounds[bvh.order[i]];
+		bounds = merged(bounds, item);
+		glm::vec3 centroid = 0.5f * (item.min + item.max);
+		centroids = merged(centroids, AABB{ .min = centroid, .max = centroid });
+	}
+	bvh.nodes[index].bounds = bounds;
+
+	if (count <= BVH::LEAF_ITEMS) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			bvh.item_leaf[bvh.order[i]] = index;
+		}
+		return index;
+	}
+
+	glm::vec3 extent = centroids.max - centroids.min;
+	int axis = 0;
+	if (extent.y > extent[axis]) axis = 1;
+	if (extent.z > extent[axis]) axis = 2;
+
+	uint32_t half = count / 2;
+	std::nth_element(bvh.order.begin() + first, bvh.order.begin() + first + half, bvh.order.begin() + first + count, [&](uint32_t a, uint32_t b) {
+		AABB const &box_a = bvh.item_bounds[a];
+		AABB const &box_b = bvh.item_bounds[b];
+		return box_a.min[axis] + box_a.max[axis] < box_b.min[axis] + box_b.max[axis];
+	});
+
+	//(nodes may be re-allocated by the recursion, so no references are held across it)
+	uint32_t left = build_node(bvh, first, half, index);
+	uint32_t right = build_node(bvh, first + half, count - half, index);
+	bvh.nodes[index].left = left;
+	bvh.nodes[index].right = right;
+	return index;
+}
+
+void BVH::build(std::vector< OBBHalfAxes > const &boxes) {
+	item_boxes = boxes;
+	item_bounds.clear();
+	item_bounds.reserve(item_boxes.size());
+	for (OBBHalfAxes const &box : item_boxes) {
+		item_bounds.emplace_back(half_axes_bounds(box));
+	}
+	rebuild();
+}
+
+void BVH::rebuild() {
+	uint32_t item_count = uint32_t(item_bounds.size());
+
+	order.resize(item_count);
+	std::iota(order.begin(), order.end(), 0);
+	item_leaf.assign(item_count, uint32_t(-1));
+
+	nodes.clear();
+	if (item_count > 0) {
+		nodes.reserve(2 * ((item_count + LEAF_ITEMS - 1) / LEAF_ITEMS));
+		build_node(*this, 0, item_count, uint32_t(-1));
+	}
+
+	item_slot.resize(item_count);
+	leaf_boxes.resize(item_count);
+	for (uint32_t slot = 0; slot < item_count; ++slot) {
+		item_slot[order[slot]] = slot;
+		leaf_boxes.set(slot, item_boxes[order[slot]]);
+	}
+
+	node_dirty.assign(nodes.size(), 0);
+	any_dirty = false;
+
+	area = 0.0f;
+	for (Node const &node : nodes) {
+		area += surface_area(node.bounds);
+	}
+	built_area = area;
+}
+
+void BVH::update(uint32_t item, OBBHalfAxes const &box) {
+	assert(item < item_boxes.size());
+	item_boxes[item] = box;
+	item_bounds[item] = half_axes_bounds(box);
+	leaf_boxes.set(item_slot[item], box);
+
+	//mark the path to the root, stopping where another moved item already marked it:
+	for (uint32_t node = item_leaf[item]; node != uint32_t(-1) && !node_dirty[node]; node = nodes[node].parent) {
+		node_dirty[node] = 1;
+	}
+	any_dirty = true;
+}
+
+void BVH::refit() {
+	if (!any_dirty) return;
+
+	//children come after their parents, so walking backwards finishes children first:
+	for (uint32_t index = uint32_t(nodes.size()); index-- > 0; ) {
+		if (!node_dirty[index]) continue;
+		node_dirty[index] = 0;
+
+		Node &node = nodes[index];
+		AABB bounds;
+		if (node.left == uint32_t(-1)) {
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				bounds = merged(bounds, item_bounds[order[i]]);
+			}
+		}
+		else {
+			bounds = merged(nodes[node.left].bounds, nodes[node.right].bounds);
+		}
+		area += surface_area(bounds) - surface_area(node.bounds);
+		node.bounds = bounds;
+	}
+	any_dirty = false;
+}
+
+bool BVH::degraded() const {
+	return area > 2.0f * built_area;
+}
+
+void BVH::cull(std::vector< FrustumPlanes > const &frusta, uint32_t accept_mask, std::vector< Visible > &out) const {
+	assert(frusta.size() <= MAX_FRUSTA);
+	if (nodes.empty() || frusta.empty()) return;
+
+	uint32_t all_frusta = frusta.size() == MAX_FRUSTA ? ~0u : (1u << frusta.size()) - 1u;
+
+	//frusta still cutting through the node ("partial") need testing further down; the others already contain it:
+	struct Entry {
+		uint32_t node;
+		uint32_t partial;
+		uint32_t inside;
+	};
+	std::vector< Entry > stack;
+	stack.emplace_back(Entry{
+		.node = 0,
+		.partial = all_frusta & ~accept_mask,
+		.inside = all_frusta & accept_mask,
+	});
+
+	while (!stack.empty()) {
+		Entry entry = stack.back();
+		stack.pop_back();
+		Node const &node = nodes[entry.node];
+
+		uint32_t partial = entry.partial;
+		uint32_t inside = entry.inside;
+		for (uint32_t bits = entry.partial; bits != 0; bits &= bits - 1) {
+			uint32_t bit = bits & (~bits + 1);
+			Containment containment = classify_aabb(frusta[std::countr_zero(bit)], node.bounds);
+			if (containment == Containment::Outside) {
+				partial &= ~bit;
+			}
+			else if (containment == Containment::Inside) {
+				partial &= ~bit;
+				inside |= bit;
+			}
+		}
+
+		if ((partial | inside) == 0) continue; //outside every frustum
+
+		if (partial == 0) { //inside the remaining frusta; take the whole subtree
+			for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+				out.emplace_back(Visible{ .item = order[i], .frusta = inside });
+			}
+		}
+		else if (node.left == uint32_t(-1)) { //leaf; test its boxes against each frustum still cutting it, one batch per frustum
+			static_assert(LEAF_ITEMS <= 32, "leaf visibility fits one check_frustum_obb_batch mask");
+			std::array< uint32_t, LEAF_ITEMS > visible;
+			visible.fill(inside);
+			for (uint32_t bits = partial; bits != 0; bits &= bits - 1) {
+				uint32_t bit = bits & (~bits + 1);
+				uint32_t boxes = check_frustum_obb_batch(frusta[std::countr_zero(bit)], leaf_boxes, node.first, node.count);
+				for (; boxes != 0; boxes &= boxes - 1) {
+					visible[std::countr_zero(boxes)] |= bit;
+				}
+			}
+			for (uint32_t i = 0; i < node.count; ++i) {
+				if (visible[i] != 0) {
+					out.emplace_back(Visible{ .item = order[node.first + i], .frusta = visible[i] });
+				}
+			}
+		}
+		else {
+			stack.emplace_back(Entry{ .node = node.right, .partial = partial, .inside = inside });
+			stack.emplace_back(Entry{ .node = node.left, .partial = partial, .inside = inside });
+		}
+	}
+}
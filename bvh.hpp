@@ -0,0 +1,61 @@
+#pragma once
+
+#include "frustum_culling.hpp"
+
+#include <vector>
+#include <cstdint>
+
+//Bounding volume hierarchy over a fixed set of world-space oriented boxes ("items").
+// built top-down once, then refit in place when items move; rebuild() when refits have loosened it too much.
+struct BVH {
+	static constexpr uint32_t LEAF_ITEMS = 8; //most items stored in one leaf; a leaf's boxes are tested as one batch
+	static constexpr uint32_t MAX_FRUSTA = 32; //frusta tested per traversal, one bit each
+
+	struct Node {
+		AABB bounds;
+		uint32_t first = 0; //items of the whole subtree are order[first, first + count)
+		uint32_t count = 0;
+		uint32_t left = uint32_t(-1); //children, or -1 for leaves; right child follows the left subtree
+		uint32_t right = uint32_t(-1);
+		uint32_t parent = uint32_t(-1);
+	};
+
+	//item visible to at least one frustum, with a bit set for every frustum it may be visible to:
+	struct Visible {
+		uint32_t item;
+		uint32_t frusta;
+	};
+
+	//replace all items; item i is boxes[i]:
+	void build(std::vector< OBBHalfAxes > const &boxes);
+
+	//rebuild over the current item bounds:
+	void rebuild();
+
+	//move one item; takes effect on the next refit():
+	void update(uint32_t item, OBBHalfAxes const &box);
+
+	//grow/shrink the nodes above moved items to fit them again:
+	void refit();
+
+	//true when refits have grown the tree's total node area well past what it was when built:
+	bool degraded() const;
+
+	//append every item touching any of frusta (at most MAX_FRUSTA) to out.
+	// frusta whose bit is set in accept_mask are not tested and take every item.
+	// whole subtrees inside or outside a frustum are accepted or rejected without visiting their items;
+	// leaves still cut by a frustum test their boxes with check_frustum_obb_batch:
+	void cull(std::vector< FrustumPlanes > const &frusta, uint32_t accept_mask, std::vector< Visible > &out) const;
+
+	std::vector< Node > nodes; //nodes[0] is the root; parents come before their children
+	std::vector< uint32_t > order; //item indices, grouped by leaf
+	std::vector< OBBHalfAxes > item_boxes;
+	std::vector< AABB > item_bounds; //enclosing item_boxes
+	OBBBatch leaf_boxes; //item_boxes in the same order as order, so every node's items are one contiguous batch
+	std::vector< uint32_t > item_slot; //position of each item in order
+	std::vector< uint32_t > item_leaf; //leaf node holding each item
+	std::vector< uint8_t > node_dirty; //nodes with moved items below them, cleared by refit()
+	bool any_dirty = false;
+	float built_area = 0.0f; //sum of node surface areas right after the last build
+	float area = 0.0f; //current sum of node surface areas
+};
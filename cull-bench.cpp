@@ -0,0 +1,99 @@
+//Microbenchmark: scalar check_frustum_obb_intersection vs. the batched check_frustum_obb_batch.
+//$ node Maekfile.js bin/cull-bench && bin/cull-bench [box-count]
+
+#include "frustum_culling.hpp"
+#include "mat4.hpp"
+
+#include "GLM.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main(int argc, char **argv) {
+	uint32_t box_count = 1 << 16;
+	if (argc > 1) box_count = uint32_t(std::max(1, std::atoi(argv[1])));
+	constexpr uint32_t Runs = 20; //best of
+
+	//boxes scattered around a camera at the origin, so some are inside the frustum and many are not:
+	std::mt19937 mt(0x0b0c0d0e);
+	std::uniform_real_distribution< float > position(-100.0f, 100.0f);
+	std::uniform_real_distribution< float > size(0.1f, 4.0f);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+
+	AABB local{ .min = glm::vec3(-0.5f), .max = glm::vec3(0.5f) };
+	std::vector< OBB > obbs;
+	obbs.reserve(box_count);
+	OBBBatch batch;
+	batch.resize(box_count);
+	for (uint32_t i = 0; i < box_count; ++i) {
+		glm::quat rotation = glm::normalize(glm::quat(unit(mt), unit(mt), unit(mt), unit(mt)));
+		glm::mat4x4 world_from_local = glm::mat4x4(1.0f);
+		world_from_local[3] = glm::vec4(position(mt), position(mt), position(mt), 1.0f);
+		world_from_local *= glm::mat4_cast(rotation);
+		world_from_local[0] *= size(mt);
+		world_from_local[1] *= size(mt);
+		world_from_local[2] *= size(mt);
+
+		obbs.emplace_back(AABB_transform_to_OBB(world_from_local, local));
+		batch.set(i, AABB_transform_to_half_axes(world_from_local, local));
+	}
+
+	glm::mat4x4 clip_from_view = glm::make_mat4(perspective(1.0f, 16.0f / 9.0f, 0.1f, 80.0f).data());
+	glm::mat4x4 view_from_world = glm::make_mat4(look_at(
+		0.0f, 0.0f, 0.0f, //eye
+		1.0f, 0.5f, 0.2f, //target
+		0.0f, 0.0f, 1.0f //up
+	).data());
+	FrustumPlanes frustum = make_frustum_planes(clip_from_view * view_from_world);
+
+	std::vector< uint8_t > scalar_visible(box_count);
+	std::vector< uint32_t > batch_visible((box_count + 31) / 32);
+
+	using Clock = std::chrono::high_resolution_clock;
+	auto best_of = [&](auto &&run) {
+		double best = std::numeric_limits< double >::infinity();
+		for (uint32_t r = 0; r < Runs; ++r) {
+			auto before = Clock::now();
+			run();
+			auto after = Clock::now();
+			best = std::min(best, std::chrono::duration< double >(after - before).count());
+		}
+		return best;
+	};
+
+	double scalar_seconds = best_of([&]() {
+		for (uint32_t i = 0; i < box_count; ++i) {
+			scalar_visible[i] = check_frustum_obb_intersection(frustum.corners, obbs[i]);
+		}
+	});
+
+	double batch_seconds = best_of([&]() {
+		for (uint32_t first = 0; first < box_count; first += 32) {
+			batch_visible[first / 32] = check_frustum_obb_batch(frustum, batch, first, std::min(32u, box_count - first));
+		}
+	});
+
+	uint32_t scalar_count = 0, batch_count = 0, missed = 0;
+	for (uint32_t i = 0; i < box_count; ++i) {
+		bool in_batch = (batch_visible[i / 32] >> (i % 32)) & 1u;
+		scalar_count += scalar_visible[i];
+		batch_count += in_batch;
+		if (scalar_visible[i] && !in_batch) ++missed;
+	}
+
+	std::cout << box_count << " boxes, batch width " << obb_batch_width() << ", best of " << Runs << " runs:\n";
+	std::cout << "  scalar: " << (scalar_seconds * 1e9 / box_count) << " ns/box, " << scalar_count << " visible\n";
+	std::cout << "  batch:  " << (batch_seconds * 1e9 / box_count) << " ns/box, " << batch_count << " visible"
+	          << " (" << (batch_count - scalar_count) << " extra, kept by skipping the edge-cross-product axes)\n";
+	std::cout << "  speedup: " << (scalar_seconds / batch_seconds) << "x" << std::endl;
+
+	if (missed != 0) {
+		std::cerr << "ERROR: batch culled " << missed << " boxes the scalar test keeps." << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -1,5 +1,16 @@
 #include "frustum_culling.hpp"
 #include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FRUSTUM_CULLING_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FRUSTUM_CULLING_NEON
+#endif
 
 
 CullingFrustum make_frustum(float vfov, float aspect, float z_near, float z_far)
@@ -14,6 +25,62 @@ CullingFrustum make_frustum(float vfov, float aspect, float z_near, float z_far)
     };
 }
 
+FrustumPlanes make_frustum_planes(const glm::mat4x4& clip_from_world)
+{
+    // rows of clip_from_world (glm is column-major)
+    glm::vec4 row_x = glm::vec4(clip_from_world[0][0], clip_from_world[1][0], clip_from_world[2][0], clip_from_world[3][0]);
+    glm::vec4 row_y = glm::vec4(clip_from_world[0][1], clip_from_world[1][1], clip_from_world[2][1], clip_from_world[3][1]);
+    glm::vec4 row_z = glm::vec4(clip_from_world[0][2], clip_from_world[1][2], clip_from_world[2][2], clip_from_world[3][2]);
+    glm::vec4 row_w = glm::vec4(clip_from_world[0][3], clip_from_world[1][3], clip_from_world[2][3], clip_from_world[3][3]);
+
+    FrustumPlanes frustum{
+        .planes = {
+            row_w + row_x, // left
+            row_w - row_x, // right
+            row_w + row_y, // top or bottom, depending on the projection's y flip
+            row_w - row_y,
+            row_z,         // near
+            row_w - row_z, // far
+        },
+    };
+    for (glm::vec4& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    const std::array<glm::vec4, 8> clip_corners = {
+        glm::vec4( 1.0f,  1.0f, 0.0f, 1.0f), // Near top right
+        glm::vec4(-1.0f,  1.0f, 0.0f, 1.0f), // Near top left
+        glm::vec4( 1.0f, -1.0f, 0.0f, 1.0f), // Near bottom right
+        glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f), // Near bottom left
+        glm::vec4( 1.0f,  1.0f, 1.0f, 1.0f), // Far top right
+        glm::vec4(-1.0f,  1.0f, 1.0f, 1.0f), // Far top left
+        glm::vec4( 1.0f, -1.0f, 1.0f, 1.0f), // Far bottom right
+        glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f), // Far bottom left
+    };
+    glm::mat4x4 world_from_clip = glm::inverse(clip_from_world);
+    for (size_t i = 0; i < clip_corners.size(); ++i) {
+        glm::vec4 corner = world_from_clip * clip_corners[i];
+        frustum.corners[i] = glm::vec3(corner) / corner.w;
+    }
+    return frustum;
+}
+
+Containment classify_aabb(const FrustumPlanes& frustum, const AABB& aabb)
+{
+    glm::vec3 center = 0.5f * (aabb.max + aabb.min);
+    glm::vec3 half_extents = 0.5f * (aabb.max - aabb.min);
+
+    Containment result = Containment::Inside;
+    for (const glm::vec4& plane : frustum.planes) {
+        glm::vec3 normal = glm::vec3(plane);
+        float distance = glm::dot(normal, center) + plane.w;
+        float radius = glm::dot(half_extents, glm::abs(normal));
+        if (distance < -radius) return Containment::Outside;
+        if (distance < radius) result = Containment::Intersecting;
+    }
+    return result;
+}
+
 OBB AABB_transform_to_OBB(const glm::mat4x4 &transform_mat, const AABB &aabb)
 {
     // Consider four adjacent corners of the ABB
@@ -49,6 +116,169 @@ OBB AABB_transform_to_OBB(const glm::mat4x4 &transform_mat, const AABB &aabb)
     return obb;
 }
 
+OBBHalfAxes AABB_transform_to_half_axes(const glm::mat4x4& transform_mat, const AABB& aabb)
+{
+    glm::vec3 center = 0.5f * (aabb.max + aabb.min);
+    glm::vec3 half_extents = 0.5f * (aabb.max - aabb.min);
+    return OBBHalfAxes{
+        .center = glm::vec3(transform_mat * glm::vec4(center, 1.0f)),
+        .half_axes = {
+            glm::vec3(transform_mat[0]) * half_extents.x,
+            glm::vec3(transform_mat[1]) * half_extents.y,
+            glm::vec3(transform_mat[2]) * half_extents.z,
+        },
+    };
+}
+
+AABB half_axes_bounds(const OBBHalfAxes& box)
+{
+    glm::vec3 reach = glm::abs(box.half_axes[0]) + glm::abs(box.half_axes[1]) + glm::abs(box.half_axes[2]);
+    return AABB{
+        .min = box.center - reach,
+        .max = box.center + reach,
+    };
+}
+
+void OBBBatch::resize(uint32_t count)
+{
+    size = count;
+    for (std::vector<float>* lane : { &center_x, &center_y, &center_z }) {
+        lane->assign(count + Padding, 0.0f);
+    }
+    for (uint32_t i = 0; i < 3; ++i) {
+        axis_x[i].assign(count + Padding, 0.0f);
+        axis_y[i].assign(count + Padding, 0.0f);
+        axis_z[i].assign(count + Padding, 0.0f);
+    }
+}
+
+void OBBBatch::set(uint32_t index, const OBBHalfAxes& box)
+{
+    assert(index < size);
+    center_x[index] = box.center.x;
+    center_y[index] = box.center.y;
+    center_z[index] = box.center.z;
+    for (uint32_t i = 0; i < 3; ++i) {
+        axis_x[i][index] = box.half_axes[i].x;
+        axis_y[i][index] = box.half_axes[i].y;
+        axis_z[i][index] = box.half_axes[i].z;
+    }
+}
+
+// one SIMD register of floats ("Lanes") and of comparison results ("Mask"):
+namespace {
+#if defined(FRUSTUM_CULLING_SSE2)
+struct Lanes { __m128 v; };
+struct Mask { __m128 v; };
+constexpr uint32_t LaneCount = 4;
+inline Lanes load(const float* p) { return { _mm_loadu_ps(p) }; }
+inline Lanes broadcast(float f) { return { _mm_set1_ps(f) }; }
+inline Lanes operator+(Lanes a, Lanes b) { return { _mm_add_ps(a.v, b.v) }; }
+inline Lanes operator-(Lanes a, Lanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline Lanes operator*(Lanes a, Lanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline Lanes abs(Lanes a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+inline Lanes min(Lanes a, Lanes b) { return { _mm_min_ps(a.v, b.v) }; }
+inline Lanes max(Lanes a, Lanes b) { return { _mm_max_ps(a.v, b.v) }; }
+inline Mask less(Lanes a, Lanes b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+inline Mask operator|(Mask a, Mask b) { return { _mm_or_ps(a.v, b.v) }; }
+inline Mask none() { return { _mm_setzero_ps() }; }
+inline uint32_t bits(Mask m) { return uint32_t(_mm_movemask_ps(m.v)); }
+#elif defined(FRUSTUM_CULLING_NEON)
+struct Lanes { float32x4_t v; };
+struct Mask { uint32x4_t v; };
+constexpr uint32_t LaneCount = 4;
+inline Lanes load(const float* p) { return { vld1q_f32(p) }; }
+inline Lanes broadcast(float f) { return { vdupq_n_f32(f) }; }
+inline Lanes operator+(Lanes a, Lanes b) { return { vaddq_f32(a.v, b.v) }; }
+inline Lanes operator-(Lanes a, Lanes b) { return { vsubq_f32(a.v, b.v) }; }
+inline Lanes operator*(Lanes a, Lanes b) { return { vmulq_f32(a.v, b.v) }; }
+inline Lanes abs(Lanes a) { return { vabsq_f32(a.v) }; }
+inline Lanes min(Lanes a, Lanes b) { return { vminq_f32(a.v, b.v) }; }
+inline Lanes max(Lanes a, Lanes b) { return { vmaxq_f32(a.v, b.v) }; }
+inline Mask less(Lanes a, Lanes b) { return { vcltq_f32(a.v, b.v) }; }
+inline Mask operator|(Mask a, Mask b) { return { vorrq_u32(a.v, b.v) }; }
+inline Mask none() { return { vdupq_n_u32(0) }; }
+inline uint32_t bits(Mask m) {
+    const uint32x4_t lane_bits = { 1u, 2u, 4u, 8u };
+    return vaddvq_u32(vandq_u32(m.v, lane_bits));
+}
+#else
+struct Lanes { float v; };
+struct Mask { bool v; };
+constexpr uint32_t LaneCount = 1;
+inline Lanes load(const float* p) { return { *p }; }
+inline Lanes broadcast(float f) { return { f }; }
+inline Lanes operator+(Lanes a, Lanes b) { return { a.v + b.v }; }
+inline Lanes operator-(Lanes a, Lanes b) { return { a.v - b.v }; }
+inline Lanes operator*(Lanes a, Lanes b) { return { a.v * b.v }; }
+inline Lanes abs(Lanes a) { return { std::abs(a.v) }; }
+inline Lanes min(Lanes a, Lanes b) { return { std::min(a.v, b.v) }; }
+inline Lanes max(Lanes a, Lanes b) { return { std::max(a.v, b.v) }; }
+inline Mask less(Lanes a, Lanes b) { return { a.v < b.v }; }
+inline Mask operator|(Mask a, Mask b) { return { a.v || b.v }; }
+inline Mask none() { return { false }; }
+inline uint32_t bits(Mask m) { return m.v ? 1u : 0u; }
+#endif
+}
+
+uint32_t obb_batch_width()
+{
+    return LaneCount;
+}
+
+uint32_t check_frustum_obb_batch(const FrustumPlanes& frustum, const OBBBatch& boxes, uint32_t first, uint32_t count)
+{
+    assert(count <= 32);
+    assert(first + count <= boxes.size);
+    static_assert(LaneCount <= OBBBatch::Padding, "a batch loaded at the last box stays inside the padding");
+
+    uint32_t visible = 0;
+    for (uint32_t offset = 0; offset < count; offset += LaneCount) {
+        uint32_t index = first + offset;
+        Lanes cx = load(&boxes.center_x[index]);
+        Lanes cy = load(&boxes.center_y[index]);
+        Lanes cz = load(&boxes.center_z[index]);
+        Lanes ax[3], ay[3], az[3];
+        for (uint32_t i = 0; i < 3; ++i) {
+            ax[i] = load(&boxes.axis_x[i][index]);
+            ay[i] = load(&boxes.axis_y[i][index]);
+            az[i] = load(&boxes.axis_z[i][index]);
+        }
+
+        Mask outside = none();
+
+        // frustum planes: outside when the center is farther behind the plane than the box reaches
+        for (const glm::vec4& plane : frustum.planes) {
+            Lanes nx = broadcast(plane.x), ny = broadcast(plane.y), nz = broadcast(plane.z);
+            Lanes distance = nx * cx + ny * cy + nz * cz + broadcast(plane.w);
+            Lanes reach = abs(nx * ax[0] + ny * ay[0] + nz * az[0])
+                        + abs(nx * ax[1] + ny * ay[1] + nz * az[1])
+                        + abs(nx * ax[2] + ny * ay[2] + nz * az[2]);
+            outside = outside | less(distance + reach, broadcast(0.0f));
+        }
+
+        // box axes: separated when the frustum corners all project past the box.
+        // (projecting onto the unnormalized half axis h scales everything by |h|, so the box spans center +/- h.h)
+        for (uint32_t i = 0; i < 3; ++i) {
+            Lanes center = ax[i] * cx + ay[i] * cy + az[i] * cz;
+            Lanes extent = ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i];
+            Lanes lowest = broadcast(std::numeric_limits<float>::infinity());
+            Lanes highest = broadcast(-std::numeric_limits<float>::infinity());
+            for (const glm::vec3& corner : frustum.corners) {
+                Lanes projected = ax[i] * broadcast(corner.x) + ay[i] * broadcast(corner.y) + az[i] * broadcast(corner.z);
+                lowest = min(lowest, projected);
+                highest = max(highest, projected);
+            }
+            outside = outside | less(highest, center - extent) | less(center + extent, lowest);
+        }
+
+        visible |= (~bits(outside) & ((1u << LaneCount) - 1u)) << offset;
+    }
+
+    // drop padding lanes past count:
+    return count == 32 ? visible : visible & ((1u << count) - 1u);
+}
+
 // Utility to project a point onto an axis (returns the scalar projection)
 float project_point_onto_axis(const glm::vec3& point, const glm::vec3& axis) {
     return glm::dot(point, glm::normalize(axis));
@@ -3,6 +3,8 @@
 #include "GLM.hpp"
 #include <limits>
 #include <array>
+#include <vector>
+#include <cstdint>
 // concept and code adapted from https://bruop.github.io/improved_frustum_culling/
 
 struct AABB // axis aligned bounding box
@@ -28,8 +30,59 @@ struct CullingFrustum
 
 CullingFrustum make_frustum(float vfov, float aspect, float z_near, float z_far);
 
+struct FrustumPlanes // planes as (normal, offset), normals pointing into the frustum
+{
+    std::array<glm::vec4, 6> planes;
+    std::array<glm::vec3, 8> corners; // in the order check_frustum_obb_intersection expects
+};
+
+// planes and corners of the vulkan clip volume (depth in [0,w]) pulled back into world space
+FrustumPlanes make_frustum_planes(const glm::mat4x4& clip_from_world);
+
+enum class Containment : uint8_t {
+    Outside,
+    Intersecting,
+    Inside,
+};
+
+// conservative: boxes near frustum corners may be reported Intersecting while actually outside
+Containment classify_aabb(const FrustumPlanes& frustum, const AABB& aabb);
+
 OBB AABB_transform_to_OBB(const glm::mat4x4& transform_mat, const AABB& aabb);
 
+struct OBBHalfAxes // oriented box as center plus half-length edge vectors; unlike OBB, stays finite for flat boxes
+{
+    glm::vec3 center;
+    glm::vec3 half_axes[3];
+};
+
+OBBHalfAxes AABB_transform_to_half_axes(const glm::mat4x4& transform_mat, const AABB& aabb);
+
+// axis aligned box enclosing the oriented box
+AABB half_axes_bounds(const OBBHalfAxes& box);
+
+// oriented boxes in structure-of-arrays layout, for check_frustum_obb_batch.
+// arrays are padded so a full batch can be loaded starting at any box
+struct OBBBatch
+{
+    static constexpr uint32_t Padding = 4;
+
+    std::vector<float> center_x, center_y, center_z;
+    std::array<std::vector<float>, 3> axis_x, axis_y, axis_z; // components of half_axes[0..2]
+    uint32_t size = 0;
+
+    void resize(uint32_t count);
+    void set(uint32_t index, const OBBHalfAxes& box);
+};
+
+// boxes tested per step by check_frustum_obb_batch: 4 with SSE2 or NEON, otherwise 1
+uint32_t obb_batch_width();
+
+// bit i is set when box first + i may intersect the frustum (count <= 32).
+// only tries the frustum planes and the box axes -- the cheap separating axes -- so, up to rounding,
+// it never rejects a box check_frustum_obb_intersection accepts
+uint32_t check_frustum_obb_batch(const FrustumPlanes& frustum, const OBBBatch& boxes, uint32_t first, uint32_t count);
+
 float project_point_onto_axis(const glm::vec3& point, const glm::vec3& axis);
 
 void project_obb_onto_axis(const OBB& obb, const glm::vec3& axis, float& min_proj, float& max_proj);
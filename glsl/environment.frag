@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 #ifndef TONEMAP
 	#include "tonemap.glsl"
@@ -10,19 +11,21 @@ layout(set=0,binding=0,std140) uniform World {
 };
 
 layout(set=0, binding=1) uniform samplerCube ENVIRONMENT;
-layout(set=2, binding=0) uniform sampler2D NORMAL;
-layout(set=2, binding=1) uniform sampler2D DISPLACEMENT;
+#ifndef MATERIAL
+	#include "material.glsl"
+#endif
 
 layout(location=0) in vec3 position;
 layout(location=1) in vec2 texCoord;
 layout(location=2) in mat3 TBN;
+layout(location=5) flat in uint material;
 
 
 layout(location=0) out vec4 outColor;
 
 void main() {
 	// Sample the normal map and convert from [0,1] to [-1,1]
-    vec3 normal_rgb = texture(NORMAL, texCoord).rgb; 
+    vec3 normal_rgb = texture(TEXTURES[nonuniformEXT(MATERIALS[material].NORMAL)], texCoord).rgb; 
     vec3 tangentNormal = normalize(normal_rgb * 2.0 - 1.0); 
 
     // Transform the normal from tangent space to world space
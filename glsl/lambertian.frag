@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 #ifndef TONEMAP
 	#include "tonemap.glsl"
@@ -31,27 +32,49 @@ layout(set=0, binding=5, std140) readonly buffer SpotLights {
 
 layout(set=0, binding=6) uniform sampler2DShadow SHADOW_ATLAS;
 
-layout(set=2, binding=0) uniform sampler2D NORMAL;
-layout(set=2, binding=1) uniform sampler2D DISPLACEMENT;
-layout(set=2, binding=2) uniform sampler2D ALBEDO;
+#ifndef MATERIAL
+	#include "material.glsl"
+#endif
 
 layout(location=0) in vec3 position;
 layout(location=1) in vec2 texCoord;
 layout(location=2) in mat3 TBN;
+layout(location=5) flat in uint material;
 
 layout(location=0) out vec4 outColor;
 
+// shadow from the nearest cascade covering the position; past the last cascade the sun is unshadowed
+float sunShadow(SunLight light) {
+	for (uint c = 0; c < light.CASCADE_COUNT; ++c) {
+		vec4 clipPosition = light.LIGHT_FROM_WORLD[c] * vec4(position, 1.0);
+		if (abs(clipPosition.x) > 1.0 || abs(clipPosition.y) > 1.0 || clipPosition.z < 0.0 || clipPosition.z > 1.0) continue;
+		vec4 rect = light.ATLAS_RECTS[c];
+		return texture(SHADOW_ATLAS, vec3(rect.xy + (clipPosition.xy * 0.5 + 0.5) * rect.z, clipPosition.z));
+	}
+	return 1.0;
+}
+
+// shadow from the cube face the position lies behind, as seen from the light
+float sphereShadow(SphereLight light) {
+	vec3 d = position - light.POSITION;
+	vec3 a = abs(d);
+	uint face = (a.x >= a.y && a.x >= a.z) ? (d.x > 0.0 ? 0u : 1u) : (a.y >= a.z ? (d.y > 0.0 ? 2u : 3u) : (d.z > 0.0 ? 4u : 5u));
+	if ((light.SHADOW_FACES & (1u << face)) == 0u) return 1.0;
+	return textureProj(SHADOW_ATLAS, light.ATLAS_COORD_FROM_WORLD[face] * vec4(position, 1.0));
+}
+
 vec3 computeDirectLightDiffuse(vec3 worldNormal, vec3 albedo) {
     vec3 light_energy = vec3(0.0);
 
     // Sun Lights
     for (uint i = 0; i < SUN_LIGHT_COUNT; ++i) {
         SunLight light = SUNLIGHTS[i];
+		float shadowTerm = sunShadow(light);
         vec3 L = normalize(light.DIRECTION);
         float NdotL = max(dot(worldNormal, L), -light.SIN_ANGLE);
 		float factor = (NdotL + light.SIN_ANGLE) / (light.SIN_ANGLE * 2.0f);
 		bool aboveHorizon = bool(floor(factor));
-        light_energy += (float(aboveHorizon) * NdotL + float(!aboveHorizon) * (factor * light.SIN_ANGLE)) * light.ENERGY * (albedo );
+        light_energy += (float(aboveHorizon) * NdotL + float(!aboveHorizon) * (factor * light.SIN_ANGLE)) * light.ENERGY * (albedo * shadowTerm);
     }
 
     // Sphere Lights
@@ -65,7 +88,7 @@ vec3 computeDirectLightDiffuse(vec3 worldNormal, vec3 albedo) {
 
 		if (light.RADIUS == 0.0) {
 			float NdotL = max(dot(worldNormal, L), 0);
-			light_energy += albedo * e * (NdotL * attenuation / PI);
+			light_energy += albedo * e * (sphereShadow(light) * NdotL * attenuation / PI);
 		}
 		else if (light.RADIUS >= d) {
 			light_energy += albedo * e * (attenuation / PI);
@@ -75,7 +98,7 @@ vec3 computeDirectLightDiffuse(vec3 worldNormal, vec3 albedo) {
 			float NdotL = max(dot(worldNormal, L), -sinHalfTheta);
 			float factor = (NdotL + sinHalfTheta) / (sinHalfTheta * 2.0f);
 			bool aboveHorizon = bool(floor(factor));
-			light_energy += (float(aboveHorizon) * NdotL + float(!aboveHorizon) * (factor * sinHalfTheta)) * (albedo * e * (attenuation / PI));
+			light_energy += (float(aboveHorizon) * NdotL + float(!aboveHorizon) * (factor * sinHalfTheta)) * (albedo * e * (sphereShadow(light) * attenuation / PI));
 		}
 
     }
@@ -137,10 +160,10 @@ vec3 computeDirectLightDiffuse(vec3 worldNormal, vec3 albedo) {
 
 void main() {
 
-	vec3 albedo = texture(ALBEDO, texCoord).rgb;
+	vec3 albedo = texture(TEXTURES[nonuniformEXT(MATERIALS[material].ALBEDO)], texCoord).rgb;
 
 	// Sample the normal map and convert from [0,1] to [-1,1]
-    vec3 normal_rgb = texture(NORMAL, texCoord).rgb; 
+    vec3 normal_rgb = texture(TEXTURES[nonuniformEXT(MATERIALS[material].NORMAL)], texCoord).rgb; 
     vec3 tangentNormal = normalize(normal_rgb * 2.0 - 1.0); 
 
     // Transform the normal from tangent space to world space
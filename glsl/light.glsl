@@ -1,9 +1,14 @@
 #define LIGHT
 
+#define MAX_SUN_CASCADES 4
+
 struct SunLight {
 	vec3 DIRECTION;
+	uint CASCADE_COUNT; // 0 when the sun casts no shadow
 	vec3 ENERGY; // divided by pi 
 	float SIN_ANGLE; // sin (theta / 2)
+	mat4 LIGHT_FROM_WORLD[MAX_SUN_CASCADES]; // orthographic, nearest cascade first
+	vec4 ATLAS_RECTS[MAX_SUN_CASCADES]; // xy: corner of the cascade's region, z: its size, in atlas texture coordinates
 };
 
 struct SphereLight {
@@ -11,6 +16,8 @@ struct SphereLight {
 	float RADIUS;
 	vec3 ENERGY; // divided by pi 
 	float LIMIT;
+	uint SHADOW_FACES; // bit f set when cube face f has a shadow
+	mat4 ATLAS_COORD_FROM_WORLD[6]; // +x, -x, +y, -y, +z, -z
 };
 
 struct SpotLight {
@@ -0,0 +1,20 @@
+#define MATERIAL
+// needs GL_EXT_nonuniform_qualifier enabled by the including shader
+
+// indices into TEXTURES, one entry per scene material
+struct Material {
+	uint NORMAL;
+	uint DISPLACEMENT;
+	uint ALBEDO; // lambertian and pbr only
+	uint ROUGHNESS; // pbr only
+	uint METALNESS; // pbr only
+	uint padding_0;
+	uint padding_1;
+	uint padding_2;
+};
+
+layout(set=2, binding=0, std430) readonly buffer Materials {
+	Material MATERIALS[];
+};
+
+layout(set=2, binding=1) uniform sampler2D TEXTURES[];
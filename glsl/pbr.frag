@@ -1,4 +1,5 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 #ifndef TONEMAP
 	#include "tonemap.glsl"
@@ -34,18 +35,37 @@ layout(set=0, binding=5, std140) readonly buffer SpotLights {
 
 layout(set=0, binding=6) uniform sampler2DShadow SHADOW_ATLAS;
 
-layout(set=2, binding=0) uniform sampler2D NORMAL;
-layout(set=2, binding=1) uniform sampler2D DISPLACEMENT;
-layout(set=2, binding=2) uniform sampler2D ALBEDO;
-layout(set=2, binding=3) uniform sampler2D ROUGHNESS;
-layout(set=2, binding=4) uniform sampler2D METALNESS;
+#ifndef MATERIAL
+	#include "material.glsl"
+#endif
 
 layout(location=0) in vec3 position;
 layout(location=1) in vec2 texCoord;
 layout(location=2) in mat3 TBN;
+layout(location=5) flat in uint material;
 
 layout(location=0) out vec4 outColor;
 
+// shadow from the nearest cascade covering the position; past the last cascade the sun is unshadowed
+float sunShadow(SunLight light) {
+	for (uint c = 0; c < light.CASCADE_COUNT; ++c) {
+		vec4 clipPosition = light.LIGHT_FROM_WORLD[c] * vec4(position, 1.0);
+		if (abs(clipPosition.x) > 1.0 || abs(clipPosition.y) > 1.0 || clipPosition.z < 0.0 || clipPosition.z > 1.0) continue;
+		vec4 rect = light.ATLAS_RECTS[c];
+		return texture(SHADOW_ATLAS, vec3(rect.xy + (clipPosition.xy * 0.5 + 0.5) * rect.z, clipPosition.z));
+	}
+	return 1.0;
+}
+
+// shadow from the cube face the position lies behind, as seen from the light
+float sphereShadow(SphereLight light) {
+	vec3 d = position - light.POSITION;
+	vec3 a = abs(d);
+	uint face = (a.x >= a.y && a.x >= a.z) ? (d.x > 0.0 ? 0u : 1u) : (a.y >= a.z ? (d.y > 0.0 ? 2u : 3u) : (d.z > 0.0 ? 4u : 5u));
+	if ((light.SHADOW_FACES & (1u << face)) == 0u) return 1.0;
+	return textureProj(SHADOW_ATLAS, light.ATLAS_COORD_FROM_WORLD[face] * vec4(position, 1.0));
+}
+
 //partly from https://learnopengl.com/PBR/IBL/Specular-IBL and https://learnopengl.com/code_viewer_gh.php?code=src/6.pbr/2.2.2.ibl_specular_textured/2.2.2.pbr.fs
 
 vec3 FresnelSchlickRoughness(float cosTheta, float roughness, vec3 F0)
@@ -109,6 +129,7 @@ vec3 computeDirectLight(vec3 worldNormal, vec3 viewDir, vec3 reflectDir, vec3 al
     // Sun Lights
     for (uint i = 0; i < SUN_LIGHT_COUNT; ++i) {
         SunLight light = SUNLIGHTS[i];
+		float shadowTerm = sunShadow(light);
         vec3 L = normalize(light.DIRECTION);
         float NdotL = max(dot(worldNormal, L), -light.SIN_ANGLE);
 		float factor = (NdotL + light.SIN_ANGLE) / (light.SIN_ANGLE * 2.0f);
@@ -128,7 +149,7 @@ vec3 computeDirectLight(vec3 worldNormal, vec3 viewDir, vec3 reflectDir, vec3 al
 		float alpha = roughness * roughness;
 		float alpha_prime = clamp(alpha + light.SIN_ANGLE, 0.0, 1.0);
 		specular *= (alpha * alpha / (alpha_prime * alpha_prime));
-		light_energy += diffuse + specular ;
+		light_energy += (diffuse + specular) * shadowTerm;
     }
 
     // Sphere Lights
@@ -166,7 +187,8 @@ vec3 computeDirectLight(vec3 worldNormal, vec3 viewDir, vec3 reflectDir, vec3 al
 		float alpha_prime = clamp(alpha + light.RADIUS / 2 * d, 0.0, 1.0);
 		specular *= (alpha * alpha / (alpha_prime * alpha_prime));
 
-		light_energy += diffuse + specular;
+		float shadowTerm = light.RADIUS >= d ? 1.0 : sphereShadow(light); //(inside the light nothing is between it and the point)
+		light_energy += (diffuse + specular) * shadowTerm;
     }
 	
     // Spot Lights
@@ -239,18 +261,18 @@ vec3 computeDirectLight(vec3 worldNormal, vec3 viewDir, vec3 reflectDir, vec3 al
 
 void main() {
 	vec3 F0 = vec3(0.04,0.04,0.04);
-	vec3 albedo = texture(ALBEDO, texCoord).rgb;
-	float metalness = texture(METALNESS, texCoord).r;
+	vec3 albedo = texture(TEXTURES[nonuniformEXT(MATERIALS[material].ALBEDO)], texCoord).rgb;
+	float metalness = texture(TEXTURES[nonuniformEXT(MATERIALS[material].METALNESS)], texCoord).r;
 	//tint for metallic surface
 	F0 = mix(F0, albedo, metalness);
 	// Sample the normal map and convert from [0,1] to [-1,1]
-    vec3 normal_rgb = texture(NORMAL, texCoord).rgb; 
+    vec3 normal_rgb = texture(TEXTURES[nonuniformEXT(MATERIALS[material].NORMAL)], texCoord).rgb; 
     vec3 tangentNormal = normalize(normal_rgb * 2.0 - 1.0); 
 
     // Transform the normal from tangent space to world space
     vec3 worldNormal = TBN * tangentNormal;
 
-	float roughness = max(texture(ROUGHNESS, texCoord).r,0.1);
+	float roughness = max(texture(TEXTURES[nonuniformEXT(MATERIALS[material].ROUGHNESS)], texCoord).r,0.1);
 
 	vec3 viewDir = normalize(CAMERA_POSITION - position);
 	vec3 reflectDir = normalize(reflect(-viewDir,worldNormal));
@@ -1,7 +1,16 @@
 #version 450
 
+layout(set=0, binding=0, std140) uniform World {
+	vec3 CAMERA_POSITION;
+	uint ENVIRONMENT_MIPS;
+	uint SUN_LIGHT_COUNT;
+	uint SPHERE_LIGHT_COUNT;
+	uint SPOT_LIGHT_COUNT;
+	uint SHADOW_ATLAS_SIZE;
+	mat4 CLIP_FROM_WORLD;
+};
+
 struct Transform {
-	mat4 CLIP_FROM_LOCAL;
 	mat4 WORLD_FROM_LOCAL;
 	mat4 WORLD_FROM_LOCAL_NORMAL;
 };
@@ -10,6 +19,22 @@ layout(set=1, binding=0, std140) readonly buffer Transforms {
 	Transform TRANSFORMS[];
 };
 
+//same layout as CullPipeline::Instance, only MATERIAL is read here:
+struct Instance {
+	vec3 AABB_MIN;
+	uint BUCKET;
+	vec3 AABB_MAX;
+	uint BUCKET_FIRST;
+	uint INDEX_COUNT;
+	uint FIRST_INDEX;
+	int VERTEX_OFFSET;
+	uint MATERIAL;
+};
+
+layout(set=1, binding=1, std430) readonly buffer Instances {
+	Instance INSTANCES[];
+};
+
 layout(location=0) in vec3 Position;
 layout(location=1) in vec3 Normal;
 layout(location=2) in vec4 Tangent;
@@ -18,11 +43,13 @@ layout(location=3) in vec2 TexCoord;
 layout(location=0) out vec3 position;
 layout(location=1) out vec2 texCoord;
 layout(location=2) out mat3 TBN;
+layout(location=5) flat out uint material;
 
 void main() {
-	gl_Position = TRANSFORMS[gl_InstanceIndex].CLIP_FROM_LOCAL * vec4(Position, 1.0);
 	position = mat4x3(TRANSFORMS[gl_InstanceIndex].WORLD_FROM_LOCAL) * vec4(Position, 1.0);
+	gl_Position = CLIP_FROM_WORLD * vec4(position, 1.0);
 	texCoord = TexCoord;
+	material = INSTANCES[gl_InstanceIndex].MATERIAL;
 
 	vec3 normal = mat3(TRANSFORMS[gl_InstanceIndex].WORLD_FROM_LOCAL_NORMAL) * Normal;
 	vec3 n = normalize(normal);
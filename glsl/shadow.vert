@@ -1,7 +1,6 @@
 #version 450
 
 struct Transform {
-	mat4 CLIP_FROM_LOCAL;
 	mat4 WORLD_FROM_LOCAL;
 	mat4 WORLD_FROM_LOCAL_NORMAL;
 };
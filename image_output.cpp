@@ -0,0 +1,175 @@
+#include "image_output.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+//BGRA -> RGB, dropping alpha:
+static std::vector< uint8_t > to_rgb(uint8_t const *bgra, uint32_t width, uint32_t height) {
+	std::vector< uint8_t > rgb(size_t(width) * height * 3);
+	for (size_t i = 0, count = size_t(width) * height; i < count; ++i) {
+		rgb[3 * i + 0] = bgra[4 * i + 2];
+		rgb[3 * i + 1] = bgra[4 * i + 1];
+		rgb[3 * i + 2] = bgra[4 * i + 0];
+	}
+	return rgb;
+}
+
+//BGRA (sRGB-encoded) -> linear RGB floats:
+static std::vector< float > to_linear(uint8_t const *bgra, uint32_t width, uint32_t height) {
+	static std::array< float, 256 > const table = []() {
+		std::array< float, 256 > ret;
+		for (uint32_t v = 0; v < 256; ++v) {
+			float c = float(v) / 255.0f;
+			ret[v] = (c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f));
+		}
+		return ret;
+	}();
+
+	std::vector< float > rgb(size_t(width) * height * 3);
+	for (size_t i = 0, count = size_t(width) * height; i < count; ++i) {
+		rgb[3 * i + 0] = table[bgra[4 * i + 2]];
+		rgb[3 * i + 1] = table[bgra[4 * i + 1]];
+		rgb[3 * i + 2] = table[bgra[4 * i + 0]];
+	}
+	return rgb;
+}
+
+static void write_file(std::string const &path, std::string const &header, void const *data, size_t size) {
+	std::ofstream file(path, std::ios::out | std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open '" + path + "' to save a frame.");
+	file.write(header.data(), std::streamsize(header.size()));
+	file.write(reinterpret_cast< char const * >(data), std::streamsize(size));
+	if (!file) throw std::runtime_error("Failed to write frame to '" + path + "'.");
+}
+
+void save_frame(std::string const &path, uint8_t const *bgra, uint32_t width, uint32_t height) {
+	std::string extension;
+	if (size_t dot = path.rfind('.'); dot != std::string::npos) {
+		extension = path.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+	}
+
+	if (extension == "png") {
+		std::vector< uint8_t > rgb = to_rgb(bgra, width, height);
+		if (!stbi_write_png(path.c_str(), int(width), int(height), 3, rgb.data(), int(width * 3))) {
+			throw std::runtime_error("Failed to write png frame to '" + path + "'.");
+		}
+	}
+	else if (extension == "qoi") {
+		std::vector< uint8_t > rgb = to_rgb(bgra, width, height);
+		std::vector< uint8_t > qoi = encode_qoi(rgb.data(), width, height);
+		write_file(path, "", qoi.data(), qoi.size());
+	}
+	else if (extension == "hdr") {
+		std::vector< float > rgb = to_linear(bgra, width, height);
+		if (!stbi_write_hdr(path.c_str(), int(width), int(height), 3, rgb.data())) {
+			throw std::runtime_error("Failed to write hdr frame to '" + path + "'.");
+		}
+	}
+	else if (extension == "pfm") {
+		std::vector< float > rgb = to_linear(bgra, width, height);
+		//pfm stores rows bottom to top:
+		std::vector< float > flipped(rgb.size());
+		size_t row = size_t(width) * 3;
+		for (uint32_t y = 0; y < height; ++y) {
+			std::copy_n(rgb.data() + (height - 1 - y) * row, row, flipped.data() + y * row);
+		}
+		// (negative scale marks little-endian data)
+		write_file(path, "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n", flipped.data(), flipped.size() * sizeof(float));
+	}
+	else {
+		std::vector< uint8_t > rgb = to_rgb(bgra, width, height);
+		write_file(path, "P6\n" + std::to_string(width) + "\n" + std::to_string(height) + "\n255\n", rgb.data(), rgb.size());
+	}
+}
+
+//as per https://qoiformat.org/qoi-specification.pdf
+std::vector< uint8_t > encode_qoi(uint8_t const *rgb, uint32_t width, uint32_t height) {
+	constexpr uint8_t QOI_OP_INDEX = 0x00;
+	constexpr uint8_t QOI_OP_DIFF = 0x40;
+	constexpr uint8_t QOI_OP_LUMA = 0x80;
+	constexpr uint8_t QOI_OP_RUN = 0xc0;
+	constexpr uint8_t QOI_OP_RGB = 0xfe;
+
+	size_t count = size_t(width) * height;
+	std::vector< uint8_t > out;
+	out.reserve(14 + count * 4 + 8); //(worst case is an OP_RGB per pixel)
+
+	auto push_u32 = [&](uint32_t v) {
+		out.emplace_back(uint8_t(v >> 24));
+		out.emplace_back(uint8_t(v >> 16));
+		out.emplace_back(uint8_t(v >> 8));
+		out.emplace_back(uint8_t(v));
+	};
+
+	//header:
+	out.insert(out.end(), {'q', 'o', 'i', 'f'});
+	push_u32(width);
+	push_u32(height);
+	out.emplace_back(uint8_t(3)); //channels
+	out.emplace_back(uint8_t(0)); //sRGB with linear alpha
+
+	struct Pixel {
+		uint8_t r = 0, g = 0, b = 0; //(alpha is always 255 here, so it never needs comparing)
+		bool operator==(Pixel const &) const = default;
+	};
+	std::array< Pixel, 64 > seen{};
+	std::array< bool, 64 > seen_valid{}; //(the decoder's table starts out transparent black, which no pixel here can match)
+	Pixel prev;
+	uint32_t run = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		Pixel px{ rgb[3 * i + 0], rgb[3 * i + 1], rgb[3 * i + 2] };
+
+		if (px == prev) {
+			++run;
+			if (run == 62 || i + 1 == count) {
+				out.emplace_back(uint8_t(QOI_OP_RUN | (run - 1)));
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0) {
+			out.emplace_back(uint8_t(QOI_OP_RUN | (run - 1)));
+			run = 0;
+		}
+
+		uint32_t hash = (px.r * 3u + px.g * 5u + px.b * 7u + 255u * 11u) % 64u;
+		if (seen_valid[hash] && seen[hash] == px) {
+			out.emplace_back(uint8_t(QOI_OP_INDEX | hash));
+		}
+		else {
+			seen[hash] = px;
+			seen_valid[hash] = true;
+
+			int8_t dr = int8_t(px.r - prev.r);
+			int8_t dg = int8_t(px.g - prev.g);
+			int8_t db = int8_t(px.b - prev.b);
+			int8_t dr_dg = int8_t(dr - dg);
+			int8_t db_dg = int8_t(db - dg);
+
+			if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+				out.emplace_back(uint8_t(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+			}
+			else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+				out.emplace_back(uint8_t(QOI_OP_LUMA | (dg + 32)));
+				out.emplace_back(uint8_t((dr_dg + 8) << 4 | (db_dg + 8)));
+			}
+			else {
+				out.insert(out.end(), {QOI_OP_RGB, px.r, px.g, px.b});
+			}
+		}
+		prev = px;
+	}
+
+	//end marker:
+	out.insert(out.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+	return out;
+}
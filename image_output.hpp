@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// saving frames read back from a VK_FORMAT_B8G8R8A8_SRGB image (headless SAVE events)
+
+//write a width x height frame in the format named by path's extension:
+// .png and .qoi store the 8-bit sRGB pixels; .hdr (Radiance RGBE) and .pfm (raw little-endian floats) store them linearized.
+// anything else is written as binary .ppm.
+//throws on failure:
+void save_frame(std::string const &path, uint8_t const *bgra, uint32_t width, uint32_t height);
+
+//QOI ("Quite OK Image") encoding of tightly-packed 8-bit RGB pixels, header and end marker included:
+std::vector< uint8_t > encode_qoi(uint8_t const *rgb, uint32_t width, uint32_t height);
@@ -60,6 +60,19 @@ inline mat4 perspective(float vfov, float aspect, float near, float far) {
 	};
 }
 
+//orthographic projection matrix.
+// - maps the box [left,right]x[bottom,top]x[-near,-far] to device coordinates
+// - near maps to 0, far maps to 1
+// looks down -z with +y up and +x right (same conventions as perspective)
+inline mat4 orthographic(float left, float right, float bottom, float top, float near, float far) {
+	return mat4{ //note: column-major storage order!
+		2.0f / (right - left), 0.0f, 0.0f, 0.0f,
+		0.0f, -2.0f / (top - bottom), 0.0f, 0.0f,
+		0.0f, 0.0f, -1.0f / (far - near), 0.0f,
+		-(right + left) / (right - left), (top + bottom) / (top - bottom), -near / (far - near), 1.0f,
+	};
+}
+
 //look at matrix:
 // makes a camera-space-from-world matrix for a camera at eye looking toward
 // target with up-vector pointing (as-close-as-possible) along up.
@@ -0,0 +1,225 @@
+#include "mesh_processing.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+void weld_vertices(PosNorTanTexVertex const *vertices, uint32_t count, std::vector< PosNorTanTexVertex > &unique_vertices, std::vector< uint32_t > &indices) {
+	//hash/compare raw bytes (so -0.0 and 0.0 stay distinct, which is fine for welding):
+	struct VertexHash {
+		size_t operator()(PosNorTanTexVertex const &v) const {
+			//FNV-1a over the vertex bytes:
+			uint64_t hash = 14695981039346656037ull;
+			unsigned char const *bytes = reinterpret_cast< unsigned char const * >(&v);
+			for (size_t i = 0; i < sizeof(PosNorTanTexVertex); ++i) {
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+			return size_t(hash);
+		}
+	};
+	struct VertexEqual {
+		bool operator()(PosNorTanTexVertex const &a, PosNorTanTexVertex const &b) const {
+			return std::memcmp(&a, &b, sizeof(PosNorTanTexVertex)) == 0;
+		}
+	};
+
+	std::unordered_map< PosNorTanTexVertex, uint32_t, VertexHash, VertexEqual > lookup;
+	lookup.reserve(count);
+	unique_vertices.clear();
+	unique_vertices.reserve(count);
+	indices.resize(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		auto [found, inserted] = lookup.emplace(vertices[i], uint32_t(unique_vertices.size()));
+		if (inserted) unique_vertices.emplace_back(vertices[i]);
+		indices[i] = found->second;
+	}
+	unique_vertices.shrink_to_fit();
+}
+
+void optimize_vertex_cache(std::vector< uint32_t > &indices, uint32_t vertex_count) {
+	if (indices.size() % 3 != 0 || indices.empty()) return; //only handles triangle lists
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	//scoring constants from the paper:
+	constexpr uint32_t CacheSize = 32;
+	constexpr float CacheDecayPower = 1.5f;
+	constexpr float LastTriScore = 0.75f;
+	constexpr float ValenceBoostScale = 2.0f;
+	constexpr float ValenceBoostPower = 0.5f;
+
+	struct Vertex {
+		int32_t cache_position = -1; //-1 if not in cache
+		uint32_t remaining = 0; //triangles still to be emitted that use this vertex
+		uint32_t first_triangle = 0; //into vertex_triangles
+		float score = 0.0f;
+	};
+	std::vector< Vertex > verts(vertex_count);
+
+	auto vertex_score = [&](Vertex const &v) -> float {
+		if (v.remaining == 0) return -1.0f; //nothing left to draw with it
+		float score = 0.0f;
+		if (v.cache_position >= 0) {
+			if (v.cache_position < 3) {
+				//was used in the last triangle, so fixed score (discourages strips of one triangle):
+				score = LastTriScore;
+			} else {
+				float scaler = 1.0f / float(CacheSize - 3);
+				score = std::pow(1.0f - float(v.cache_position - 3) * scaler, CacheDecayPower);
+			}
+		}
+		//bonus for vertices with few triangles left, to clear out lone vertices:
+		score += ValenceBoostScale * std::pow(float(v.remaining), -ValenceBoostPower);
+		return score;
+	};
+
+	//vertex -> triangle adjacency (compressed rows):
+	for (uint32_t index : indices) {
+		assert(index < vertex_count);
+		verts[index].remaining += 1;
+	}
+	{
+		uint32_t offset = 0;
+		for (Vertex &v : verts) {
+			v.first_triangle = offset;
+			offset += v.remaining;
+		}
+	}
+	std::vector< uint32_t > vertex_triangles(indices.size());
+	{
+		std::vector< uint32_t > fill(vertex_count, 0);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3*t + c];
+				vertex_triangles[verts[v].first_triangle + fill[v]] = t;
+				fill[v] += 1;
+			}
+		}
+	}
+	for (Vertex &v : verts) {
+		v.score = vertex_score(v);
+	}
+
+	std::vector< float > triangle_score(triangle_count);
+	std::vector< bool > emitted(triangle_count, false);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		triangle_score[t] = verts[indices[3*t]].score + verts[indices[3*t+1]].score + verts[indices[3*t+2]].score;
+	}
+
+	std::vector< uint32_t > output;
+	output.reserve(indices.size());
+	std::vector< uint32_t > cache; //vertex indices, most recent first
+	cache.reserve(CacheSize + 3);
+	std::vector< uint32_t > new_cache;
+	new_cache.reserve(CacheSize + 3);
+
+	uint32_t scan_start = 0; //for finding the next triangle when the cache has nothing to offer
+	int64_t best = -1;
+	{ //start with the best triangle overall:
+		float best_score = -1.0f;
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			if (triangle_score[t] > best_score) {
+				best_score = triangle_score[t];
+				best = t;
+			}
+		}
+	}
+
+	while (best >= 0) {
+		uint32_t tri = uint32_t(best);
+		emitted[tri] = true;
+
+		//emit, and remove the triangle from its vertices' adjacency lists:
+		for (uint32_t c = 0; c < 3; ++c) {
+			uint32_t vi = indices[3*tri + c];
+			output.emplace_back(vi);
+			Vertex &v = verts[vi];
+			uint32_t *begin = vertex_triangles.data() + v.first_triangle;
+			uint32_t *end = begin + v.remaining;
+			uint32_t *found = std::find(begin, end, tri);
+			assert(found != end);
+			std::swap(*found, *(end - 1));
+			v.remaining -= 1;
+		}
+
+		//move the triangle's vertices to the front of the (LRU) cache:
+		new_cache.clear();
+		for (uint32_t c = 0; c < 3; ++c) {
+			new_cache.emplace_back(indices[3*tri + c]);
+		}
+		for (uint32_t vi : cache) {
+			if (vi != new_cache[0] && vi != new_cache[1] && vi != new_cache[2]) {
+				new_cache.emplace_back(vi);
+			}
+		}
+		//vertices that fall off the end of the cache lose their cache score:
+		for (uint32_t i = CacheSize; i < new_cache.size(); ++i) {
+			Vertex &v = verts[new_cache[i]];
+			v.cache_position = -1;
+			v.score = vertex_score(v);
+		}
+		if (new_cache.size() > CacheSize) new_cache.resize(CacheSize);
+		std::swap(cache, new_cache);
+
+		//rescore cached vertices and their triangles, picking the best as we go:
+		for (uint32_t i = 0; i < cache.size(); ++i) {
+			Vertex &v = verts[cache[i]];
+			v.cache_position = int32_t(i);
+			v.score = vertex_score(v);
+		}
+		best = -1;
+		float best_score = -1.0f;
+		for (uint32_t vi : cache) {
+			Vertex const &v = verts[vi];
+			for (uint32_t i = 0; i < v.remaining; ++i) {
+				uint32_t t = vertex_triangles[v.first_triangle + i];
+				float score = verts[indices[3*t]].score + verts[indices[3*t+1]].score + verts[indices[3*t+2]].score;
+				triangle_score[t] = score;
+				if (score > best_score) {
+					best_score = score;
+					best = t;
+				}
+			}
+		}
+
+		//nothing adjacent to the cache; fall back to the next un-emitted triangle:
+		if (best < 0) {
+			while (scan_start < triangle_count && emitted[scan_start]) ++scan_start;
+			if (scan_start < triangle_count) best = scan_start;
+		}
+	}
+
+	assert(output.size() == indices.size());
+	indices = std::move(output);
+}
+
+void optimize_vertex_fetch(std::vector< PosNorTanTexVertex > &vertices, std::vector< uint32_t > &indices) {
+	std::vector< uint32_t > remap(vertices.size(), ~0u);
+	std::vector< PosNorTanTexVertex > reordered;
+	reordered.reserve(vertices.size());
+	for (uint32_t &index : indices) {
+		if (remap[index] == ~0u) {
+			remap[index] = uint32_t(reordered.size());
+			reordered.emplace_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	//(unreferenced vertices are dropped)
+	vertices = std::move(reordered);
+}
+
+float compute_ACMR(std::vector< uint32_t > const &indices, uint32_t cache_size) {
+	if (indices.size() < 3) return 0.0f;
+	std::vector< uint32_t > fifo(cache_size, ~0u);
+	uint32_t head = 0;
+	uint32_t misses = 0;
+	for (uint32_t index : indices) {
+		if (std::find(fifo.begin(), fifo.end(), index) == fifo.end()) {
+			misses += 1;
+			fifo[head] = index;
+			head = (head + 1) % cache_size;
+		}
+	}
+	return float(misses) / float(indices.size() / 3);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "PosNorTanTexVertex.hpp"
+
+#include <vector>
+#include <cstdint>
+
+// load-time processing of triangle-list meshes into indexed geometry
+
+//merge bitwise-identical vertices; fills unique_vertices and one index per input vertex:
+void weld_vertices(PosNorTanTexVertex const *vertices, uint32_t count, std::vector< PosNorTanTexVertex > &unique_vertices, std::vector< uint32_t > &indices);
+
+//reorder triangles (in place) for post-transform vertex cache locality.
+// uses Tom Forsyth's "Linear-Speed Vertex Cache Optimisation" scoring:
+void optimize_vertex_cache(std::vector< uint32_t > &indices, uint32_t vertex_count);
+
+//renumber vertices in order of first use by indices (improves vertex fetch locality):
+void optimize_vertex_fetch(std::vector< PosNorTanTexVertex > &vertices, std::vector< uint32_t > &indices);
+
+//average cache miss ratio (post-transform vertex shader invocations per triangle) for a FIFO cache:
+float compute_ACMR(std::vector< uint32_t > const &indices, uint32_t cache_size = 16);
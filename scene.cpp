@@ -1,15 +1,21 @@
 #include "scene.hpp"
 #include "sejp.hpp"
 #include "data_path.hpp"
+#include "SceneCache.hpp"
 
 #include <fstream>
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
+#include <functional>
 #include <algorithm>
 
-Scene::Scene(std::string filename, std::optional<std::string> camera, uint8_t animation_setting_)
+Scene::Scene(std::string filename, std::optional<std::string> camera, uint8_t animation_setting_, std::optional<std::string> cache_dir)
 :animation_setting(animation_setting_)
 {
+    if (cache_dir.has_value()) {
+        cache = std::make_unique<SceneCache>(cache_dir.value(), data_path(filename));
+    }
     load(data_path(filename), camera);
 }
 
@@ -20,19 +26,343 @@ Scene::~Scene()
     }
 }
 
-void Scene::load(std::string filename, std::optional<std::string> requested_camera)
-{
-    if (filename.substr(filename.size()-4, 4) != ".s72") {
-        throw std::runtime_error("Scene " + filename + " is not a compatible format (s72 required). Last 4 char is " + filename.substr(filename.size()-4, 4));
+// One top-level .s72 object, collected from sejp's events while it streams in,
+// so loading only ever holds one object's values rather than a document of the whole file.
+// Values are keyed by their path of keys inside the object, '/'-separated ("pbr/albedo", "attributes/POSITION/src"); array entries append.
+struct S72Object {
+    std::unordered_map<std::string, std::vector<double>> number_values;
+    std::unordered_map<std::string, std::vector<std::string>> string_values;
+    std::unordered_set<std::string> present; // paths holding objects, arrays, bools, or nulls (which have nothing else to store)
+
+    void clear() {
+        number_values.clear();
+        string_values.clear();
+        present.clear();
     }
-    scene_path = filename.substr(0, filename.rfind('/'));;
-    sejp::value val = sejp::load(filename);
-    try {
-        std::vector<sejp::value > const &object = val.as_array().value();
-        if (object[0].as_string() != "s72-v2") {
 
-            throw std::runtime_error("cannot find the correct header");
+    bool has(std::string const &path) const {
+        return number_values.count(path) || string_values.count(path) || present.count(path);
+    }
+
+    // all numbers at path (empty if there are none):
+    std::vector<double> const &numbers(std::string const &path) const {
+        static std::vector<double> const none;
+        auto found = number_values.find(path);
+        return found != number_values.end() ? found->second : none;
+    }
+    std::vector<std::string> const &strings(std::string const &path) const {
+        static std::vector<std::string> const none;
+        auto found = string_values.find(path);
+        return found != string_values.end() ? found->second : none;
+    }
+
+    // a required value; throws if it is missing:
+    double number(std::string const &path) const {
+        std::vector<double> const &values = numbers(path);
+        if (values.empty()) throw std::runtime_error("missing number '" + path + "' in " + describe());
+        return values.front();
+    }
+    std::string const &string(std::string const &path) const {
+        std::vector<std::string> const &values = strings(path);
+        if (values.empty()) throw std::runtime_error("missing string '" + path + "' in " + describe());
+        return values.front();
+    }
+
+    std::string describe() const {
+        std::vector<std::string> const &type = strings("type");
+        std::vector<std::string> const &name = strings("name");
+        return (type.empty() ? "object" : type.front()) + " '" + (name.empty() ? "" : name.front()) + "'";
+    }
+};
+
+// Walks an .s72 file's events, handing each top-level object to apply() as soon as it closes:
+struct S72Reader : sejp::handler {
+    std::function<void(S72Object const &)> apply;
+
+    S72Object object;
+    uint32_t depth = 0; // containers open, counting the top-level array
+    uint32_t element = 0; // index of the current top-level array element (0 is the header)
+    std::string path; // path of the current value inside object
+    std::vector<size_t> prefix; // for each object open inside the top-level object, the length of path before its keys
+
+    void top_level_value() {
+        if (depth == 0) throw std::runtime_error("expected an array at the top level of .s72 format");
+        if (element == 0) throw std::runtime_error("cannot find the correct header");
+        throw std::runtime_error("expected only objects after the header in .s72 format");
+    }
+
+    void begin_array() override {
+        if (depth == 1) top_level_value();
+        if (depth > 1) object.present.insert(path);
+        ++depth;
+    }
+    void end_array() override {
+        --depth;
+    }
+
+    void begin_object() override {
+        if (depth <= 1) {
+            if (depth == 0 || element == 0) top_level_value();
+            object.clear();
+            path.clear();
+        } else {
+            object.present.insert(path);
+        }
+        prefix.push_back(path.size());
+        ++depth;
+    }
+    void key(std::string_view key) override {
+        path.resize(prefix.back());
+        if (!path.empty()) path += '/';
+        path += key;
+    }
+    void end_object() override {
+        --depth;
+        prefix.pop_back();
+        if (depth == 1) {
+            apply(object);
+            ++element;
+        }
+    }
+
+    void string(std::string_view string) override {
+        if (depth <= 1) {
+            if (depth == 1 && element == 0 && string == "s72-v2") {
+                ++element;
+                return;
+            }
+            top_level_value();
+        }
+        object.string_values[path].emplace_back(string);
+    }
+    void number(double number) override {
+        if (depth <= 1) top_level_value();
+        object.number_values[path].emplace_back(number);
+    }
+    void boolean(bool) override {
+        if (depth <= 1) top_level_value();
+        object.present.insert(path);
+    }
+    void null() override {
+        if (depth <= 1) top_level_value();
+        object.present.insert(path);
+    }
+};
+
+// --scene-cache: everything parse() produces, in the order parse()'s results are read back.
+// (What load() derives afterwards -- light instances, camera paths, the flattened hierarchy -- is cheap, and depends on the requested camera, so it is rebuilt either way.)
+static void write_cache(Scene const &scene, SceneCache::Writer &writer) {
+    writer.pod(uint64_t(scene.nodes.size()));
+    for (Scene::Node const &node : scene.nodes) {
+        writer.string(node.name);
+        writer.pod(node.transform);
+        writer.array(node.children);
+        writer.pod(node.cameras_index);
+        writer.pod(node.mesh_index);
+        writer.pod(node.light_index);
+        writer.pod(uint8_t(node.environment));
+    }
+
+    writer.pod(uint64_t(scene.cameras.size()));
+    for (Scene::Camera const &camera : scene.cameras) {
+        writer.string(camera.name);
+        writer.pod(camera.aspect);
+        writer.pod(camera.vfov);
+        writer.pod(camera.near);
+        writer.pod(camera.far);
+    }
+
+    writer.pod(uint64_t(scene.lights.size()));
+    for (Scene::Light const &light : scene.lights) {
+        writer.string(light.name);
+        writer.pod(light.tint);
+        writer.pod(light.shadow);
+        writer.pod(light.light_type);
+        writer.pod(uint8_t(light.additional_params.index()));
+        std::visit([&](auto const &params) { writer.pod(params); }, light.additional_params);
+    }
+
+    writer.pod(uint64_t(scene.meshes.size()));
+    for (Scene::Mesh const &mesh : scene.meshes) {
+        writer.string(mesh.name);
+        for (Scene::Mesh::Attribute const &attribute : mesh.attributes) {
+            writer.string(attribute.source);
+            writer.pod(attribute.offset);
+            writer.pod(attribute.stride);
+            writer.pod(attribute.format);
+        }
+        writer.pod(mesh.topology);
+        writer.pod(mesh.count);
+        writer.pod(mesh.material_index);
+    }
+
+    writer.pod(uint64_t(scene.materials.size()));
+    for (Scene::Material const &material : scene.materials) {
+        writer.pod(material.material_type);
+        writer.string(material.name);
+        writer.pod(material.normal_index);
+        writer.pod(material.displacement_index);
+        writer.pod(uint8_t(material.material_textures.index()));
+        std::visit([&](auto const &textures) { writer.pod(textures); }, material.material_textures);
+    }
+
+    writer.pod(uint64_t(scene.textures.size()));
+    for (Scene::Texture const &texture : scene.textures) {
+        writer.pod(uint8_t(texture.value.index()));
+        if (std::holds_alternative<float>(texture.value)) writer.pod(std::get<float>(texture.value));
+        else if (std::holds_alternative<glm::vec3>(texture.value)) writer.pod(std::get<glm::vec3>(texture.value));
+        else writer.string(std::get<std::string>(texture.value));
+        writer.pod(uint8_t(texture.is_2D));
+        writer.pod(uint8_t(texture.has_src));
+        writer.pod(uint8_t(texture.single_channel));
+        writer.pod(texture.format);
+    }
+
+    writer.pod(uint64_t(scene.drivers.size()));
+    for (Scene::Driver const &driver : scene.drivers) {
+        writer.string(driver.name);
+        writer.pod(driver.node_index);
+        writer.pod(driver.channel);
+        writer.array(driver.times);
+        writer.array(driver.values);
+        writer.pod(driver.interpolation);
+    }
+
+    writer.string(scene.environment.name);
+    writer.string(scene.environment.source);
+
+    writer.pod(uint8_t(scene.cloud != nullptr));
+    if (scene.cloud) {
+        writer.string(scene.cloud->name);
+        writer.string(scene.cloud->folder_path);
+        writer.pod(scene.cloud->cloud_type);
+    }
+
+    writer.array(scene.root_nodes);
+    writer.pod(scene.vertices_count);
+    writer.pod(scene.MatPBR_count);
+    writer.pod(scene.MatLambertian_count);
+    writer.pod(scene.MatEnvMirror_count);
+}
+
+static void read_cache(Scene &scene, SceneCache::Reader &reader) {
+    scene.nodes.resize(reader.pod<uint64_t>());
+    for (Scene::Node &node : scene.nodes) {
+        node.name = reader.string();
+        node.transform = reader.pod<Scene::Transform>();
+        node.children = reader.vector<uint32_t>();
+        node.cameras_index = reader.pod<int32_t>();
+        node.mesh_index = reader.pod<int32_t>();
+        node.light_index = reader.pod<int32_t>();
+        node.environment = reader.pod<uint8_t>() != 0;
+    }
+
+    scene.cameras.resize(reader.pod<uint64_t>());
+    for (Scene::Camera &camera : scene.cameras) {
+        camera.name = reader.string();
+        camera.aspect = reader.pod<float>();
+        camera.vfov = reader.pod<float>();
+        camera.near = reader.pod<float>();
+        camera.far = reader.pod<float>();
+    }
+
+    uint64_t light_count = reader.pod<uint64_t>();
+    scene.lights.reserve(light_count);
+    for (uint64_t i = 0; i < light_count; ++i) {
+        // (built all at once, since lights aren't default-constructible)
+        std::string name = reader.string();
+        glm::vec3 tint = reader.pod<glm::vec3>();
+        uint32_t shadow = reader.pod<uint32_t>();
+        Scene::Light::LightType light_type = reader.pod<Scene::Light::LightType>();
+        auto read_params = [&]() -> decltype(Scene::Light::additional_params) {
+            switch (reader.pod<uint8_t>()) {
+                case 0: return reader.pod<Scene::Light::ParamSun>();
+                case 1: return reader.pod<Scene::Light::ParamSphere>();
+                case 2: return reader.pod<Scene::Light::ParamSpot>();
+                default: throw std::runtime_error("Scene cache has an unknown light parameter type.");
+            }
+        };
+        scene.lights.push_back(Scene::Light{
+            .name = name,
+            .tint = tint,
+            .shadow = shadow,
+            .light_type = light_type,
+            .additional_params = read_params(),
+        });
+    }
+
+    scene.meshes.resize(reader.pod<uint64_t>());
+    for (Scene::Mesh &mesh : scene.meshes) {
+        mesh.name = reader.string();
+        for (Scene::Mesh::Attribute &attribute : mesh.attributes) {
+            attribute.source = reader.string();
+            attribute.offset = reader.pod<uint32_t>();
+            attribute.stride = reader.pod<uint32_t>();
+            attribute.format = reader.pod<VkFormat>();
         }
+        mesh.topology = reader.pod<VkPrimitiveTopology>();
+        mesh.count = reader.pod<uint32_t>();
+        mesh.material_index = reader.pod<uint32_t>();
+    }
+
+    scene.materials.resize(reader.pod<uint64_t>());
+    for (Scene::Material &material : scene.materials) {
+        material.material_type = reader.pod<Scene::Material::MaterialType>();
+        material.name = reader.string();
+        material.normal_index = reader.pod<uint32_t>();
+        material.displacement_index = reader.pod<uint32_t>();
+        switch (reader.pod<uint8_t>()) {
+            case 0: material.material_textures = reader.pod<std::monostate>(); break;
+            case 1: material.material_textures = reader.pod<Scene::Material::MatLambertian>(); break;
+            case 2: material.material_textures = reader.pod<Scene::Material::MatPBR>(); break;
+            default: throw std::runtime_error("Scene cache has an unknown material texture type.");
+        }
+    }
+
+    scene.textures.resize(reader.pod<uint64_t>());
+    for (Scene::Texture &texture : scene.textures) {
+        switch (reader.pod<uint8_t>()) {
+            case 0: texture.value = reader.pod<float>(); break;
+            case 1: texture.value = reader.pod<glm::vec3>(); break;
+            case 2: texture.value = reader.string(); break;
+            default: throw std::runtime_error("Scene cache has an unknown texture value type.");
+        }
+        texture.is_2D = reader.pod<uint8_t>() != 0;
+        texture.has_src = reader.pod<uint8_t>() != 0;
+        texture.single_channel = reader.pod<uint8_t>() != 0;
+        texture.format = reader.pod<Scene::Texture::Format>();
+    }
+
+    scene.drivers.resize(reader.pod<uint64_t>());
+    for (Scene::Driver &driver : scene.drivers) {
+        driver.name = reader.string();
+        driver.node_index = reader.pod<uint32_t>();
+        driver.channel = reader.pod<Scene::Driver::Channel>();
+        driver.times = reader.vector<float>();
+        driver.values = reader.vector<float>();
+        driver.interpolation = reader.pod<Scene::Driver::InterpolationMode>();
+    }
+
+    scene.environment.name = reader.string();
+    scene.environment.source = reader.string();
+
+    if (reader.pod<uint8_t>() != 0) {
+        scene.cloud = new Scene::Cloud();
+        scene.cloud->name = reader.string();
+        scene.cloud->folder_path = reader.string();
+        scene.cloud->cloud_type = reader.pod<Scene::Cloud::CloudType>();
+    }
+
+    scene.root_nodes = reader.vector<uint32_t>();
+    scene.vertices_count = reader.pod<uint32_t>();
+    scene.MatPBR_count = reader.pod<uint32_t>();
+    scene.MatLambertian_count = reader.pod<uint32_t>();
+    scene.MatEnvMirror_count = reader.pod<uint32_t>();
+}
+
+void Scene::parse(std::string const &filename)
+{
+    try {
         std::unordered_map<std::string, uint32_t> nodes_map;
         std::unordered_map<std::string, uint32_t> meshes_map;
         std::unordered_map<std::string, uint32_t> materials_map;
@@ -53,133 +383,75 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
             .material_textures = Material::MatLambertian(),
         });
 
-        for (int32_t i = 1; i < int32_t(object.size()); ++i) {
-            auto object_i = object[i].as_object().value();
-            std::optional<std::string> type = object_i.find("type")->second.as_string();
-            if (!type) {
+        // objects can be referred to by name before they appear, so find the entry for a name or add a placeholder with just the name:
+        auto index_of = [](auto &list, std::unordered_map<std::string, uint32_t> &map, std::string const &name) -> uint32_t {
+            if (auto found = map.find(name); found != map.end()) {
+                return found->second;
+            }
+            uint32_t index = uint32_t(list.size());
+            list.push_back({.name = name});
+            map.insert({name, index});
+            return index;
+        };
+        auto texture_index = [&](std::string const &tex_name, auto &&make_texture) -> uint32_t {
+            if (auto found = textures_map.find(tex_name); found != textures_map.end()) {
+                return found->second;
+            }
+            uint32_t index = uint32_t(textures.size());
+            textures.push_back(make_texture());
+            textures_map.insert({tex_name, index});
+            return index;
+        };
+
+        S72Reader reader;
+        reader.apply = [&](S72Object const &object) {
+            std::vector<std::string> const &type = object.strings("type");
+            if (type.empty()) {
                 throw std::runtime_error("expected a type value in objects in .s72 format");
             }
-            if (type.value() == "SCENE") {
-                if (auto res = object_i.find("roots"); res != object_i.end()) {
-                    auto roots_opt = res->second.as_array();
-                    if (roots_opt.has_value()) {
-                        std::vector<sejp::value> roots = roots_opt.value();
-                        root_nodes.reserve(roots.size());
-                        // find node index through the map, insert index to node, if node doesn't exist in the map, create a placeholder entry
-                        for (int32_t j = 0; j < int32_t(roots.size()); ++j) {
-                            std::string child_name = roots[j].as_string().value();
-                            if (auto node_found = nodes_map.find(child_name); node_found != nodes_map.end()) {
-                                root_nodes.push_back(node_found->second);
-                            }
-                            else {
-                                Node new_node = {.name = child_name};
-                                int32_t index = int32_t(nodes.size());
-                                nodes.push_back(new_node);
-                                nodes_map.insert({child_name, index});
-                                root_nodes.push_back(index);
-                            }
-                        }
-                    }
-                }
-            } else if (type.value() == "NODE") {
-                std::string node_name = object_i.find("name")->second.as_string().value();
-                int32_t cur_node_index;
-                // look at the map and see if the node has been made already
-                if (auto node_found = nodes_map.find(node_name); node_found != nodes_map.end()) {
-                    cur_node_index = node_found->second;
-                }
-                else {
-                    Node new_node = {.name = node_name};
-                    cur_node_index = int32_t(nodes.size());
-                    nodes.push_back(new_node);
-                    nodes_map.insert({node_name, cur_node_index});
+            if (type.front() == "SCENE") {
+                std::vector<std::string> const &roots = object.strings("roots");
+                root_nodes.reserve(roots.size());
+                for (std::string const &child_name : roots) {
+                    root_nodes.push_back(index_of(nodes, nodes_map, child_name));
                 }
+            } else if (type.front() == "NODE") {
+                uint32_t cur_node_index = index_of(nodes, nodes_map, object.string("name"));
                 // set position
-                if (auto translation = object_i.find("translation"); translation != object_i.end()) {
-                    std::vector<sejp::value> res = translation->second.as_array().value();
+                if (std::vector<double> const &res = object.numbers("translation"); !res.empty()) {
                     assert(res.size() == 3);
-                    nodes[cur_node_index].transform.position.x = float(res[0].as_number().value());
-                    nodes[cur_node_index].transform.position.y = float(res[1].as_number().value());
-                    nodes[cur_node_index].transform.position.z = float(res[2].as_number().value());
+                    nodes[cur_node_index].transform.position = glm::vec3(float(res[0]), float(res[1]), float(res[2]));
                 }
                 // set rotation
-                if (auto rotation = object_i.find("rotation"); rotation != object_i.end()) {
-                    std::vector<sejp::value> res = rotation->second.as_array().value();
+                if (std::vector<double> const &res = object.numbers("rotation"); !res.empty()) {
                     assert(res.size() == 4);
-                    nodes[cur_node_index].transform.rotation.x = float(res[0].as_number().value());
-                    nodes[cur_node_index].transform.rotation.y = float(res[1].as_number().value());
-                    nodes[cur_node_index].transform.rotation.z = float(res[2].as_number().value());
-                    nodes[cur_node_index].transform.rotation.w = float(res[3].as_number().value());
+                    nodes[cur_node_index].transform.rotation.x = float(res[0]);
+                    nodes[cur_node_index].transform.rotation.y = float(res[1]);
+                    nodes[cur_node_index].transform.rotation.z = float(res[2]);
+                    nodes[cur_node_index].transform.rotation.w = float(res[3]);
                 }
                 // set scale
-                if (auto scale = object_i.find("scale"); scale != object_i.end()) {
-                    std::vector<sejp::value> res = scale->second.as_array().value();
+                if (std::vector<double> const &res = object.numbers("scale"); !res.empty()) {
                     assert(res.size() == 3);
-                    nodes[cur_node_index].transform.scale.x = float(res[0].as_number().value());
-                    nodes[cur_node_index].transform.scale.y = float(res[1].as_number().value());
-                    nodes[cur_node_index].transform.scale.z = float(res[2].as_number().value());
+                    nodes[cur_node_index].transform.scale = glm::vec3(float(res[0]), float(res[1]), float(res[2]));
                 }
-                // set children
-                if (auto res = object_i.find("children"); res != object_i.end()) {
-                    std::vector<sejp::value> children = res->second.as_array().value();
-                    for (int32_t j = 0; j < int32_t(children.size()); ++j) {
-                            std::string child_name = children[j].as_string().value();
-                            if (auto node_found = nodes_map.find(child_name); node_found != nodes_map.end()) {
-                                nodes[cur_node_index].children.push_back(node_found->second);
-                            } else {
-                                Node new_node = {.name = child_name};
-                                int32_t index = int32_t(nodes.size());
-                                nodes.push_back(new_node);
-                                nodes_map.insert({child_name, index});
-                                nodes[cur_node_index].children.push_back(index);
-                            }
-                        }
+                // set children (looked up first: adding a placeholder can move nodes)
+                for (std::string const &child_name : object.strings("children")) {
+                    uint32_t child_index = index_of(nodes, nodes_map, child_name);
+                    nodes[cur_node_index].children.push_back(child_index);
                 }
-
-                // set mesh
-                if (auto res = object_i.find("mesh"); res != object_i.end()) {
-                    std::string mesh_name = res->second.as_string().value();
-                    if (auto mesh_found = meshes_map.find(mesh_name); mesh_found != meshes_map.end()) {
-                        nodes[cur_node_index].mesh_index = mesh_found->second;
-                    } else {
-                        Mesh new_mesh = {.name = mesh_name};
-                        int32_t index = int32_t(meshes.size());
-                        meshes.push_back(new_mesh);
-                        meshes_map.insert({mesh_name, index});
-                        nodes[cur_node_index].mesh_index = index;
-                    }
+                // set mesh, camera, light
+                if (std::vector<std::string> const &res = object.strings("mesh"); !res.empty()) {
+                    nodes[cur_node_index].mesh_index = int32_t(index_of(meshes, meshes_map, res.front()));
                 }
-
-                // set camera
-                if (auto res = object_i.find("camera"); res != object_i.end()) {
-                    std::string camera_name = res->second.as_string().value();
-                    if (auto camera_found = cameras_map.find(camera_name); camera_found != cameras_map.end()) {
-                        nodes[cur_node_index].cameras_index = camera_found->second;
-                    } else {
-                        Camera new_camera = {.name = camera_name};
-                        int32_t index = int32_t(cameras.size());
-                        cameras.push_back(new_camera);
-                        cameras_map.insert({camera_name, index});
-                        nodes[cur_node_index].cameras_index = index;
-                    }
+                if (std::vector<std::string> const &res = object.strings("camera"); !res.empty()) {
+                    nodes[cur_node_index].cameras_index = int32_t(index_of(cameras, cameras_map, res.front()));
                 }
-
-                // set light
-                if (auto res = object_i.find("light"); res != object_i.end()) {
-                    std::string light_name = res->second.as_string().value();
-                    if (auto light_found = lights_map.find(light_name); light_found != lights_map.end()) {
-                        nodes[cur_node_index].light_index = light_found->second;
-                    } else {
-                        Light new_light = {.name = light_name};
-                        int32_t index = int32_t(lights.size());
-                        lights.push_back(new_light);
-                        lights_map.insert({light_name, index});
-                        nodes[cur_node_index].light_index = index;
-                    }
-                    
+                if (std::vector<std::string> const &res = object.strings("light"); !res.empty()) {
+                    nodes[cur_node_index].light_index = int32_t(index_of(lights, lights_map, res.front()));
                 }
 
-            } else if (type.value() == "CLOUD") {
+            } else if (type.front() == "CLOUD") {
                 // An addition to the s72 file format, should have at most 1 cloud node per s72 file
                 /**
                  *{
@@ -197,182 +469,81 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
                     throw std::runtime_error("Error: more than one cloud node requested in s72 file, this is not supported.");
                 }
                 cloud = new Cloud();
-                cloud->name = object_i.find("name")->second.as_string().value();
-                
+                cloud->name = object.string("name");
+
                 cloud->cloud_type = Cloud::CloudType::NONE;
-                if (auto folder_path_res = object_i.find("folderPath"); folder_path_res != object_i.end()) {
-                    cloud->folder_path = folder_path_res->second.as_string().value();
+                if (std::vector<std::string> const &folder_path = object.strings("folderPath"); !folder_path.empty()) {
+                    cloud->folder_path = folder_path.front();
                     cloud->cloud_type = Cloud::CloudType::CUSTOM;
                 }
-                else if (auto preset_cloud_res = object_i.find("presetCloud"); preset_cloud_res != object_i.end()) {
-                    uint8_t preset_index = static_cast<uint8_t>(preset_cloud_res->second.as_number().value());
+                else if (std::vector<double> const &preset_cloud = object.numbers("presetCloud"); !preset_cloud.empty()) {
+                    uint8_t preset_index = static_cast<uint8_t>(preset_cloud.front());
                     cloud->cloud_type = static_cast<Cloud::CloudType>(preset_index);
                 }
-            } else if (type.value() == "MESH") {
-                std::string mesh_name = object_i.find("name")->second.as_string().value();
-                int32_t cur_mesh_index;
-                // look at the map and see if the node has been made already
-                if (auto mesh_found = meshes_map.find(mesh_name); mesh_found != meshes_map.end()) {
-                    cur_mesh_index = mesh_found->second;
-                }
-                else {
-                    Mesh new_mesh = {.name = mesh_name};
-                    cur_mesh_index = int32_t(meshes.size());
-                    meshes.push_back(new_mesh);
-                    meshes_map.insert({mesh_name, cur_mesh_index});
-                }
+            } else if (type.front() == "MESH") {
+                std::string const &mesh_name = object.string("name");
+                uint32_t cur_mesh_index = index_of(meshes, meshes_map, mesh_name);
 
                 // Assuming all topology is triangle list
                 // Assuming all attributes are in the same PosNorTanTex format
 
                 // get count
-                meshes[cur_mesh_index].count = int(object_i.find("count")->second.as_number().value());
+                meshes[cur_mesh_index].count = int(object.number("count"));
                 vertices_count += meshes[cur_mesh_index].count;
-                
-                // get attributes
-                if (auto attributes_res = object_i.find("attributes"); attributes_res != object_i.end()) {
-                    auto attributes = attributes_res->second.as_object().value();
-                    // get position
-                    if (auto attribute_res = attributes.find("POSITION"); attribute_res != attributes.end()) {
-                        auto position = attribute_res->second.as_object().value();
-                        meshes[cur_mesh_index].attributes[0].source = position.find("src")->second.as_string().value();
-                        meshes[cur_mesh_index].attributes[0].offset = uint32_t(int32_t(position.find("offset")->second.as_number().value()));
-                        meshes[cur_mesh_index].attributes[0].stride = uint32_t(int32_t(position.find("stride")->second.as_number().value()));
-                        std::string format = position.find("format")->second.as_string().value();
-                        if (format == "R32G32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
-                        } else if (format == "R32G32B32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-                        } else if (format == "R32G32B32A32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-                        } else if (format == "R8G8B8A8_UNORM") {
-                            meshes[cur_mesh_index].attributes[0].format = VK_FORMAT_R8G8B8A8_UNORM;
-                        } else {
-                            throw std::runtime_error("Unsupported mesh format " + format + " for " + mesh_name);
-                        }
-                    }
-                    // get normal
-                    if (auto attribute_res = attributes.find("NORMAL"); attribute_res != attributes.end()) {
-                        auto normal = attribute_res->second.as_object().value();
-                        meshes[cur_mesh_index].attributes[1].source = normal.find("src")->second.as_string().value();
-                        meshes[cur_mesh_index].attributes[1].offset = uint32_t(int32_t(normal.find("offset")->second.as_number().value()));
-                        meshes[cur_mesh_index].attributes[1].stride = uint32_t(int32_t(normal.find("stride")->second.as_number().value()));
-                        std::string format = normal.find("format")->second.as_string().value();
-                        if (format == "R32G32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[1].format = VK_FORMAT_R32G32_SFLOAT;
-                        } else if (format == "R32G32B32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-                        } else if (format == "R32G32B32A32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-                        } else if (format == "R8G8B8A8_UNORM") {
-                            meshes[cur_mesh_index].attributes[1].format = VK_FORMAT_R8G8B8A8_UNORM;
-                        } else {
-                            throw std::runtime_error("Unsupported mesh format " + format + " for " + mesh_name);
-                        }
-                    }
-                    // get tangent
-                    if (auto attribute_res = attributes.find("TANGENT"); attribute_res != attributes.end()) {
-                        auto tangent = attribute_res->second.as_object().value();
-                        meshes[cur_mesh_index].attributes[2].source = tangent.find("src")->second.as_string().value();
-                        meshes[cur_mesh_index].attributes[2].offset = uint32_t(int32_t(tangent.find("offset")->second.as_number().value()));
-                        meshes[cur_mesh_index].attributes[2].stride = uint32_t(int32_t(tangent.find("stride")->second.as_number().value()));
-                        std::string format = tangent.find("format")->second.as_string().value();
-                        if (format == "R32G32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[2].format = VK_FORMAT_R32G32_SFLOAT;
-                        } else if (format == "R32G32B32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-                        } else if (format == "R32G32B32A32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-                        } else if (format == "R8G8B8A8_UNORM") {
-                            meshes[cur_mesh_index].attributes[2].format = VK_FORMAT_R8G8B8A8_UNORM;
-                        } else {
-                            throw std::runtime_error("Unsupported mesh format " + format + " for " + mesh_name);
-                        }
-                    }
-                    // get texture coords
-                    if (auto attribute_res = attributes.find("TEXCOORD"); attribute_res != attributes.end()) {
-                        auto texcoord = attribute_res->second.as_object().value();
-                        meshes[cur_mesh_index].attributes[3].source = texcoord.find("src")->second.as_string().value();
-                        meshes[cur_mesh_index].attributes[3].offset = uint32_t(int32_t(texcoord.find("offset")->second.as_number().value()));
-                        meshes[cur_mesh_index].attributes[3].stride = uint32_t(int32_t(texcoord.find("stride")->second.as_number().value()));
-                        std::string format = texcoord.find("format")->second.as_string().value();
-                        if (format == "R32G32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[3].format = VK_FORMAT_R32G32_SFLOAT;
-                        } else if (format == "R32G32B32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-                        } else if (format == "R32G32B32A32_SFLOAT") {
-                            meshes[cur_mesh_index].attributes[3].format = VK_FORMAT_R32G32B32A32_SFLOAT;
-                        } else if (format == "R8G8B8A8_UNORM") {
-                            meshes[cur_mesh_index].attributes[3].format = VK_FORMAT_R8G8B8A8_UNORM;
-                        } else {
-                            throw std::runtime_error("Unsupported mesh format " + format + " for " + mesh_name);
-                        }
+
+                // get attributes, in the order of Mesh::attributes
+                static char const *attribute_names[4] = {"POSITION", "NORMAL", "TANGENT", "TEXCOORD"};
+                for (uint32_t a = 0; a < 4; ++a) {
+                    std::string attribute = std::string("attributes/") + attribute_names[a];
+                    if (!object.has(attribute)) continue;
+                    meshes[cur_mesh_index].attributes[a].source = object.string(attribute + "/src");
+                    meshes[cur_mesh_index].attributes[a].offset = uint32_t(int32_t(object.number(attribute + "/offset")));
+                    meshes[cur_mesh_index].attributes[a].stride = uint32_t(int32_t(object.number(attribute + "/stride")));
+                    std::string const &format = object.string(attribute + "/format");
+                    if (format == "R32G32_SFLOAT") {
+                        meshes[cur_mesh_index].attributes[a].format = VK_FORMAT_R32G32_SFLOAT;
+                    } else if (format == "R32G32B32_SFLOAT") {
+                        meshes[cur_mesh_index].attributes[a].format = VK_FORMAT_R32G32B32_SFLOAT;
+                    } else if (format == "R32G32B32A32_SFLOAT") {
+                        meshes[cur_mesh_index].attributes[a].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+                    } else if (format == "R8G8B8A8_UNORM") {
+                        meshes[cur_mesh_index].attributes[a].format = VK_FORMAT_R8G8B8A8_UNORM;
+                    } else {
+                        throw std::runtime_error("Unsupported mesh format " + format + " for " + mesh_name);
                     }
                 }
 
                 // get material
-                if (auto res = object_i.find("material"); res != object_i.end()) {
-                    std::string material_name = res->second.as_string().value();
-                    if (auto material_found = materials_map.find(material_name); material_found != materials_map.end()) {
-                        meshes[cur_mesh_index].material_index = material_found->second;
-                    } else {
-                        Material new_material = {.name = material_name};
-                        int32_t index = int32_t(materials.size());
-                        materials.push_back(new_material);
-                        materials_map.insert({material_name, index});
-                        meshes[cur_mesh_index].material_index = index;
-                    }
+                if (std::vector<std::string> const &res = object.strings("material"); !res.empty()) {
+                    meshes[cur_mesh_index].material_index = index_of(materials, materials_map, res.front());
                 }
                 else {
                     meshes[cur_mesh_index].material_index = 0;
                 }
 
-            } else if (type.value() == "CAMERA") {
-                std::string camera_name = object_i.find("name")->second.as_string().value();
-                int32_t cur_camera_index;
-                // look at the map and see if the node has been made already
-                if (auto camera_found = cameras_map.find(camera_name); camera_found != cameras_map.end()) {
-                    cur_camera_index = camera_found->second;
-                }
-                else {
-                    Camera new_camera = {.name = camera_name};
-                    cur_camera_index = int32_t(cameras.size());
-                    cameras.push_back(new_camera);
-                    cameras_map.insert({camera_name, cur_camera_index});
-                }
+            } else if (type.front() == "CAMERA") {
+                uint32_t cur_camera_index = index_of(cameras, cameras_map, object.string("name"));
                 // get perspective
-                if (auto res = object_i.find("perspective"); res != object_i.end()) {
-                    auto perspective = res->second.as_object().value();
+                if (object.has("perspective")) {
                     //aspect, vfov, and near are required
-                    cameras[cur_camera_index].aspect = float(perspective.find("aspect")->second.as_number().value());
-                    cameras[cur_camera_index].vfov = float(perspective.find("vfov")->second.as_number().value());
-                    cameras[cur_camera_index].near = float(perspective.find("near")->second.as_number().value());
+                    cameras[cur_camera_index].aspect = float(object.number("perspective/aspect"));
+                    cameras[cur_camera_index].vfov = float(object.number("perspective/vfov"));
+                    cameras[cur_camera_index].near = float(object.number("perspective/near"));
 
                     // see if there is far
-                    if (auto far_res = perspective.find("far"); far_res != perspective.end()) {
-                        cameras[cur_camera_index].far = float(far_res->second.as_number().value());
+                    if (std::vector<double> const &far_res = object.numbers("perspective/far"); !far_res.empty()) {
+                        cameras[cur_camera_index].far = float(far_res.front());
                     }
                 }
 
-            } else if (type.value() == "MATERIAL") {
-
-                std::string material_name = object_i.find("name")->second.as_string().value();
-                int32_t cur_material_index;
-                // look at the map and see if the node has been made already
-                if (auto material_found = materials_map.find(material_name); material_found != materials_map.end()) {
-                    cur_material_index = material_found->second;
-                }
-                else {
-                    Material new_material = {.name = material_name};
-                    cur_material_index = int32_t(materials.size());
-                    materials.push_back(new_material);
-                    materials_map.insert({material_name, cur_material_index});
-                }
+            } else if (type.front() == "MATERIAL") {
+                std::string const &material_name = object.string("name");
+                uint32_t cur_material_index = index_of(materials, materials_map, material_name);
 
-                auto get_texture_format = [&](std::map<std::string, sejp::value> res){
+                auto get_texture_format = [&](std::string const &res){
                     Texture::Format format = Texture::Linear;
-                    if (auto format_res = res.find("format"); format_res != res.end()) {
-                        std::string tex_format = format_res->second.as_string().value();
+                    if (std::vector<std::string> const &format_res = object.strings(res + "/format"); !format_res.empty()) {
+                        std::string const &tex_format = format_res.front();
                         if (tex_format == "srgb") {
                             format = Texture::sRGB;
                         }
@@ -385,331 +556,127 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
                     }
                     return format;
                 };
-                materials[cur_material_index].normal_index = static_cast<uint32_t>(Texture::DefaultTexture::DefaultNormal);
-                materials[cur_material_index].displacement_index = static_cast<uint32_t>(Texture::DefaultTexture::DefaultDisplacement);
-                if (auto res = object_i.find("normalMap"); res != object_i.end()) {
-                    if (auto source = res->second.as_object().value().find("src"); source != res->second.as_object().value().end()) {
-                        std::string tex_name = source->second.as_string().value();
-                        if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                materials[cur_material_index].normal_index = tex_map_entry->second;
-                        } else {
-                            Texture new_texture = Texture(tex_name, get_texture_format(res->second.as_object().value()));
-                            uint32_t index = uint32_t(textures.size());
-                            textures.push_back(new_texture);
-                            textures_map.insert({tex_name, index});
-                            materials[cur_material_index].normal_index = index;
-                        }
+                // index of the texture for a map or channel: a constant (made with make_constant, named after the material) or a "src" texture, or fallback if it has neither:
+                auto channel_index = [&](std::string const &res, std::string const &constant_name, auto &&make_constant, bool single_channel, Texture::DefaultTexture fallback) -> uint32_t {
+                    if (std::vector<double> const &constant = object.numbers(res); !constant.empty()) {
+                        return texture_index(constant_name, [&]() { return make_constant(constant); });
                     }
-                }
-
-                if (auto res = object_i.find("displacementMap"); res != object_i.end()) {
-                    if (auto source = res->second.as_object().value().find("src"); source != res->second.as_object().value().end()) {
-                        std::string tex_name = source->second.as_string().value();
-                        if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                materials[cur_material_index].displacement_index = tex_map_entry->second;
-                        } else {
-                            Texture new_texture = Texture(tex_name, true, get_texture_format(res->second.as_object().value()));
-                            uint32_t index = uint32_t(textures.size());
-                            textures.push_back(new_texture);
-                            textures_map.insert({tex_name, index});
-                            materials[cur_material_index].displacement_index = index;
-                        }
+                    if (std::vector<std::string> const &source = object.strings(res + "/src"); !source.empty()) {
+                        std::string const &tex_name = source.front();
+                        return texture_index(tex_name, [&]() { return Texture(tex_name, single_channel, get_texture_format(res)); });
                     }
-                }
+                    return static_cast<uint32_t>(fallback);
+                };
+                auto albedo_constant = [](std::vector<double> const &albedo) {
+                    assert(albedo.size() == 3);
+                    return Texture(glm::vec3(float(albedo[0]), float(albedo[1]), float(albedo[2])));
+                };
+                auto scalar_constant = [](std::vector<double> const &value) {
+                    return Texture(float(value.front()));
+                };
+                // (maps can't be constants)
+                auto no_constant = [](std::vector<double> const &) -> Texture {
+                    throw std::runtime_error("expected an object with a \"src\" for a texture map");
+                };
 
+                materials[cur_material_index].normal_index = channel_index("normalMap", "", no_constant, false, Texture::DefaultTexture::DefaultNormal);
+                materials[cur_material_index].displacement_index = channel_index("displacementMap", "", no_constant, true, Texture::DefaultTexture::DefaultDisplacement);
 
                 //lambertian material
-                if (auto res = object_i.find("lambertian"); res != object_i.end()) {
+                if (object.has("lambertian")) {
                     MatLambertian_count++;
                     materials[cur_material_index].material_type = Material::Lambertian;
-
-                    if (auto albedo_res = res->second.as_object().value().find("albedo"); albedo_res != res->second.as_object().value().end()) {
-                        auto albedo_vals = albedo_res->second.as_array();
-                        // stored as a const value
-                        if (albedo_vals) {
-                            std::vector<sejp::value> albedo_vector = albedo_vals.value();
-                            assert(albedo_vector.size() == 3);
-                            std::string tex_name = material_name;
-                            if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                materials[cur_material_index].material_textures = Material::MatLambertian(tex_map_entry->second);
-                            } else {
-                                Texture new_texture = Texture(glm::vec3(float(albedo_vector[0].as_number().value()), float(albedo_vector[1].as_number().value()), float(albedo_vector[2].as_number().value())));
-                                uint32_t index = uint32_t(textures.size());
-                                textures.push_back(new_texture);
-                                textures_map.insert({tex_name, index});
-                                materials[cur_material_index].material_textures = Material::MatLambertian(index);
-                            }
-                        } 
-                        // stored as a texture
-                        else {
-                            // check whether or not the albedo has a texture
-                            if (auto tex_res = albedo_res->second.as_object().value().find("src"); tex_res != albedo_res->second.as_object().value().end()) {
-                                std::string tex_name = tex_res->second.as_string().value();
-                                if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                    materials[cur_material_index].material_textures = Material::MatLambertian(tex_map_entry->second);
-                                } else {
-                                    Texture new_texture = Texture(tex_name, get_texture_format(albedo_res->second.as_object().value()));
-                                    uint32_t index = uint32_t(textures.size());
-                                    textures.push_back(new_texture);
-                                    textures_map.insert({tex_name, index});
-                                    materials[cur_material_index].material_textures = Material::MatLambertian(index);
-                                }
-                            }
-                            // somehow has no source texture
-                            else {
-                                materials[cur_material_index].material_textures = Material::MatLambertian(static_cast<uint32_t>(Texture::DefaultTexture::DefaultAlbedo));
-                            }
-                        }
-                    }
-                    // no albedo field, use the fall back texture
-                    else {
-                        materials[cur_material_index].material_textures = Material::MatLambertian(static_cast<uint32_t>(Texture::DefaultTexture::DefaultAlbedo));
-                    }
+                    materials[cur_material_index].material_textures = Material::MatLambertian(
+                        channel_index("lambertian/albedo", material_name, albedo_constant, false, Texture::DefaultTexture::DefaultAlbedo)
+                    );
                 }
                 //mirror 
-                else if (auto mirror_res = object_i.find("mirror"); mirror_res != object_i.end()) {
+                else if (object.has("mirror")) {
                     MatEnvMirror_count++;
                     materials[cur_material_index].material_type = Material::Mirror;
                 }
                 //environment
-                else if (auto environment_res = object_i.find("environment"); environment_res != object_i.end()) {
+                else if (object.has("environment")) {
                     MatEnvMirror_count++;
                     materials[cur_material_index].material_type = Material::Environment;
                 }
                 //pbr
-                else if (auto pbr_res = object_i.find("pbr"); pbr_res != object_i.end()) {
+                else if (object.has("pbr")) {
                     MatPBR_count++;
                     materials[cur_material_index].material_type = Material::PBR;
                     Material::MatPBR new_material = Material::MatPBR();
-                    if (auto albedo_res = pbr_res->second.as_object().value().find("albedo"); albedo_res != pbr_res->second.as_object().value().end()) {
-                        auto albedo_vals = albedo_res->second.as_array();
-                        // stored as a const value
-                        if (albedo_vals) {
-                            std::vector<sejp::value> albedo_vector = albedo_vals.value();
-                            assert(albedo_vector.size() == 3);
-                            std::string tex_name = material_name;
-                            if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                new_material.albedo_index = tex_map_entry->second;
-                            } else {
-                                Texture new_texture = Texture(glm::vec3(float(albedo_vector[0].as_number().value()), float(albedo_vector[1].as_number().value()), float(albedo_vector[2].as_number().value())));
-                                uint32_t index = uint32_t(textures.size());
-                                textures.push_back(new_texture);
-                                textures_map.insert({tex_name, index});
-                                new_material.albedo_index = index;
-                            }
-                        } 
-                        // stored as a texture
-                        else {
-                            // check whether or not the albedo has a texture
-                            if (auto tex_res = albedo_res->second.as_object().value().find("src"); tex_res != albedo_res->second.as_object().value().end()) {
-                                std::string tex_name = tex_res->second.as_string().value();
-                                if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                    new_material.albedo_index = tex_map_entry->second;
-                                } else {
-                                    Texture new_texture = Texture(tex_name, get_texture_format(albedo_res->second.as_object().value()));
-                                    uint32_t index = uint32_t(textures.size());
-                                    textures.push_back(new_texture);
-                                    textures_map.insert({tex_name, index});
-                                    new_material.albedo_index = index;
-                                }
-                            }
-                            // somehow has no source texture
-                            else {
-                                new_material.albedo_index = static_cast<uint32_t>(Texture::DefaultTexture::DefaultAlbedo);
-                            }
-                        }
-                    }
-                    // no albedo field, use the fall back texture
-                    else {
-                        new_material.albedo_index = static_cast<uint32_t>(Texture::DefaultTexture::DefaultAlbedo);
-                    }
-
-                    if (auto roughness_res = pbr_res->second.as_object().value().find("roughness"); roughness_res != pbr_res->second.as_object().value().end()) {
-                        auto roughness_vals = roughness_res->second.as_number();
-                        // stored as a const value
-                        if (roughness_vals) {
-                            float roughness_value = float(roughness_vals.value());
-                            std::string tex_name = material_name + " roughness";
-                            if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                new_material.roughness_index = tex_map_entry->second;
-                            } else {
-                                uint32_t index = uint32_t(textures.size());
-                                Texture new_texture = Texture(roughness_value);
-                                textures.push_back(new_texture);
-                                textures_map.insert({tex_name, index});
-                                new_material.roughness_index = index;
-                            }
-                        } 
-                        // stored as a texture
-                        else {
-                            // check whether or not the roughness has a texture
-                            if (auto tex_res = roughness_res->second.as_object().value().find("src"); tex_res != roughness_res->second.as_object().value().end()) {
-                                std::string tex_name = tex_res->second.as_string().value();
-                                if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                    new_material.roughness_index = tex_map_entry->second;
-                                } else {
-                                    Texture new_texture = Texture(tex_name, true, get_texture_format(roughness_res->second.as_object().value()));
-                                    uint32_t index = uint32_t(textures.size());
-                                    textures.push_back(new_texture);
-                                    textures_map.insert({tex_name, index});
-                                    new_material.roughness_index = index;
-                                }
-                            }
-                            // somehow has no source texture
-                            else {
-                                new_material.roughness_index = static_cast<uint32_t>(Texture::DefaultTexture::DefaultRoughness);
-                            }
-                        }
-                    }
-                    // no roughness field, use the fall back texture
-                    else {
-                        new_material.roughness_index = static_cast<uint32_t>(Texture::DefaultTexture::DefaultRoughness);
-                    }
-
-                    if (auto metalness_res = pbr_res->second.as_object().value().find("metalness"); metalness_res != pbr_res->second.as_object().value().end()) {
-                        auto metalness_vals = metalness_res->second.as_number();
-                        // stored as a const value
-                        if (metalness_vals) {
-                            float metalness_value = float(metalness_vals.value());
-                            std::string tex_name = material_name + "metalness";
-                            if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                new_material.metalness_index = tex_map_entry->second;
-                            } else {
-                                uint32_t index = uint32_t(textures.size());
-                                Texture new_texture = Texture(metalness_value);
-                                textures.push_back(new_texture);
-                                textures_map.insert({tex_name, index});
-                                new_material.metalness_index = index;
-                            }
-                        } 
-                        // stored as a texture
-                        else {
-                            // check whether or not the metalness has a texture
-                            if (auto tex_res = metalness_res->second.as_object().value().find("src"); tex_res != metalness_res->second.as_object().value().end()) {
-                                std::string tex_name = tex_res->second.as_string().value();
-                                if (auto tex_map_entry = textures_map.find(tex_name); tex_map_entry != textures_map.end()) {
-                                    new_material.metalness_index = tex_map_entry->second;
-                                } else {
-                                    Texture new_texture = Texture(tex_name, true, get_texture_format(metalness_res->second.as_object().value()));
-                                    uint32_t index = uint32_t(textures.size());
-                                    textures.push_back(new_texture);
-                                    textures_map.insert({tex_name, index});
-                                    new_material.metalness_index = index;
-                                }
-                            }
-                            // somehow has no source texture
-                            else {
-                                new_material.metalness_index = static_cast<uint32_t>(Texture::DefaultTexture::DefaultMetalness);
-                            }
-                        }
-                    }
-                    // no metalness field, use the fall back texture
-                    else {
-                        new_material.metalness_index = static_cast<uint32_t>(Texture::DefaultTexture::DefaultMetalness);
-                    }
-
+                    new_material.albedo_index = channel_index("pbr/albedo", material_name, albedo_constant, false, Texture::DefaultTexture::DefaultAlbedo);
+                    new_material.roughness_index = channel_index("pbr/roughness", material_name + " roughness", scalar_constant, true, Texture::DefaultTexture::DefaultRoughness);
+                    new_material.metalness_index = channel_index("pbr/metalness", material_name + "metalness", scalar_constant, true, Texture::DefaultTexture::DefaultMetalness);
                     materials[cur_material_index].material_textures = new_material;
                 }
 
-            } else if (type.value() == "ENVIRONMENT") {
+            } else if (type.front() == "ENVIRONMENT") {
                 assert(environment.source == "" && "environment should not be instantiated already");
-                std::string environment_name = object_i.find("name")->second.as_string().value();
-                auto radiance_res = object_i.find("radiance")->second.as_object().value();
-                std::string environment_source = radiance_res.find("src")->second.as_string().value();
-                assert(radiance_res.find("type")->second.as_string().value() == "cube");
-                assert(radiance_res.find("format")->second.as_string().value() == "rgbe");
-                environment.name = environment_name;
-                environment.source = environment_source;
-            } else if (type.value() == "LIGHT") {
-                std::string light_name = object_i.find("name")->second.as_string().value();
-                uint32_t light_index = 0;
-                if (auto light_found = lights_map.find(light_name); light_found != lights_map.end()) {
-                    light_index = light_found->second;
-                }
-                else {
-                    Light new_light = {.name = light_name};
-                    int32_t index = int32_t(lights.size());
-                    lights.push_back(new_light);
-                    lights_map.insert({light_name, index});
-                    light_index = index;
-                }
+                assert(object.string("radiance/type") == "cube");
+                assert(object.string("radiance/format") == "rgbe");
+                environment.name = object.string("name");
+                environment.source = object.string("radiance/src");
+            } else if (type.front() == "LIGHT") {
+                uint32_t light_index = index_of(lights, lights_map, object.string("name"));
+
+                // optional parameters keep their defaults:
+                auto read = [&](std::string const &path, float &into) {
+                    if (std::vector<double> const &res = object.numbers(path); !res.empty()) {
+                        into = float(res.front());
+                    }
+                };
 
                 {// tint
                     glm::vec3 tint = glm::vec3(1.0f,1.0f,1.0f);
-                    if (auto tint_res = object_i.find("tint"); tint_res != object_i.end()) {
-                        auto tint_arr = tint_res->second.as_array().value();
+                    if (std::vector<double> const &tint_arr = object.numbers("tint"); !tint_arr.empty()) {
                         assert(tint_arr.size() == 3);
-                        tint.x = float(tint_arr[0].as_number().value());
-                        tint.y = float(tint_arr[1].as_number().value());
-                        tint.z = float(tint_arr[2].as_number().value());
+                        tint = glm::vec3(float(tint_arr[0]), float(tint_arr[1]), float(tint_arr[2]));
                     }
                     lights[light_index].tint = tint;
                 }
 
                 {// shadow
                     uint32_t shadow = 0;
-                    if (auto shadow_res = object_i.find("shadow"); shadow_res != object_i.end()) {
-                        shadow = uint32_t(shadow_res->second.as_number().value());
+                    if (std::vector<double> const &shadow_res = object.numbers("shadow"); !shadow_res.empty()) {
+                        shadow = uint32_t(shadow_res.front());
                     }
                     lights[light_index].shadow = shadow;
                 }
 
-                if (auto sun_res = object_i.find("sun"); sun_res != object_i.end()) {
+                if (object.has("sun")) {
                     lights[light_index].light_type = Light::Sun;
                     Light::ParamSun additional_params;
-                    auto sun_obj = sun_res->second.as_object().value();
-                    if (auto angle_res = sun_obj.find("angle"); angle_res != sun_obj.end()) {
-                        additional_params.angle = float(angle_res->second.as_number().value());
-                    }
-                    if (auto strength_res = sun_obj.find("strength"); strength_res != sun_obj.end()) {
-                        additional_params.strength = float(strength_res->second.as_number().value());
-                    }
+                    read("sun/angle", additional_params.angle);
+                    read("sun/strength", additional_params.strength);
                     lights[light_index].additional_params = additional_params;
                 }
-                else if (auto sphere_res = object_i.find("sphere"); sphere_res != object_i.end()) {
+                else if (object.has("sphere")) {
                     lights[light_index].light_type = Light::Sphere;
                     Light::ParamSphere additional_params;
-                    auto sphere_obj = sphere_res->second.as_object().value();
-                    if (auto radius_res = sphere_obj.find("radius"); radius_res != sphere_obj.end()) {
-                        additional_params.radius = float(radius_res->second.as_number().value());
-                    }
-                    if (auto power_res = sphere_obj.find("power"); power_res != sphere_obj.end()) {
-                        additional_params.power = float(power_res->second.as_number().value());
-                    }
-                    if (auto limit_res = sphere_obj.find("limit"); limit_res != sphere_obj.end()) {
-                        additional_params.limit = float(limit_res->second.as_number().value());
-                    }
+                    read("sphere/radius", additional_params.radius);
+                    read("sphere/power", additional_params.power);
+                    read("sphere/limit", additional_params.limit);
                     lights[light_index].additional_params = additional_params;
                 }
-                else if (auto spot_res = object_i.find("spot"); spot_res != object_i.end()){
+                else if (object.has("spot")) {
                     lights[light_index].light_type = Light::Spot;
                     Light::ParamSpot additional_params;
-                    auto spot_obj = spot_res->second.as_object().value();
-                    if (auto radius_res = spot_obj.find("radius"); radius_res != spot_obj.end()) {
-                        additional_params.radius = float(radius_res->second.as_number().value());
-                    }
-                    if (auto power_res = spot_obj.find("power"); power_res != spot_obj.end()) {
-                        additional_params.power = float(power_res->second.as_number().value());
-                    }
-                    if (auto limit_res = spot_obj.find("limit"); limit_res != spot_obj.end()) {
-                        additional_params.limit = float(limit_res->second.as_number().value());
-                    }
-                    if (auto fov_res = spot_obj.find("fov"); fov_res != spot_obj.end()) {
-                        additional_params.fov = float(fov_res->second.as_number().value());
-                    }
-                    if (auto blend_res = spot_obj.find("blend"); blend_res != spot_obj.end()) {
-                        additional_params.blend = float(blend_res->second.as_number().value());
-                    }
+                    read("spot/radius", additional_params.radius);
+                    read("spot/power", additional_params.power);
+                    read("spot/limit", additional_params.limit);
+                    read("spot/fov", additional_params.fov);
+                    read("spot/blend", additional_params.blend);
                     lights[light_index].additional_params = additional_params;
                 }
                 else {
                     throw std::runtime_error("Unsupported light type, only supports Sun, Sphere, and Spot light.");
                 }
 
-            } else if (type.value() == "DRIVER") {
-                std::string driver_name = object_i.find("name")->second.as_string().value();
-                std::string node_name = object_i.find("node")->second.as_string().value();
-                std::string channel_str = object_i.find("channel")->second.as_string().value();
+            } else if (type.front() == "DRIVER") {
+                std::string const &driver_name = object.string("name");
+                std::string const &node_name = object.string("node");
+                std::string const &channel_str = object.string("channel");
                 Driver::Channel channel;
                 if (channel_str == "translation") {
                     channel = Driver::Channel::Translation;
@@ -724,8 +691,8 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
                     throw std::runtime_error("Unrecognized channel: " + channel_str);
                 }
                 Driver::InterpolationMode interp = Driver::InterpolationMode::LINEAR;
-                if (auto interp_res = object_i.find("interpolation"); interp_res != object_i.end()) {
-                    std::string interp_str = interp_res->second.as_string().value();
+                if (std::vector<std::string> const &interp_res = object.strings("interpolation"); !interp_res.empty()) {
+                    std::string const &interp_str = interp_res.front();
                     if (interp_str == "STEP") interp = Driver::InterpolationMode::STEP;
                     else if (interp_str == "LINEAR") interp = Driver::InterpolationMode::LINEAR;
                     else if (interp_str == "SLERP") interp = Driver::InterpolationMode::SLERP;
@@ -738,10 +705,7 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
                     node_index = node_found->second;
                 }
                 else {
-                    Node new_node = {.name = node_name};
-                    node_index = int32_t(nodes.size());
-                    nodes.push_back(new_node);
-                    nodes_map.insert({node_name, node_index});
+                    node_index = index_of(nodes, nodes_map, node_name);
                     root_nodes.push_back(node_index);
                 }
                 Driver driver = {
@@ -750,8 +714,8 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
                     .channel = channel,
                     .interpolation = interp,
                 };
-                std::vector<sejp::value> times = object_i.find("times")->second.as_array().value();
-                std::vector<sejp::value> values = object_i.find("values")->second.as_array().value();
+                std::vector<double> const &times = object.numbers("times");
+                std::vector<double> const &values = object.numbers("values");
                 if (channel == Driver::Channel::Rotation) {
                     if (times.size() * 4 != values.size()) {
                         std::cerr<<"Value size: "<<values.size()<< "; Time Size" << times.size()<<std::endl;
@@ -762,23 +726,46 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
                     std::cerr<<"Value size: "<<values.size()<< "; Time Size" << times.size()<<std::endl;
                     throw std::runtime_error("Translation/Scaling driver " + driver_name +" does not have correct number of values (3 * time)");
                 }
-                for (uint32_t time_i = 0; time_i < times.size(); ++time_i) {
-                    driver.times.push_back(float(times[time_i].as_number().value()));
+                driver.times.reserve(times.size());
+                for (double time : times) {
+                    driver.times.push_back(float(time));
                 }
-                for (uint32_t value_i = 0; value_i < values.size(); ++value_i) {
-                    driver.values.push_back(float(values[value_i].as_number().value()));
+                driver.values.reserve(values.size());
+                for (double value : values) {
+                    driver.values.push_back(float(value));
                 }
-                drivers.push_back(driver);
+                drivers.push_back(std::move(driver));
             } else {
-                std::cerr << "Unknown type: " + type.value() <<std::endl;
+                std::cerr << "Unknown type: " << type.front() <<std::endl;
             }
-        }
+        };
 
+        sejp::load(filename, reader);
+        if (reader.element == 0) {
+            throw std::runtime_error("cannot find the correct header");
+        }
 
     } catch (std::exception &e) {
         std::cerr<<"Exception occured while trying to parse .s72 scene file\n";
         throw e;
     }
+}
+
+void Scene::load(std::string filename, std::optional<std::string> requested_camera)
+{
+    if (filename.substr(filename.size()-4, 4) != ".s72") {
+        throw std::runtime_error("Scene " + filename + " is not a compatible format (s72 required). Last 4 char is " + filename.substr(filename.size()-4, 4));
+    }
+    scene_path = filename.substr(0, filename.rfind('/'));;
+    if (cache && cache->hit) {
+        read_cache(*this, cache->reader);
+    } else {
+        parse(filename);
+        if (cache && cache->writing()) {
+            cache->add_source(filename);
+            write_cache(*this, cache->writer);
+        }
+    }
 
     std::cout<< "----Finished loading " + filename +"----"<<std::endl;
 
@@ -829,6 +816,9 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
 		});
 
 	}
+
+    flatten_hierarchy();
+
     // could not find requested camera
     if (requested_camera.has_value() && requested_camera_index == -1) {
         throw std::runtime_error("Did not find camera with name: " + requested_camera.value() + ", aborting...");
@@ -844,6 +834,61 @@ void Scene::load(std::string filename, std::optional<std::string> requested_came
     debug();
 }
 
+void Scene::flatten_hierarchy() {
+    // walk every path depth-first, the order lights and cameras are numbered in:
+    struct Visit {
+        uint32_t node;
+        int32_t parent; // index in visits
+        uint32_t depth;
+    };
+    std::vector<Visit> visits;
+    std::function<void(uint32_t, int32_t, uint32_t)> visit = [&](uint32_t i, int32_t parent, uint32_t depth) {
+        int32_t self = int32_t(visits.size());
+        visits.push_back(Visit{.node = i, .parent = parent, .depth = depth});
+        for (uint32_t child_index : nodes[i].children) {
+            visit(child_index, self, depth + 1);
+        }
+    };
+    for (uint32_t i = 0; i < root_nodes.size(); ++i) {
+        visit(root_nodes[i], -1, 0);
+    }
+
+    // group the visits by depth, keeping depth-first order within each depth:
+    std::vector<uint32_t> order(visits.size());
+    for (uint32_t v = 0; v < order.size(); ++v) order[v] = v;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return visits[a].depth < visits[b].depth;
+    });
+    std::vector<uint32_t> entry_of_visit(visits.size());
+    for (uint32_t e = 0; e < order.size(); ++e) {
+        entry_of_visit[order[e]] = e;
+    }
+
+    hierarchy = Hierarchy();
+    hierarchy.node.reserve(visits.size());
+    hierarchy.parent.reserve(visits.size());
+    for (uint32_t e = 0; e < order.size(); ++e) {
+        const Visit& cur_visit = visits[order[e]];
+        hierarchy.node.push_back(cur_visit.node);
+        hierarchy.parent.push_back(cur_visit.parent == -1 ? -1 : int32_t(entry_of_visit[cur_visit.parent]));
+        while (hierarchy.level_first.size() <= cur_visit.depth) {
+            hierarchy.level_first.push_back(e);
+        }
+        if (nodes[cur_visit.node].mesh_index != -1) {
+            hierarchy.mesh_entries.push_back(e);
+        }
+    }
+    hierarchy.level_first.push_back(uint32_t(order.size()));
+    for (uint32_t v = 0; v < visits.size(); ++v) {
+        if (nodes[visits[v].node].light_index != -1) {
+            hierarchy.light_entries.push_back(entry_of_visit[v]);
+        }
+    }
+    hierarchy.parent_from_local.resize(visits.size());
+    hierarchy.world_from_local.resize(visits.size());
+    hierarchy.dirty.assign(visits.size(), 1);
+}
+
 void Scene::debug() {
     for (const auto& node : nodes) {
         // Print node name
@@ -1040,6 +1085,12 @@ void Scene::debug() {
 void Scene::update_drivers(float dt)
 {
     if (animation_setting == 2) return;
+    // remember the driven transforms, so only nodes that actually move get marked dirty:
+    std::vector<Transform> driven_before(drivers.size());
+    for (uint32_t i = 0; i < drivers.size(); ++i) {
+        driven_before[i] = nodes[drivers[i].node_index].transform;
+    }
+
     for (Scene::Driver& driver : drivers) {
         if (driver.cur_time_index == driver.times.size()) continue;
         driver.cur_time += dt;
@@ -1223,6 +1274,15 @@ void Scene::update_drivers(float dt)
         }
         
     }
+
+    for (uint32_t i = 0; i < drivers.size(); ++i) {
+        Node& node = nodes[drivers[i].node_index];
+        if (node.transform.position != driven_before[i].position
+         || node.transform.rotation != driven_before[i].rotation
+         || node.transform.scale != driven_before[i].scale) {
+            node.dirty = true;
+        }
+    }
 }
 
 void Scene::set_driver_time(float time)
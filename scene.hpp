@@ -1,11 +1,14 @@
 #pragma once
 #include "VK.hpp"
 #include "GLM.hpp"
+#include <memory>
 #include <string>
 #include <vector>
 #include <optional>
 #include <variant>
 
+struct SceneCache;
+
 /**
  *  Loads from .s72 format and manages a hiearchy of transformations
  * 
@@ -167,6 +170,7 @@ struct Scene
         int32_t mesh_index = -1;
         int32_t light_index = -1;
         bool environment = false;
+        bool dirty = true; // transform changed since world matrices were last computed; set by update_drivers
     };
 
     struct Driver {
@@ -214,12 +218,34 @@ struct Scene
     std::vector<uint32_t> root_nodes;
     std::string scene_path;
 
-    Scene(std::string filename, std::optional<std::string> camera, uint8_t animation_setting);
+    // The node hierarchy flattened for per-frame traversal, one entry per path to a node (a node with several parents appears once per parent).
+    // Stored as parallel arrays sorted by depth, so every entry comes after its parent:
+    struct Hierarchy {
+        std::vector<uint32_t> node; // index into nodes
+        std::vector<int32_t> parent; // entry index of the parent, -1 for roots
+        std::vector<glm::mat4x4> parent_from_local; // refreshed from nodes[node].transform every frame
+        std::vector<glm::mat4x4> world_from_local;
+        std::vector<uint8_t> dirty; // world_from_local changed this frame: the node or an ancestor is dirty
+        std::vector<uint32_t> level_first; // entries of depth d are [level_first[d], level_first[d+1])
+        std::vector<uint32_t> mesh_entries; // entries with a mesh
+        std::vector<uint32_t> light_entries; // entries with a light, in the depth-first order lights are numbered in
+    } hierarchy;
+
+    // --scene-cache: where this scene (and the renderer's payloads for it) are read from or written to; nullptr if not caching
+    std::unique_ptr<SceneCache> cache;
+
+    Scene(std::string filename, std::optional<std::string> camera, uint8_t animation_setting, std::optional<std::string> cache_dir = std::nullopt);
 
     ~Scene();
 
     void load(std::string file_path, std::optional<std::string> requested_camera);
 
+    // reads the .s72 file itself into nodes, meshes, materials, etc. (load() then builds everything derived from those)
+    void parse(std::string const &filename);
+
+    // builds hierarchy from root_nodes and the nodes' children
+    void flatten_hierarchy();
+
     void debug();
 
     void update_drivers(float dt);
@@ -0,0 +1,114 @@
+//Microbenchmark: sejp's scanning stage, event walk, and full parse with each scanner the CPU supports.
+//$ node Maekfile.js bin/sejp-bench && bin/sejp-bench [megabytes | file.s72]
+
+#include "sejp.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//an s72-shaped document: lots of nodes with short names and transform arrays, some meshes and materials:
+static std::string make_scene(size_t target_bytes) {
+	std::mt19937 mt(0x5e1b0a7d);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+	auto number = [&]() {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%g", unit(mt) * 10.0f);
+		return std::string(buf);
+	};
+	auto numbers = [&](uint32_t count) {
+		std::string str = "[";
+		for (uint32_t i = 0; i < count; ++i) str += (i ? "," : "") + number();
+		return str + "]";
+	};
+
+	std::string text = "[\"s72-v2\",\n";
+	text += "{\n\t\"type\":\"SCENE\",\n\t\"name\":\"Generated\",\n\t\"roots\":[1]\n}";
+	for (uint32_t n = 1; text.size() < target_bytes; ++n) {
+		text += ",\n{\n\t\"type\":\"NODE\",\n\t\"name\":\"node " + std::to_string(n) + (n % 16 == 0 ? " \\\"quoted\\\"" : "") + "\",\n";
+		text += "\t\"translation\":" + numbers(3) + ",\n";
+		text += "\t\"rotation\":" + numbers(4) + ",\n";
+		text += "\t\"scale\":[1,1,1],\n";
+		text += "\t\"children\":[" + std::to_string(n + 1) + "," + std::to_string(n + 2) + "],\n";
+		if (n % 4 == 0) {
+			text += "\t\"mesh\":\"mesh " + std::to_string(n) + "\"\n},\n";
+			text += "{\n\t\"type\":\"MESH\",\n\t\"name\":\"mesh " + std::to_string(n) + "\",\n\t\"topology\":\"TRIANGLE_LIST\",\n\t\"count\":" + std::to_string(mt() % 10000) + ",\n";
+			text += "\t\"attributes\":{\n\t\t\"POSITION\":{ \"src\":\"mesh.b72\", \"offset\":0, \"stride\":52, \"format\":\"R32G32B32_SFLOAT\" },\n";
+			text += "\t\t\"NORMAL\":{ \"src\":\"mesh.b72\", \"offset\":12, \"stride\":52, \"format\":\"R32G32B32_SFLOAT\" }\n\t},\n";
+			text += "\t\"material\":\"material " + std::to_string(n) + "\"\n},\n";
+			text += "{\n\t\"type\":\"MATERIAL\",\n\t\"name\":\"material " + std::to_string(n) + "\",\n\t\"pbr\":{ \"albedo\":" + numbers(3) + ", \"roughness\":" + number() + ", \"metalness\":0.0 }\n}";
+		} else {
+			text += "\t\"camera\":null,\n\t\"visible\":" + std::string(n % 3 ? "true" : "false") + "\n}";
+		}
+	}
+	text += "\n]\n";
+	return text;
+}
+
+int main(int argc, char **argv) {
+	std::string text;
+	std::string source = "generated";
+	if (argc > 1 && std::string(argv[1]).find_first_not_of("0123456789") != std::string::npos) {
+		MappedFile file(argv[1]);
+		text.assign(reinterpret_cast< char const * >(file.data), file.size);
+		source = argv[1];
+	} else {
+		size_t megabytes = (argc > 1 ? std::max(1, std::atoi(argv[1])) : 64);
+		text = make_scene(megabytes << 20);
+	}
+	constexpr uint32_t Runs = 10; //best of
+
+	using Clock = std::chrono::high_resolution_clock;
+	auto best_of = [&](auto &&run) {
+		double best = std::numeric_limits< double >::infinity();
+		for (uint32_t r = 0; r < Runs; ++r) {
+			auto before = Clock::now();
+			run();
+			auto after = Clock::now();
+			best = std::min(best, std::chrono::duration< double >(after - before).count());
+		}
+		return best;
+	};
+
+	std::cout << source << ": " << (double(text.size()) / (1 << 20)) << " MB, best of " << Runs << " runs:\n";
+
+	std::vector< sejp::Scanner > scanners;
+	for (sejp::Scanner scanner : {sejp::Scanner::Scalar, sejp::Scanner::SSE2, sejp::Scanner::AVX2}) {
+		if (sejp::supported(scanner)) scanners.emplace_back(scanner);
+	}
+
+	size_t expected_tokens = 0;
+	uint32_t mismatches = 0;
+	for (sejp::Scanner scanner : scanners) {
+		size_t tokens = 0;
+		double scan_seconds = best_of([&]() {
+			tokens = sejp::scan(text, scanner);
+		});
+		double events_seconds = best_of([&]() {
+			sejp::handler ignore; //(every event does nothing)
+			sejp::parse(std::string_view(text), ignore, scanner);
+		});
+		double parse_seconds = best_of([&]() {
+			sejp::document document = sejp::parse(text, scanner);
+		});
+		if (scanner == scanners[0]) expected_tokens = tokens;
+		else if (tokens != expected_tokens) ++mismatches;
+
+		std::cout << "  " << sejp::name(scanner) << (scanner == sejp::fastest_scanner() ? " (default)" : "") << ":\n";
+		std::cout << "    scan:   " << (double(text.size()) / scan_seconds / 1e9) << " GB/s, " << tokens << " tokens\n";
+		std::cout << "    events: " << (double(text.size()) / events_seconds / 1e9) << " GB/s (" << (events_seconds * 1e3) << " ms)\n";
+		std::cout << "    parse:  " << (double(text.size()) / parse_seconds / 1e9) << " GB/s (" << (parse_seconds * 1e3) << " ms)\n";
+	}
+
+	if (mismatches != 0) {
+		std::cerr << "ERROR: " << mismatches << " scanners disagree with the scalar scanner's token count." << std::endl;
+		return 1;
+	}
+	return 0;
+}
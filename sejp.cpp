@@ -1,20 +1,43 @@
 #include "sejp.hpp"
 
+#include "MappedFile.hpp"
+
+#include <algorithm>
 #include <stdexcept>
 #include <cassert>
-#include <iostream>
-#include <fstream>
-#include <sstream>
 #include <charconv>
+#include <cstring>
+#include <bit>
+#include <deque>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define SEJP_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define SEJP_TARGET_AVX2
+#else
+#define SEJP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 namespace sejp {
 
 struct parsed {
-	std::vector< std::optional< std::string > > strings;
-	std::vector< std::optional< double > > numbers;
+	//source text; strings without escapes are views straight into it:
+	MappedFile file; //(when loaded from a file)
+	std::string text; //(when parsed from a string)
+
+	std::vector< std::string_view > strings;
+	std::deque< std::string > unescaped; //strings that had escapes in the source (deque, so growing it doesn't move them)
+	std::vector< double > numbers;
 	//(nothing to store for booleans and nulls)
-	std::vector< std::optional< std::vector< value > > > arrays;
-	std::vector< std::optional< std::map< std::string, value > > > objects;
+
+	//arrays and objects are [begin,end) ranges of elements and members:
+	std::vector< value > elements;
+	std::vector< member > members;
+	std::vector< std::pair< uint32_t, uint32_t > > arrays;
+	std::vector< std::pair< uint32_t, uint32_t > > objects;
 };
 
 enum Masks : uint32_t {
@@ -33,53 +56,320 @@ enum Types : uint32_t {
 	Empty   = 0xe0000000, //<--- used during parsing
 };
 
-value parse(std::istream &from) {
-	//helpers to read from string:
+//------------------------------------------
+//stage 1: find every structural character ({}[]:,), string start, and scalar start, outside of strings.
+// Each 64-byte block is classified into bit masks (the only part that differs between scanners),
+// and the masks are turned into positions with branch-free bit tricks, as described in
+// "Parsing Gigabytes of JSON per Second" (Langdale and Lemire, 2019).
+
+//raw character classes of a 64-byte block, one bit per byte:
+struct BlockMasks {
+	uint64_t quote = 0;
+	uint64_t backslash = 0;
+	uint64_t op = 0; //{}[]:,
+	uint64_t whitespace = 0;
+};
 
-	auto skip_wsp = [&from]() {
-		for(;;) {
-			std::istream::int_type c = from.peek();
-			if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
-				from.get();
-			} else {
-				break;
+//positions found so far, plus the state carried from one 64-byte block to the next:
+struct ScanState {
+	std::vector< uint32_t > tokens; //offset of the first character of every structural, string, and scalar
+	std::vector< uint32_t > string_ends; //offset of every closing quote, in order
+	size_t token_count = 0, string_end_count = 0; //(the vectors are kept a block ahead of these, so appending never checks capacity per bit)
+	uint64_t prev_odd_backslash = 0; //1 if the last block ended in an odd-length run of backslashes
+	uint64_t prev_in_string = 0; //all ones if the last block ended inside a string
+	uint64_t prev_scalar = 0; //1 if the last block ended in a (non-quote) scalar character
+
+	static void append(uint64_t bits, uint32_t base, std::vector< uint32_t > &to, size_t &count) {
+		if (to.size() < count + 64) to.resize(std::max(to.size() * 2, count + 64));
+		uint32_t *at = to.data() + count;
+		count += size_t(std::popcount(bits));
+		//positions are written four at a time, unconditionally; entries past the last set bit are junk that the next block overwrites:
+		while (bits) {
+			for (uint32_t i = 0; i < 4; ++i) {
+				*at++ = base + uint32_t(std::countr_zero(bits));
+				bits &= bits - 1;
 			}
 		}
-	};
+	}
 
-	auto read_char = [&from]() -> char {
-		char c;
-		if (!from.get(c)) throw std::runtime_error("parse error: unexpected EOF.");
-		return c;
-	};
-	
-	auto read_exactly = [&read_char](std::string const &expect) {
+	void block(BlockMasks const &m, uint32_t base) {
+		//characters preceded by an odd number of backslashes are escaped:
+		constexpr uint64_t even_bits = 0x5555555555555555ULL;
+		constexpr uint64_t odd_bits = ~even_bits;
+		uint64_t start_edges = m.backslash & ~(m.backslash << 1);
+		uint64_t even_start_mask = even_bits ^ prev_odd_backslash;
+		uint64_t even_starts = start_edges & even_start_mask;
+		uint64_t odd_starts = start_edges & ~even_start_mask;
+		uint64_t even_carries = m.backslash + even_starts;
+		uint64_t odd_carries = m.backslash + odd_starts;
+		bool ends_odd_backslash = odd_carries < m.backslash; //(overflowed)
+		odd_carries |= prev_odd_backslash;
+		prev_odd_backslash = ends_odd_backslash ? 1 : 0;
+		uint64_t even_carry_ends = even_carries & ~m.backslash;
+		uint64_t odd_carry_ends = odd_carries & ~m.backslash;
+		uint64_t escaped = (even_carry_ends & odd_bits) | (odd_carry_ends & even_bits);
+
+		//inside strings is everything between an unescaped quote and the next (including the opening quote):
+		uint64_t quote = m.quote & ~escaped;
+		uint64_t in_string = quote;
+		in_string ^= in_string << 1;
+		in_string ^= in_string << 2;
+		in_string ^= in_string << 4;
+		in_string ^= in_string << 8;
+		in_string ^= in_string << 16;
+		in_string ^= in_string << 32;
+		in_string ^= prev_in_string;
+		prev_in_string = uint64_t(int64_t(in_string) >> 63);
+
+		//scalars start at any character that isn't whitespace or an operator and doesn't follow a scalar character:
+		uint64_t scalar = ~(m.op | m.whitespace);
+		uint64_t nonquote_scalar = scalar & ~quote;
+		uint64_t follows_scalar = (nonquote_scalar << 1) | prev_scalar;
+		prev_scalar = nonquote_scalar >> 63;
+
+		//string contents and closing quotes are not structural:
+		uint64_t string_tail = in_string ^ quote;
+		append((m.op | (scalar & ~follows_scalar)) & ~string_tail, base, tokens, token_count);
+		append(quote & ~in_string, base, string_ends, string_end_count);
+	}
+};
+
+static BlockMasks classify_scalar(char const *block) {
+	BlockMasks m;
+	for (uint32_t i = 0; i < 64; ++i) {
+		uint64_t bit = uint64_t(1) << i;
+		char c = block[i];
+		if      (c == '"') m.quote |= bit;
+		else if (c == '\\') m.backslash |= bit;
+		else if (c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',') m.op |= bit;
+		else if (c == ' ' || c == '\t' || c == '\n' || c == '\r') m.whitespace |= bit;
+	}
+	return m;
+}
+
+static void scan_scalar(char const *text, size_t from, size_t to, ScanState &state) {
+	size_t offset = from;
+	for (; offset + 64 <= to; offset += 64) {
+		state.block(classify_scalar(text + offset), uint32_t(offset));
+	}
+	if (offset < to) { //pad a partial last block with whitespace:
+		char padded[64];
+		std::memset(padded, ' ', 64);
+		std::memcpy(padded, text + offset, to - offset);
+		state.block(classify_scalar(padded), uint32_t(offset));
+	}
+}
+
+#if defined(SEJP_X86)
+static BlockMasks classify_sse2(char const *block) {
+	BlockMasks m;
+	for (uint32_t i = 0; i < 4; ++i) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast< __m128i const * >(block + 16 * i));
+		__m128i brackets = _mm_or_si128(v, _mm_set1_epi8(0x20)); //('[' -> '{', ']' -> '}')
+		auto is = [](__m128i a, char c) { return _mm_cmpeq_epi8(a, _mm_set1_epi8(c)); };
+		auto bits = [i](__m128i a) { return uint64_t(uint32_t(_mm_movemask_epi8(a))) << (16 * i); };
+		m.quote |= bits(is(v, '"'));
+		m.backslash |= bits(is(v, '\\'));
+		m.op |= bits(_mm_or_si128(_mm_or_si128(is(brackets, '{'), is(brackets, '}')), _mm_or_si128(is(v, ':'), is(v, ','))));
+		m.whitespace |= bits(_mm_or_si128(_mm_or_si128(is(v, ' '), is(v, '\t')), _mm_or_si128(is(v, '\n'), is(v, '\r'))));
+	}
+	return m;
+}
+
+static void scan_sse2(char const *text, size_t from, size_t to, ScanState &state) {
+	size_t offset = from;
+	for (; offset + 64 <= to; offset += 64) {
+		state.block(classify_sse2(text + offset), uint32_t(offset));
+	}
+	if (offset < to) {
+		char padded[64];
+		std::memset(padded, ' ', 64);
+		std::memcpy(padded, text + offset, to - offset);
+		state.block(classify_sse2(padded), uint32_t(offset));
+	}
+}
+
+SEJP_TARGET_AVX2 static inline __m256i is_avx2(__m256i a, char c) {
+	return _mm256_cmpeq_epi8(a, _mm256_set1_epi8(c));
+}
+
+SEJP_TARGET_AVX2 static BlockMasks classify_avx2(char const *block) {
+	BlockMasks m;
+	for (uint32_t i = 0; i < 2; ++i) {
+		__m256i v = _mm256_loadu_si256(reinterpret_cast< __m256i const * >(block + 32 * i));
+		__m256i brackets = _mm256_or_si256(v, _mm256_set1_epi8(0x20)); //('[' -> '{', ']' -> '}')
+		uint32_t shift = 32 * i;
+		m.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(is_avx2(v, '"')))) << shift;
+		m.backslash |= uint64_t(uint32_t(_mm256_movemask_epi8(is_avx2(v, '\\')))) << shift;
+		m.op |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_or_si256(is_avx2(brackets, '{'), is_avx2(brackets, '}')),
+			_mm256_or_si256(is_avx2(v, ':'), is_avx2(v, ','))
+		)))) << shift;
+		m.whitespace |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_or_si256(is_avx2(v, ' '), is_avx2(v, '\t')),
+			_mm256_or_si256(is_avx2(v, '\n'), is_avx2(v, '\r'))
+		)))) << shift;
+	}
+	return m;
+}
+
+SEJP_TARGET_AVX2 static void scan_avx2(char const *text, size_t from, size_t to, ScanState &state) {
+	size_t offset = from;
+	for (; offset + 64 <= to; offset += 64) {
+		state.block(classify_avx2(text + offset), uint32_t(offset));
+	}
+	if (offset < to) {
+		char padded[64];
+		std::memset(padded, ' ', 64);
+		std::memcpy(padded, text + offset, to - offset);
+		state.block(classify_avx2(padded), uint32_t(offset));
+	}
+}
+#endif
+
+//scan [from,to) of text; 'from' must be a multiple of 64, as must 'to' unless it's the end of the text:
+static void scan_range(Scanner scanner, char const *text, size_t from, size_t to, ScanState &state) {
+	if (scanner == Scanner::Scalar) scan_scalar(text, from, to, state);
+	#if defined(SEJP_X86)
+	else if (scanner == Scanner::SSE2) scan_sse2(text, from, to, state);
+	else if (scanner == Scanner::AVX2) scan_avx2(text, from, to, state);
+	#endif
+}
+
+static void check_scan(Scanner scanner, size_t size) {
+	if (!supported(scanner)) throw std::runtime_error(std::string("sejp: the ") + name(scanner) + " scanner isn't supported on this CPU.");
+	if (size > 0xffffffffULL) throw std::runtime_error("parse error: more than 4GB of text.");
+}
+
+Scanner fastest_scanner() {
+	static Scanner const fastest = []() {
+		if (supported(Scanner::AVX2)) return Scanner::AVX2;
+		if (supported(Scanner::SSE2)) return Scanner::SSE2;
+		return Scanner::Scalar;
+	}();
+	return fastest;
+}
+
+bool supported(Scanner scanner) {
+	if (scanner == Scanner::Scalar) return true;
+	#if defined(SEJP_X86)
+	if (scanner == Scanner::SSE2) return true; //(part of x86-64)
+	if (scanner == Scanner::AVX2) {
+		#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 1);
+		bool os_saves_ymm = (info[2] & (1 << 27)) && (_xgetbv(0) & 6) == 6; //(OSXSAVE, and the OS saves xmm and ymm state)
+		__cpuidex(info, 7, 0);
+		return os_saves_ymm && (info[1] & (1 << 5));
+		#else
+		return __builtin_cpu_supports("avx2");
+		#endif
+	}
+	#endif
+	return false;
+}
+
+char const *name(Scanner scanner) {
+	if (scanner == Scanner::Scalar) return "scalar";
+	if (scanner == Scanner::SSE2) return "SSE2";
+	if (scanner == Scanner::AVX2) return "AVX2";
+	return "unknown";
+}
+
+size_t scan(std::string_view text, Scanner scanner) {
+	check_scan(scanner, text.size());
+	ScanState state;
+	state.tokens.resize(text.size() / 8 + 64); //(just a guess; s72 files are mostly short numbers)
+	scan_range(scanner, text.data(), 0, text.size(), state);
+	if (state.prev_in_string) throw std::runtime_error("parse error: unexpected EOF.");
+	return state.token_count;
+}
+
+//------------------------------------------
+//stage 2: walk the structural positions, turning them into events for a document builder or a handler.
+
+//reads the text a window at a time; each window is scanned just before it is needed, so the position lists stay small:
+struct Reader {
+	static constexpr size_t Window = 1 << 16; //bytes scanned per refill (a multiple of the 64-byte block size)
+
+	char const *begin;
+	char const *end;
+	Scanner scanner;
+	std::deque< std::string > *keep; //unescaped strings go here; if null, they go in 'scratch' and only last until the next string
+	std::string scratch;
+
+	ScanState state;
+	size_t scanned = 0; //bytes of text scanned so far
+	size_t token = 0; //next unread entry in state.tokens
+	size_t string_end = 0; //next unread entry in state.string_ends
+	char const *at; //just past the last character read
+
+	Reader(char const *begin_, char const *end_, Scanner scanner_, std::deque< std::string > *keep_)
+	: begin(begin_), end(end_), scanner(scanner_), keep(keep_), at(begin_) {
+		check_scan(scanner, size_t(end - begin));
+	}
+
+	//scan the next window, dropping positions that were already read; returns false at the end of the text:
+	bool refill() {
+		size_t size = size_t(end - begin);
+		if (scanned == size) return false;
+		std::copy(state.tokens.begin() + token, state.tokens.begin() + state.token_count, state.tokens.begin());
+		state.token_count -= token;
+		token = 0;
+		std::copy(state.string_ends.begin() + string_end, state.string_ends.begin() + state.string_end_count, state.string_ends.begin());
+		state.string_end_count -= string_end;
+		string_end = 0;
+
+		size_t to = std::min(scanned + Window, size);
+		scan_range(scanner, begin, scanned, to, state);
+		scanned = to;
+		if (scanned == size && state.prev_in_string) throw std::runtime_error("parse error: unexpected EOF.");
+		return true;
+	}
+
+	//move to the next token, returning its first character:
+	char next() {
+		while (token == state.token_count) {
+			if (!refill()) throw std::runtime_error("parse error: unexpected EOF.");
+		}
+		at = begin + state.tokens[token];
+		++token;
+		return *at++;
+	}
+
+	char read_char() {
+		if (at == end) throw std::runtime_error("parse error: unexpected EOF.");
+		return *at++;
+	}
+
+	void read_exactly(std::string_view expect) {
 		for (auto e : expect) {
 			char c = read_char();
 			if (c != e) throw std::runtime_error(std::string("parse error: expected '") + e + "', got '" + c + "'.");
 		}
-	};
+	}
+
+	//scanning only marks where scalars start, so check that nothing but whitespace follows one before the next token:
+	void end_scalar() {
+		while (token == state.token_count && refill()) { }
+		char const *next_at = (token == state.token_count ? end : begin + state.tokens[token]);
+		for (; at < next_at; ++at) {
+			if (!(*at == ' ' || *at == '\t' || *at == '\n' || *at == '\r')) {
+				throw std::runtime_error(std::string("parse error: unexpected '") + *at + "' after value.");
+			}
+		}
+	}
+
+	double read_number(char first) {
+		char const *start = at - 1; //(first was already read)
 
-	auto read_number = [&from,&read_char](char first) -> double {
-		std::string acc;
-		acc += first;
-	
 		if (first == '-') {
 			//advance to first digit:
 			first = read_char();
-			acc += first;
 		}
 
-		auto digits = [&acc,&from]() {
-			for(;;) {
-				std::istream::int_type p = from.peek();
-				if ('0' <= p && p <= '9') {
-					acc += char(p);
-					from.get();
-				} else {
-					break;
-				}
-			}
+		auto digits = [&]() {
+			while (at != end && '0' <= *at && *at <= '9') ++at;
 		};
 
 		if (first == '0') {
@@ -92,40 +382,55 @@ value parse(std::istream &from) {
 		}
 
 		//fraction:
-		if (from.peek() == '.') {
-			acc += read_char();
+		if (at != end && *at == '.') {
+			++at;
 			char c = read_char();
 			if (!('0' <= c && c <= '9')) throw std::runtime_error(std::string("parse error: wanted fraction digits, got '") + c + "'.");
-			acc += c;
 			digits();
 		}
 
 		//exponent:
-		if (from.peek() == 'E' || from.peek() == 'e') {
-			acc += read_char();
-			if (from.peek() == '-' || from.peek() == '+') {
-				acc += read_char();
-			}
+		if (at != end && (*at == 'E' || *at == 'e')) {
+			++at;
+			if (at != end && (*at == '-' || *at == '+')) ++at;
 			char c = read_char();
 			if (!('0' <= c && c <= '9')) throw std::runtime_error(std::string("parse error: wanted exponent digits, got '") + c + "'.");
-			acc += c;
 			digits();
 		}
 
 		double val;
 		#ifdef __APPLE__
 		//(until clang gets its charconv right)
-		val = std::stod(acc);
+		val = std::stod(std::string(start, at));
 		#else
-		const char *begin = acc.data();
-		std::from_chars(begin, begin + acc.size(), val);
+		std::from_chars(start, at, val);
 		#endif
 		return val;
-	};
+	}
+
+	//strings close at the next closing quote scanning found; escapes are rare, so strings are views into the source unless they have one:
+	std::string_view read_string() {
+		while (string_end == state.string_end_count) {
+			if (!refill()) throw std::runtime_error("parse error: unexpected EOF.");
+		}
+		char const *start = at;
+		char const *close = begin + state.string_ends[string_end];
+		++string_end;
+		assert(close >= start);
+		at = close + 1;
+		if (std::memchr(start, '\\', size_t(close - start)) == nullptr) {
+			return std::string_view(start, size_t(close - start));
+		}
 
-	auto read_string = [&read_char]() -> std::string {
-		std::string ret;
-		for (char c = read_char(); c != '"'; c = read_char()) {
+		char const *p = start;
+		auto read_char = [&]() -> char {
+			if (p == close) throw std::runtime_error("parse error: unterminated escape.");
+			return *p++;
+		};
+		std::string &ret = (keep ? keep->emplace_back() : scratch);
+		ret.clear();
+		while (p != close) {
+			char c = read_char();
 			if (c == '\\') {
 				//handle escapes:
 				c = read_char();
@@ -174,203 +479,297 @@ value parse(std::istream &from) {
 			}
 		}
 		return ret;
-	};
+	}
 
+	//after the root value, only whitespace may remain:
+	void finish() {
+		while (token == state.token_count && refill()) { }
+		if (token != state.token_count) throw std::runtime_error("parse error: trailing junk.");
+	}
+};
 
-	//-------------------
-	//parsing:
-
-	std::shared_ptr< sejp::parsed > parsed = std::make_shared< sejp::parsed >();
-
-	value root = value(parsed, -1U);
-	std::vector< uint32_t > parents; //containing maps/arrays
-
-	//overall parsing idea:
-	//value: (target is empty)
-	// whitespace
-	//  set up next entry if target is object or array:
-	//    (only if) target is object:
-	//         '}' -> finish target, continue
-	//         expect ',' if non-empty
-	//         '"' -> expect key, ':', push empty, fall through
-	//    (only if) target is array:
-	//         ']' -> finish target, continue
-	//         expect ',' if non-empty
-	//         push empty, fall through
-	//  now target is empty, fill with value:
-	//  '{' -> key_or_object_end [new object, set target to object, continue]
-	//  '[' -> value_or_array_end [new array, set target to array, continue]
-	//   '"' -> string
-	//   '-', '0'-'9' -> number
-	//   't' -> bool ("true")
-	//   'f' -> bool ("false")
-	//   'n' -> null ("null")
-	//   finish target
-
-	while (root.index == -1U || !parents.empty()) {
-		skip_wsp();
-		char c = read_char(); //first character of value
-
-		//value to be filled in later:
-		value *target = nullptr;
-
-		//figure out which value to fill in:
-		if (parents.empty()) {
-			target = &root;
-		} else if ((parents.back() & TypeBits) == Object) {
-			if (c == '}') {
-				parents.pop_back();
-				continue;
-			}
-			std::map< std::string, value > &map = parsed->objects.at( parents.back() & IndexBits ).value();
-			if (!map.empty()) {
-				//consume comma between entries:
-				if (c != ',') throw std::runtime_error("parse error: expected ',' between object members.");
-				skip_wsp();
-				c = read_char();
-			}
-			if (c != '"') throw std::runtime_error("parse error: expecting '\"' at start of key.");
-			std::string key = read_string();
-			skip_wsp();
-			c = read_char();
-			if (c != ':') throw std::runtime_error("parse error: expecting ':' after value.");
-			skip_wsp();
-			c = read_char(); //actual first character of value
-			auto ret = map.insert_or_assign(key, value(parsed, -1U));
-			target = &ret.first->second;
-			//(fall through to value-getting code)
-		} else if ((parents.back() & TypeBits) == Array) {
-			if (c == ']') {
-				parents.pop_back();
-				continue;
-			}
-			std::vector< value > &array = parsed->arrays.at( parents.back() & IndexBits ).value();
-			if (!array.empty()) {
-				if (c != ',') throw std::runtime_error(std::string("parse error: expected ',' between array entries; got '") + c + "'.");
-				skip_wsp();
-				c = read_char(); //actual first character of value
-			}
-			array.emplace_back(parsed, -1U);
-			target = &array.back();
-			//(fall through to value-getting code)
-		}
+//walk one JSON value (the whole text), calling events.begin_object() / key() / ... as it goes:
+template< typename Events >
+static void walk(Reader &reader, Events &events) {
+	std::vector< bool > in_object; //for each container still open: object (true) or array (false)
 
-		//actually fill in the value:
-		assert(target && (target->index & TypeBits) == Empty);
+	auto read_key = [&](char c) {
+		if (c != '"') throw std::runtime_error("parse error: expecting '\"' at start of key.");
+		events.key(reader.read_string());
+		c = reader.next();
+		if (c != ':') throw std::runtime_error("parse error: expecting ':' after value.");
+	};
 
+	char c = reader.next(); //first character of value
+	while (true) {
+		//read a value:
 		if        (c == '{') { //object
-			if (uint32_t(parsed->objects.size()) & ~IndexBits) std::runtime_error("parser error: too many objects.");
-			target->index = Object | uint32_t(parsed->objects.size());
-			parents.emplace_back(target->index);
-			parsed->objects.emplace_back(std::in_place);
-			continue;
+			events.begin_object();
+			c = reader.next();
+			if (c != '}') {
+				in_object.emplace_back(true);
+				read_key(c);
+				c = reader.next(); //first character of member's value
+				continue;
+			}
+			events.end_object();
 		} else if (c == '[') { //array
-			if (uint32_t(parsed->arrays.size()) & ~IndexBits) std::runtime_error("parser error: too many arrays.");
-			target->index = Array | uint32_t(parsed->arrays.size());
-			parents.emplace_back(target->index);
-			parsed->arrays.emplace_back(std::in_place);
-			continue;
+			events.begin_array();
+			c = reader.next();
+			if (c != ']') {
+				in_object.emplace_back(false);
+				continue; //(c is first character of first element)
+			}
+			events.end_array();
 		} else if (c == '"') { //string
-			if (uint32_t(parsed->strings.size()) & ~IndexBits) std::runtime_error("parser error: too many strings.");
-			target->index = String | uint32_t(parsed->strings.size());
-			parsed->strings.emplace_back(read_string());
+			events.string(reader.read_string());
 		} else if (c == '-' || (c >= '0' && c <= '9')) { //number
-			if (uint32_t(parsed->numbers.size()) & ~IndexBits) std::runtime_error("parser error: too many numbers.");
-			target->index = Number | uint32_t(parsed->numbers.size());
-			parsed->numbers.emplace_back(read_number(c));
+			double number = reader.read_number(c);
+			reader.end_scalar();
+			events.number(number);
 		} else if (c == 't') { //true
-			read_exactly("rue");
-			target->index = True;
+			reader.read_exactly("rue");
+			reader.end_scalar();
+			events.boolean(true);
 		} else if (c == 'f') { //false
-			read_exactly("alse");
-			target->index = False;
+			reader.read_exactly("alse");
+			reader.end_scalar();
+			events.boolean(false);
 		} else if (c == 'n') { //null
-			read_exactly("ull");
-			target->index = Null;
+			reader.read_exactly("ull");
+			reader.end_scalar();
+			events.null();
 		} else {
 			throw std::runtime_error(std::string("parse error: value cannot start with '") + c + "'.");
 		}
+
+		//value is done; close containers until one continues with ',':
+		bool more = false;
+		while (!more && !in_object.empty()) {
+			c = reader.next();
+			if (in_object.back()) {
+				if (c == '}') {
+					in_object.pop_back();
+					events.end_object();
+				} else if (c == ',') {
+					read_key(reader.next());
+					more = true;
+				} else {
+					throw std::runtime_error("parse error: expected ',' between object members.");
+				}
+			} else {
+				if (c == ']') {
+					in_object.pop_back();
+					events.end_array();
+				} else if (c == ',') {
+					more = true;
+				} else {
+					throw std::runtime_error(std::string("parse error: expected ',' between array entries; got '") + c + "'.");
+				}
+			}
+		}
+		if (!more) break;
+		c = reader.next(); //first character of next value
+	}
+
+	reader.finish();
+}
+
+//builds document storage from walk()'s events:
+struct Builder {
+	Builder(parsed &data_) : data(data_) { }
+
+	parsed &data;
+	value root{ .data = &data, .index = Empty };
+
+	//containers still being filled; their entries pile up on pending_elements / pending_members
+	// and are moved into data.elements / data.members (so each container's entries end up contiguous) when they close:
+	struct Open {
+		uint32_t index; //Object or Array value index
+		size_t first; //first entry on the pending stack
+	};
+	std::vector< Open > parents;
+	std::vector< value > pending_elements;
+	std::vector< member > pending_members;
+	std::string_view pending_key; //key of the next member
+
+	static uint32_t next_index(size_t size, char const *what) {
+		if (size & ~size_t(IndexBits)) throw std::runtime_error(std::string("parser error: too many ") + what + ".");
+		return uint32_t(size);
+	}
+
+	//value to fill in with the next event:
+	value &target() {
+		if (parents.empty()) return root;
+		if ((parents.back().index & TypeBits) == Object) {
+			return pending_members.emplace_back(member{ .first = pending_key, .second = value{ .data = &data, .index = Empty } }).second;
+		}
+		return pending_elements.emplace_back(value{ .data = &data, .index = Empty });
+	}
+
+	void begin_object() {
+		value &into = target();
+		into.index = Object | next_index(data.objects.size(), "objects");
+		data.objects.emplace_back(0, 0);
+		parents.emplace_back(Open{ .index = into.index, .first = pending_members.size() });
+	}
+	void key(std::string_view key) {
+		pending_key = key;
+	}
+	void end_object() {
+		Open const &open = parents.back();
+		//sort members by key, keeping only the last of any repeated key:
+		auto first = pending_members.begin() + open.first;
+		std::stable_sort(first, pending_members.end(), [](member const &a, member const &b) { return a.first < b.first; });
+		auto &range = data.objects[open.index & IndexBits];
+		range.first = uint32_t(data.members.size());
+		for (auto m = first; m != pending_members.end(); ++m) {
+			if (m + 1 != pending_members.end() && (m + 1)->first == m->first) continue;
+			data.members.emplace_back(*m);
+		}
+		range.second = uint32_t(data.members.size());
+		pending_members.erase(first, pending_members.end());
+		parents.pop_back();
 	}
 
-	skip_wsp();
+	void begin_array() {
+		value &into = target();
+		into.index = Array | next_index(data.arrays.size(), "arrays");
+		data.arrays.emplace_back(0, 0);
+		parents.emplace_back(Open{ .index = into.index, .first = pending_elements.size() });
+	}
+	void end_array() {
+		Open const &open = parents.back();
+		auto first = pending_elements.begin() + open.first;
+		auto &range = data.arrays[open.index & IndexBits];
+		range.first = uint32_t(data.elements.size());
+		data.elements.insert(data.elements.end(), first, pending_elements.end());
+		range.second = uint32_t(data.elements.size());
+		pending_elements.erase(first, pending_elements.end());
+		parents.pop_back();
+	}
 
-	if (from.peek() != std::iostream::traits_type::eof()) throw std::runtime_error("parse error: trailing junk.");
+	void string(std::string_view string) {
+		target().index = String | next_index(data.strings.size(), "strings");
+		data.strings.emplace_back(string);
+	}
+	void number(double number) {
+		target().index = Number | next_index(data.numbers.size(), "numbers");
+		data.numbers.emplace_back(number);
+	}
+	void boolean(bool boolean) {
+		target().index = (boolean ? True : False);
+	}
+	void null() {
+		target().index = Null;
+	}
+};
 
-	return root;
+//parse [begin,end) into data, returning the root:
+static value build(parsed &data, char const *begin, char const *end, Scanner scanner) {
+	Reader reader(begin, end, scanner, &data.unescaped);
+	Builder builder(data);
+	walk(reader, builder);
+	return builder.root;
 }
 
 //------------------------------------------
 
 
-std::optional< std::string > const &value::as_string() const {
-	static std::optional< std::string > const empty;
+std::optional< std::string_view > value::as_string() const {
 	if ((index & TypeBits) == String) {
 		return data->strings[index & IndexBits];
 	} else {
-		return empty;
+		return std::nullopt;
 	}
 }
 
-std::optional< double > const &value::as_number() const {
-	static std::optional< double > const empty;
+std::optional< double > value::as_number() const {
 	if ((index & TypeBits) == Number) {
 		return data->numbers[index & IndexBits];
 	} else {
-		return empty;
+		return std::nullopt;
 	}
 }
 
-std::optional< bool > const &value::as_bool() const {
-	static std::optional< bool > const true_value(true);
-	static std::optional< bool > const false_value(false);
-	static std::optional< bool > const empty;
+std::optional< bool > value::as_bool() const {
 	if ((index & TypeBits) == True) {
-		return true_value;
+		return true;
 	} else if ((index & TypeBits) == False) {
-		return false_value;
+		return false;
 	} else {
-		return empty;
+		return std::nullopt;
 	}
 }
 
-std::optional< nullptr_t > const &value::as_null() const {
-	static std::optional< nullptr_t > const null_value(nullptr);
-	static std::optional< nullptr_t > const empty;
+std::optional< std::nullptr_t > value::as_null() const {
 	if ((index & TypeBits) == Null) {
-		return null_value;
+		return nullptr;
 	} else {
-		return empty;
+		return std::nullopt;
 	}
 }
 
-std::optional< std::vector< value > > const &value::as_array() const {
-	static std::optional< std::vector< value > > const empty;
+std::optional< array > value::as_array() const {
 	if ((index & TypeBits) == Array) {
-		return data->arrays[index & IndexBits];
+		auto const &range = data->arrays[index & IndexBits];
+		return array{ .first = data->elements.data() + range.first, .last = data->elements.data() + range.second };
 	} else {
-		return empty;
+		return std::nullopt;
 	}
 }
 
-std::optional< std::map< std::string, value > > const &value::as_object() const {
-	static std::optional< std::map< std::string, value > > const empty;
+std::optional< object > value::as_object() const {
 	if ((index & TypeBits) == Object) {
-		return data->objects[index & IndexBits];
+		auto const &range = data->objects[index & IndexBits];
+		return object{ .first = data->members.data() + range.first, .last = data->members.data() + range.second };
 	} else {
-		return empty;
+		return std::nullopt;
 	}
 }
 
+member const *object::find(std::string_view key) const {
+	member const *at = std::lower_bound(first, last, key, [](member const &m, std::string_view k) { return m.first < k; });
+	if (at != last && at->first == key) return at;
+	return last;
+}
+
 //-------------------------------
 
-value load(std::string const &filename) {
-	std::ifstream in(filename, std::ios::binary);
-	return parse(in);
+document::document() = default;
+document::document(document &&) = default;
+document &document::operator=(document &&) = default;
+document::~document() = default;
+
+document load(std::string const &filename, Scanner scanner) {
+	std::unique_ptr< parsed > data = std::make_unique< parsed >();
+	data->file = MappedFile(filename);
+	char const *begin = reinterpret_cast< char const * >(data->file.data);
+	document ret;
+	ret.root = build(*data, begin, begin + data->file.size, scanner);
+	ret.data = std::move(data);
+	return ret;
+}
+
+document parse(std::string const &string, Scanner scanner) {
+	std::unique_ptr< parsed > data = std::make_unique< parsed >();
+	data->text = string;
+	document ret;
+	ret.root = build(*data, data->text.data(), data->text.data() + data->text.size(), scanner);
+	ret.data = std::move(data);
+	return ret;
+}
+
+void load(std::string const &filename, handler &handler, Scanner scanner) {
+	MappedFile file(filename);
+	char const *begin = reinterpret_cast< char const * >(file.data);
+	Reader reader(begin, begin + file.size, scanner, nullptr);
+	walk(reader, handler);
 }
 
-value parse(std::string const &string) {
-	std::istringstream in(string, std::ios::binary);
-	return parse(in);
+void parse(std::string_view string, handler &handler, Scanner scanner) {
+	Reader reader(string.data(), string.data() + string.size(), scanner, nullptr);
+	walk(reader, handler);
 }
 
 } //namespace sejp
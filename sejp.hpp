@@ -5,37 +5,122 @@
 //then provides a generic "value" handle to the root.
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <map>
 #include <optional>
 #include <memory>
+#include <cstddef>
+#include <stdint.h>
 
 namespace sejp {
 	//sejp::parsed represents the results of scanning a JSON file:
 	struct parsed;
-	
+
+	struct array;
+	struct object;
+
 	//generic value:
+	//  NOTE: values are plain (pointer, index) pairs, so copying them is free;
+	//        they are only valid as long as the document they came from.
 	struct value {
 		//internals:
-		std::shared_ptr< parsed const > data;
-		uint32_t index; //(opaque) index data's value storage
-		value(std::shared_ptr< parsed const > const &data_, uint32_t index_) : data(data_), index(index_) { }
+		parsed const *data = nullptr;
+		uint32_t index = -1U; //(opaque) index data's value storage
 
 		//interface:
 		//  NOTE: these functions take O(1) time
-		std::optional< std::string > const &as_string() const;
-		std::optional< double > const &as_number() const;
-		std::optional< bool > const &as_bool() const;
-		std::optional< nullptr_t > const &as_null() const;
-		std::optional< std::vector< value > > const &as_array() const;
-		std::optional< std::map< std::string, value > > const &as_object() const;
+		//  NOTE: strings are views into the document (usually straight into the source text)
+		std::optional< std::string_view > as_string() const;
+		std::optional< double > as_number() const;
+		std::optional< bool > as_bool() const;
+		std::optional< std::nullptr_t > as_null() const;
+		std::optional< array > as_array() const;
+		std::optional< object > as_object() const;
+	};
+
+	//arrays are contiguous runs of values:
+	struct array {
+		value const *first = nullptr;
+		value const *last = nullptr;
+
+		value const *begin() const { return first; }
+		value const *end() const { return last; }
+		size_t size() const { return size_t(last - first); }
+		bool empty() const { return first == last; }
+		value const &operator[](size_t i) const { return first[i]; }
 	};
 
-	//how you make values:
+	//object members, named like std::map's entries so `find(key)->second` reads the same:
+	struct member {
+		std::string_view first; //key
+		value second;
+	};
+
+	//objects are contiguous runs of members, sorted by key (if a key repeats, the last one wins):
+	struct object {
+		member const *first = nullptr;
+		member const *last = nullptr;
+
+		member const *begin() const { return first; }
+		member const *end() const { return last; }
+		size_t size() const { return size_t(last - first); }
+		bool empty() const { return first == last; }
+
+		//O(log members) lookup; returns end() if the key is missing:
+		member const *find(std::string_view key) const;
+	};
+
+	//a parsed file; the values it hands out point into it, so it has to outlive them:
+	struct document {
+		std::unique_ptr< parsed const > data; //(on the heap, so moving the document leaves values valid)
+		value root;
+
+		document();
+		document(document &&);
+		document &operator=(document &&);
+		~document();
+	};
+
+	//parsing runs in two stages: "scanning" finds every structural character, string, and scalar in the text
+	// (64 bytes at a time, with SIMD where the CPU has it), and the document is then built by walking that index.
+	enum class Scanner : uint8_t {
+		Scalar, //plain C++, works everywhere
+		SSE2, //x86-64 only
+		AVX2, //x86-64 CPUs that report AVX2
+	};
+	Scanner fastest_scanner(); //best scanner the running CPU supports (checked once)
+	bool supported(Scanner scanner);
+	char const *name(Scanner scanner);
+
+	//how you make documents:
 	//  NOTE: O(length of data) time, space.
-	//  NOTE: loaded data is retained via shared_ptr until values referring to it go out of scope
-	//  NOTE: throws on parse error
-	value load(std::string const &filename);
-	value parse(std::string const &string);
+	//  NOTE: load() maps the file and keeps it mapped for as long as the document lives
+	//  NOTE: throws on parse error (and if the scanner isn't supported)
+	document load(std::string const &filename, Scanner scanner = fastest_scanner());
+	document parse(std::string const &string, Scanner scanner = fastest_scanner());
+
+	//event ("SAX") interface, for walking a file without building a document:
+	//  load() / parse() call these in file order; objects' keys come just before their values.
+	//  NOTE: key and string views are only valid until the call returns
+	//  NOTE: memory use is the mapped file plus a small window of scanned positions (whatever the handler keeps is up to it)
+	struct handler {
+		virtual ~handler() = default;
+		virtual void begin_object() { }
+		virtual void key(std::string_view /*key*/) { }
+		virtual void end_object() { }
+		virtual void begin_array() { }
+		virtual void end_array() { }
+		virtual void string(std::string_view /*string*/) { }
+		virtual void number(double /*number*/) { }
+		virtual void boolean(bool /*boolean*/) { }
+		virtual void null() { }
+	};
+	//  NOTE: events already sent stand even if a parse error is thrown later
+	void load(std::string const &filename, handler &handler, Scanner scanner = fastest_scanner());
+	void parse(std::string_view string, handler &handler, Scanner scanner = fastest_scanner());
+
+	//just the scanning stage, for benchmarking; returns how many structural positions were found:
+	//  NOTE: throws on unterminated strings
+	size_t scan(std::string_view text, Scanner scanner = fastest_scanner());
 
 } //namespace sejp